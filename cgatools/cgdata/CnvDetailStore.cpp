@@ -151,6 +151,7 @@ void CnvDetailStore::trimTree(){
             trimmed.put(r.first,r.second);
         }
     }
+    trimmed.index();
     data_.swap(trimmed);
 }
 
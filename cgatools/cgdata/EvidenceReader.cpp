@@ -372,18 +372,52 @@ namespace cgatools { namespace cgdata {
     }
 
 
-    EvidenceReader::IntervalsFile::IntervalsFile(const std::string& fn, const CrrFile& crr)
+    namespace {
+        std::istream& shareExceptions(std::istream& in, const std::istream& source)
+        {
+            in.exceptions(source.exceptions());
+            return in;
+        }
+    }
+
+    EvidenceReader::EvidenceFile::EvidenceFile(const std::string& fn)
         :   filename_(fn),
             f_(util::InputStream::openCompressedInputStreamByExtension(fn)),
-            parser_(*f_, fn)
+            index_(util::BlockCompressedIndex::open(fn)),
+            in_(f_->rdbuf()),
+            parser_(shareExceptions(in_, *f_), fn)
+    {
+    }
+
+    bool EvidenceReader::EvidenceFile::jumpForward(int64_t currentKey, int64_t key)
+    {
+        if (0 == index_.get())
+            return false;
+
+        // Only jump if the current record is before the last record of
+        // the block preceding the target block, so that the jump never
+        // moves the stream backwards.
+        const std::vector<BlockCompressedIndex::Block>& blocks = index_->getBlocks();
+        size_t block = index_->findBlock(key);
+        if (0 == block || block == blocks.size() || currentKey >= blocks[block-1].lastKey_)
+            return false;
+
+        boost::shared_ptr<std::istream> f = index_->openBlock(filename_, block);
+        in_.rdbuf(f->rdbuf());
+        in_.clear();
+        f_ = f;
+        return true;
+    }
+
+    EvidenceReader::IntervalsFile::IntervalsFile(const std::string& fn, const CrrFile& crr)
+        :   EvidenceFile(fn)
     {
         IntervalRecord::bindToParser(parser_,rec_,crr);
     }
 
     EvidenceReader::DnbsFile::DnbsFile(const std::string& fn, const reference::CrrFile& crr)
-        : filename_(fn),
-          f_(util::InputStream::openCompressedInputStreamByExtension(fn)),
-          parser_(*f_, fn)
+        : EvidenceFile(fn),
+          eof_(false)
     {
         DnbRecord::bindToParser(parser_,rec_, crr);
     }
@@ -411,6 +445,9 @@ namespace cgatools { namespace cgdata {
     {
         openIntervals(r.chromosome_);
 
+        if (intervalsFile_->jumpForward(
+                int64_t(intervalsFile_->rec_.offset_) + intervalsFile_->rec_.length_, r.begin_))
+            nextInChr();
         while (intervalsFile_->rec_.offset_ + intervalsFile_->rec_.length_ < r.begin_)
             nextInChr();
         inInterval_ = (intervalsFile_->rec_.offset_ + intervalsFile_->rec_.length_ >= r.end_ &&
@@ -467,6 +504,11 @@ namespace cgatools { namespace cgdata {
 
         if (dnbsFile_->rec_.intervalId_ <= intervalsFile_->rec_.intervalId_)
             dnbs_.clear();
+        if (!dnbsFile_->eof_ &&
+            dnbsFile_->jumpForward(dnbsFile_->rec_.intervalId_, intervalsFile_->rec_.intervalId_))
+        {
+            nextDnbs();
+        }
         while (dnbsFile_->rec_.intervalId_ <= intervalsFile_->rec_.intervalId_) 
         {
             if (dnbsFile_->rec_.intervalId_ == intervalsFile_->rec_.intervalId_)
@@ -499,6 +541,7 @@ namespace cgatools { namespace cgdata {
         {
             dnbsFile_->rec_.intervalId_ = std::numeric_limits<uint32_t>::max();
             dnbsFile_->rec_.scoreAllele_.assign(std::numeric_limits<int32_t>::min());
+            dnbsFile_->eof_ = true;
             return false;
         }
         return true;
@@ -18,6 +18,7 @@
 //! @file EvidenceReader.hpp
 
 #include "cgatools/core.hpp"
+#include "cgatools/util/BlockCompressedFile.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
 #include "cgatools/reference/CrrFile.hpp"
 #include "cgatools/cgdata/GenomeMetadata.hpp"
@@ -166,22 +167,40 @@ namespace cgatools { namespace cgdata {
         uint32_t countSupportingDnbs(uint16_t alleleIndex, int32_t scoreThreshold);
 
     private:
-        struct IntervalsFile
+        //! An evidence file, which may be read sequentially or, if it
+        //! is block-compressed and indexed, from the block holding a
+        //! given key. The parser reads through in_, so that a jump to
+        //! another block only replaces the stream buffer of in_ and
+        //! the header parsed on open remains valid.
+        struct EvidenceFile
         {
             std::string filename_;
             boost::shared_ptr<std::istream> f_;
+            boost::shared_ptr<util::BlockCompressedIndex> index_;
+            std::istream in_;
             util::DelimitedFile parser_;
+
+            explicit EvidenceFile(const std::string& fn);
+
+            //! Moves the stream to the block holding the first record
+            //! with a key greater than or equal to key, if that block
+            //! is past the record with the given current key. Returns
+            //! true if the stream was moved, in which case the next
+            //! record is the first record of the block.
+            bool jumpForward(int64_t currentKey, int64_t key);
+        };
+
+        struct IntervalsFile : public EvidenceFile
+        {
             IntervalRecord rec_;
 
             IntervalsFile(const std::string& fn, const reference::CrrFile& crr);
         };
 
-        struct DnbsFile
+        struct DnbsFile : public EvidenceFile
         {
-            std::string filename_;
-            boost::shared_ptr<std::istream> f_;
-            util::DelimitedFile parser_;
             DnbRecord rec_;
+            bool eof_;
 
             DnbsFile(const std::string& fn, const reference::CrrFile& crr);
         };
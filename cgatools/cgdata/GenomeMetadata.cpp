@@ -19,7 +19,9 @@
 #include "cgatools/util/Streams.hpp"
 #include "cgatools/util/Files.hpp"
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 
 namespace cgatools { namespace cgdata {
@@ -283,6 +285,21 @@ namespace cgatools { namespace cgdata {
         return util::files::listDir(mapDir_,".*");
     }
 
+    std::vector<std::string> GenomeMetadata::getLaneBatchIds( const std::string& laneName ) const
+    {
+        fs::path laneDir = mapDir_ / laneName;
+        util::files::check_dir(laneDir);
+        std::string prefix = "reads_";
+        std::vector<std::string> readsFiles = util::files::listDir(laneDir, 
+            prefix + laneName + "_[0-9]+\\.tsv(\\.gz|\\.bz2)?");
+
+        std::vector<std::string> result;
+        BOOST_FOREACH(const std::string& fileName, readsFiles)
+            result.push_back(fileName.substr(prefix.size(), fileName.find(".tsv")-prefix.size()));
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
     std::string GenomeMetadata::getReadsFileName( const std::string& laneBatchId ) const
     {
         std::string::size_type strEnd = laneBatchId.rfind('_');
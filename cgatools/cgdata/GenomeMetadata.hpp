@@ -67,6 +67,9 @@ namespace cgatools { namespace cgdata {
         std::string getLaneDir(const std::string& laneName) const;
         std::string getLibraryName(const std::string& laneName) const;
         std::vector<std::string> getLaneNames() const;
+        //! the ids of the lane batches of a lane that have a reads file,
+        //! sorted, in the format "SLIDE-LANE_BATCH": GS14901-FS3-L03_001
+        std::vector<std::string> getLaneBatchIds(const std::string& laneName) const;
 
         //
         //@param laneBatchId - an id in a form "A_B" where "A" is a lane id and "B" is a 3 digit batch id 
@@ -16,6 +16,7 @@
 #include "cgatools/util/BaseUtil.hpp"
 #include "cgatools/util/Streams.hpp"
 #include "cgatools/util/StringSet.hpp"
+#include "cgatools/util/ThreadPool.hpp"
 #include "cgatools/reference/ChromosomeIdField.hpp"
 #include "cgatools/command/CallDiff.hpp"
 #include "cgatools/variants/SuperlocusIterator.hpp"
@@ -25,6 +26,7 @@
 #include "cgatools/cgdata/ReferenceSupportReader.hpp"
 #include "cgatools/util/parse.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
@@ -198,6 +200,9 @@ namespace cgatools { namespace command {
             ("calibration-root", po::value<string>(&calibPrefix_),
              "The directory containing calibration data. For example, there should "
              "exist a file calibration-root/0.0.0/metrics.tsv.")
+            ("threads", po::value<size_t>(&threadCount_)->default_value(1),
+             "The number of threads used to compare superloci. The output does not "
+             "depend on the number of threads.")
             ("beta", "This flag enables the SomaticOutput report, which is beta functionality.");
             ;
 
@@ -732,11 +737,10 @@ namespace cgatools { namespace command {
             }
         }
 
-        void moveToSuperlocus(Range xrg, const SuperlocusIterator& slIt, bool haploid)
+        void moveToSuperlocus(Range xrg, const Location& refStart, bool haploid)
         {
             extend(xrg);
 
-            Location refStart = slIt.getPrecedingRefStart();
             if (refStart < xrg.beginLocation() &&
                 xrg.begin_ - refStart.offset_ >= MIN_REFERENCE_STRETCH &&
                 refStart.chromosome_ == xrg.chromosome_)
@@ -2111,6 +2115,40 @@ namespace cgatools { namespace command {
             }
 
         }
+
+        // Superloci per thread in a batch of superloci compared in
+        // parallel.
+        const size_t SUPERLOCUS_BATCH_SIZE = 256;
+
+        // A superlocus and its comparison result.
+        struct SuperlocusDiff
+        {
+            SuperlocusDiff()
+                : sl_(0)
+            {
+            }
+
+            // Points to slCopy_, or to the superlocus iterator's
+            // superlocus when comparing on a single thread.
+            const Superlocus* sl_;
+            Superlocus slCopy_;
+            Location precedingRefStart_;
+            vector< vector<PhasedHypothesis> > hypotheses_;
+            CallDiffResult dr_;
+        };
+
+        void compareSuperlocus(vector<SuperlocusDiff>& batch,
+                               size_t maxHypothesisCount,
+                               const CrrFile& crr,
+                               size_t offset)
+        {
+            SuperlocusDiff& sd = batch[offset];
+            sd.sl_->buildPhasedHypotheses(sd.hypotheses_, maxHypothesisCount, true);
+            CGA_ASSERT(sd.hypotheses_.size() == 2);
+            sd.dr_ = CallDiffResult();
+            PhasedHypothesis::findBestDiff(*sd.sl_, maxHypothesisCount,
+                                           sd.hypotheses_[0], sd.hypotheses_[1], crr, sd.dr_);
+        }
     }
 
     int CallDiff::run(po::variables_map& vm)
@@ -2241,148 +2279,181 @@ namespace cgatools { namespace command {
         }
 #endif
 
+        // Superloci are compared in batches: the superlocus iterator
+        // fills a batch, the batch is compared on the thread pool, and
+        // the results are reported in superlocus order, so the output
+        // does not depend on the thread count.
+        ThreadPool pool(threadCount_);
+        vector<SuperlocusDiff> batch(1 == pool.size() ? 1 : SUPERLOCUS_BATCH_SIZE * pool.size());
         size_t slCount = 0;
-        for(slIt.seekFirst(); !slIt.eof(); ++slIt, slCount++)
+        slIt.seekFirst();
+        while (!slIt.eof())
         {
 //             if (slCount >= 10000)
 //                 break;
 //             if (slIt->getRange().chromosome_ > 1)
 //                 break;
 
-            const Superlocus& sl = *slIt;
-            Range range = sl.getRange();
-
-            vector< vector<PhasedHypothesis> > hypotheses;
-            sl.buildPhasedHypotheses(hypotheses, maxHypothesisCount_, true);
-            CGA_ASSERT(hypotheses.size() == 2);
-
-            bool matchedRegion =
-                !hypotheses[0].empty() && !hypotheses[1].empty() &&
-                hypotheses[0][0].size() == hypotheses[1][0].size();
-            bool matchedHaploidRegion = matchedRegion && hypotheses[0][0].size() == 1;
-
-            if (somaticScoreCalc && matchedRegion)
-                somaticScoreCalc->moveToSuperlocus(range, slIt, matchedHaploidRegion);
-
-            if (0 != superDebug.get())
-                *superDebug << range.chromosome_ << " " << range.begin_ << " " << range.end_ << " "
-                            << hypotheses[0].size() << " " << hypotheses[1].size() << endl;
-            CallDiffResult dr;
-            PhasedHypothesis::findBestDiff(sl, maxHypothesisCount_, hypotheses[0], hypotheses[1], crr, dr);
-            string classification = CallDiffResult::getMatchTypeString(dr.matchType_);
-            superlocusStats[dr.matchType_]++;
-            string refAllele = crr.getSequence(range);
-            size_t refBAlleleCount = 0;
-            for(size_t ii=0; ii<dr.hyp_[1].size(); ii++)
+            size_t batchSize = 0;
+            if (1 == pool.size())
             {
-                if (dr.hyp_[1][ii].allele() == refAllele)
-                    refBAlleleCount++;
+                // No need to copy the superlocus when comparing on
+                // this thread.
+                batch[0].sl_ = &*slIt;
+                batch[0].precedingRefStart_ = slIt.getPrecedingRefStart();
+                batchSize = 1;
             }
-#if 0
-            if (0 != mafReport.get() && matchedRegion)
-                mafReport->addMafRecords(dr, sl);
-#endif
-            if (0 != superOut.get())
+            else
             {
-                *superOut << sl.getId() << "\t"
-//                           << "A" << boost::size(sl.getLoci(0)) << "B" << boost::size(sl.getLoci(1)) << "\t"
-                          << crr.listChromosomes()[range.chromosome_].getName() << "\t"
-                          << range.begin_ << "\t" << range.end_ << "\t"
-                          << classification << "\t" << crr.getSequence(range);
-                *superOut << "\t";
-                for(size_t ii=0; ii<dr.hyp_[0].size(); ii++)
+                for(; batchSize<batch.size() && !slIt.eof(); ++slIt, batchSize++)
                 {
-                    if (ii > 0)
-                        *superOut << ";";
-                    *superOut << dr.hyp_[0][ii].allele();
+                    batch[batchSize].slCopy_ = *slIt;
+                    batch[batchSize].sl_ = &batch[batchSize].slCopy_;
+                    batch[batchSize].precedingRefStart_ = slIt.getPrecedingRefStart();
                 }
-                *superOut << "\t";
+            }
+
+            pool.parallelFor(batchSize, boost::bind(&compareSuperlocus, boost::ref(batch),
+                                                    maxHypothesisCount_, boost::cref(crr), _1));
+
+            for(size_t slOffset=0; slOffset<batchSize; slOffset++, slCount++)
+            {
+                const Superlocus& sl = *batch[slOffset].sl_;
+                Range range = sl.getRange();
+                const vector< vector<PhasedHypothesis> >& hypotheses = batch[slOffset].hypotheses_;
+                const CallDiffResult& dr = batch[slOffset].dr_;
+
+                bool matchedRegion =
+                    !hypotheses[0].empty() && !hypotheses[1].empty() &&
+                    hypotheses[0][0].size() == hypotheses[1][0].size();
+                bool matchedHaploidRegion = matchedRegion && hypotheses[0][0].size() == 1;
+
+                if (somaticScoreCalc && matchedRegion)
+                    somaticScoreCalc->moveToSuperlocus(
+                        range, batch[slOffset].precedingRefStart_, matchedHaploidRegion);
+
+                if (0 != superDebug.get())
+                    *superDebug << range.chromosome_ << " " << range.begin_ << " " << range.end_ << " "
+                                << hypotheses[0].size() << " " << hypotheses[1].size() << endl;
+                string classification = CallDiffResult::getMatchTypeString(dr.matchType_);
+                superlocusStats[dr.matchType_]++;
+                string refAllele = crr.getSequence(range);
+                size_t refBAlleleCount = 0;
                 for(size_t ii=0; ii<dr.hyp_[1].size(); ii++)
                 {
-                    if (ii > 0)
-                        *superOut << ";";
-                    *superOut << dr.hyp_[1][ii].allele();
+                    if (dr.hyp_[1][ii].allele() == refAllele)
+                        refBAlleleCount++;
                 }
-                *superOut << "\n";
-            }
-            if (0 != callOut.get())
-            {
-                for(size_t ii=0; ii<2; ii++)
+#if 0
+                if (0 != mafReport.get() && matchedRegion)
+                    mafReport->addMafRecords(dr, sl);
+#endif
+                if (0 != superOut.get())
                 {
-                    BOOST_FOREACH(const Locus& locus, sl.getLoci(ii))
+                    *superOut << sl.getId() << "\t"
+//                           << "A" << boost::size(sl.getLoci(0)) << "B" << boost::size(sl.getLoci(1)) << "\t"
+                              << crr.listChromosomes()[range.chromosome_].getName() << "\t"
+                              << range.begin_ << "\t" << range.end_ << "\t"
+                              << classification << "\t" << crr.getSequence(range);
+                    *superOut << "\t";
+                    for(size_t ii=0; ii<dr.hyp_[0].size(); ii++)
+                    {
+                        if (ii > 0)
+                            *superOut << ";";
+                        *superOut << dr.hyp_[0][ii].allele();
+                    }
+                    *superOut << "\t";
+                    for(size_t ii=0; ii<dr.hyp_[1].size(); ii++)
                     {
-                        BOOST_FOREACH(const Call& call, locus.getCalls())
+                        if (ii > 0)
+                            *superOut << ";";
+                        *superOut << dr.hyp_[1][ii].allele();
+                    }
+                    *superOut << "\n";
+                }
+                if (0 != callOut.get())
+                {
+                    for(size_t ii=0; ii<2; ii++)
+                    {
+                        BOOST_FOREACH(const Locus& locus, sl.getLoci(ii))
                         {
-                            vector<cdmt::MatchType> mtCall;
-                            for(size_t jj=0; jj<dr.callClass_[ii].size(); jj++)
+                            BOOST_FOREACH(const Call& call, locus.getCalls())
                             {
-                                for(size_t kk=0; kk<dr.callClass_[ii][jj].size(); kk++)
+                                vector<cdmt::MatchType> mtCall;
+                                for(size_t jj=0; jj<dr.callClass_[ii].size(); jj++)
                                 {
-                                    if (dr.callClass_[ii][jj][kk].second == &call)
-                                        mtCall.push_back(dr.callClass_[ii][jj][kk].first);
+                                    for(size_t kk=0; kk<dr.callClass_[ii][jj].size(); kk++)
+                                    {
+                                        if (dr.callClass_[ii][jj][kk].second == &call)
+                                            mtCall.push_back(dr.callClass_[ii][jj][kk].first);
+                                    }
                                 }
+                                string callClass = CallDiffResult::getMatchTypeString(mtCall);
+                                *callOut << sl.getId() << "\t" << char('A'+ii) << "\t"
+                                         << classification << "\t";
+                                *callOut << callClass << "\t";
+                                call.write(*callOut, crr);
+                                *callOut << "\n";
                             }
-                            string callClass = CallDiffResult::getMatchTypeString(mtCall);
-                            *callOut << sl.getId() << "\t" << char('A'+ii) << "\t" << classification << "\t";
-                            *callOut << callClass << "\t";
-                            call.write(*callOut, crr);
-                            *callOut << "\n";
                         }
                     }
                 }
-            }
 
-            for(size_t ii=0; ii<2; ii++)
-            {
-                BOOST_FOREACH(const Locus& locus, sl.getLoci(ii))
+                for(size_t ii=0; ii<2; ii++)
                 {
-                    if (locus.isRefConsistent())
-                        continue;
-
-                    vector<cdmt::MatchType> mtLocus;
-                    BOOST_FOREACH(const Allele& allele, locus.getAlleles())
+                    BOOST_FOREACH(const Locus& locus, sl.getLoci(ii))
                     {
-                        cdmt::MatchType mt = cdmt::REF_IDENTICAL;
-                        BOOST_FOREACH(size_t offset, allele.getCallOffsets())
+                        if (locus.isRefConsistent())
+                            continue;
+
+                        vector<cdmt::MatchType> mtLocus;
+                        BOOST_FOREACH(const Allele& allele, locus.getAlleles())
                         {
-                            const Call& call = locus.getCalls()[offset];
-                            for(size_t jj=0; jj<dr.callClass_[ii].size(); jj++)
+                            cdmt::MatchType mt = cdmt::REF_IDENTICAL;
+                            BOOST_FOREACH(size_t offset, allele.getCallOffsets())
                             {
-                                for(size_t kk=0; kk<dr.callClass_[ii][jj].size(); kk++)
+                                const Call& call = locus.getCalls()[offset];
+                                for(size_t jj=0; jj<dr.callClass_[ii].size(); jj++)
                                 {
-                                    if (dr.callClass_[ii][jj][kk].second == &call)
-                                        mt = CallDiffResult::mergeMatchTypes(
-                                            mt, dr.callClass_[ii][jj][kk].first);
+                                    for(size_t kk=0; kk<dr.callClass_[ii][jj].size(); kk++)
+                                    {
+                                        if (dr.callClass_[ii][jj][kk].second == &call)
+                                            mt = CallDiffResult::mergeMatchTypes(
+                                                mt, dr.callClass_[ii][jj][kk].first);
+                                    }
                                 }
                             }
+                            mtLocus.push_back(mt);
+                        }
+                        std::sort(mtLocus.begin(), mtLocus.end());
+                        if (needVariantOutput) {
+                            locusDiffClassCache[ii][locus.getId()] = mtLocus;
+                            if (1 == ii && isLohVar(dr, mtLocus))
+                                lohLoci.insert(locus.getId());
                         }
-                        mtLocus.push_back(mt);
-                    }
-                    std::sort(mtLocus.begin(), mtLocus.end());
-                    if (needVariantOutput) {
-                        locusDiffClassCache[ii][locus.getId()] = mtLocus;
-                        if (1 == ii && isLohVar(dr, mtLocus))
-                            lohLoci.insert(locus.getId());
-                    }
 
-                    string locusClass = getClassification(locus, crr);
-                    locusStats[ii][locusClass][mtLocus]++;
-                    if (0 != locusOut.get())
-                    {
-                        string locusDiffClass = CallDiffResult::getMatchTypeString(mtLocus);
-                        BOOST_FOREACH(const Call& call, locus.getCalls())
+                        string locusClass = getClassification(locus, crr);
+                        locusStats[ii][locusClass][mtLocus]++;
+                        if (0 != locusOut.get())
                         {
-                            *locusOut << sl.getId() << "\t" << char('A'+ii) << "\t";
-                            *locusOut << locusClass << "\t" << locusDiffClass << "\t";
-                            call.write(*locusOut, crr);
-                            *locusOut << "\n";
+                            string locusDiffClass = CallDiffResult::getMatchTypeString(mtLocus);
+                            BOOST_FOREACH(const Call& call, locus.getCalls())
+                            {
+                                *locusOut << sl.getId() << "\t" << char('A'+ii) << "\t";
+                                *locusOut << locusClass << "\t" << locusDiffClass << "\t";
+                                call.write(*locusOut, crr);
+                                *locusOut << "\n";
+                            }
                         }
+                        if (somaticScoreCalc && matchedRegion && 0 == ii)
+                            somaticScoreCalc->processLocus(
+                                sl.getId(), locus, locItA, locusClass, mtLocus, refBAlleleCount);
                     }
-                    if (somaticScoreCalc && matchedRegion && 0 == ii)
-                        somaticScoreCalc->processLocus(
-                            sl.getId(), locus, locItA, locusClass, mtLocus, refBAlleleCount);
                 }
             }
+
+            if (1 == pool.size())
+                ++slIt;
         }
 
         if (0 != reports.count("LocusStats"))
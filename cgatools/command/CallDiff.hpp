@@ -73,6 +73,7 @@ namespace cgatools { namespace command {
         size_t extendBases_;
         size_t statsColumnCount_;
         size_t maxHypothesisCount_;
+        size_t threadCount_;
         bool noReferenceCoverValidation_;
         bool addVarFlags_;
         bool eaf_;
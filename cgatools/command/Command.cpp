@@ -17,6 +17,9 @@
 #include "cgatools/util/Exception.hpp"
 #include "cgatools/util/Streams.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+#include "cgatools/util/ReadAheadSource.hpp"
+#include "cgatools/util/WriteBehindSink.hpp"
 #include <iostream>
 #include <sstream>
 #include <boost/algorithm/string.hpp>
@@ -44,6 +47,8 @@ namespace cgatools { namespace command {
             "testvariants",
             "evidence2sam",
             "evidence2cache",
+            "indexevidence",
+            "indexvar",
             "mergedmap2sam",
             "join",
             "junctiondiff",
@@ -51,6 +56,7 @@ namespace cgatools { namespace command {
             "junctions2events",
             "generatemastervar",
             "varfilter",
+            "var2bin",
             "mkvcf"
         };
 
@@ -82,7 +88,24 @@ namespace cgatools { namespace command {
              "pipeline software version (SOFTWARE_VERSION in metadata) override")
             ("commonhdr-file",
              po::value<std::string>(&commonHeaderFileName_),
-             "file with common metadata headers to prepend to output files (for supported commands)");
+             "file with common metadata headers to prepend to output files (for supported commands)")
+            ("compression-threads",
+             po::value<size_t>(&util::ParallelCompression::THREAD_COUNT)->default_value(1),
+             "number of threads used to compress and decompress gzip and bzip2 files "
+             "(0 for one per hardware thread)")
+            ("read-ahead",
+             po::bool_switch(&util::ReadAheadSource::ENABLED)->default_value(false),
+             "decompress gzip and bzip2 input files on a read-ahead thread")
+            ("write-behind",
+             po::bool_switch(&util::WriteBehindSink::ENABLED)->default_value(false),
+             "format output into large buffers, and compress and write them "
+             "on a background thread")
+            ("write-buffer-size",
+             po::value<size_t>(&util::WriteBehindSink::BUFFER_SIZE)->default_value(1024*1024),
+             "size of the buffers used by write-behind")
+            ("no-fsync",
+             po::bool_switch(&util::FileDescriptorDevice::SKIP_FSYNC_ON_CLOSE)->default_value(false),
+             "do not fsync output files when closing them");
 
         BOOST_FOREACH(const char* bc, CGA_BETA_COMMANDS)
         {
@@ -51,6 +51,15 @@ namespace cgatools { namespace command {
             ("extract-genomic-region", po::value<util::StringVector>(&config_.exportRegionList_),
              "Defines a region as a half-open interval 'chr,from,to' or 'chr'. "
              "Multiple intervals can be defined byusing the option multiple times.")
+            ("sort-memory", po::value<size_t>(&config_.sortMemory_)->default_value(1024),
+             "The memory in MB used to hold records, divided among the chromosomes "
+             "processed at a time. Beyond it, the records are sorted in runs written "
+             "to temporary files in the output directory, which are merged into the "
+             "cache files.")
+            ("threads", po::value<size_t>(&config_.threadCount_)->default_value(1),
+             "The number of chromosomes processed at a time. Each one holds its "
+             "records until it is written, so the chromosomes processed at a time "
+             "share --sort-memory. The output does not depend on the number of threads.")
             ("debug-output,v", po::bool_switch(&config_.verboseOutput_)->default_value(false),
              "Generate verbose debug output. Please don't rely on this option in production.")
             ;
@@ -68,7 +77,8 @@ namespace cgatools { namespace command {
         cgdata::GenomeMetadata  genomeMetadata(config_.exportRootDirName_);
 
         mapping::EvidenceCacheBuilder   cacheBuilder(genomeMetadata,config_.reference_);
-        cacheBuilder.exportRanges(config_.outputDirName_, *config_.exportRegions_);
+        cacheBuilder.exportRanges(config_.outputDirName_, *config_.exportRegions_,
+                                  config_.threadCount_, config_.sortMemory_*1024*1024);
 
         return 0;
     }
@@ -28,13 +28,15 @@ namespace cgatools { namespace command {
     class Evidence2CacheConfig {
     public:
         Evidence2CacheConfig() 
-            :verboseOutput_(false)
+            :verboseOutput_(false), threadCount_(1), sortMemory_(1024)
         {}
 
         void init();
 
         bool   addAlleleId_;
         bool   verboseOutput_;
+        size_t threadCount_;
+        size_t sortMemory_;
 
         boost::scoped_ptr<util::FastRangeSet>  
                             exportRegions_;
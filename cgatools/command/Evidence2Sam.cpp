@@ -19,23 +19,49 @@
 #include "cgatools/util/DelimitedFile.hpp"
 #include "cgatools/util/parse.hpp"
 #include "cgatools/util/BaseUtil.hpp"
+#include "cgatools/util/ThreadPool.hpp"
 #include "cgatools/reference/CrrFile.hpp"
 
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace cgatools { namespace command {
 
-    //! Contains an "LRU cache"-like structure: a list of records + an indexing multimap
+    //! A sliding window over the evidence DNB records, from the interval
+    //! being converted to LOOK_AHEAD_DISTANCE beyond it: the records in
+    //! the order they were loaded, and an index by DNB. A record removed
+    //! from the middle of the window is only marked as removed, and is
+    //! dropped once it reaches the front.
     class EvidenceDnbBuffer {
     public:
         static const int32_t LOOK_AHEAD_DISTANCE = 1000;
 
-        typedef std::list<mapping::EvidenceDnbRecord>        EvidenceDnbs;
-        typedef std::vector<EvidenceDnbs::iterator> EvidenceDnbSet;
+        //! A record of the window, with its DNB id.
+        class EvidenceDnb : public mapping::EvidenceDnbRecord {
+        public:
+            EvidenceDnb(const mapping::EvidenceDnbRecord& record, uint64_t dnbId)
+                : mapping::EvidenceDnbRecord(record), dnbId_(dnbId), removed_(false)
+            {}
+
+            uint64_t    dnbId_;
+            bool        removed_;
+        };
+
+        //! The records keep their address while they are in the window.
+        typedef std::deque<EvidenceDnb>     EvidenceDnbs;
+        typedef std::vector<EvidenceDnb*>   EvidenceDnbSet;
 
         class IntervalDescriptor {
         public:
@@ -50,9 +76,11 @@ namespace cgatools { namespace command {
         };
 
         typedef std::list<IntervalDescriptor>   Intervals;
-        typedef std::multimap<uint64_t, EvidenceDnbs::iterator> EvidenceDnbIndex;
+        typedef std::multimap<uint64_t, EvidenceDnb*> EvidenceDnbIndex;
+
+        EvidenceDnbBuffer() : size_(0) {}
 
-        uint64_t getDnbId(const mapping::EvidenceDnbRecord &evidenceRecord) { 
+        static uint64_t getDnbId(const mapping::EvidenceDnbRecord &evidenceRecord) { 
             //slideId - 5 decimal digits
             //laneId - 2 decimal digits
             //lanePartId - 2 decimal digits
@@ -87,8 +115,6 @@ namespace cgatools { namespace command {
         {
             bool result = false;
 
-            EvidenceDnbs::iterator it;
-
             while(interval.id_ == evidenceRecord.intervalId_) {
                 uint64_t dnbId = getDnbId(evidenceRecord);
 
@@ -98,8 +124,9 @@ namespace cgatools { namespace command {
                 if (evidenceRecord.offsetInReference_[0] > interval.maxPosition_)
                     interval.maxPosition_ = evidenceRecord.offsetInReference_[0];
 
-                it = evidenceDnbs_.insert(evidenceDnbs_.end(),evidenceRecord);
-                evidenceDnbIndex_.insert(std::make_pair(dnbId,it));
+                evidenceDnbs_.push_back(EvidenceDnb(evidenceRecord,dnbId));
+                evidenceDnbIndex_.insert(std::make_pair(dnbId,&evidenceDnbs_.back()));
+                ++size_;
 
                 if (!file.next()) {
                     result = true;
@@ -113,52 +140,62 @@ namespace cgatools { namespace command {
         void removeLastInterval(int32_t intervalId) {
             CGA_ASSERT(!intervals_.empty());
             CGA_ASSERT_EQ(intervals_.front().id_,intervalId);
-            while (!evidenceDnbs_.empty() && 
-                evidenceDnbs_.front().intervalId_ == intervalId) 
+            while (!empty() && getEvidenceDnbsBegin()->intervalId_ == intervalId) 
             {
-                removeMappingRecord(evidenceDnbs_.begin());
+                removeMappingRecord(getEvidenceDnbsBegin());
             }
             intervals_.pop_front();
         }
 
-        EvidenceDnbs::iterator removeMappingRecord(EvidenceDnbs::iterator record) {
-            uint64_t dnbId = getDnbId(*record);
-            EvidenceDnbIndex::iterator it = evidenceDnbIndex_.find(dnbId);
-            CGA_ASSERT_MSG(it!=evidenceDnbIndex_.end(),"corrupted evidenceDnbIndex_");
-            for (;it->second != record; ++it) {
-                CGA_ASSERT_MSG(it!=evidenceDnbIndex_.end() && it->first == dnbId,
-                    "corrupted evidenceDnbIndex_: " << CGA_VOUT(it->first) << CGA_VOUT(dnbId));
-            }
+        //! Removes the record from the window. The record stays valid
+        //! until the next call to getEvidenceDnbsBegin().
+        void removeMappingRecord(EvidenceDnb* record) {
+            CGA_ASSERT(!record->removed_);
+            std::pair<EvidenceDnbIndex::iterator,EvidenceDnbIndex::iterator> range =
+                evidenceDnbIndex_.equal_range(record->dnbId_);
+            EvidenceDnbIndex::iterator it = range.first;
+            while (it!=range.second && it->second!=record)
+                ++it;
+            CGA_ASSERT_MSG(it!=range.second,
+                "corrupted evidenceDnbIndex_: " << CGA_VOUT(record->dnbId_));
             evidenceDnbIndex_.erase(it);
-            EvidenceDnbs::iterator result = evidenceDnbs_.erase(record);
-            return result;
+            record->removed_ = true;
+            --size_;
         }
 
-        void findDnbRecordsOfTheSameDnb(EvidenceDnbs::iterator& record, EvidenceDnbSet& result) {
-            uint64_t dnbId = getDnbId(*record);
-            EvidenceDnbIndex::iterator it = evidenceDnbIndex_.find(dnbId);
-            CGA_ASSERT_MSG(it!=evidenceDnbIndex_.end(),"corrupted evidenceDnbIndex_");
-            for (;it!=evidenceDnbIndex_.end() && it->first == dnbId; ++it) {
+        void findDnbRecordsOfTheSameDnb(const EvidenceDnb* record, EvidenceDnbSet& result) {
+            std::pair<EvidenceDnbIndex::iterator,EvidenceDnbIndex::iterator> range =
+                evidenceDnbIndex_.equal_range(record->dnbId_);
+            CGA_ASSERT_MSG(range.first!=range.second,"corrupted evidenceDnbIndex_");
+            for (EvidenceDnbIndex::iterator it=range.first; it!=range.second; ++it) {
                 result.push_back(it->second);
             }
         }
 
         bool empty() const {
-            CGA_ASSERT_EQ(evidenceDnbs_.empty(),evidenceDnbIndex_.empty());
-            return evidenceDnbs_.empty();
+            bool result = 0==size_;
+            CGA_ASSERT_EQ(result,evidenceDnbIndex_.empty());
+            return result;
         }
 
         const IntervalDescriptor &  getLastInterval() {return intervals_.front();}
-        EvidenceDnbs::iterator      getEvidenceDnbsBegin() {return evidenceDnbs_.begin();}
+
+        //! The first record of the window, which must not be empty.
+        EvidenceDnb* getEvidenceDnbsBegin() {
+            while (evidenceDnbs_.front().removed_)
+                evidenceDnbs_.pop_front();
+            return &evidenceDnbs_.front();
+        }
 
         const Intervals &       getIntervals() const {return intervals_;}
-        const EvidenceDnbs &    getEvidenceDnbs() const {return evidenceDnbs_;}
         const EvidenceDnbIndex& getEvidenceDnbIndex() const {return evidenceDnbIndex_;}
 
     protected:
 
         Intervals           intervals_;
         EvidenceDnbs        evidenceDnbs_;
+        //! the number of records of evidenceDnbs_ that are not removed
+        size_t              size_;
         EvidenceDnbIndex    evidenceDnbIndex_;
     };
 
@@ -196,42 +233,171 @@ namespace cgatools { namespace command {
         boost::array<int,4> armRanges_;
     };
 
+    //! Writes the SAM records of several shards, which are converted
+    //! concurrently, in the order of the shards. The records of the
+    //! shard being written go to the output at once. Those of the
+    //! following shards wait for their turn, at most MAX_WAITING_BUFFERS
+    //! buffers per shard, so that the memory used does not depend on the
+    //! size of the shards. The shards must be started in order.
+    class SamShardWriter : boost::noncopyable {
+    public:
+        typedef mapping::SamRecordGenerator::RecordBuffer RecordBuffer;
+
+        static const size_t MAX_WAITING_BUFFERS = 4;
+
+        SamShardWriter(mapping::SamRecordGenerator& samRecordGenerator, size_t shardCount)
+          : samRecordGenerator_(samRecordGenerator),
+            current_(0),
+            finished_(shardCount, false),
+            waiting_(shardCount),
+            failed_(false)
+        {}
+
+        //! Writes the records of the buffer, or keeps them until the turn
+        //! of the shard, and returns the buffer empty. Blocks while the
+        //! shard has too many buffers waiting.
+        void write(size_t shard, RecordBuffer& buffer)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (!failed_ && shard != current_ && waiting_[shard].size() >= MAX_WAITING_BUFFERS)
+                turn_.wait(lock);
+
+            if (failed_)
+            {
+                buffer.clear();
+            } else if (shard == current_)
+            {
+                samRecordGenerator_.write(buffer);
+                buffer.clear();
+            } else
+            {
+                waiting_[shard].push_back(RecordBuffer());
+                waiting_[shard].back().swap(buffer);
+                if (!spareBuffers_.empty())
+                {
+                    buffer.swap(spareBuffers_.back());
+                    spareBuffers_.pop_back();
+                }
+            }
+        }
+
+        //! Called once all the records of the shard have been written.
+        void finish(size_t shard)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            finished_[shard] = true;
+            while (current_ < finished_.size() && finished_[current_])
+            {
+                ++current_;
+                if (current_ < finished_.size())
+                    writeWaiting(current_);
+            }
+            turn_.notify_all();
+        }
+
+        //! Drops the records of all the shards from now on, so that the
+        //! conversion of the other shards can stop after an error.
+        void fail()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            failed_ = true;
+            turn_.notify_all();
+        }
+
+        bool isFailed()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            return failed_;
+        }
+
+    private:
+        void writeWaiting(size_t shard)
+        {
+            std::deque<RecordBuffer>& waiting = waiting_[shard];
+            for (; !waiting.empty(); waiting.pop_front())
+            {
+                if (!failed_)
+                    samRecordGenerator_.write(waiting.front());
+                waiting.front().clear();
+                spareBuffers_.push_back(RecordBuffer());
+                spareBuffers_.back().swap(waiting.front());
+            }
+        }
+
+        mapping::SamRecordGenerator&            samRecordGenerator_;
+        size_t                                  current_;
+        std::vector<bool>                       finished_;
+        std::vector< std::deque<RecordBuffer> > waiting_;
+        std::vector<RecordBuffer>               spareBuffers_;
+        bool                                    failed_;
+        boost::mutex                            mutex_;
+        boost::condition_variable               turn_;
+    };
+
+    //! Converts the records of one evidence file into one shard of the
+    //! SAM output.
     class Evidence2SamConverter {
     public:
         static const char SAM_SEPARATOR = '\t';
+        //! the number of SAM records converted before they are written
+        static const size_t RECORD_BUFFER_SIZE = 10000;
 
         typedef boost::shared_ptr<std::istream> InStream;
 
-        Evidence2SamConverter(const Evidence2SamConfig &config, std::ostream &outSamFile)
+        //! Opens the evidence file and reads its header.
+        Evidence2SamConverter(const Evidence2SamConfig &config, 
+                              const std::string& evidenceDnbsFileName,
+                              const reference::CrrFile& reference,
+                              const util::FastRangeSet& exportRegions,
+                              const boost::shared_ptr<std::ostream>& selectedEvidenceRecords,
+                              const boost::shared_ptr<std::ostream>& deletedEvidenceRecords)
           : formatVersion_(0), 
             halfDnbSize_(35), 
-            chrSequence_(NULL),
-            outSamFile_(outSamFile), 
-            config_(config)
+            chrId_(0),
+            reference_(reference),
+            exportRegions_(exportRegions),
+            selectedEvidenceRecords_(selectedEvidenceRecords),
+            deletedEvidenceRecords_(deletedEvidenceRecords),
+            config_(config),
+            samRecordGenerator_(NULL),
+            output_(NULL),
+            shard_(0)
         {
-            init();
+            init(evidenceDnbsFileName);
         }
 
-        struct SortEvidenceDnbIteratorsByInterval {
-            bool operator() (const EvidenceDnbBuffer::EvidenceDnbs::const_iterator &o1,
-                             const EvidenceDnbBuffer::EvidenceDnbs::const_iterator &o2) 
+        struct SortEvidenceDnbsByInterval {
+            bool operator() (const EvidenceDnbBuffer::EvidenceDnb *o1,
+                             const EvidenceDnbBuffer::EvidenceDnb *o2) 
             { return o1->intervalId_ < o2->intervalId_; }
         };
 
-        struct SortEvidenceDnbIteratorsByStrand {
-            bool operator() (const EvidenceDnbBuffer::EvidenceDnbs::const_iterator &o1,
-                const EvidenceDnbBuffer::EvidenceDnbs::const_iterator &o2) 
+        struct SortEvidenceDnbsByStrand {
+            bool operator() (const EvidenceDnbBuffer::EvidenceDnb *o1,
+                const EvidenceDnbBuffer::EvidenceDnb *o2) 
             { return o1->side_ == o2->side_ ? o1->strand_ < o2->strand_ : o1->side_ < o2->side_; }
         };
 
-        EvidenceDnbBuffer::EvidenceDnbs::iterator removeFromBuffer(
+        struct SameInterval {
+            bool operator() (const EvidenceDnbBuffer::EvidenceDnb *o1,
+                             const EvidenceDnbBuffer::EvidenceDnb *o2) 
+            { return o1->intervalId_ == o2->intervalId_; }
+        };
+
+        struct SameSideAndStrand {
+            bool operator() (const EvidenceDnbBuffer::EvidenceDnb *o1,
+                             const EvidenceDnbBuffer::EvidenceDnb *o2) 
+            { return o1->side_ == o2->side_ && o1->strand_ == o2->strand_; }
+        };
+
+        void removeFromBuffer(
             EvidenceDnbBuffer& buffer,
-            EvidenceDnbBuffer::EvidenceDnbs::iterator record)
+            EvidenceDnbBuffer::EvidenceDnb* record)
         {
             if (config_.verboseOutput_) {
                 (*deletedEvidenceRecords_) << *record << std::endl;
             }
-            return buffer.removeMappingRecord(record);
+            buffer.removeMappingRecord(record);
         }
 
         void getBetterMapping(mapping::EvidenceDnbRecord &targetRecord,
@@ -249,6 +415,24 @@ namespace cgatools { namespace command {
             targetRecord.mateMappingQuality_ = anotherRecord.mappingQuality_;
         }
 
+        //! Merges each run of mappings that are the same by "same" into
+        //! the first mapping of the run, which gets the better mapping,
+        //! and removes the others from the buffer.
+        template <class Same>
+        void mergeSameMappings(
+            EvidenceDnbBuffer &recordBuffer,
+            EvidenceDnbBuffer::EvidenceDnbSet &dnbSet,
+            Same same)
+        {
+            for (size_t i=dnbSet.size()-1; i>0; --i) {
+                if (same(dnbSet[i-1],dnbSet[i])) {
+                    getBetterMapping(*dnbSet[i-1],*dnbSet[i]);
+                    removeFromBuffer(recordBuffer,dnbSet[i]);
+                }
+            }
+            dnbSet.erase(std::unique(dnbSet.begin(),dnbSet.end(),same),dnbSet.end());
+        }
+
         void processIntersectingMappings(
             EvidenceDnbBuffer &recordBuffer,
             EvidenceDnbBuffer::EvidenceDnbSet &intersectingDnbSet) 
@@ -259,31 +443,16 @@ namespace cgatools { namespace command {
                 // get the best mapping from the same interval, remove the other
                 // eliminates DNBs supporting different alleles of the same interval
                 std::sort(intersectingDnbSet.begin(),intersectingDnbSet.end(),
-                    SortEvidenceDnbIteratorsByInterval());
-                for(int prevI=intersectingDnbSet.size()-1, i=prevI-1; i>=0; prevI=i, --i) {
-                    if (intersectingDnbSet[prevI]->intervalId_==intersectingDnbSet[i]->intervalId_) 
-                    {
-                        getBetterMapping(*intersectingDnbSet[i],*intersectingDnbSet[prevI]);
-                        removeFromBuffer(recordBuffer,intersectingDnbSet[prevI]);
-                        intersectingDnbSet.erase(intersectingDnbSet.begin()+prevI);
-                    }
-                }
+                    SortEvidenceDnbsByInterval());
+                mergeSameMappings(recordBuffer,intersectingDnbSet,SameInterval());
             }
 
             if (intersectingDnbSet.size()>=2) 
             {
                 // get the best mapping from neighbor intervals, remove the other
                 std::sort(intersectingDnbSet.begin(),intersectingDnbSet.end(),
-                    SortEvidenceDnbIteratorsByStrand());
-                for(int prevI=intersectingDnbSet.size()-1, i=prevI-1; i>=0; prevI=i, --i) {
-                    if (intersectingDnbSet[prevI]->side_==intersectingDnbSet[i]->side_ &&
-                        intersectingDnbSet[prevI]->strand_==intersectingDnbSet[i]->strand_) 
-                    {
-                        getBetterMapping(*intersectingDnbSet[i],*intersectingDnbSet[prevI]);
-                        removeFromBuffer(recordBuffer,intersectingDnbSet[prevI]);
-                        intersectingDnbSet.erase(intersectingDnbSet.begin()+prevI);
-                    }
-                }
+                    SortEvidenceDnbsByStrand());
+                mergeSameMappings(recordBuffer,intersectingDnbSet,SameSideAndStrand());
             }
 
             if (intersectingDnbSet.size()==2) {
@@ -327,9 +496,9 @@ namespace cgatools { namespace command {
             EvidenceDnbBuffer::EvidenceDnbSet dnbSet;
             EvidenceDnbBuffer::EvidenceDnbSet intersectingDnbSet;
             bool eof = recordBuffer.updateBuffer(*evidenceDnbsFile_,evidenceRecord);
-            while (!recordBuffer.empty()) {
+            while (!recordBuffer.empty() && !output_->isFailed()) {
                 const EvidenceDnbBuffer::IntervalDescriptor &interval = recordBuffer.getLastInterval();
-                EvidenceDnbBuffer::EvidenceDnbs::iterator it=recordBuffer.getEvidenceDnbsBegin();
+                EvidenceDnbBuffer::EvidenceDnb* it=recordBuffer.getEvidenceDnbsBegin();
                 CGA_ASSERT_MSG(it->intervalId_ >= interval.id_,
                     CGA_VOUT(it->intervalId_)<<CGA_VOUT(interval.id_));
                 while (it->intervalId_==interval.id_) {
@@ -339,7 +508,7 @@ namespace cgatools { namespace command {
                     if (dnbSet.size()>1) {
                         intersectingDnbSet.clear();
                         FullMappingRange currentRecordRange(*it);
-                        BOOST_FOREACH(EvidenceDnbBuffer::EvidenceDnbs::iterator &mapIt, dnbSet)
+                        BOOST_FOREACH(EvidenceDnbBuffer::EvidenceDnb* mapIt, dnbSet)
                         {
                             if (mapIt!=it) 
                             {
@@ -357,9 +526,9 @@ namespace cgatools { namespace command {
                     }
                     generateSamRecord(*it);
                     removeFromBuffer(recordBuffer,it);
-                    it = recordBuffer.getEvidenceDnbsBegin();
                     if (recordBuffer.empty())
                         break;
+                    it = recordBuffer.getEvidenceDnbsBegin();
                 }
                 recordBuffer.removeLastInterval(interval.id_);
                 if (!eof)
@@ -368,44 +537,6 @@ namespace cgatools { namespace command {
 
         }
 
-
-        void processOneIntervalRemoveIntervalDuplicates(int32_t intervalId_,
-                                mapping::EvidenceDnbRecord &evidenceRecord)
-        {
-            typedef std::map<uint64_t, mapping::EvidenceDnbRecord> DuplicatedDnbs;
-            DuplicatedDnbs duplicatedDnbs;
-
-
-            while(intervalId_ == evidenceRecord.intervalId_) {
-                //slideId - 5 decimal digits
-                //laneId - 2 decimal digits
-                //lanePartId - 2 decimal digits
-                //dnbIdInAPart - 10 decimal digits
-                //--------------------------------
-                // = 19 decimal digits < log10(2^64)
-                uint64_t dnbId = 
-                    (util::parseValue<int>(evidenceRecord.slide_.substr(2,5)
-                        + evidenceRecord.lane_.substr(1,2)) * 100
-                    + evidenceRecord.fileNumInLane_) * 10000000000
-                    + evidenceRecord.dnbOffsetInLaneFile_;
-
-                DuplicatedDnbs::iterator it = duplicatedDnbs.find(dnbId);
-                if (it!=duplicatedDnbs.end()) { 
-                    if (it->second.mappingQuality_<evidenceRecord.mappingQuality_)
-                        it->second = evidenceRecord;
-                } else
-                    duplicatedDnbs[dnbId] = evidenceRecord;
-
-                if (!evidenceDnbsFile_->next())
-                    break;
-            }
-
-            BOOST_FOREACH(DuplicatedDnbs::value_type &p, duplicatedDnbs) {
-                generateSamRecord(p.second);
-            }
-
-        }
-
         bool processOneInterval(int32_t intervalId_, mapping::EvidenceDnbRecord &evidenceRecord) 
         {
 
@@ -414,11 +545,17 @@ namespace cgatools { namespace command {
                 if (!evidenceDnbsFile_->next())
                     return false;
             }
-            return true;
+            return !output_->isFailed();
         }
 
-        void run() {
-            samRecordGenerator_->setHeader(createHeader());
+        //! Converts the records of the file into the given shard of the
+        //! output. The header of samRecordGenerator must be set.
+        void run(const mapping::SamRecordGenerator& samRecordGenerator,
+                 SamShardWriter& output, size_t shard)
+        {
+            samRecordGenerator_ = &samRecordGenerator;
+            output_ = &output;
+            shard_ = shard;
 
             mapping::EvidenceDnbRecord evidenceRecord;
             evidenceRecord.initParser(*evidenceDnbsFile_, formatVersion_, reference_);
@@ -435,49 +572,20 @@ namespace cgatools { namespace command {
                     processIntervals(evidenceRecord);
                 }
             }
-        }
-
-
-    protected:
-        mapping::SamFileHeaderBlock createHeader() {
-            const util::DelimitedFile::Metadata& readsHeader = evidenceDnbsFile_->getMetadata();
 
-            mapping::SamFileHeaderBlock h("");
-
-            h.get(mapping::SamFileHeaderBlock("@HD","@HD","",""))
-                .add(mapping::SamFileHeaderBlock("VN","VN","\t","1.4"));
-
-            BOOST_FOREACH(const reference::CompactDnaSequence &s, reference_.listChromosomes()) 
-            {
-                h.get(mapping::SamFileHeaderBlock(s.getName(),"@SQ","\n",""))
-                    .add(mapping::SamFileHeaderBlock("SN","\t",s.getName()))
-                    .add(mapping::SamFileHeaderBlock("LN","\t",boost::lexical_cast<std::string>(s.length())))
-                    .add(mapping::SamFileHeaderBlock("AS","\t",assemblyId_))
-                    .add(mapping::SamFileHeaderBlock("UR","\t",config_.referenceFileName_));
-            }
-
-            std::string date = readsHeader.get("GENERATED_AT");
-            date = date.substr(0,date.find(' '));
-            boost::gregorian::date dd(boost::gregorian::from_simple_string(date));
-
-            h.get(mapping::SamFileHeaderBlock("@RG","@RG","\n",""))
-                .add(mapping::SamFileHeaderBlock("ID","\t",evidenceFileId_))
-                .add(mapping::SamFileHeaderBlock("SM","\t",
-                    (readsHeader.hasKey("SAMPLE") ? readsHeader.get("SAMPLE"):"not-provided") ))
-                //.add(SamFileHeaderBlock("LB","\t",readsHeader.get("LIBRARY"))) - may be from different libs
-                .add(mapping::SamFileHeaderBlock("PU","\t",evidenceFileId_))
-                .add(mapping::SamFileHeaderBlock("CN","\t","\"Complete Genomics\""))
-                .add(mapping::SamFileHeaderBlock("DT","\t",boost::gregorian::to_iso_extended_string(dd)))
-                .add(mapping::SamFileHeaderBlock("PL","\t","\"Complete Genomics\""));
-
-            h.get(mapping::SamFileHeaderBlock("@PG","@PG","\n",""))
-                .add(mapping::SamFileHeaderBlock("ID","\t","cgatools"))
-                .add(mapping::SamFileHeaderBlock("VN","\t",CGA_TOOLS_VERSION))
-                .add(mapping::SamFileHeaderBlock("CL","\t",config_.commandLine_));
+            output_->write(shard_, buffer_);
+            output_->finish(shard_);
+        }
 
-            return h;
+        const util::DelimitedFile::Metadata& getMetadata() const {
+            return evidenceDnbsFile_->getMetadata();
         }
 
+        const std::string& getAssemblyId() const {return assemblyId_;}
+        const std::string& getEvidenceFileId() const {return evidenceFileId_;}
+        uint16_t getChromosomeId() const {return chrId_;}
+
+    protected:
         void generateSamRecord(mapping::EvidenceDnbRecord &evidenceRecord) 
         {
             if (config_.verboseOutput_) {
@@ -488,32 +596,36 @@ namespace cgatools { namespace command {
             evidenceRecord.adjustOffset(
                 reference_.listChromosomes()[evidenceRecord.chromosome_].length());
 
-            boost::ptr_vector<mapping::SamRecord> records;
-            for (size_t i=0; i<sides; ++i) 
-                records.push_back(new mapping::EvidenceSamRecord(
-                    evidenceRecord, !config_.keepDuplicates_, i, halfDnbSize_, reference_));
+            mapping::EvidenceSamRecord record0(
+                evidenceRecord, !config_.keepDuplicates_, 0, halfDnbSize_, reference_);
+            mapping::EvidenceSamRecord record1(
+                evidenceRecord, !config_.keepDuplicates_, 1, halfDnbSize_, reference_);
+            mapping::SamRecord* records[sides] = { &record0, &record1 };
 
             for (size_t i=0; i<sides; ++i)
-                records[i].mates_.push_back(&records[1-i]);
+                records[i]->mates_.push_back(records[1-i]);
 
             for (size_t i=0; i<sides; ++i) {
                 int startPos = evidenceRecord.offsetInReference_[i];
                 mapping::Cigar c(evidenceRecord.referenceAlignment_[i]);
                 reference::Range range(evidenceRecord.chromosome_,
                     startPos,startPos+c.getReferenceLength());
-                if (!exportRegions_->intersects(range))
+                if (!exportRegions_.intersects(range))
                     continue;
 
-                samRecordGenerator_->mappingRecordToSam(records[i]);
+                samRecordGenerator_->mappingRecordToSam(*records[i], buffer_);
             }
+
+            if (buffer_.size() >= RECORD_BUFFER_SIZE)
+                output_->write(shard_, buffer_);
         }
 
 
-        void init() {
+        void init(const std::string& evidenceDnbsFileName) {
             evidenceDnbsFileStream_ = util::InputStream::
-                openCompressedInputStreamByExtension(config_.evidenceDnbsFileName_);
+                openCompressedInputStreamByExtension(evidenceDnbsFileName);
             evidenceDnbsFile_.reset(new util::DelimitedFile(*evidenceDnbsFileStream_,
-                                                            config_.evidenceDnbsFileName_));
+                                                            evidenceDnbsFileName));
 
             const util::DelimitedFile::Metadata& evidenceFileHeader = evidenceDnbsFile_->getMetadata();
 
@@ -522,7 +634,7 @@ namespace cgatools { namespace command {
             if (evidenceFileHeader.hasKey("ASSEMBLY_ID")) {
                 assemblyId_ = evidenceFileHeader.get("ASSEMBLY_ID");
             } else {
-                std::string fname = boost::filesystem::path(config_.evidenceDnbsFileName_).leaf();
+                std::string fname = boost::filesystem::path(evidenceDnbsFileName).leaf();
                 std::string fprefix = "evidenceDnbs-"+chrName+"-";
                 size_t pos=fname.find(fprefix);
                 if (pos==std::string::npos)
@@ -538,6 +650,138 @@ namespace cgatools { namespace command {
             }
             evidenceFileId_ = assemblyId_+"-"+chrName;
 
+            chrId_ = reference_.getChromosomeId(chrName);
+            std::cerr << "Export the sequence: " << chrName 
+                << ", length: " << reference_.listChromosomes()[chrId_].length()
+                << std::endl;
+        }
+
+        size_t      formatVersion_;
+        std::string assemblyId_;
+        std::string evidenceFileId_;
+
+        size_t   halfDnbSize_;
+        uint16_t chrId_;
+
+        InStream evidenceDnbsFileStream_;
+
+        boost::shared_ptr<util::DelimitedFile>          evidenceDnbsFile_;
+
+        const reference::CrrFile&                       reference_;
+        const util::FastRangeSet&                       exportRegions_;
+
+        boost::shared_ptr<std::ostream>                 selectedEvidenceRecords_;
+        boost::shared_ptr<std::ostream>                 deletedEvidenceRecords_;
+
+        const Evidence2SamConfig &                      config_;
+
+        const mapping::SamRecordGenerator*              samRecordGenerator_;
+        SamShardWriter*                                 output_;
+        size_t                                          shard_;
+        mapping::SamRecordGenerator::RecordBuffer       buffer_;
+    };
+
+    namespace {
+        bool compareByChromosome(const Evidence2SamConverter* c0, const Evidence2SamConverter* c1)
+        {
+            return c0->getChromosomeId() < c1->getChromosomeId();
+        }
+
+        void convertEvidenceFile(const std::vector<Evidence2SamConverter*>& converters,
+                                 const mapping::SamRecordGenerator& samRecordGenerator,
+                                 SamShardWriter& output, size_t index)
+        {
+            try
+            {
+                converters[index]->run(samRecordGenerator, output, index);
+            }
+            catch(...)
+            {
+                output.fail();
+                throw;
+            }
+        }
+    }
+
+    //! Converts the evidence files of the config into one SAM output:
+    //! the files are converted concurrently, each into a shard of the
+    //! output, and the shards are written in the order of their
+    //! chromosomes in the reference.
+    class Evidence2SamShardedConverter {
+    public:
+        Evidence2SamShardedConverter(const Evidence2SamConfig &config, std::ostream &outSamFile)
+          : outSamFile_(outSamFile), 
+            config_(config)
+        {
+            init();
+        }
+
+        void run() {
+            mapping::SamRecordGenerator samRecordGenerator(outSamFile_,reference_,
+                config_.samGeneratorConfig_,std::vector<std::string>());
+            samRecordGenerator.setHeader(createHeader());
+
+            SamShardWriter output(samRecordGenerator, shards_.size());
+
+            // The debug output is written while converting, so it needs
+            // a single thread.
+            util::ThreadPool pool(config_.verboseOutput_ ? 1 : config_.threadCount_);
+            pool.parallelFor(shards_.size(),
+                             boost::bind(&convertEvidenceFile, boost::cref(shards_),
+                                         boost::cref(samRecordGenerator), boost::ref(output), _1));
+            samRecordGenerator.close();
+        }
+
+    protected:
+        mapping::SamFileHeaderBlock createHeader() {
+            const util::DelimitedFile::Metadata& readsHeader = shards_.front()->getMetadata();
+            const std::string& assemblyId = shards_.front()->getAssemblyId();
+            BOOST_FOREACH(const Evidence2SamConverter* shard, shards_) {
+                if (shard->getAssemblyId() != assemblyId)
+                    throw util::Exception("The evidence files are of different assemblies: " 
+                                          + assemblyId + " and " + shard->getAssemblyId());
+            }
+            // the read group of several files is the assembly
+            std::string evidenceFileId = 
+                shards_.size()==1 ? shards_.front()->getEvidenceFileId() : assemblyId;
+
+            mapping::SamFileHeaderBlock h("");
+
+            h.get(mapping::SamFileHeaderBlock("@HD","@HD","",""))
+                .add(mapping::SamFileHeaderBlock("VN","VN","\t","1.4"));
+
+            BOOST_FOREACH(const reference::CompactDnaSequence &s, reference_.listChromosomes()) 
+            {
+                h.get(mapping::SamFileHeaderBlock(s.getName(),"@SQ","\n",""))
+                    .add(mapping::SamFileHeaderBlock("SN","\t",s.getName()))
+                    .add(mapping::SamFileHeaderBlock("LN","\t",boost::lexical_cast<std::string>(s.length())))
+                    .add(mapping::SamFileHeaderBlock("AS","\t",assemblyId))
+                    .add(mapping::SamFileHeaderBlock("UR","\t",config_.referenceFileName_));
+            }
+
+            std::string date = readsHeader.get("GENERATED_AT");
+            date = date.substr(0,date.find(' '));
+            boost::gregorian::date dd(boost::gregorian::from_simple_string(date));
+
+            h.get(mapping::SamFileHeaderBlock("@RG","@RG","\n",""))
+                .add(mapping::SamFileHeaderBlock("ID","\t",evidenceFileId))
+                .add(mapping::SamFileHeaderBlock("SM","\t",
+                    (readsHeader.hasKey("SAMPLE") ? readsHeader.get("SAMPLE"):"not-provided") ))
+                //.add(SamFileHeaderBlock("LB","\t",readsHeader.get("LIBRARY"))) - may be from different libs
+                .add(mapping::SamFileHeaderBlock("PU","\t",evidenceFileId))
+                .add(mapping::SamFileHeaderBlock("CN","\t","\"Complete Genomics\""))
+                .add(mapping::SamFileHeaderBlock("DT","\t",boost::gregorian::to_iso_extended_string(dd)))
+                .add(mapping::SamFileHeaderBlock("PL","\t","\"Complete Genomics\""));
+
+            h.get(mapping::SamFileHeaderBlock("@PG","@PG","\n",""))
+                .add(mapping::SamFileHeaderBlock("ID","\t","cgatools"))
+                .add(mapping::SamFileHeaderBlock("VN","\t",CGA_TOOLS_VERSION))
+                .add(mapping::SamFileHeaderBlock("CL","\t",config_.commandLine_));
+
+            return h;
+        }
+
+        void init() {
             if (!config_.referenceFileName_.empty())
                 reference_.open(config_.referenceFileName_);
 
@@ -548,42 +792,22 @@ namespace cgatools { namespace command {
             else
                 exportRegions_->add(config_.exportRegions_);
 
-            std::cerr << "Export the sequence: " << chrName 
-                << ", length: " << reference_.listChromosomes()[reference_.getChromosomeId(chrName)].length()
-                << std::endl;
-
             if (config_.verboseOutput_) {
                 CGA_ASSERT_MSG(!config_.outputFileName_.empty(),"The output file name must be provided");
                 selectedEvidenceRecords_.reset(new util::OutputStream(config_.outputFileName_+".sel"));
                 deletedEvidenceRecords_.reset(new util::OutputStream(config_.outputFileName_+".del"));
             }
 
-            samRecordGenerator_.reset(
-                new mapping::SamRecordGenerator(outSamFile_,reference_,
-                    config_.samGeneratorConfig_,std::vector<std::string>()));
-        }
-
-        const reference::CompactDnaSequence& getChrSequence( const std::string& chrName )
-        {
-            if (chrSequence_==NULL)
-                chrSequence_ = &reference_.listChromosomes()[reference_.getChromosomeId(chrName)];
-            CGA_ASSERT_EQ(chrSequence_->getName(),chrName);
-            return *chrSequence_;
+            BOOST_FOREACH(const std::string& fileName, config_.evidenceDnbsFileNames_) {
+                converters_.push_back(new Evidence2SamConverter(config_, fileName, reference_,
+                    *exportRegions_, selectedEvidenceRecords_, deletedEvidenceRecords_));
+                shards_.push_back(&converters_.back());
+            }
+            std::stable_sort(shards_.begin(), shards_.end(), compareByChromosome);
         }
 
-
-        size_t      formatVersion_;
-        std::string assemblyId_;
-        std::string evidenceFileId_;
-
-        size_t   halfDnbSize_;
-
-        InStream evidenceDnbsFileStream_;
-
-        boost::shared_ptr<util::DelimitedFile>          evidenceDnbsFile_;
-
         reference::CrrFile                              reference_;
-        const reference::CompactDnaSequence *           chrSequence_;
+        boost::scoped_ptr<util::FastRangeSet>           exportRegions_;
 
         std::ostream &                                  outSamFile_;
         boost::shared_ptr<std::ostream>                 selectedEvidenceRecords_;
@@ -591,8 +815,9 @@ namespace cgatools { namespace command {
 
         const Evidence2SamConfig &                      config_;
 
-        boost::scoped_ptr<util::FastRangeSet>               exportRegions_;
-        boost::scoped_ptr<mapping::SamRecordGenerator>  samRecordGenerator_;
+        boost::ptr_vector<Evidence2SamConverter>        converters_;
+        //! the converters in the order of their chromosomes
+        std::vector<Evidence2SamConverter*>             shards_;
     };
 
     Evidence2Sam::Evidence2Sam(const std::string& name)
@@ -607,8 +832,11 @@ namespace cgatools { namespace command {
         )
     {
         options_.add_options()
-            ("evidence-dnbs,e", po::value<std::string>(&config_.evidenceDnbsFileName_),
-             "Input evidence dnbs file.")
+            ("evidence-dnbs,e", po::value<util::StringVector>(&config_.evidenceDnbsFileNames_),
+             "Input evidence dnbs file. Several files, for example one per chromosome, "
+             "can be converted into one output by using the option multiple times; "
+             "the records of the files are written in the order of their chromosomes "
+             "in the reference.")
             ("reference,s", po::value<std::string>(&config_.referenceFileName_),
              "Reference file.")
             ("output,o", po::value<std::string>(&config_.outputFileName_)->default_value("STDOUT"),
@@ -621,6 +849,9 @@ namespace cgatools { namespace command {
             ("add-allele-id", po::bool_switch(
                 &config_.samGeneratorConfig_.printAlleleInfo_)->default_value(false),
              "Generate interval id and allele id tags.")
+            ("threads", po::value<size_t>(&config_.threadCount_)->default_value(1),
+             "The number of evidence files converted at a time. The output does not "
+             "depend on the number of threads.")
              ;
 
         addSamConfigOptions(config_.samGeneratorConfig_, options_);
@@ -633,12 +864,12 @@ namespace cgatools { namespace command {
 
     int Evidence2Sam::run(po::variables_map& vm)
     {
-        //requireParam(vm, "evidence-dnbs");
+        requireParam(vm, "evidence-dnbs");
         requireParam(vm, "reference");
 
         config_.commandLine_ = getCommandLine();
 
-        Evidence2SamConverter convertor(config_, openStdout(config_.outputFileName_));
+        Evidence2SamShardedConverter convertor(config_, openStdout(config_.outputFileName_));
         convertor.run();
 
         return 0;
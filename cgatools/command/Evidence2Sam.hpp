@@ -31,16 +31,20 @@ namespace cgatools { namespace command {
             //,addMateSequenceAndScore_(false)
             //,addAlleleId_(false)
             ,verboseOutput_(false)
+            ,threadCount_(1)
         {}
 
         bool   keepDuplicates_;
         //bool   addMateSequenceAndScore_;
         //bool   addAlleleId_;
         bool   verboseOutput_;
+        //! the number of evidence files converted at a time,
+        //! the output does not depend on it
+        size_t threadCount_;
 
         util::StringVector exportRegions_;
 
-        std::string evidenceDnbsFileName_;
+        util::StringVector evidenceDnbsFileNames_;
         std::string inputLibFileName_;
         std::string referenceFileName_;
         std::string outputFileName_;
@@ -0,0 +1,159 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/command/IndexEvidence.hpp"
+#include "cgatools/util/BlockCompressedFile.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
+#include "cgatools/util/parse.hpp"
+
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+namespace cgatools { namespace command {
+
+    using std::string;
+    using std::vector;
+
+    using util::Exception;
+
+    namespace ba = boost::algorithm;
+
+    namespace {
+        size_t findColumn(const vector<string>& headers, const string& name)
+        {
+            for(size_t ii=0; ii<headers.size(); ii++)
+            {
+                if (ba::iequals(headers[ii], name))
+                    return ii;
+            }
+            return headers.size();
+        }
+
+        //! Returns the [first,last) bounds of the given column of line.
+        void findField(const string& line, size_t column, const string& fn,
+                       const char*& first, const char*& last)
+        {
+            size_t begin = 0;
+            for(size_t ii=0; ii<column; ii++)
+            {
+                begin = line.find('\t', begin);
+                if (string::npos == begin)
+                    throw Exception("failed to index "+fn+": missing field: "+line);
+                begin++;
+            }
+            size_t end = line.find('\t', begin);
+            if (string::npos == end)
+                end = line.size();
+            first = line.c_str() + begin;
+            last = line.c_str() + end;
+        }
+
+        int64_t parseField(const string& line, size_t column, const string& fn)
+        {
+            const char* first;
+            const char* last;
+            findField(line, column, fn, first, last);
+            return util::parseValue<int64_t>(first, last);
+        }
+    }
+
+    IndexEvidence::IndexEvidence(const std::string& name)
+        : Command(name,
+                  "Creates a block-compressed, indexed copy of an evidence file.",
+                  "0.3 or later",
+        "Creates a block-compressed, indexed copy of an evidenceIntervals or "
+        "evidenceDnbs file. The output is a gzip file made of independently "
+        "compressed blocks, which can be read by any gzip reader, and the "
+        "index is written next to it, with \".idx\" appended to the output "
+        "file name. When the indexed file replaces the original file in the "
+        "EVIDENCE directory of a genome, commands reading evidence for a "
+        "subset of a chromosome, such as testvariants and evidence2sam, read "
+        "only the blocks of the file that they need. Intervals files are "
+        "indexed by the end of each interval, and DNBs files by IntervalId; "
+        "the file type is detected from the column headers."
+        )
+    {
+        options_.add_options()
+            ("input", po::value<string>(&inputFileName_),
+             "The input evidenceIntervals or evidenceDnbs file (may be passed in "
+             "as argument at the end of the command).")
+            ("output", po::value<string>(&outputFileName_),
+             "The output file, whose name must end in \".gz\".")
+            ("block-size", po::value<size_t>(&blockSize_)->
+             default_value(util::BlockCompressedWriter::DEFAULT_BLOCK_SIZE),
+             "The uncompressed size of the blocks of the output file, in bytes.")
+            ;
+
+        positionalOptions_.add("input", 1);
+    }
+
+    int IndexEvidence::run(po::variables_map& vm)
+    {
+        requireParam(vm, "input");
+        requireParam(vm, "output");
+        if (!ba::ends_with(outputFileName_, ".gz"))
+            throw Exception("output file name must end in .gz: "+outputFileName_);
+        if (0 == blockSize_)
+            throw Exception("block-size must be positive");
+
+        std::istream& in = openStdin(inputFileName_);
+        util::BlockCompressedWriter out(outputFileName_, blockSize_);
+
+        // Copy the metadata and column headers as they are.
+        string line, header;
+        bool ok;
+        while ( (ok = util::InputStream::getline(in, line)) &&
+                (line.empty() || '#' == line[0]) )
+        {
+            header += line;
+            header.push_back('\n');
+        }
+        if (!ok || '>' != line[0])
+            throw Exception("failed to index "+inputFileName_+": missing column headers");
+        header += line;
+        header.push_back('\n');
+        out.writeHeader(header);
+
+        vector<string> headers;
+        string headerLine = line.substr(1);
+        ba::split(headers, headerLine, ba::is_any_of("\t"));
+        size_t offsetColumn = findColumn(headers, "OffsetInChromosome");
+        size_t lengthColumn = findColumn(headers, "Length");
+        size_t idColumn = findColumn(headers, "IntervalId");
+        bool isIntervals = offsetColumn < headers.size() && lengthColumn < headers.size();
+        if (!isIntervals && idColumn == headers.size())
+            throw Exception("failed to index "+inputFileName_+": not an evidence file");
+
+        while (util::InputStream::getline(in, line))
+        {
+            if (line.empty())
+                continue;
+
+            int64_t key;
+            if (isIntervals)
+                key = parseField(line, offsetColumn, inputFileName_) +
+                    parseField(line, lengthColumn, inputFileName_);
+            else
+                key = parseField(line, idColumn, inputFileName_);
+            out.writeLine(line, key);
+        }
+
+        out.close();
+        return 0;
+    }
+
+} } // cgatools::command
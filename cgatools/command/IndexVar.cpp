@@ -0,0 +1,176 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/command/IndexVar.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/BlockCompressedFile.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
+#include "cgatools/util/parse.hpp"
+#include "cgatools/variants/VariantFileIterator.hpp"
+
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+namespace cgatools { namespace command {
+
+    using std::string;
+    using std::vector;
+
+    using reference::Location;
+    using util::Exception;
+
+    namespace ba = boost::algorithm;
+
+    namespace {
+        size_t findColumn(const vector<string>& headers, const string& name)
+        {
+            for(size_t ii=0; ii<headers.size(); ii++)
+            {
+                if (ba::iequals(headers[ii], name))
+                    return ii;
+            }
+            return headers.size();
+        }
+
+        //! Returns the given column of line.
+        string findField(const string& line, size_t column, const string& fn)
+        {
+            size_t begin = 0;
+            for(size_t ii=0; ii<column; ii++)
+            {
+                begin = line.find('\t', begin);
+                if (string::npos == begin)
+                    throw Exception("failed to index "+fn+": missing field: "+line);
+                begin++;
+            }
+            size_t end = line.find('\t', begin);
+            if (string::npos == end)
+                end = line.size();
+            return line.substr(begin, end-begin);
+        }
+    }
+
+    IndexVar::IndexVar(const std::string& name)
+        : Command(name,
+                  "Creates a block-compressed, indexed copy of a var file or masterVar file.",
+                  "0.3 or later",
+        "Creates a block-compressed, indexed copy of a var file or masterVar file. "
+        "The output is a gzip file made of independently compressed blocks of "
+        "whole loci, which can be read by any gzip reader, and the index is "
+        "written next to it, with \".idx\" appended to the output file name. "
+        "The index lists the end of the last locus of each block. When the "
+        "indexed file is given instead of the original file, commands reading a "
+        "subset of the genome, such as listvariants, testvariants and varfilter "
+        "with --range or --regions-file, read only the blocks of the file that "
+        "they need."
+        )
+    {
+        options_.add_options()
+            ("reference", po::value<string>(&referenceFileName_),
+             "The reference crr file.")
+            ("input", po::value<string>(&inputFileName_),
+             "The input var file or masterVar file (may be passed in as argument "
+             "at the end of the command).")
+            ("output", po::value<string>(&outputFileName_),
+             "The output file, whose name must end in \".gz\".")
+            ("block-size", po::value<size_t>(&blockSize_)->
+             default_value(util::BlockCompressedWriter::DEFAULT_BLOCK_SIZE),
+             "The uncompressed size of the blocks of the output file, in bytes.")
+            ;
+
+        positionalOptions_.add("input", 1);
+    }
+
+    int IndexVar::run(po::variables_map& vm)
+    {
+        requireParam(vm, "reference");
+        requireParam(vm, "input");
+        requireParam(vm, "output");
+        if (!ba::ends_with(outputFileName_, ".gz"))
+            throw Exception("output file name must end in .gz: "+outputFileName_);
+        if (0 == blockSize_)
+            throw Exception("block-size must be positive");
+
+        reference::CrrFile crr(referenceFileName_);
+        std::istream& in = openStdin(inputFileName_);
+        util::BlockCompressedWriter out(outputFileName_, blockSize_);
+
+        // Copy the metadata and column headers as they are.
+        string line, header;
+        bool ok;
+        while ( (ok = util::InputStream::getline(in, line)) &&
+                (line.empty() || '#' == line[0]) )
+        {
+            header += line;
+            header.push_back('\n');
+        }
+        if (!ok || '>' != line[0])
+            throw Exception("failed to index "+inputFileName_+": missing column headers");
+        header += line;
+        header.push_back('\n');
+        out.writeHeader(header);
+
+        vector<string> headers;
+        string headerLine = line.substr(1);
+        ba::split(headers, headerLine, ba::is_any_of("\t"));
+        size_t locusColumn = findColumn(headers, "locus");
+        size_t chromosomeColumn = findColumn(headers, "chromosome");
+        size_t endColumn = findColumn(headers, "end");
+        if (chromosomeColumn == headers.size() || endColumn == headers.size())
+            throw Exception("failed to index "+inputFileName_+": not a var file or masterVar file");
+
+        // The lines of a locus are written as one line of the block-
+        // compressed file, so that blocks hold whole loci. A locus is
+        // keyed by its end, the largest end of its lines.
+        string locus, locusId;
+        Location locusEnd;
+        while (util::InputStream::getline(in, line))
+        {
+            if (line.empty())
+                continue;
+
+            string id;
+            if (locusColumn < headers.size())
+                id = findField(line, locusColumn, inputFileName_);
+            Location end(crr.getChromosomeId(findField(line, chromosomeColumn, inputFileName_)),
+                         util::parseValue<uint32_t>(findField(line, endColumn, inputFileName_)));
+            if (!locus.empty() && (locusColumn == headers.size() || id != locusId))
+            {
+                out.writeLine(locus, variants::VariantFileIterator::getIndexKey(locusEnd));
+                locus.clear();
+            }
+
+            if (locus.empty())
+            {
+                locusId = id;
+                locusEnd = end;
+            }
+            else
+            {
+                locus.push_back('\n');
+                locusEnd = std::max(locusEnd, end);
+            }
+            locus += line;
+        }
+        if (!locus.empty())
+            out.writeLine(locus, variants::VariantFileIterator::getIndexKey(locusEnd));
+
+        out.close();
+        return 0;
+    }
+
+} } // cgatools::command
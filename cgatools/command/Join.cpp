@@ -14,10 +14,13 @@
 
 #include "cgatools/core.hpp"
 #include "cgatools/command/Join.hpp"
+#include "cgatools/reference/CrrFile.hpp"
 #include "cgatools/util/RangeIntersector.hpp"
 #include "cgatools/util/Streams.hpp"
 #include "cgatools/util/IndirectComparator.hpp"
 
+#include <deque>
+
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
@@ -62,6 +65,26 @@ namespace cgatools { namespace command {
         }
     };
 
+    //! A record of file B in the active window of a sorted join.
+    struct SortedJoinRecord
+    {
+        std::pair<int64_t,int64_t> range_;
+        size_t lineOffset_;
+        std::vector<std::string> fields_;
+    };
+
+    //! Orders SortedJoinRecord pointers by range, then by position in
+    //! file B, matching the order of matches in an in-memory join.
+    struct SortedJoinRecordLess
+    {
+        bool operator()(const SortedJoinRecord* lhs, const SortedJoinRecord* rhs) const
+        {
+            if (lhs->range_ != rhs->range_)
+                return lhs->range_ < rhs->range_;
+            return lhs->lineOffset_ < rhs->lineOffset_;
+        }
+    };
+
     class JoinOutputStream
     {
     public:
@@ -390,7 +413,8 @@ namespace cgatools { namespace command {
              "for stdin). There must be exactly two input files to join. If only "
              "one file is specified by name, file A is taken to be stdin and "
              "file B is the named file. File B is read fully into memory, and "
-             "file A is streamed. File A's columns appear first in the output.")
+             "file A is streamed, unless --sorted-input is given. File A's columns "
+             "appear first in the output.")
             ("output", po::value<string>(&outputFileName_)->default_value("STDOUT"),
              "The output file name (may be omitted for stdout).")
             ("match", po::value< vector<string> >(&match_),
@@ -428,6 +452,19 @@ namespace cgatools { namespace command {
              "Set of fields to select for output.")
             ("always-dump,a", po::bool_switch(&alwaysDump_)->default_value(false),
              "Dump every record of A, even if there are no matches with file B.")
+            ("sorted-input", po::bool_switch(&sortedInput_)->default_value(false),
+             "Stream both files instead of reading file B into memory. Both "
+             "files must be sorted by their match fields, and then by the "
+             "beginning of their overlap range. Match field values that are "
+             "chromosome names of the --reference are ordered as the chromosomes "
+             "of the reference (the order of Complete Genomics files); other "
+             "values follow all chromosome names, in lexical order. Each file is "
+             "read once, and memory use is proportional to the number of file B "
+             "records overlapping a file A record. File B may be a pipe. The "
+             "output is the same as without --sorted-input.")
+            ("reference", po::value<string>(&referenceFileName_),
+             "The reference crr file, whose chromosome order sorts the input "
+             "files. Required with --sorted-input.")
             ("overlap-fraction-A", po::value<double>(&overlapFractionA_)->default_value(0.0),
              "Minimum fraction of A region overlap for filtering output.")
             ("boundary-uncertainty-A", po::value<int64_t>(&boundaryUncertaintyA_)->default_value(0),
@@ -481,13 +518,31 @@ namespace cgatools { namespace command {
             throw Exception("unrecognized output-mode: "+outputMode_);
         out->writeHeaders(aa, bb);
 
+        if (sortedInput_)
+        {
+            requireParam(vm, "reference");
+            reference::CrrFile crr(referenceFileName_);
+            for(size_t ii=0; ii<crr.listChromosomes().size(); ii++)
+                chromosomeOrder_[crr.listChromosomes()[ii].getName()] = ii;
+            joinSorted(aa, bb, *out);
+        }
+        else
+            joinInMemory(aa, bb, *out);
+
+        return 0;
+    }
+
+    void Join::joinInMemory(util::DelimitedFile& aa,
+                            util::DelimitedFile& bb,
+                            JoinOutputStream& out)
+    {
         // Read file B into memory.
         string matchKey;
         pair<int64_t, int64_t> range;
         vector< string > bLinesAll;
-        typedef IntervalTree<pair<int64_t, int64_t>, int64_t, size_t,
-                             PairOverlap<int64_t>,
-                             GetPairBoundary<int64_t> > RI;
+        typedef StaticIntervalTree<pair<int64_t, int64_t>, int64_t, size_t,
+                                   PairOverlap<int64_t>,
+                                   GetPairBoundary<int64_t> > RI;
         map<string, RI> ri;
         while (bb.next())
         {
@@ -497,6 +552,8 @@ namespace cgatools { namespace command {
             ri[matchKey].put(range, bLinesAll.size());
             bLinesAll.push_back(bb.getLine());
         }
+        for(map<string, RI>::iterator it=ri.begin(); it!=ri.end(); ++it)
+            it->second.index();
 
         // Stream file A, filtering and annotating as necessary.
         std::vector<RI::QueryResultType> matches;
@@ -508,7 +565,7 @@ namespace cgatools { namespace command {
 
             if (ri.find(matchKey) == ri.end())
             {
-                out->finishRecord(aFields_, range);
+                out.finishRecord(aFields_, range);
                 continue;
             }
 
@@ -525,38 +582,197 @@ namespace cgatools { namespace command {
                 vector<string> bFields;
                 boost::split(bFields, bLine, boost::is_any_of("\t"));
 
-                if ("strict" == overlapMode_)
+                if (!passesOverlapFilter(range, mrange))
+                    continue;
+
+                // Add to bFields.
+                out.nextB(aFields_, bFields, range, mrange);
+            }
+
+            out.finishRecord(aFields_, range);
+        }
+    }
+
+    void Join::joinSorted(util::DelimitedFile& aa,
+                          util::DelimitedFile& bb,
+                          JoinOutputStream& out)
+    {
+        // Match keys ascend in reference order in both files, so the
+        // two files are merged by comparing keys, reading each file once.
+
+        // The current record of file B, not yet in the window.
+        string matchKey;
+        vector<string> bKey, prevBKey;
+        pair<int64_t, int64_t> bRange;
+        size_t bLineOffset = 0;
+        bool bMore = bb.next();
+        if (bMore)
+        {
+            parseJoinFields(bFields_, qp_[1], matchKey, bRange);
+            if (bRange.second < bRange.first)
+                throw Exception("range begins after it ends: "+bb.getLine());
+            getMatchFields(bFields_, qp_[1], bKey);
+        }
+
+        // The file B records that may overlap the current or a later
+        // file A record, in file B order.
+        std::deque<SortedJoinRecord> window;
+        PairOverlap<int64_t> isOverlap;
+        vector<const SortedJoinRecord*> ordered;
+
+        vector<string> key, aKey;
+        pair<int64_t, int64_t> range;
+        bool aFirst = true;
+        int64_t aBegin = 0;
+        while (aa.next())
+        {
+            parseJoinFields(aFields_, qp_[0], matchKey, range);
+            if (range.second < range.first)
+                throw Exception("range begins after it ends: "+aa.getLine());
+            getMatchFields(aFields_, qp_[0], key);
+
+            if (aFirst || key != aKey)
+            {
+                if (!aFirst && compareMatchKeys(key, aKey) < 0)
+                    throw Exception("file A is not sorted by match fields: "+aa.getLine());
+                aFirst = false;
+                aKey.swap(key);
+                window.clear();
+            }
+            else if (range.first < aBegin)
+                throw Exception("file A is not sorted by range: "+aa.getLine());
+            aBegin = range.first;
+
+            // Skip file B records of earlier keys, and add file B
+            // records of this key that begin at or before the end of
+            // this record to the window.
+            while (bMore)
+            {
+                int cmp = compareMatchKeys(bKey, aKey);
+                if (cmp > 0 || (0 == cmp && bRange.first > range.second))
+                    break;
+                if (0 == cmp)
                 {
-                    if ( ! (range.first < mrange.second && mrange.first < range.second) )
-                        continue;
+                    window.push_back(SortedJoinRecord());
+                    window.back().range_ = bRange;
+                    window.back().lineOffset_ = bLineOffset;
+                    window.back().fields_ = bFields_;
                 }
 
-                // Check overlap constraints.
-                int64_t overlap = std::min(mrange.second, range.second) - std::max(mrange.first, range.first);
-                CGA_ASSERT(overlap >= 0);
-                if (overlapFractionA_ > 0.0)
+                pair<int64_t, int64_t> prevRange = bRange;
+                prevBKey.swap(bKey);
+                bMore = bb.next();
+                bLineOffset++;
+                if (bMore)
                 {
-                    int64_t len = std::max(int64_t(0), range.second-range.first - boundaryUncertaintyA_);
-                    if (overlap < len * overlapFractionA_)
-                        continue;
+                    parseJoinFields(bFields_, qp_[1], matchKey, bRange);
+                    if (bRange.second < bRange.first)
+                        throw Exception("range begins after it ends: "+bb.getLine());
+                    getMatchFields(bFields_, qp_[1], bKey);
+                    int order = compareMatchKeys(bKey, prevBKey);
+                    if (order < 0)
+                        throw Exception("file B is not sorted by match fields: "+bb.getLine());
+                    if (0 == order && bRange.first < prevRange.first)
+                        throw Exception("file B is not sorted by range: "+bb.getLine());
                 }
-                if (overlapFractionB_ > 0.0)
+            }
+
+            // Drop file B records that end before this record begins;
+            // they cannot overlap this or any later record with this
+            // key.
+            size_t kept = 0;
+            for(size_t ii=0; ii<window.size(); ii++)
+            {
+                if (window[ii].range_.second < range.first)
+                    continue;
+                if (kept != ii)
                 {
-                    int64_t len = std::max(int64_t(0), mrange.second-mrange.first - boundaryUncertaintyB_);
-                    if (overlap < len * overlapFractionB_)
-                        continue;
+                    window[kept].range_ = window[ii].range_;
+                    window[kept].lineOffset_ = window[ii].lineOffset_;
+                    window[kept].fields_.swap(window[ii].fields_);
                 }
+                kept++;
+            }
+            window.resize(kept);
 
-                // Add to bFields.
-                out->nextB(aFields_, bFields, range, mrange);
+            ordered.clear();
+            for(std::deque<SortedJoinRecord>::const_iterator iter=window.begin();
+                iter!=window.end(); ++iter)
+            {
+                if (isOverlap(range, iter->range_))
+                    ordered.push_back(&*iter);
+            }
+            std::sort(ordered.begin(), ordered.end(), SortedJoinRecordLess());
+
+            for(size_t ii=0; ii<ordered.size(); ii++)
+            {
+                if (!passesOverlapFilter(range, ordered[ii]->range_))
+                    continue;
+                out.nextB(aFields_, ordered[ii]->fields_, range, ordered[ii]->range_);
             }
 
-            out->finishRecord(aFields_, range);
+            out.finishRecord(aFields_, range);
+        }
+    }
+
+    bool Join::passesOverlapFilter(const std::pair<int64_t, int64_t>& rangeA,
+                                   const std::pair<int64_t, int64_t>& rangeB) const
+    {
+        if ("strict" == overlapMode_)
+        {
+            if ( ! (rangeA.first < rangeB.second && rangeB.first < rangeA.second) )
+                return false;
+        }
+
+        // Check overlap constraints.
+        int64_t overlap = std::min(rangeB.second, rangeA.second) - std::max(rangeB.first, rangeA.first);
+        CGA_ASSERT(overlap >= 0);
+        if (overlapFractionA_ > 0.0)
+        {
+            int64_t len = std::max(int64_t(0), rangeA.second-rangeA.first - boundaryUncertaintyA_);
+            if (overlap < len * overlapFractionA_)
+                return false;
+        }
+        if (overlapFractionB_ > 0.0)
+        {
+            int64_t len = std::max(int64_t(0), rangeB.second-rangeB.first - boundaryUncertaintyB_);
+            if (overlap < len * overlapFractionB_)
+                return false;
         }
+        return true;
+    }
 
+    int Join::compareMatchKeys(const std::vector<std::string>& lhs,
+                               const std::vector<std::string>& rhs) const
+    {
+        CGA_ASSERT(lhs.size() == rhs.size());
+        for(size_t ii=0; ii<lhs.size(); ii++)
+        {
+            if (lhs[ii] == rhs[ii])
+                continue;
+            std::map<std::string, size_t>::const_iterator
+                lIter = chromosomeOrder_.find(lhs[ii]),
+                rIter = chromosomeOrder_.find(rhs[ii]);
+            if (lIter != chromosomeOrder_.end() && rIter != chromosomeOrder_.end())
+                return lIter->second < rIter->second ? -1 : 1;
+            if (lIter != chromosomeOrder_.end())
+                return -1;
+            if (rIter != chromosomeOrder_.end())
+                return 1;
+            return lhs[ii] < rhs[ii] ? -1 : 1;
+        }
         return 0;
     }
 
+    void Join::getMatchFields(const std::vector<std::string>& fields,
+                              const QueryPlan& qp,
+                              std::vector<std::string>& key) const
+    {
+        key.resize(qp.matchIdx_.size());
+        for(size_t ii=0; ii<qp.matchIdx_.size(); ii++)
+            key[ii] = fields[qp.matchIdx_[ii]];
+    }
+
     void Join::dumpRecord(std::ostream& out,
                           const std::vector<std::string>& aFields,
                           const std::vector<std::string>& bFields)
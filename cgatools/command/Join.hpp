@@ -21,8 +21,12 @@
 #include "cgatools/command/Command.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
 
+#include <map>
+
 namespace cgatools { namespace command {
 
+    class JoinOutputStream;
+
     class Join : public Command
     {
     public:
@@ -40,6 +44,19 @@ namespace cgatools { namespace command {
             std::pair<int,int> overlapIdx_;
         };
 
+        void joinInMemory(util::DelimitedFile& aa,
+                          util::DelimitedFile& bb,
+                          JoinOutputStream& out);
+        void joinSorted(util::DelimitedFile& aa,
+                        util::DelimitedFile& bb,
+                        JoinOutputStream& out);
+        int compareMatchKeys(const std::vector<std::string>& lhs,
+                             const std::vector<std::string>& rhs) const;
+        void getMatchFields(const std::vector<std::string>& fields,
+                            const QueryPlan& qp,
+                            std::vector<std::string>& key) const;
+        bool passesOverlapFilter(const std::pair<int64_t, int64_t>& rangeA,
+                                 const std::pair<int64_t, int64_t>& rangeB) const;
         void dumpRecord(std::ostream& out,
                         const std::vector<std::string>& aFields,
                         const std::vector<std::string>& bFields);
@@ -66,10 +83,13 @@ namespace cgatools { namespace command {
         std::string overlapMode_;
         std::string select_;
         bool alwaysDump_;
+        bool sortedInput_;
+        std::string referenceFileName_;
         double overlapFractionA_, overlapFractionB_;
         int64_t boundaryUncertaintyA_, boundaryUncertaintyB_;
 
         std::vector<QueryPlan> qp_;
+        std::map<std::string, size_t> chromosomeOrder_;
         std::vector<std::string> aFields_, bFields_;
         std::vector< std::pair<size_t, size_t> > transform_;
     };
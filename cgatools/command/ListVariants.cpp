@@ -18,12 +18,15 @@
 #include "cgatools/variants/SuperlocusIterator.hpp"
 #include "cgatools/util/BaseUtil.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/Interned.hpp"
+#include "cgatools/util/RangeSet.hpp"
 #include "cgatools/reference/ChromosomeIdField.hpp"
 
 #include <queue>
 #include <set>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 
@@ -61,8 +64,10 @@ namespace cgatools { namespace command {
     {
     public:
         VariantFileVariantLister(const CrrFile& crr,
-                                 const std::string& variantFileName)
+                                 const std::string& variantFileName,
+                                 const FastRangeSet* regions)
             : locIt_(crr),
+              regions_(regions),
               idx_(0)
         {
             locIt_.open(variantFileName);
@@ -99,6 +104,7 @@ namespace cgatools { namespace command {
         void buildQueue();
 
         VariantFileIterator locIt_;
+        const FastRangeSet* regions_;
         std::vector<Call> queue_;
         size_t idx_;
     };
@@ -108,6 +114,13 @@ namespace cgatools { namespace command {
         const CrrFile& crr = locIt_->getReference();
         for(; !locIt_.eof(); ++locIt_)
         {
+            if (0 != regions_)
+            {
+                locIt_.seek(*regions_);
+                if (locIt_.eof())
+                    break;
+            }
+
             const vector<Call>& calls = locIt_->getCalls();
             for(size_t ii=0; ii<calls.size(); ii++)
             {
@@ -288,7 +301,7 @@ namespace cgatools { namespace command {
             df_->addField(ChromosomeIdField("chromosome", &nextCall_.range_.chromosome_, crr_));
             df_->addField(ValueField<uint32_t>("begin", &nextCall_.range_.begin_));
             df_->addField(ValueField<uint32_t>("end", &nextCall_.range_.end_));
-            df_->addField(StringField("varType", &nextCall_.varType_), DelimitedFile::FPT_OPTIONAL);
+            df_->addField(InternedStringField("varType", &nextCall_.varType_), DelimitedFile::FPT_OPTIONAL);
             df_->addField(StringField("reference", &nextCall_.reference_));
             df_->addField(StringField("alleleSeq", &nextCall_.alleleSeq_));
             df_->addField(StringField("xRef", &nextCall_.xRef_), DelimitedFile::FPT_OPTIONAL);
@@ -396,7 +409,10 @@ namespace cgatools { namespace command {
                   "    varType    \tThe varType as extracted from the variant file.\n"
                   "    reference  \tThe reference sequence.\n"
                   "    alleleSeq  \tThe variant allele sequence as extracted from the variant file.\n"
-                  "    xRef       \tThe xRef as extrated from the variant file."
+                  "    xRef       \tThe xRef as extrated from the variant file.\n\n"
+                  "With --range or --regions-file, only the variants intersecting the "
+                  "given regions are listed. Variant files indexed by indexvar are then "
+                  "read only in the blocks holding these regions."
             ),
           queueBaseCount_(1000),
           variantId_(1)
@@ -413,6 +429,12 @@ namespace cgatools { namespace command {
             ("list-long-variants", po::bool_switch(&listLongVariants_)->default_value(false),
              "In addition to listing short variants, list longer variants as well "
              "(10's of bases) by concatenating nearby calls.\n")
+            ("range", po::value<StringVector>(&ranges_),
+             "A region of the reference to list variants in, as 'chr,begin,end' or "
+             "'chr'. May be given several times.")
+            ("regions-file", po::value<string>(&regionsFileName_),
+             "A tab-delimited file of regions of the reference to list variants in, "
+             "with chromosome, begin and end columns.")
             ;
 
         positionalOptions_.add("variants", -1);
@@ -425,13 +447,24 @@ namespace cgatools { namespace command {
         crr_.open(referenceFileName_);
         std::ostream& out = openStdout(outputFileName_);
 
+        boost::scoped_ptr<FastRangeSet> regions;
+        if (!ranges_.empty() || !regionsFileName_.empty())
+        {
+            regions.reset(new FastRangeSet(crr_));
+            regions->add(ranges_);
+            if (!regionsFileName_.empty())
+                regions->addFile(regionsFileName_);
+            regions->merge();
+        }
+
         priority_queue< shared_ptr<VariantLister>,
             vector< shared_ptr<VariantLister> >, VariantListerDescByPosition > pq;
         BOOST_FOREACH(const string& variantFileName, variantFileNames_)
         {
             if (!listLongVariants_)
             {
-                shared_ptr<VariantLister> vl(new VariantFileVariantLister(crr_, variantFileName));
+                shared_ptr<VariantLister> vl(new VariantFileVariantLister(crr_, variantFileName,
+                                                                         regions.get()));
                 if (!vl->eof())
                     pq.push(vl);
             }
@@ -456,8 +489,11 @@ namespace cgatools { namespace command {
             shared_ptr<VariantLister> vl = pq.top();
             pq.pop();
 
-            queueCall(callSet, *(*vl));
-            retireQueuedCalls(out, callSet);
+            if (0 == regions.get() || regions->intersects((*vl)->range_))
+            {
+                queueCall(callSet, *(*vl));
+                retireQueuedCalls(out, callSet);
+            }
 
             ++(*vl);
             if (!vl->eof())
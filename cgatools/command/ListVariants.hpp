@@ -21,6 +21,7 @@
 #include "cgatools/command/Command.hpp"
 #include "cgatools/variants/Call.hpp"
 #include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/RangeSet.hpp"
 
 #include <set>
 
@@ -75,6 +76,8 @@ namespace cgatools { namespace command {
 
         std::vector<std::string> variantFileNames_;
         std::vector<std::string> variantListingFileNames_;
+        util::StringVector ranges_;
+        std::string regionsFileName_;
         bool listLongVariants_;
         uint32_t queueBaseCount_;
         uint32_t variantId_;
@@ -62,6 +62,10 @@ namespace cgatools { namespace command {
             ("extract-genomic-region,e", po::value<util::StringVector>(&config_->exportRegions_),
              "Defines a region as a half-open interval 'chr,from,to'")
 
+            ("threads", po::value<size_t>(&config_->threadCount_)->default_value(1),
+             "The number of threads used to convert DNBs. The output does not "
+             "depend on the number of threads.")
+
             ("cgi-bam-caveat-acknowledgement", po::bool_switch(&config_->caveat_)->default_value(false),
              "Supply this option to enable map2sam. Before enabling this option, please "
              "contact support@completegenomics.com for how "
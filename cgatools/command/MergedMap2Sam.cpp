@@ -15,9 +15,33 @@
 #include "cgatools/core.hpp"
 #include "cgatools/command/MergedMap2Sam.hpp"
 #include "cgatools/mapping/MergeMap2SamConverter.hpp"
+#include "cgatools/cgdata/GenomeMetadata.hpp"
+#include "cgatools/util/Streams.hpp"
+#include "cgatools/util/ThreadPool.hpp"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 namespace cgatools { namespace command {
 
+    namespace {
+        // Converts one lane batch of an --all-lane-batches run.
+        void convertLaneBatch(const std::vector<mapping::MergedMap2SamConfig>& configs,
+                              const mapping::MergedMap2SamSharedData& sharedData,
+                              size_t index)
+        {
+            const mapping::MergedMap2SamConfig& config = configs[index];
+            boost::shared_ptr<std::ostream> out =
+                util::OutputStream::openCompressedOutputStreamByExtension(config.outputFileName_);
+            mapping::MergedMap2SamConverter converter(config, *out, &sharedData);
+            converter.init();
+            converter.run();
+        }
+    }
+
     MergedMap2Sam::MergedMap2Sam(const std::string& name)
         : Command(name,
                   "Converts CGI initial reference mappings and variant evidence mappings into SAM format.",
@@ -31,9 +55,13 @@ namespace cgatools { namespace command {
         "The result subset can be optionally filtered (min-mapq, primary-mappings-only,...). "
         "The result mappings are converted into corresponding SAM records: "
         "one half DNB mapping to one SAM record. "
-        "The negative gaps in CGI mappings are represented using GS/GQ/GC tags."
+        "The negative gaps in CGI mappings are represented using GS/GQ/GC tags. "
+        "With --all-lane-batches, all the lane batches of the genome are converted "
+        "in one process, sharing the reference, the library data and the evidence "
+        "cache index, into one file per lane batch in the --output directory."
         )
         ,config_(new mapping::MergedMap2SamConfig())
+        ,allLaneBatches_(false)
     {
         options_.add_options()
             ("lane-batch-id,l", po::value<std::string>(&config_->inputReadsBatchId_),
@@ -51,8 +79,15 @@ namespace cgatools { namespace command {
              "Root directory of the evidence cache created by evidence2cache. "
              "Several cache directories can be combined by providing the common root.")
 
+            ("all-lane-batches", po::bool_switch(&allLaneBatches_),
+             "Convert all the lane batches of the genome instead of --lane-batch-id. "
+             "The lane batches are converted --threads at a time, and written "
+             "to LANE_BATCH.sam (or .bam) in the --output directory. The lane "
+             "batches converted at a time share --threads and --sort-memory.")
+
             ("output,o", po::value<std::string>(&config_->outputFileName_)->default_value("STDOUT"),
-             "The output SAM file (may be omitted for stdout).")
+             "The output SAM file (may be omitted for stdout), or the output directory "
+             "with --all-lane-batches.")
 
             ("outputStream,O",po::value<util::StringVector>(&config_->outputStreamNames_),
              "The output SAM stream name for a chromosome. Format: 'chrName,streamName'. "
@@ -83,6 +118,10 @@ namespace cgatools { namespace command {
             ("to,t", po::value<size_t>(&config_->recordsTo_)->
              default_value(std::numeric_limits<size_t>::max()),
              "Defines end read record (the end record is not converted).")
+
+            ("threads", po::value<size_t>(&config_->threadCount_)->default_value(1),
+             "The number of threads used to convert DNBs, or lane batches with "
+             "--all-lane-batches. The output does not depend on the number of threads.")
             ;
 
         hiddenOptions_.add_options()
@@ -93,7 +132,8 @@ namespace cgatools { namespace command {
 
     int MergedMap2Sam::run(po::variables_map& vm)
     {
-        requireParam(vm, "lane-batch-id");
+        if (!allLaneBatches_)
+            requireParam(vm, "lane-batch-id");
         requireParam(vm, "genome-root");
         requireParam(vm, "reference");
 
@@ -101,6 +141,9 @@ namespace cgatools { namespace command {
             CGA_ERROR_EX("Invalid MAPQ:"<< tmpMapq_ <<". MAPQ should be in the range 0-255");
         config_->minMapQ_ = boost::uint8_t(tmpMapq_);
 
+        if (allLaneBatches_)
+            return runAllLaneBatches(vm);
+
         {
             cgdata::GenomeMetadata gm(config_->exportRootDirName_);
             config_->inputReadsFileName_ = gm.getReadsFileName(config_->inputReadsBatchId_);
@@ -115,4 +158,59 @@ namespace cgatools { namespace command {
         return 0;
     }
 
+    int MergedMap2Sam::runAllLaneBatches(po::variables_map& vm)
+    {
+        if (vm.count("lane-batch-id") || !config_->outputStreamNames_.empty())
+            throw util::Exception(
+                "--lane-batch-id and --outputStream cannot be used with --all-lane-batches");
+        if ("STDOUT" == config_->outputFileName_)
+            throw util::Exception("--all-lane-batches requires an --output directory");
+        boost::filesystem::path outputDir(config_->outputFileName_);
+        boost::filesystem::create_directories(outputDir);
+        std::string extension = config_->samGeneratorConfig_.isBamOutput() ? ".bam" : ".sam";
+
+        config_->commandLine_ = getCommandLine();
+
+        cgdata::GenomeMetadata gm(config_->exportRootDirName_);
+        std::vector<std::string> laneNames;
+        std::vector<mapping::MergedMap2SamConfig> configs;
+        BOOST_FOREACH(const std::string& laneName, gm.getLaneNames())
+        {
+            std::vector<std::string> laneBatchIds = gm.getLaneBatchIds(laneName);
+            if (laneBatchIds.empty())
+                continue;
+            laneNames.push_back(laneName);
+            BOOST_FOREACH(const std::string& laneBatchId, laneBatchIds)
+            {
+                mapping::MergedMap2SamConfig config(*config_);
+                config.inputReadsBatchId_ = laneBatchId;
+                config.inputReadsFileName_ = gm.getReadsFileName(laneBatchId);
+                config.inputMappingsFileName_ = gm.getMappingsFileName(laneBatchId);
+                config.outputFileName_ = (outputDir / (laneBatchId + extension)).string();
+                configs.push_back(config);
+            }
+        }
+
+        // The debug info is written while converting, so it needs a
+        // single thread. The lane batches converted at a time divide
+        // the threads and the sort memory among themselves.
+        size_t concurrentCount = config_->dumpDebugInfo_ ? 1 :
+            std::max(size_t(1), std::min(config_->threadCount_, configs.size()));
+        BOOST_FOREACH(mapping::MergedMap2SamConfig& config, configs)
+        {
+            config.threadCount_ = std::max(size_t(1), config_->threadCount_ / concurrentCount);
+            config.samGeneratorConfig_.sortMemory_ =
+                std::max(size_t(1), config_->samGeneratorConfig_.sortMemory_ / concurrentCount);
+        }
+
+        mapping::MergedMap2SamSharedData sharedData(*config_, laneNames);
+
+        util::ThreadPool pool(concurrentCount);
+        pool.parallelFor(configs.size(),
+                         boost::bind(&convertLaneBatch, boost::cref(configs),
+                                     boost::cref(sharedData), _1));
+
+        return 0;
+    }
+
 } } // cgatools::command
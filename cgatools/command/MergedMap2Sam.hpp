@@ -36,8 +36,12 @@ namespace cgatools { namespace command {
         int run(po::variables_map& vm);
 
     private:
+        //! Converts all the lane batches of the genome, several at a time.
+        int runAllLaneBatches(po::variables_map& vm);
+
         boost::shared_ptr<mapping::MergedMap2SamConfig> config_;
         boost::uint16_t tmpMapq_;
+        bool allLaneBatches_;
     };
 
 } } // cgatools::command
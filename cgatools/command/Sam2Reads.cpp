@@ -19,9 +19,15 @@
 #include "cgatools/mapping/Cigar.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
 #include "cgatools/util/BaseUtil.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/ThreadPool.hpp"
+#include "cgatools/util/parse.hpp"
 
+#include <sstream>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 namespace cgatools { namespace command {
 
@@ -32,9 +38,11 @@ public:
         const boost::filesystem::path& outputPrefix, 
         const std::string & fileType,
         const std::string & headerLine,
-        const mapping::SamFileHeader& samHeader
+        const mapping::SamFileHeader& samHeader,
+        size_t maxOpenFiles
         )
-        : mapping::OutLaneBatchStreams(outputPrefix, fileType,headerLine), samHeader_(samHeader)
+        : mapping::OutLaneBatchStreams(outputPrefix, fileType,headerLine,maxOpenFiles),
+          samHeader_(samHeader)
     {
     }
 
@@ -61,70 +69,82 @@ protected:
     const mapping::SamFileHeader&   samHeader_;
 };
 
-Sam2Reads::Sam2Reads(const std::string& name)
-    : Command(name,
-              "Converts SAM files into lane/batch separated read files.",
-              "CGI SAM 1.4 or later",
-    "The sam2reads converter takes as input SAM files... "
-    )
-    ,config_(new Sam2ReadsConfig())
-{
-    options_.add_options()
-        ("input-sam,i", po::value<std::string>(&config_->inputSamFileName_)->default_value("STDIN"),
-         "Input SAM file.")
+namespace {
 
-        ("output,o", po::value<std::string>(&config_->outputDirName_),"Output directory.")
-
-        ("from,f", po::value<std::string>(&config_->recordsFrom_),
-         "Defines start read record id.")
+    //! The number of records converted by each thread at a time.
+    const size_t RECORDS_PER_SLICE = 16*1024;
 
-        ("to,t", po::value<std::string>(&config_->recordsTo_),
-         "Defines end read record id (the end record is not included in the results).")
-
-        ("extract-genomic-region,e", po::value<util::StringVector>(&config_->exportRegionList_),
-         "Defines a region as a half-open interval 'chr,from,to'")
-        ;
+    //! The reads converted from a slice of a chunk of SAM records, by
+    //! one thread. The output text of the reads is kept in one string,
+    //! to be written in large blocks, and the memory is reused by the
+    //! next chunk.
+    class ReadsSlice : boost::noncopyable
+    {
+    public:
+        class Read
+        {
+        public:
+            std::string slide_;
+            std::string lane_;
+            size_t      batchNo_;
+            //! The end of the output of the read in text_.
+            size_t      end_;
+        };
 
-    hiddenOptions_.add_options()
-        ("debug-info,d", po::bool_switch(&config_->dumpDebugInfo_)->default_value(false),
-        "Dump debug information together with output. ")
-        ;
+        explicit ReadsSlice(const mapping::SamFileParser& parser)
+            : decoder_(parser), count_(0)
+        {}
 
-}
+        void clear()
+        {
+            count_ = 0;
+            text_.clear();
+            debug_.clear();
+        }
 
-int Sam2Reads::run(po::variables_map& vm)
-{
-    requireParam(vm, "input-sam");
-    requireParam(vm, "output");
+        //! Returns an unused read, to be filled in and counted by
+        //! commitRead().
+        Read& nextRead()
+        {
+            if (count_ == reads_.size())
+                reads_.push_back(Read());
+            return reads_[count_];
+        }
 
-    std::istream& in = openStdin(config_->inputSamFileName_);
+        void commitRead()
+        {
+            reads_[count_++].end_ = text_.size();
+        }
 
-    std::string slide;
-    std::string lane;
-    size_t batchNo;
-    size_t offset;
+        mapping::SamRecordDecoder decoder_;
 
-    mapping::SamFileParser parser(in, config_->inputSamFileName_);
+        //! Only the first count_ reads are valid.
+        std::vector<Read>   reads_;
+        size_t              count_;
+        std::string         text_;
+        std::string         debug_;
 
-    SamOutLaneBatchStreams outStreams(config_->outputDirName_,
-        "SAM_READS",
-        ">readOffset\tside\tbases\tscores",
-        parser.header_);
+        std::string         seq_;
+        std::string         qual_;
+    };
 
-    while (parser.next())
+    void convertRecord(const mapping::SamFileRecord& r, ReadsSlice& slice, bool dumpDebugInfo)
     {
-        const mapping::SamFileRecord & r = parser.getRecord();
-        r.parseQName(slide, lane, batchNo, offset);
+        ReadsSlice::Read& read = slice.nextRead();
+        size_t offset;
+        r.parseQName(read.slide_, read.lane_, read.batchNo_, offset);
         if (r.isSecondary() || (r.flag_==0 && r.qname_=="empty"))
-            continue;
+            return;
 
-        std::string updatedSeq;
-        std::string updatedQual;
-        if (r.samTags_.hasTag("GC"))
+        std::string& updatedSeq = slice.seq_;
+        std::string& updatedQual = slice.qual_;
+        updatedSeq.clear();
+        updatedQual.clear();
+        const mapping::SamTag* gapCigar = r.samTags_.findTag("GC");
+        if (0 != gapCigar)
         {
             size_t readPos = 0;
-            const mapping::SamTag& gapCigar = r.samTags_.getTag("GC");
-            mapping::Cigar c(gapCigar.value_);
+            mapping::Cigar c(gapCigar->value_);
             for (size_t i=0; i < c.size(); ++i)
             {
                 switch(c[i].type_)
@@ -137,15 +157,19 @@ int Sam2Reads::run(po::variables_map& vm)
                     readPos += c[i].length_;
                     break;
                 case 'G':
+                {
                     readPos += c[i].length_;
-                    if (!r.samTags_.hasTag("GS"))
+                    const mapping::SamTag* gapSeq = r.samTags_.findTag("GS");
+                    const mapping::SamTag* gapQual = r.samTags_.findTag("GQ");
+                    if (0 == gapSeq)
                         CGA_ERROR_EX("the record with GC tag but is missing GS tag: " << r);
-                    if (!r.samTags_.hasTag("GQ"))
+                    if (0 == gapQual)
                         CGA_ERROR_EX("the record with GC tag but is missing GQ tag: " << r);
-                    updatedSeq.insert(updatedSeq.length(),r.samTags_.getTag("GS").value_);
-                    updatedQual.insert(updatedQual.length(),r.samTags_.getTag("GQ").value_);
+                    updatedSeq.insert(updatedSeq.length(),gapSeq->value_);
+                    updatedQual.insert(updatedQual.length(),gapQual->value_);
                     break;
                 }
+                }
             }
         }
 
@@ -164,17 +188,142 @@ int Sam2Reads::run(po::variables_map& vm)
             std::reverse(updatedQual.begin(),updatedQual.end());
         }
 
-        std::ostream & ostr = outStreams.getBatchStream(slide, lane, batchNo);
-        ostr 
-            << offset << '\t'
-            << r.getSide() << '\t'
-            << (updatedSeq.empty() ? r.seq_ : updatedSeq) << '\t'
-            << (updatedQual.empty() ? r.qual_ : updatedQual) << '\t'
-            << std::endl;
+        std::string& text = slice.text_;
+        util::appendInt(text, offset);
+        text.push_back('\t');
+        util::appendInt(text, r.getSide());
+        text.push_back('\t');
+        text.append(updatedSeq.empty() ? r.seq_ : updatedSeq);
+        text.push_back('\t');
+        text.append(updatedQual.empty() ? r.qual_ : updatedQual);
+        text.append("\t\n");
+        slice.commitRead();
+
+        if (dumpDebugInfo)
+        {
+            std::ostringstream debug;
+            debug << r << '\n';
+            slice.debug_.append(debug.str());
+        }
+    }
+
+    //! Parses and converts the records of slice sliceIndex of chunk.
+    void convertSlice(const mapping::SamRawRecords& chunk, size_t chunkSize,
+                      boost::ptr_vector<ReadsSlice>& slices, bool dumpDebugInfo, size_t sliceIndex)
+    {
+        ReadsSlice& slice = slices[sliceIndex];
+        slice.clear();
+        size_t first = chunkSize * sliceIndex / slices.size();
+        size_t last = chunkSize * (sliceIndex+1) / slices.size();
+        for (size_t i=first; i<last; ++i)
+            convertRecord(slice.decoder_.decode(chunk[i]), slice, dumpDebugInfo);
+    }
+
+    //! Writes the reads of a slice, in order, with one write for each
+    //! run of reads of the same lane batch.
+    void writeSlice(const ReadsSlice& slice, mapping::OutLaneBatchStreams& outStreams)
+    {
+        size_t begin = 0;
+        for (size_t i=0; i<slice.count_; )
+        {
+            const ReadsSlice::Read& read = slice.reads_[i];
+            size_t next = i+1;
+            while (next < slice.count_ &&
+                   slice.reads_[next].batchNo_ == read.batchNo_ &&
+                   slice.reads_[next].lane_ == read.lane_ &&
+                   slice.reads_[next].slide_ == read.slide_)
+                ++next;
+            size_t end = slice.reads_[next-1].end_;
+            outStreams.getBatchStream(read.slide_, read.lane_, read.batchNo_).write(
+                slice.text_.data()+begin, end-begin);
+            begin = end;
+            i = next;
+        }
+        if (!slice.debug_.empty())
+            std::cout << slice.debug_ << std::flush;
+    }
+}
+
+Sam2Reads::Sam2Reads(const std::string& name)
+    : Command(name,
+              "Converts SAM files into lane/batch separated read files.",
+              "CGI SAM 1.4 or later",
+    "The sam2reads converter takes as input SAM files... "
+    )
+    ,config_(new Sam2ReadsConfig())
+{
+    options_.add_options()
+        ("input-sam,i", po::value<std::string>(&config_->inputSamFileName_)->default_value("STDIN"),
+         "Input SAM or BAM file. The format is found from the data.")
+
+        ("output,o", po::value<std::string>(&config_->outputDirName_),"Output directory.")
+
+        ("from,f", po::value<std::string>(&config_->recordsFrom_),
+         "Defines start read record id.")
+
+        ("to,t", po::value<std::string>(&config_->recordsTo_),
+         "Defines end read record id (the end record is not included in the results).")
+
+        ("extract-genomic-region,e", po::value<util::StringVector>(&config_->exportRegionList_),
+         "Defines a region as a half-open interval 'chr,from,to'")
+
+        ("threads", po::value<size_t>(&config_->threadCount_)->default_value(1),
+         "The number of threads used to parse and convert the records. "
+         "The output does not depend on the number of threads.")
+
+        ("max-open-files",
+         po::value<size_t>(&config_->maxOpenFiles_)->default_value(
+             mapping::OutLaneBatchStreams::DEFAULT_MAX_OPEN_FILES),
+         "The maximum number of output files open at a time. When there are more "
+         "lane batches, their files are closed and reopened in turn.")
+        ;
+
+    hiddenOptions_.add_options()
+        ("debug-info,d", po::bool_switch(&config_->dumpDebugInfo_)->default_value(false),
+        "Dump debug information together with output. ")
+        ;
+
+}
+
+int Sam2Reads::run(po::variables_map& vm)
+{
+    requireParam(vm, "input-sam");
+    requireParam(vm, "output");
+    if (0 == config_->maxOpenFiles_)
+        throw util::Exception("max-open-files must be at least 1");
+
+    std::istream& in = openStdin(config_->inputSamFileName_);
+
+    mapping::SamFileParser parser(in, config_->inputSamFileName_);
+
+    SamOutLaneBatchStreams outStreams(config_->outputDirName_,
+        "SAM_READS",
+        ">readOffset\tside\tbases\tscores",
+        parser.header_,
+        config_->maxOpenFiles_);
+
+    // The records are read in chunks, which are parsed and converted
+    // on the threads, a slice per thread, and written in order.
+    util::ThreadPool pool(config_->threadCount_);
+    boost::ptr_vector<ReadsSlice> slices;
+    for (size_t i=0; i<pool.size(); ++i)
+        slices.push_back(new ReadsSlice(parser));
+
+    mapping::SamRawRecords chunk;
+    for (;;)
+    {
+        size_t chunkSize = parser.nextChunk(chunk, RECORDS_PER_SLICE * slices.size());
+        if (0 == chunkSize)
+            break;
+
+        pool.parallelFor(slices.size(),
+                         boost::bind(&convertSlice, boost::cref(chunk), chunkSize,
+                                     boost::ref(slices), config_->dumpDebugInfo_, _1));
 
-        if (config_->dumpDebugInfo_)
-            std::cout << parser.getRecord() << std::endl;
+        BOOST_FOREACH(const ReadsSlice& slice, slices)
+            writeSlice(slice, outStreams);
     }
+    outStreams.close();
 
     return 0;
 }
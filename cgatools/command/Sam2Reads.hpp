@@ -32,6 +32,8 @@ namespace cgatools { namespace command {
 
         util::StringVector  exportRegionList_;
         bool        dumpDebugInfo_;
+        size_t      threadCount_;
+        size_t      maxOpenFiles_;
     };
 
     class Sam2Reads : public Command
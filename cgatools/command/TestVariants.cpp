@@ -18,9 +18,13 @@
 #include "cgatools/variants/SuperlocusIterator.hpp"
 #include "cgatools/reference/ChromosomeIdField.hpp"
 #include "cgatools/util/BaseUtil.hpp"
+#include "cgatools/util/RangeSet.hpp"
+#include "cgatools/util/ThreadPool.hpp"
 
 #include <queue>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 
 namespace cgatools { namespace command {
 
@@ -31,6 +35,76 @@ namespace cgatools { namespace command {
 
     using boost::shared_ptr;
 
+    namespace
+    {
+        // Input variants read and tested per batch.
+        const size_t VARIANT_BATCH_SIZE = 4096;
+
+        // With regions, the variant files are moved forward to this
+        // many bases before each tested variant, skipping the loci in
+        // between, which are too far from the variant to be part of
+        // its superlocus.
+        const uint32_t REGION_SEEK_MARGIN = 10000;
+
+        // An input variant to test.
+        struct TestedVariant
+        {
+            string line_;
+            Range range_;
+            string alleleSeq_;
+        };
+
+        // The superlocus iterator of a variant file, and the results
+        // of the current batch of input variants for the file.
+        struct GenomeTester
+        {
+            shared_ptr<SuperlocusIterator> slit_;
+
+            // The hypotheses of the last superlocus, reused while
+            // consecutive variants fall in the same superlocus.
+            Range hypothesisRange_;
+            vector< vector<PhasedHypothesis> > hypotheses_;
+
+            vector<string> results_;
+        };
+
+        void testGenome(vector<GenomeTester>& testers,
+                        const vector<TestedVariant>& batch,
+                        size_t batchSize,
+                        size_t maxHypothesisCount,
+                        const CrrFile& crr,
+                        bool seekVariants,
+                        size_t offset)
+        {
+            GenomeTester& tester = testers[offset];
+            SuperlocusIterator& slit = *tester.slit_;
+            tester.results_.resize(batchSize);
+            for(size_t ii=0; ii<batchSize; ii++)
+            {
+                if (seekVariants)
+                {
+                    Location loc = batch[ii].range_.beginLocation();
+                    loc.offset_ = loc.offset_ > REGION_SEEK_MARGIN ? loc.offset_ - REGION_SEEK_MARGIN : 0;
+                    slit.seek(loc);
+                }
+                slit.skipToVariant(batch[ii].range_, batch[ii].alleleSeq_);
+                const Superlocus& sl = *slit;
+                if (tester.hypotheses_.empty() || sl.getRange() != tester.hypothesisRange_)
+                {
+                    sl.buildPhasedHypotheses(tester.hypotheses_, maxHypothesisCount, true);
+                    tester.hypothesisRange_ = sl.getRange();
+                }
+
+                PhasedHypothesis::testVariant(
+                    sl, tester.hypotheses_[0],
+                    batch[ii].range_,
+                    batch[ii].alleleSeq_,
+                    crr,
+                    tester.results_[ii]);
+            }
+        }
+    }
+
     TestVariants::TestVariants(const std::string& name)
         : Command(name,
                   "Tests variant files for presence of variants.",
@@ -44,9 +118,14 @@ namespace cgatools { namespace command {
                   "but inconsistent with the variant.\n"
                   "    1 \tThis allele of this genome has the input variant at this locus.\n"
                   "    N \tThis allele of this genome has no-calls but is consistent with "
-                  "the input variant.\n"
+                  "the input variant.\n\n"
+                  "With --range or --regions-file, only the input variants intersecting "
+                  "the given regions are tested, and the variant files skip the loci far "
+                  "from any tested variant. Variant files indexed by indexvar then read "
+                  "only the blocks of the file near the tested variants.\n"
             ),
-          maxHypothesisCount_(32)
+          maxHypothesisCount_(32),
+          threadCount_(1)
     {
         options_.add_options()
             ("reference", po::value<string>(&referenceFileName_),
@@ -57,6 +136,16 @@ namespace cgatools { namespace command {
              "The output file (may be omitted for stdout).")
             ("variants", po::value< vector<string> >(&variantFileNames_),
              "The input variant files (may be passed in as arguments at the end of the command).")
+            ("threads", po::value<size_t>(&threadCount_)->default_value(1),
+             "The number of threads used to test the variant files, each file "
+             "being tested on one thread. The output does not depend on the "
+             "number of threads.")
+            ("range", po::value<StringVector>(&ranges_),
+             "A region of the reference to test the input variants in, as "
+             "'chr,begin,end' or 'chr'. May be given several times.")
+            ("regions-file", po::value<string>(&regionsFileName_),
+             "A tab-delimited file of regions of the reference to test the input "
+             "variants in, with chromosome, begin and end columns.")
             ;
 
         positionalOptions_.add("variants", -1);
@@ -71,17 +160,26 @@ namespace cgatools { namespace command {
         std::istream& in = openStdin(inputFileName_);
         std::ostream& out = openStdout(outputFileName_);
 
+        boost::scoped_ptr<FastRangeSet> regions;
+        if (!ranges_.empty() || !regionsFileName_.empty())
+        {
+            regions.reset(new FastRangeSet(crr));
+            regions->add(ranges_);
+            if (!regionsFileName_.empty())
+                regions->addFile(regionsFileName_);
+            regions->merge();
+        }
+
         vector< shared_ptr<VariantFileIterator> > vfi;
-        vector< shared_ptr<SuperlocusIterator> > sli;
-        BOOST_FOREACH(const string& variantFileName, variantFileNames_)
+        vector<GenomeTester> testers(variantFileNames_.size());
+        for(size_t ii=0; ii<variantFileNames_.size(); ii++)
         {
             shared_ptr<VariantFileIterator> it(new VariantFileIterator(crr));
-            it->open(variantFileName);
+            it->open(variantFileNames_[ii]);
             vfi.push_back(it);
 
-            shared_ptr<SuperlocusIterator> slit(new SuperlocusIterator(6, 0));
-            slit->setVariantFile(*it);
-            sli.push_back(slit);
+            testers[ii].slit_.reset(new SuperlocusIterator(6, 0));
+            testers[ii].slit_->setVariantFile(*it);
         }
 
         Range range;
@@ -94,29 +192,49 @@ namespace cgatools { namespace command {
         df.addField(StringField("reference", &reference), DelimitedFile::FPT_OPTIONAL);
         df.addField(StringField("alleleSeq", &alleleSeq));
         writeHeader(out, df.getLine(), vfi);
-        while (df.next())
+
+        // The input variants are read in batches, each variant file
+        // is tested against a batch on the thread pool, advancing its
+        // own superlocus iterator, and the result columns are written
+        // in input order, so the output does not depend on the thread
+        // count.
+        ThreadPool pool(threadCount_);
+        vector<TestedVariant> batch(VARIANT_BATCH_SIZE);
+        bool more = true;
+        while (more)
         {
-            if (reference != "" && reference != "?" && reference != crr.getSequence(range))
-                throw Exception("variant list reference sequence mismatch: "+df.getLine());
-            out << df.getLine();
-            for(size_t ii=0; ii<sli.size(); ii++)
+            size_t batchSize = 0;
+            while (batchSize < batch.size())
             {
-                SuperlocusIterator& slit = *(sli[ii]);
-                slit.skipToVariant(range, alleleSeq);
-                const Superlocus& sl = *slit;
-                vector< vector<PhasedHypothesis> > hypotheses;
-                sl.buildPhasedHypotheses(hypotheses, maxHypothesisCount_, true);
+                if (!df.next())
+                {
+                    more = false;
+                    break;
+                }
+                if (reference != "" && reference != "?" && reference != crr.getSequence(range))
+                    throw Exception("variant list reference sequence mismatch: "+df.getLine());
+                if (0 != regions.get() && !regions->intersects(range))
+                    continue;
+                TestedVariant& variant = batch[batchSize++];
+                variant.line_ = df.getLine();
+                variant.range_ = range;
+                variant.alleleSeq_ = alleleSeq;
+            }
+            if (0 == batchSize)
+                break;
 
-                string result;
-                PhasedHypothesis::testVariant(
-                    sl, hypotheses[0],
-                    range,
-                    alleleSeq,
-                    crr,
-                    result);
-                out << "\t" << result;
+            pool.parallelFor(testers.size(), boost::bind(&testGenome, boost::ref(testers),
+                                                         boost::cref(batch), batchSize,
+                                                         maxHypothesisCount_, boost::cref(crr),
+                                                         0 != regions.get(), _1));
+
+            for(size_t ii=0; ii<batchSize; ii++)
+            {
+                out << batch[ii].line_;
+                for(size_t jj=0; jj<testers.size(); jj++)
+                    out << "\t" << testers[jj].results_[ii];
+                out << "\n";
             }
-            out << "\n";
         }
 
         return 0;
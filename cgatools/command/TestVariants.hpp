@@ -19,6 +19,7 @@
 
 #include "cgatools/core.hpp"
 #include "cgatools/command/Command.hpp"
+#include "cgatools/util/RangeSet.hpp"
 #include "cgatools/variants/VariantFileIterator.hpp"
 
 namespace cgatools { namespace command {
@@ -40,8 +41,11 @@ namespace cgatools { namespace command {
         std::string inputFileName_;
         std::string outputFileName_;
         size_t maxHypothesisCount_;
+        size_t threadCount_;
 
         std::vector<std::string> variantFileNames_;
+        util::StringVector ranges_;
+        std::string regionsFileName_;
     };
 
 } } // cgatools::command
@@ -0,0 +1,86 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/command/Var2Bin.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/variants/VariantBinaryFile.hpp"
+#include "cgatools/variants/VariantFileIterator.hpp"
+
+using namespace std;
+using namespace cgatools::util;
+using namespace cgatools::reference;
+using namespace cgatools::variants;
+
+namespace cgatools { namespace command {
+
+    Var2Bin::Var2Bin(const std::string& name)
+        : Command(name,
+                  "Converts a var file or masterVar file to a binary file "
+                  "that loads faster.",
+                  "0.3 or later",
+
+                  "Converts a var file or masterVar file to a compact binary file. "
+                  "The binary file may be given instead of the original file to any "
+                  "cgatools command that reads a var file or masterVar file, such as "
+                  "listvariants, testvariants, calldiff and mkvcf; it is detected by "
+                  "its contents, and filters may be appended to its name as for the "
+                  "original file (see varfilter). The loci are validated against the "
+                  "reference once, by var2bin, and read back from the binary file "
+                  "without parsing or validating them again. The binary file holds "
+                  "the metadata of the original file, and must be read with the same "
+                  "reference.\n\n"
+                  "Loci are stored in blocks of loci of one chromosome, compressed by "
+                  "column. The format is specific to this version of cgatools and is "
+                  "meant as a cache; keep the original file."
+            )
+    {
+        options_.add_options()
+            ("reference", po::value<string>(&referenceFileName_),
+             "The reference crr file.")
+            ("input", po::value<string>(&inputFileName_),
+             "The input var file or masterVar file (may be passed in as argument "
+             "at the end of the command).")
+            ("output", po::value<string>(&outputFileName_),
+             "The output binary file.")
+            ("block-size", po::value<size_t>(&blockLocusCount_)->
+             default_value(VariantBinaryFileWriter::DEFAULT_BLOCK_LOCUS_COUNT),
+             "The number of loci in each block of the output file.")
+            ;
+
+        positionalOptions_.add("input", 1);
+    }
+
+    int Var2Bin::run(po::variables_map& vm)
+    {
+        requireParam(vm, "reference");
+        requireParam(vm, "input");
+        requireParam(vm, "output");
+        if (0 == blockLocusCount_)
+            throw Exception("block-size must be positive");
+
+        CrrFile crr(referenceFileName_);
+        VariantFileIterator vf(crr);
+        vf.open(inputFileName_);
+
+        VariantBinaryFileWriter out(outputFileName_, crr, vf, blockLocusCount_);
+        for(; !vf.eof(); ++vf)
+            out.write(*vf);
+        out.close();
+
+        return 0;
+    }
+
+} } // cgatools::command
@@ -17,6 +17,9 @@
 #include "cgatools/reference/CrrFile.hpp"
 #include "cgatools/variants/VariantFileIterator.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/RangeSet.hpp"
+
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 using namespace cgatools::util;
@@ -55,6 +58,9 @@ namespace cgatools { namespace command {
                   "&lt; 25 and heterozygous insertions with varScoreEAF &lt; 50:\n\n"
                   "&apos;/path/to/var.tsv.bz2#hom:varType=snp:varScoreVAF&lt;25,"
                   "het:varType=ins:varScoreEAF&lt;50&apos;\n"
+                  "\nWith --range or --regions-file, only the loci intersecting the "
+                  "given regions are copied. If the input file was indexed by "
+                  "indexvar, only the blocks of the file holding these loci are read.\n"
             )
     {
         options_.add_options()
@@ -62,6 +68,12 @@ namespace cgatools { namespace command {
              "The reference crr file.")
             ("input", po::value<string>(&inputFileName_),
              "The input var file or masterVar file (typically with filters specified).")
+            ("range", po::value<StringVector>(&ranges_),
+             "A region of the reference to copy, as 'chr,begin,end' or 'chr'. "
+             "May be given several times.")
+            ("regions-file", po::value<string>(&regionsFileName_),
+             "A tab-delimited file of regions of the reference to copy, with "
+             "chromosome, begin and end columns.")
             ("output", po::value<string>(&outputFileName_)->default_value("STDOUT"),
              "The output file (may be omitted for stdout).")
             ;
@@ -81,6 +93,16 @@ namespace cgatools { namespace command {
         vf.setReferenceCoverValidation(false);
         vf.open(inputFileName_);
 
+        boost::scoped_ptr<FastRangeSet> regions;
+        if (!ranges_.empty() || !regionsFileName_.empty())
+        {
+            regions.reset(new FastRangeSet(crr));
+            regions->add(ranges_);
+            if (!regionsFileName_.empty())
+                regions->addFile(regionsFileName_);
+            regions->merge();
+        }
+
         DelimitedFileMetadata metaOut;
         metaOut.initDefaults(vf.getMetadata());
         if ("" != vf.getFilterString())
@@ -93,6 +115,12 @@ namespace cgatools { namespace command {
             out << endl;
             for(; !vf.eof(); ++vf)
             {
+                if (0 != regions.get())
+                {
+                    vf.seek(*regions);
+                    if (vf.eof())
+                        break;
+                }
                 vf->writeAsOneLine(out);
                 out << "\n";
             }
@@ -101,7 +129,15 @@ namespace cgatools { namespace command {
         {
             out << ">" << Call::getHeader() << endl;
             for(; !vf.eof(); ++vf)
+            {
+                if (0 != regions.get())
+                {
+                    vf.seek(*regions);
+                    if (vf.eof())
+                        break;
+                }
                 out << (*vf);
+            }
         }
 
         return 0;
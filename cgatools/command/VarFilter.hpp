@@ -19,6 +19,7 @@
 
 #include "cgatools/core.hpp"
 #include "cgatools/command/Command.hpp"
+#include "cgatools/util/RangeSet.hpp"
 
 namespace cgatools { namespace command {
 
@@ -34,6 +35,8 @@ namespace cgatools { namespace command {
         std::string referenceFileName_;
         std::string inputFileName_;
         std::string outputFileName_;
+        util::StringVector ranges_;
+        std::string regionsFileName_;
     };
 
 } } // cgatools::command
@@ -0,0 +1,328 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/BamReader.hpp"
+#include "cgatools/mapping/SamReader.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/parse.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <istream>
+
+namespace cgatools { namespace mapping {
+
+    using util::appendInt;
+
+    const char BamReader::MAGIC[4] = { 'B', 'A', 'M', 1 };
+
+    namespace {
+        const char CIGAR_OPS[] = "MIDNSHP=X";
+        const char SEQ_CODES[] = "=ACMGRSVTWYHKDBN";
+
+        uint16_t getUInt16(const char* data)
+        {
+            const uint8_t* d = reinterpret_cast<const uint8_t*>(data);
+            return uint16_t(d[0] | (d[1] << 8));
+        }
+
+        uint32_t getUInt32(const char* data)
+        {
+            const uint8_t* d = reinterpret_cast<const uint8_t*>(data);
+            return uint32_t(d[0]) | (uint32_t(d[1]) << 8) |
+                (uint32_t(d[2]) << 16) | (uint32_t(d[3]) << 24);
+        }
+
+        int32_t getInt32(const char* data)
+        {
+            return int32_t(getUInt32(data));
+        }
+
+        void appendFloat(std::string& out, float val)
+        {
+            char buf[32];
+            std::sprintf(buf, "%g", double(val));
+            out.append(buf);
+        }
+
+        void checkSize(const char* first, const char* last, size_t size)
+        {
+            if (size_t(last - first) < size)
+                CGA_ERROR_EX("Truncated BAM record");
+        }
+
+        size_t getTagValueSize(char type)
+        {
+            switch(type)
+            {
+            case 'A':
+            case 'c':
+            case 'C':
+                return 1;
+            case 's':
+            case 'S':
+                return 2;
+            case 'i':
+            case 'I':
+            case 'f':
+                return 4;
+            default:
+                CGA_ERROR_EX("Unknown BAM tag type: " << type);
+            }
+            return 0;
+        }
+
+        //! Appends the value of type at data, one of the types of
+        //! getTagValueSize().
+        void appendTagValue(std::string& out, char type, const char* data)
+        {
+            switch(type)
+            {
+            case 'A':
+                out.push_back(*data);
+                break;
+            case 'c':
+                appendInt(out, int8_t(*data));
+                break;
+            case 'C':
+                appendInt(out, uint8_t(*data));
+                break;
+            case 's':
+                appendInt(out, int16_t(getUInt16(data)));
+                break;
+            case 'S':
+                appendInt(out, getUInt16(data));
+                break;
+            case 'i':
+                appendInt(out, getInt32(data));
+                break;
+            case 'I':
+                appendInt(out, getUInt32(data));
+                break;
+            case 'f':
+            {
+                uint32_t bits = getUInt32(data);
+                float val;
+                std::memcpy(&val, &bits, sizeof(val));
+                appendFloat(out, val);
+                break;
+            }
+            }
+        }
+
+        void readBytes(std::istream& in, char* data, size_t size)
+        {
+            in.read(data, size);
+            if (size_t(in.gcount()) != size)
+                CGA_ERROR_EX("Truncated BAM file");
+        }
+
+        int32_t readInt32(std::istream& in)
+        {
+            char data[4];
+            readBytes(in, data, sizeof(data));
+            return getInt32(data);
+        }
+    }
+
+    BamReader::BamReader(std::istream& in, SamFileHeader& header)
+        : in_(in)
+    {
+        int32_t textLength = readInt32(in_);
+        if (textLength < 0)
+            CGA_ERROR_EX("Bad BAM header text length: " << textLength);
+        std::string text(textLength, '\0');
+        if (0 != textLength)
+            readBytes(in_, &text[0], text.size());
+        text.resize(std::strlen(text.c_str()));
+
+        size_t first = 0;
+        while (first < text.size())
+        {
+            size_t last = text.find('\n', first);
+            if (std::string::npos == last)
+                last = text.size();
+            std::string line = text.substr(first, last-first);
+            if (!line.empty() && '\r' == line[line.size()-1])
+                line.resize(line.size()-1);
+            if (!line.empty())
+                header.addLine(line);
+            first = last+1;
+        }
+
+        int32_t refCount = readInt32(in_);
+        if (refCount < 0)
+            CGA_ERROR_EX("Bad BAM reference count: " << refCount);
+        for (int32_t i=0; i<refCount; ++i)
+        {
+            int32_t nameLength = readInt32(in_);
+            if (nameLength < 1)
+                CGA_ERROR_EX("Bad BAM reference name length: " << nameLength);
+            std::string name(nameLength, '\0');
+            readBytes(in_, &name[0], name.size());
+            name.resize(nameLength-1);
+            refNames_.push_back(name);
+            readInt32(in_);
+        }
+    }
+
+    bool BamReader::next(std::string& record)
+    {
+        char data[4];
+        in_.read(data, sizeof(data));
+        if (0 == in_.gcount())
+            return false;
+        if (sizeof(data) != size_t(in_.gcount()))
+            CGA_ERROR_EX("Truncated BAM file");
+        int32_t blockSize = getInt32(data);
+        if (blockSize < 32)
+            CGA_ERROR_EX("Bad BAM record size: " << blockSize);
+        record.resize(blockSize);
+        readBytes(in_, &record[0], record.size());
+        return true;
+    }
+
+    void BamReader::decode(const std::string& record, SamFileRecord& out) const
+    {
+        const char* data = record.data();
+        const char* last = data + record.size();
+        checkSize(data, last, 32);
+
+        int32_t refId = getInt32(data);
+        int32_t pos = getInt32(data+4);
+        uint8_t nameLength = uint8_t(data[8]);
+        uint8_t mapq = uint8_t(data[9]);
+        uint16_t cigarCount = getUInt16(data+12);
+        uint16_t flag = getUInt16(data+14);
+        int32_t seqLength = getInt32(data+16);
+        int32_t nextRefId = getInt32(data+20);
+        int32_t nextPos = getInt32(data+24);
+        int32_t tlen = getInt32(data+28);
+        if (nameLength < 1 || seqLength < 0)
+            CGA_ERROR_EX("Bad BAM record");
+
+        const char* current = data + 32;
+        checkSize(current, last,
+                  nameLength + 4*size_t(cigarCount) + (size_t(seqLength)+1)/2 + seqLength);
+
+        if (refId < -1 || refId >= int32_t(refNames_.size()) ||
+            nextRefId < -1 || nextRefId >= int32_t(refNames_.size()))
+            CGA_ERROR_EX("BAM record reference id not in the header: " << refId << " " << nextRefId);
+
+        out.qname_.assign(current, nameLength-1);
+        current += nameLength;
+        out.flag_ = flag;
+        if (-1 == refId)
+            out.rname_.assign("*");
+        else
+            out.rname_.assign(refNames_[refId]);
+        out.pos_ = uint32_t(pos+1);
+        out.mapq_ = mapq;
+
+        out.cigar_.clear();
+        for (size_t i=0; i<cigarCount; ++i, current+=4)
+        {
+            uint32_t op = getUInt32(current);
+            if ((op & 0xf) >= sizeof(CIGAR_OPS)-1)
+                CGA_ERROR_EX("Bad BAM CIGAR operation: " << (op & 0xf));
+            appendInt(out.cigar_, op >> 4);
+            out.cigar_.push_back(CIGAR_OPS[op & 0xf]);
+        }
+        if (out.cigar_.empty())
+            out.cigar_.assign("*");
+
+        if (-1 == nextRefId)
+            out.rnext_.assign("*");
+        else if (nextRefId == refId)
+            out.rnext_.assign("=");
+        else
+            out.rnext_.assign(refNames_[nextRefId]);
+        out.pnext_ = uint32_t(nextPos+1);
+        out.tlen_ = tlen;
+
+        out.seq_.resize(seqLength);
+        for (int32_t i=0; i<seqLength; ++i)
+        {
+            uint8_t packed = uint8_t(current[i/2]);
+            out.seq_[i] = SEQ_CODES[0 == i%2 ? packed >> 4 : packed & 0xf];
+        }
+        current += (seqLength+1)/2;
+        if (0 == seqLength)
+            out.seq_.assign("*");
+
+        if (0 == seqLength || 0xff == uint8_t(*current))
+            out.qual_.assign("*");
+        else
+        {
+            out.qual_.resize(seqLength);
+            for (int32_t i=0; i<seqLength; ++i)
+                out.qual_[i] = char(current[i] + 33);
+        }
+        current += seqLength;
+
+        out.samTags_.clear();
+        while (current < last)
+        {
+            checkSize(current, last, 3);
+            SamTag& tag = out.samTags_.nextTag();
+            tag.name_.assign(current, 2);
+            char type = current[2];
+            current += 3;
+            tag.value_.clear();
+            switch(type)
+            {
+            case 'Z':
+            case 'H':
+            {
+                const char* end = static_cast<const char*>(std::memchr(current, 0, last-current));
+                if (0 == end)
+                    CGA_ERROR_EX("Truncated BAM record");
+                tag.type_ = type;
+                tag.value_.assign(current, end);
+                current = end+1;
+                break;
+            }
+            case 'B':
+            {
+                checkSize(current, last, 5);
+                char elementType = current[0];
+                uint32_t count = getUInt32(current+1);
+                size_t elementSize = getTagValueSize(elementType);
+                current += 5;
+                checkSize(current, last, count*elementSize);
+                tag.type_ = 'B';
+                tag.value_.push_back(elementType);
+                for (uint32_t i=0; i<count; ++i, current+=elementSize)
+                {
+                    tag.value_.push_back(',');
+                    appendTagValue(tag.value_, elementType, current);
+                }
+                break;
+            }
+            default:
+            {
+                size_t size = getTagValueSize(type);
+                checkSize(current, last, size);
+                tag.type_ = 'A' == type || 'f' == type ? type : 'i';
+                appendTagValue(tag.value_, type, current);
+                current += size;
+                break;
+            }
+            }
+            out.samTags_.commitTag();
+        }
+    }
+
+} } // cgatools::mapping
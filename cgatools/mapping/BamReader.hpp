@@ -0,0 +1,66 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGA_TOOLS_BAM_READER_HPP_
+#define CGA_TOOLS_BAM_READER_HPP_ 1
+
+//! @file BamReader.hpp
+//! File containing the definition of BamReader.
+
+#include "cgatools/core.hpp"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace cgatools { namespace mapping {
+
+    class SamFileHeader;
+    class SamFileRecord;
+
+    //! Reads BAM from a stream that has already been decompressed. The
+    //! alignment records are read without being decoded, so that they
+    //! can be decoded on several threads.
+    class BamReader : boost::noncopyable
+    {
+    public:
+        //! The BAM magic number, which starts the decompressed data.
+        static const char MAGIC[4];
+
+        //! Reads the header from in, which must be positioned just after
+        //! the magic number, and adds its text lines to header.
+        BamReader(std::istream& in, SamFileHeader& header);
+
+        //! Reads the next alignment record, without its block_size.
+        //! Returns false at the end of the file.
+        bool next(std::string& record);
+
+        //! Decodes a record read by next() into the fields of the SAM
+        //! text record. Safe to call concurrently.
+        void decode(const std::string& record, SamFileRecord& out) const;
+
+        const std::vector<std::string>& getReferenceNames() const
+        {
+            return refNames_;
+        }
+
+    private:
+        std::istream&               in_;
+        std::vector<std::string>    refNames_;
+    };
+
+} } // cgatools::mapping
+
+#endif // CGA_TOOLS_BAM_READER_HPP_
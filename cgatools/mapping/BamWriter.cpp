@@ -0,0 +1,355 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/BamWriter.hpp"
+#include "cgatools/mapping/SamRecord.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+#include "cgatools/util/parse.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <boost/foreach.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace cgatools { namespace mapping {
+
+    using util::Exception;
+
+    namespace {
+        const char BAM_MAGIC[4] = { 'B', 'A', 'M', 1 };
+        const char CIGAR_OPS[] = "MIDNSHP=X";
+        const char SEQ_CODES[] = "=ACMGRSVTWYHKDBN";
+
+        void appendUInt8(std::string& out, uint8_t val)
+        {
+            out.push_back(char(val));
+        }
+
+        void appendUInt16(std::string& out, uint16_t val)
+        {
+            out.push_back(char(val & 0xff));
+            out.push_back(char(val >> 8));
+        }
+
+        void appendUInt32(std::string& out, uint32_t val)
+        {
+            for(size_t ii=0; ii<4; ii++)
+                out.push_back(char((val >> (8*ii)) & 0xff));
+        }
+
+        void appendInt32(std::string& out, int32_t val)
+        {
+            appendUInt32(out, uint32_t(val));
+        }
+
+        // The BAI bin of the 0-based half open range [beg,end), as in
+        // the SAM specification.
+        uint16_t reg2bin(int32_t beg, int32_t end)
+        {
+            --end;
+            if (beg>>14 == end>>14) return uint16_t(((1<<15)-1)/7 + (beg>>14));
+            if (beg>>17 == end>>17) return uint16_t(((1<<12)-1)/7 + (beg>>17));
+            if (beg>>20 == end>>20) return uint16_t(((1<<9)-1)/7 + (beg>>20));
+            if (beg>>23 == end>>23) return uint16_t(((1<<6)-1)/7 + (beg>>23));
+            if (beg>>26 == end>>26) return uint16_t(((1<<3)-1)/7 + (beg>>26));
+            return 0;
+        }
+
+        uint32_t getCigarOp(char type)
+        {
+            const char* op = std::strchr(CIGAR_OPS, type);
+            if (0 == op || 0 == type)
+                throw Exception(std::string("CIGAR operation not supported in BAM: ") + type);
+            return uint32_t(op - CIGAR_OPS);
+        }
+
+        // The length of reference covered by the cigar. Unlike
+        // Cigar::getReferenceLength(), this treats S as a soft clip.
+        int32_t getReferenceLength(const Cigar& cigar)
+        {
+            int32_t result = 0;
+            BOOST_FOREACH(const Cigar::CigarElement& e, cigar.getParsedCigar())
+            {
+                if ('M' == e.type_ || 'D' == e.type_ || 'N' == e.type_ ||
+                    '=' == e.type_ || 'X' == e.type_)
+                    result += int32_t(e.length_);
+            }
+            return result;
+        }
+
+        class SeqCodes
+        {
+        public:
+            SeqCodes()
+            {
+                std::memset(codes_, 15, sizeof(codes_));
+                for(size_t ii=0; ii<16; ii++)
+                {
+                    codes_[uint8_t(SEQ_CODES[ii])] = uint8_t(ii);
+                    codes_[uint8_t(std::tolower(SEQ_CODES[ii]))] = uint8_t(ii);
+                }
+            }
+
+            uint8_t operator[](char ch) const
+            {
+                return codes_[uint8_t(ch)];
+            }
+
+        private:
+            uint8_t codes_[256];
+        };
+
+        const SeqCodes seqCodes;
+
+        void appendIntTag(std::string& out, int64_t val)
+        {
+            if (val >= 0)
+            {
+                if (val <= 0xff)
+                {
+                    out.push_back('C');
+                    appendUInt8(out, uint8_t(val));
+                }
+                else if (val <= 0xffff)
+                {
+                    out.push_back('S');
+                    appendUInt16(out, uint16_t(val));
+                }
+                else if (val <= int64_t(0xffffffffu))
+                {
+                    out.push_back('I');
+                    appendUInt32(out, uint32_t(val));
+                }
+                else
+                    throw Exception("integer tag value too large for BAM");
+            }
+            else
+            {
+                if (val >= -0x80)
+                {
+                    out.push_back('c');
+                    appendUInt8(out, uint8_t(int8_t(val)));
+                }
+                else if (val >= -0x8000)
+                {
+                    out.push_back('s');
+                    appendUInt16(out, uint16_t(int16_t(val)));
+                }
+                else if (val >= -int64_t(0x80000000u))
+                {
+                    out.push_back('i');
+                    appendInt32(out, int32_t(val));
+                }
+                else
+                    throw Exception("integer tag value too small for BAM");
+            }
+        }
+    }
+
+    void SamAlignment::clear()
+    {
+        qname_.clear();
+        flag_ = 0;
+        rname_.clear();
+        pos_ = 0;
+        mapq_ = 0;
+        cigar_ = Cigar();
+        hasCigar_ = false;
+        mrnm_.clear();
+        mpos_ = 0;
+        isize_ = 0;
+        seq_.clear();
+        qual_.clear();
+        tags_.clear();
+    }
+
+    void SamAlignment::writeSam(std::ostream& out) const
+    {
+        const char sep = SamRecordGenerator::SAM_SEPARATOR;
+        out << qname_;                                      // QNAME
+        out << sep << flag_;                                // FLAG
+        out << sep << rname_;                               // RNAME
+        out << sep << pos_;                                 // POS (1-based)
+        out << sep << mapq_;                                // MAPQ
+        out << sep;                                         // CIGAR
+        if (hasCigar_)
+            out << cigar_;
+        else
+            out << "*";
+        out << sep << mrnm_;                                // MRNM
+        out << sep << mpos_;                                // MPOS (1-based)
+        out << sep << isize_;                               // ISIZE
+        out << sep << seq_;                                 // SEQ
+        out << sep << qual_;                                // QUAL
+        BOOST_FOREACH(const Tag& tag, tags_)
+        {
+            out << sep << tag.name_ << ':' << tag.type_ << ':';
+            if ('Z' == tag.type_)
+                out << tag.string_;
+            else
+                out << tag.int_;
+        }
+        out << std::endl;
+    }
+
+    BamWriter::BamWriter(std::ostream& out)
+        : closed_(false)
+    {
+        boost::shared_ptr<boost::iostreams::filtering_ostream> bgzf(
+            new boost::iostreams::filtering_ostream());
+        bgzf->push(util::ParallelCompressorSink(
+                       out, util::ParallelCompressorSink::GZIP,
+                       util::CompressedOutputStream::DEFAULT_COMPRESSION),
+                   64*1024);
+        bgzf->exceptions(std::ios::badbit | std::ios::failbit);
+        bgzf_ = bgzf;
+    }
+
+    BamWriter::~BamWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch(std::exception& ee)
+        {
+            std::cerr << ee.what() << std::endl;
+            // A BAM file that could not be finished is truncated; only
+            // let it pass silently if another error is already pending.
+            if (!std::uncaught_exception())
+                CGA_ASSERT(false);
+        }
+    }
+
+    void BamWriter::writeHeader(const SamFileHeaderBlock& header)
+    {
+        std::ostringstream text;
+        text << header << std::endl;
+
+        record_.assign(BAM_MAGIC, sizeof(BAM_MAGIC));
+        appendInt32(record_, int32_t(text.str().size()));
+        record_.append(text.str());
+
+        refIds_.clear();
+        std::vector<const SamFileHeaderBlock*> refs;
+        BOOST_FOREACH(const SamFileHeaderBlock& b, header.children_)
+        {
+            if ("@SQ" == b.type_)
+                refs.push_back(&b);
+        }
+        appendInt32(record_, int32_t(refs.size()));
+        for(size_t ii=0; ii<refs.size(); ii++)
+        {
+            const std::string& name = refs[ii]->getChild("SN").value_;
+            uint32_t length = util::parseValue<uint32_t>(refs[ii]->getChild("LN").value_);
+            refIds_[name] = int32_t(ii);
+            appendInt32(record_, int32_t(name.size()+1));
+            record_.append(name.c_str(), name.size()+1);
+            appendUInt32(record_, length);
+        }
+        bgzf_->write(record_.data(), record_.size());
+    }
+
+    int32_t BamWriter::getRefId(const std::string& name) const
+    {
+        if ("*" == name)
+            return -1;
+        std::map<std::string, int32_t>::const_iterator it = refIds_.find(name);
+        if (refIds_.end() == it)
+            throw Exception("reference sequence not in the BAM header: "+name);
+        return it->second;
+    }
+
+    void BamWriter::write(const SamAlignment& a)
+    {
+        if (a.qname_.size() > 254)
+            throw Exception("read name too long for BAM: "+a.qname_);
+
+        int32_t refId = getRefId(a.rname_);
+        int32_t pos = int32_t(a.pos_) - 1;
+        int32_t nextRefId = "=" == a.mrnm_ ? refId : getRefId(a.mrnm_);
+        int32_t nextPos = int32_t(a.mpos_) - 1;
+
+        const Cigar::ParsedCigar& cigar = a.cigar_.getParsedCigar();
+        size_t cigarOpCount = a.hasCigar_ ? cigar.size() : 0;
+        int32_t end = pos + (a.hasCigar_ ? getReferenceLength(a.cigar_) : 0);
+        if (end <= pos)
+            end = pos + 1;
+
+        size_t seqLength = "*" == a.seq_ ? 0 : a.seq_.size();
+        bool hasQual = "*" != a.qual_ && a.qual_.size() == seqLength;
+
+        record_.clear();
+        appendInt32(record_, 0);                            // block_size, set below
+        appendInt32(record_, refId);
+        appendInt32(record_, pos);
+        appendUInt8(record_, uint8_t(a.qname_.size()+1));
+        appendUInt8(record_, uint8_t(a.mapq_));
+        appendUInt16(record_, reg2bin(pos, end));
+        appendUInt16(record_, uint16_t(cigarOpCount));
+        appendUInt16(record_, a.flag_);
+        appendInt32(record_, int32_t(seqLength));
+        appendInt32(record_, nextRefId);
+        appendInt32(record_, nextPos);
+        appendInt32(record_, a.isize_);
+        record_.append(a.qname_.c_str(), a.qname_.size()+1);
+
+        for(size_t ii=0; ii<cigarOpCount; ii++)
+            appendUInt32(record_, (uint32_t(cigar[ii].length_) << 4) | getCigarOp(cigar[ii].type_));
+
+        for(size_t ii=0; ii<seqLength; ii+=2)
+        {
+            uint8_t packed = seqCodes[a.seq_[ii]] << 4;
+            if (ii+1 < seqLength)
+                packed |= seqCodes[a.seq_[ii+1]];
+            appendUInt8(record_, packed);
+        }
+
+        for(size_t ii=0; ii<seqLength; ii++)
+            appendUInt8(record_, hasQual ? uint8_t(a.qual_[ii] - 33) : 0xff);
+
+        BOOST_FOREACH(const SamAlignment::Tag& tag, a.tags_)
+        {
+            CGA_ASSERT_EQ(2, tag.name_.size());
+            record_.append(tag.name_);
+            if ('Z' == tag.type_)
+            {
+                record_.push_back('Z');
+                record_.append(tag.string_.c_str(), tag.string_.size()+1);
+            }
+            else
+                appendIntTag(record_, tag.int_);
+        }
+
+        uint32_t blockSize = uint32_t(record_.size() - 4);
+        for(size_t ii=0; ii<4; ii++)
+            record_[ii] = char((blockSize >> (8*ii)) & 0xff);
+        bgzf_->write(record_.data(), record_.size());
+    }
+
+    void BamWriter::close()
+    {
+        if (closed_)
+            return;
+        closed_ = true;
+        static_cast<boost::iostreams::filtering_ostream&>(*bgzf_).reset();
+    }
+
+} } // cgatools::mapping
@@ -0,0 +1,131 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGA_TOOLS_BAM_WRITER_HPP_
+#define CGA_TOOLS_BAM_WRITER_HPP_ 1
+
+//! @file BamWriter.hpp
+//! File containing definitions of SamAlignment and BamWriter.
+
+#include "cgatools/core.hpp"
+#include "Cigar.hpp"
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace cgatools { namespace mapping {
+
+    class SamFileHeaderBlock;
+
+    //! The fields of one SAM record, as filled in by SamRecordGenerator,
+    //! to be written either as a line of SAM text or as a BAM record.
+    class SamAlignment
+    {
+    public:
+        //! An optional field: a string (type 'Z') or an integer (type
+        //! 'I' in SAM text, stored in BAM as the smallest fitting type).
+        class Tag
+        {
+        public:
+            Tag(const std::string& name, const std::string& value)
+                : name_(name), type_('Z'), string_(value), int_(0)
+            {}
+            Tag(const std::string& name, int64_t value)
+                : name_(name), type_('I'), int_(value)
+            {}
+
+            std::string name_;
+            char        type_;
+            std::string string_;
+            int64_t     int_;
+        };
+        typedef std::vector<Tag> Tags;
+
+        SamAlignment()
+            : flag_(0), pos_(0), mapq_(0), hasCigar_(false), mpos_(0), isize_(0)
+        {}
+
+        //! Resets all fields, keeping the allocated memory.
+        void clear();
+
+        void addTag(const std::string& name, const std::string& value)
+        {
+            tags_.push_back(Tag(name, value));
+        }
+
+        void addTag(const std::string& name, int64_t value)
+        {
+            tags_.push_back(Tag(name, value));
+        }
+
+        //! Writes the record as a line of SAM text.
+        void writeSam(std::ostream& out) const;
+
+        std::string qname_;
+        uint16_t    flag_;
+        //! The reference name, or "*".
+        std::string rname_;
+        //! 1-based position, 0 if none.
+        uint32_t    pos_;
+        int         mapq_;
+        //! The CIGAR, written as "*" if hasCigar_ is false.
+        Cigar       cigar_;
+        bool        hasCigar_;
+        //! The mate reference name: "*", "=" or a reference name.
+        std::string mrnm_;
+        //! 1-based mate position, 0 if none.
+        uint32_t    mpos_;
+        int         isize_;
+        std::string seq_;
+        std::string qual_;
+        Tags        tags_;
+    };
+
+    //! Writes BAM: the header and the records encoded in binary, in
+    //! BGZF blocks that are compressed on the ParallelCompression
+    //! threads (see --compression-threads).
+    class BamWriter : boost::noncopyable
+    {
+    public:
+        //! Writes the BAM file to out, which must outlive the writer.
+        explicit BamWriter(std::ostream& out);
+        ~BamWriter();
+
+        //! Writes the SAM header text, and the reference sequence
+        //! dictionary taken from its @SQ lines.
+        void writeHeader(const SamFileHeaderBlock& header);
+
+        //! Writes a record. Its reference names must be in the header.
+        void write(const SamAlignment& a);
+
+        //! Writes the end-of-file marker and flushes the output. Called
+        //! by the destructor if not called before.
+        void close();
+
+    private:
+        int32_t getRefId(const std::string& name) const;
+
+        boost::shared_ptr<std::ostream> bgzf_;
+        std::map<std::string, int32_t> refIds_;
+        std::string record_;
+        bool closed_;
+    };
+
+} } // cgatools::mapping
+
+#endif // CGA_TOOLS_BAM_WRITER_HPP_
@@ -18,43 +18,343 @@
 #include "cgatools/mapping/EvidenceCache.hpp"
 #include "cgatools/mapping/AlleleAlignment.hpp"
 #include "cgatools/mapping/LibraryData.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
+#include "cgatools/util/ThreadPool.hpp"
 #include <math.h>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <boost/bind.hpp>
+#include <boost/filesystem/convenience.hpp>
 #include <boost/foreach.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/lexical_cast.hpp>
 
 namespace cgatools { namespace mapping {
 
 
-void CacheOutStreams::writeMetadata(
-    std::ostream &output, const std::string& slide, const std::string& lane, size_t batchNo) const
+namespace {
+    const char MAGIC[4] = { 'C', 'E', 'C', '\n' };
+    const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+    const uint32_t VERSION = 1;
+
+    // The header of a binary cache file. It is followed by the
+    // records, and by the string data: the slide, the lane and the
+    // alignments. The file is written in the byte order of the
+    // machine, so that it can be memory-mapped.
+    struct FileHeader
+    {
+        char        magic_[4];
+        uint32_t    byteOrder_;
+        uint32_t    version_;
+        uint32_t    recordSize_;
+        uint64_t    recordCount_;
+        uint64_t    stringsSize_;
+        uint16_t    fileNumInLane_;
+        uint16_t    slideLength_;
+        uint16_t    laneLength_;
+        uint16_t    reserved_;
+    };
+
+    // Packs dnb into record, appending its alignments to strings,
+    // which start at stringsOffset in the string data of the file.
+    void packRecord(const cgdata::EvidenceReader::DnbRecord& dnb, double alleleConcordance,
+                    EvidenceCachePackedRecord& record, uint64_t stringsOffset, std::string& strings)
+    {
+        record.alleleConcordance_ = alleleConcordance;
+        record.dnbOffsetInLaneFile_ = dnb.dnbOffsetInLaneFile_;
+        record.intervalId_ = dnb.intervalId_;
+        record.offsetInAllele_ = dnb.offsetInAllele_;
+        record.offsetInReference_[0] = dnb.offsetInReference_[0];
+        record.offsetInReference_[1] = dnb.offsetInReference_[1];
+        record.chromosome_ = dnb.chromosome_;
+        record.alleleIndex_ = dnb.alleleIndex_;
+        record.side_ = dnb.side_;
+        record.strand_ = dnb.strand_;
+        record.mappingQuality_ = dnb.mappingQuality_;
+
+        const std::string* alignments[EvidenceCachePackedRecord::ALIGNMENT_COUNT] =
+            { &dnb.alleleAlignment_, &dnb.referenceAlignment_[0], &dnb.referenceAlignment_[1] };
+        for (size_t ii=0; ii<EvidenceCachePackedRecord::ALIGNMENT_COUNT; ++ii)
+        {
+            uint64_t offset = stringsOffset + strings.size();
+            if (alignments[ii]->size() > std::numeric_limits<uint16_t>::max() ||
+                offset > std::numeric_limits<uint32_t>::max() - alignments[ii]->size())
+                throw util::Exception("evidence cache record too large: " + dnb.getId());
+            record.alignmentOffset_[ii] = uint32_t(offset);
+            record.alignmentLength_[ii] = uint16_t(alignments[ii]->size());
+            strings.append(*alignments[ii]);
+        }
+    }
+
+    bool lessByDnbOffset(const EvidenceCachePackedRecord& r0, const EvidenceCachePackedRecord& r1)
+    {
+        return r0.dnbOffsetInLaneFile_ < r1.dnbOffsetInLaneFile_;
+    }
+
+    void initCacheRecordParser(
+        util::DelimitedFile &delimitedFile, EvidenceCacheDnbRecord& record, const reference::CrrFile& crr)
+    {
+        delimitedFile.addField(
+            util::ValueField<uint32_t>("DnbOffsetInLaneFile",&record.dnbOffsetInLaneFile_));
+        delimitedFile.addField(util::ValueField<int32_t>("IntervalId",&record.intervalId_));
+        delimitedFile.addField(util::ValueField<uint8_t>("AlleleIndex",&record.alleleIndex_));
+        delimitedFile.addField(reference::ChromosomeIdField("Chromosome",&record.chromosome_, crr));
+        delimitedFile.addField(util::SideField("Side",&record.side_));
+        delimitedFile.addField(util::StrandField("Strand",&(record.strand_)));
+        delimitedFile.addField(util::ValueField<int32_t>("OffsetInAllele",&record.offsetInAllele_));
+        delimitedFile.addField(util::StringField("AlleleAlignment",&record.alleleAlignment_));
+        delimitedFile.addField(util::ValueField<int32_t>("OffsetInReference",&record.offsetInReference_[0]));
+        delimitedFile.addField(util::StringField("ReferenceAlignment",&record.referenceAlignment_[0]));
+        delimitedFile.addField(
+            util::ValueField<int32_t>("MateOffsetInReference",&record.offsetInReference_[1]));
+        delimitedFile.addField(util::StringField("MateReferenceAlignment",&record.referenceAlignment_[1]));
+        delimitedFile.addField(util::CharField("MappingQuality",(char *)&record.mappingQuality_));
+        delimitedFile.addField(util::ValueField<double>("AlleleConcordance",&record.alleleConcordance_));
+    }
+}
+
+//! Reads the records of a run in turn.
+class CacheOutBatches::RunReader
+{
+public:
+    RunReader(const std::string& fileName, size_t runIndex)
+        : in_(fileName), runIndex_(runIndex)
+    {
+    }
+
+    //! Reads the next record, returning false at the end of the run.
+    bool next()
+    {
+        if (!in_.read(reinterpret_cast<char*>(&record_), sizeof(record_)))
+        {
+            if (0 != in_.gcount())
+                throw util::Exception("truncated temporary evidence cache file");
+            return false;
+        }
+        return true;
+    }
+
+    //! Orders the readers of a heap by record, then by run, so that
+    //! the records of the same DNB keep the order they were added in.
+    bool operator>(const RunReader& other) const
+    {
+        if (record_.dnbOffsetInLaneFile_ != other.record_.dnbOffsetInLaneFile_)
+            return record_.dnbOffsetInLaneFile_ > other.record_.dnbOffsetInLaneFile_;
+        return runIndex_ > other.runIndex_;
+    }
+
+    const EvidenceCachePackedRecord& getRecord() const {return record_;}
+
+private:
+    util::InputStream in_;
+    size_t runIndex_;
+    EvidenceCachePackedRecord record_;
+};
+
+namespace {
+    template <class Reader>
+    class GreaterReader
+    {
+    public:
+        bool operator()(const Reader* lhs, const Reader* rhs) const
+        {
+            return *lhs > *rhs;
+        }
+    };
+
+    void copyFile(const std::string& fileName, std::ostream& out)
+    {
+        util::InputStream in(fileName);
+        std::vector<char> buffer(1024*1024);
+        while (in)
+        {
+            in.read(&buffer[0], buffer.size());
+            out.write(&buffer[0], in.gcount());
+        }
+    }
+}
+
+CacheOutBatches::CacheOutBatches(const boost::filesystem::path& outputPrefix, size_t memory)
+    : outputPrefix_(outputPrefix),
+      memory_(memory),
+      usedMemory_(0),
+      runCount_(0)
+{
+}
+
+CacheOutBatches::~CacheOutBatches()
+{
+    try
+    {
+        for (Batches::iterator it=batches_.begin(); it!=batches_.end(); ++it)
+            removeRuns(*it->second);
+    }
+    catch (std::exception&)
+    {
+    }
+}
+
+void CacheOutBatches::add(const cgdata::EvidenceReader::DnbRecord& dnb, double alleleConcordance)
+{
+    std::string key = BaseLaneBatchStreams::getBatchStreamKey(dnb.slide_,dnb.lane_,dnb.fileNumInLane_);
+
+    Batches::iterator it = batches_.find(key);
+    if (it==batches_.end()) {
+        it = batches_.insert(it,key,new Batch());
+        Batch& batch = *it->second;
+        batch.slide_ = dnb.slide_;
+        batch.lane_ = dnb.lane_;
+        batch.fileNumInLane_ = dnb.fileNumInLane_;
+        batch.strings_ = dnb.slide_ + dnb.lane_;
+    }
+    Batch& batch = *it->second;
+    size_t stringsSize = batch.strings_.size();
+    batch.records_.push_back(EvidenceCachePackedRecord());
+    packRecord(dnb, alleleConcordance, batch.records_.back(),
+               batch.spilledStringsSize_, batch.strings_);
+    batch.recordCount_++;
+
+    usedMemory_ += sizeof(EvidenceCachePackedRecord) + batch.strings_.size() - stringsSize;
+    if (usedMemory_ >= memory_)
+        spill();
+}
+
+void CacheOutBatches::spill()
+{
+    boost::filesystem::create_directories(outputPrefix_);
+
+    for (Batches::iterator it=batches_.begin(); it!=batches_.end(); ++it)
+    {
+        Batch& batch = *it->second;
+        if (batch.records_.empty())
+            continue;
+        std::stable_sort(batch.records_.begin(), batch.records_.end(), lessByDnbOffset);
+
+        std::string run = boost::lexical_cast<std::string>(batch.recordRuns_.size());
+        batch.recordRuns_.push_back(getFileName(batch) + ".records" + run);
+        util::OutputStream records(batch.recordRuns_.back());
+        records.write(reinterpret_cast<const char*>(&batch.records_[0]),
+                      batch.records_.size()*sizeof(EvidenceCachePackedRecord));
+        records.close();
+
+        batch.stringRuns_.push_back(getFileName(batch) + ".strings" + run);
+        util::OutputStream strings(batch.stringRuns_.back());
+        strings.write(batch.strings_.data(), batch.strings_.size());
+        strings.close();
+
+        batch.spilledStringsSize_ += batch.strings_.size();
+        std::vector<EvidenceCachePackedRecord>().swap(batch.records_);
+        std::string().swap(batch.strings_);
+        runCount_++;
+    }
+    usedMemory_ = 0;
+}
+
+void CacheOutBatches::write()
+{
+    if (batches_.empty())
+        return;
+    boost::filesystem::create_directories(outputPrefix_);
+
+    while (!batches_.empty())
+    {
+        writeBatch(*batches_.begin()->second);
+        batches_.erase(batches_.begin());
+    }
+    usedMemory_ = 0;
+}
+
+void CacheOutBatches::writeBatch(Batch& batch)
+{
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic_, MAGIC, sizeof(MAGIC));
+    header.byteOrder_ = CACHE_BYTE_ORDER;
+    header.version_ = VERSION;
+    header.recordSize_ = sizeof(EvidenceCachePackedRecord);
+    header.recordCount_ = batch.recordCount_;
+    header.stringsSize_ = batch.spilledStringsSize_ + batch.strings_.size();
+    header.fileNumInLane_ = batch.fileNumInLane_;
+    header.slideLength_ = uint16_t(batch.slide_.size());
+    header.laneLength_ = uint16_t(batch.lane_.size());
+
+    util::OutputStream out(getFileName(batch));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::stable_sort(batch.records_.begin(), batch.records_.end(), lessByDnbOffset);
+    if (batch.recordRuns_.empty())
+    {
+        out.write(reinterpret_cast<const char*>(&batch.records_[0]),
+                  batch.records_.size()*sizeof(EvidenceCachePackedRecord));
+    }
+    else
+    {
+        // Merge the runs and the records still in memory, which come
+        // last in the order the records were added.
+        boost::ptr_vector<RunReader> readers;
+        std::priority_queue<RunReader*, std::vector<RunReader*>, GreaterReader<RunReader> > heap;
+        for (size_t ii=0; ii<batch.recordRuns_.size(); ++ii)
+        {
+            readers.push_back(new RunReader(batch.recordRuns_[ii], ii));
+            if (readers.back().next())
+                heap.push(&readers.back());
+        }
+        std::vector<EvidenceCachePackedRecord>::const_iterator inMemory = batch.records_.begin();
+        while (!heap.empty() || inMemory != batch.records_.end())
+        {
+            if (heap.empty() || (inMemory != batch.records_.end() &&
+                                 lessByDnbOffset(*inMemory, heap.top()->getRecord())))
+            {
+                out.write(reinterpret_cast<const char*>(&*inMemory), sizeof(*inMemory));
+                ++inMemory;
+                continue;
+            }
+            RunReader* reader = heap.top();
+            heap.pop();
+            out.write(reinterpret_cast<const char*>(&reader->getRecord()),
+                      sizeof(EvidenceCachePackedRecord));
+            if (reader->next())
+                heap.push(reader);
+        }
+    }
+    std::vector<EvidenceCachePackedRecord>().swap(batch.records_);
+
+    BOOST_FOREACH(const std::string& run, batch.stringRuns_)
+        copyFile(run, out);
+    out.write(batch.strings_.data(), batch.strings_.size());
+    out.close();
+
+    removeRuns(batch);
+}
+
+std::string CacheOutBatches::getFileName(const Batch& batch) const
 {
-    OutLaneBatchStreams::writeMetadata(output, slide, lane, batchNo);
+    std::string fileNum = boost::lexical_cast<std::string>(batch.fileNumInLane_);
+    return (outputPrefix_ / (batch.slide_+"-"+batch.lane_+"_"+fileNum+".bin")).string();
+}
 
-    output
-        << '>'  << "DnbOffsetInLaneFile"
-        << '\t' << "IntervalId"
-        << '\t' << "AlleleIndex"
-        << '\t' << "Chromosome"
-        << '\t' << "Side"
-        << '\t' << "Strand"
-        << '\t' << "OffsetInAllele"
-        << '\t' << "AlleleAlignment"
-        << '\t' << "OffsetInReference"
-        << '\t' << "ReferenceAlignment"
-        << '\t' << "MateOffsetInReference"
-        << '\t' << "MateReferenceAlignment"
-        << '\t' << "MappingQuality"
-        << '\t' << "AlleleConcordance"
-        << std::endl;
+void CacheOutBatches::removeRuns(Batch& batch)
+{
+    BOOST_FOREACH(const std::string& run, batch.recordRuns_)
+        boost::filesystem::remove(run);
+    BOOST_FOREACH(const std::string& run, batch.stringRuns_)
+        boost::filesystem::remove(run);
+    batch.recordRuns_.clear();
+    batch.stringRuns_.clear();
 }
 
 void EvidenceCacheBuilder::processChrData(uint16_t chr, 
-    const boost::filesystem::path& outputPrefix, const util::FastRangeSet::RangeSet &exportRanges)
+    const boost::filesystem::path& outputPrefix, const util::FastRangeSet::RangeSet &exportRanges,
+    size_t memory)
 {
     CGA_ASSERT(!exportRanges.empty());
 
     std::string chrName = reference_.listChromosomes()[chr].getName();
-    CacheOutStreams outStreams(outputPrefix/chrName);
+    CacheOutBatches outBatches(outputPrefix/chrName, memory);
     cgdata::EvidenceReader reader(reference_,genomeMetadata_);
     reader.seekToChr(chr);
 
@@ -110,33 +410,42 @@ void EvidenceCacheBuilder::processChrData(uint16_t chr,
 
             #endif //Check mapping quality
 
-            std::ostream& osr = outStreams.getBatchStream(dnb.slide_,dnb.lane_,dnb.fileNumInLane_);
-            osr << dnb.dnbOffsetInLaneFile_ 
-                << '\t' << dnb.intervalId_
-                << '\t' << int(dnb.alleleIndex_)
-                << '\t' << reference_.listChromosomes()[dnb.chromosome_].getName()
-                << '\t' << "LR"[dnb.side_]
-                << '\t' << "+-"[size_t(dnb.strand_)]
-                << '\t' << dnb.offsetInAllele_
-                << '\t' << dnb.alleleAlignment_
-                << '\t' << dnb.offsetInReference_[0]
-                << '\t' << dnb.referenceAlignment_[0]
-                << '\t' << dnb.offsetInReference_[1]
-                << '\t' << dnb.referenceAlignment_[1]
-                << '\t' << dnb.mappingQuality_
-                << '\t' << mapWeight
-                ;
-            osr << std::endl;
+            outBatches.add(dnb, mapWeight);
         }
     }
+    outBatches.write();
 }
 
 void EvidenceCacheBuilder::exportRanges(
-    const boost::filesystem::path& outputPrefix, const util::FastRangeSet& ranges)
+    const boost::filesystem::path& outputPrefix, const util::FastRangeSet& ranges,
+    size_t threadCount, size_t memory)
 {
+    std::vector<uint16_t> chromosomes;
     for (size_t i=0; i<ranges.getRanges().size(); ++i)
         if (!ranges.getRanges()[i].empty())
-            processChrData(i,outputPrefix,ranges.getRanges()[i]);
+            chromosomes.push_back(uint16_t(i));
+
+    // The assembly id is cached on first use, so look it up before the
+    // evidence readers are opened concurrently.
+    genomeMetadata_.getAsmId();
+
+    // Each chromosome holds its records in memory until it is written,
+    // so the chromosomes processed at a time share the memory.
+    size_t concurrentCount = std::max(size_t(1), std::min(threadCount, chromosomes.size()));
+
+    util::ThreadPool pool(concurrentCount);
+    pool.parallelFor(chromosomes.size(),
+        boost::bind(&EvidenceCacheBuilder::exportChromosome, this,
+                    boost::cref(outputPrefix), boost::cref(ranges), boost::cref(chromosomes),
+                    memory / concurrentCount, _1));
+}
+
+void EvidenceCacheBuilder::exportChromosome(
+    const boost::filesystem::path& outputPrefix, const util::FastRangeSet& ranges,
+    const std::vector<uint16_t>& chromosomes, size_t memory, size_t index)
+{
+    uint16_t chr = chromosomes[index];
+    processChrData(chr,outputPrefix,ranges.getRanges()[chr],memory);
 }
 
 EvidenceCacheBuilder::EvidenceCacheBuilder( const cgdata::GenomeMetadata& genomeMetadata,
@@ -146,52 +455,189 @@ EvidenceCacheBuilder::EvidenceCacheBuilder( const cgdata::GenomeMetadata& genome
     libraries_.reset(new LibraryMetadataContainer(genomeMetadata,false));
 }
 
-void EvidenceCacheReader::readBatchRecords(
-    const std::string& slide, const std::string& lane, size_t batchNo,
-    BatchRecords& result, const reference::CrrFile& crr)
+//! A cache file, memory-mapped or read into memory.
+class EvidenceCacheBatch::File
 {
-    size_t loadedRecords = 0;
-    const InputBatchFiles& files = inputBatches_.getBatchFiles(slide, lane, batchNo);
-    BOOST_FOREACH(const boost::filesystem::path& file, files)
+public:
+    File()
+        : records_(0), recordCount_(0), strings_(0), fileNumInLane_(0)
+    {}
+
+    boost::iostreams::mapped_file_source    mappedFile_;
+    std::vector<Record>                     ownRecords_;
+    std::string                             ownStrings_;
+
+    const Record*   records_;
+    size_t          recordCount_;
+    const char*     strings_;
+
+    std::string     slide_;
+    std::string     lane_;
+    uint16_t        fileNumInLane_;
+};
+
+EvidenceCacheBatch::EvidenceCacheBatch()
+{
+}
+
+EvidenceCacheBatch::~EvidenceCacheBatch()
+{
+}
+
+void EvidenceCacheBatch::clear()
+{
+    index_.clear();
+    files_.clear();
+}
+
+void EvidenceCacheBatch::addFile(const std::string& fileName, const reference::CrrFile& crr)
+{
+    files_.push_back(new File());
+    File& file = files_.back();
+    if (isBinaryFile(fileName))
+        readBinaryFile(fileName, crr, file);
+    else
+        readTextFile(fileName, crr, file);
+
+    // The records of each file are sorted, and the stable merge keeps
+    // the order of the files for the records of the same DNB.
+    size_t oldSize = index_.size();
+    index_.reserve(oldSize + file.recordCount_);
+    for (size_t ii=0; ii<file.recordCount_; ++ii)
+        index_.push_back(IndexEntry(file.records_+ii, &file));
+    std::inplace_merge(index_.begin(), index_.begin()+oldSize, index_.end());
+}
+
+std::pair<size_t,size_t> EvidenceCacheBatch::equalRange(uint32_t dnbOffsetInLaneFile) const
+{
+    Record key;
+    key.dnbOffsetInLaneFile_ = dnbOffsetInLaneFile;
+    std::pair<std::vector<IndexEntry>::const_iterator,std::vector<IndexEntry>::const_iterator> range
+        = std::equal_range(index_.begin(), index_.end(), IndexEntry(&key, 0));
+    return std::make_pair(range.first-index_.begin(), range.second-index_.begin());
+}
+
+void EvidenceCacheBatch::getRecord(size_t index, EvidenceCacheDnbRecord& record) const
+{
+    CGA_ASSERT_L(index, index_.size());
+    const Record& r = *index_[index].record_;
+    const File& file = *index_[index].file_;
+
+    record.slide_ = file.slide_;
+    record.lane_ = file.lane_;
+    record.fileNumInLane_ = file.fileNumInLane_;
+    record.alleleConcordance_ = r.alleleConcordance_;
+    record.dnbOffsetInLaneFile_ = r.dnbOffsetInLaneFile_;
+    record.intervalId_ = r.intervalId_;
+    record.offsetInAllele_ = r.offsetInAllele_;
+    record.offsetInReference_[0] = r.offsetInReference_[0];
+    record.offsetInReference_[1] = r.offsetInReference_[1];
+    record.chromosome_ = r.chromosome_;
+    record.alleleIndex_ = r.alleleIndex_;
+    record.side_ = r.side_;
+    record.strand_ = 0 != r.strand_;
+    record.mappingQuality_ = r.mappingQuality_;
+
+    std::string* alignments[Record::ALIGNMENT_COUNT] =
+        { &record.alleleAlignment_, &record.referenceAlignment_[0], &record.referenceAlignment_[1] };
+    for (size_t ii=0; ii<Record::ALIGNMENT_COUNT; ++ii)
+        alignments[ii]->assign(file.strings_ + r.alignmentOffset_[ii], r.alignmentLength_[ii]);
+}
+
+bool EvidenceCacheBatch::isBinaryFile(const std::string& fileName)
+{
+    try
     {
-        boost::shared_ptr<std::istream> inStream 
-            = util::InputStream::openCompressedInputStreamByExtension(file.string());
-        util::DelimitedFile parser(*inStream, file.string());
-        EvidenceCacheDnbRecord record;
-        initCacheRecordParser(parser,record,crr);
-        const std::string &slide = parser.getMetadata().get("SLIDE");
-        const std::string &lane = parser.getMetadata().get("LANE");
-        uint16_t fileNum = parser.getMetadata().get<uint16_t>("BATCH_FILE_NUMBER");
-        while (parser.next()) 
+        util::InputStream in(fileName);
+        char magic[sizeof(MAGIC)];
+        in.read(magic, sizeof(magic));
+        return size_t(in.gcount()) == sizeof(magic) &&
+            0 == std::memcmp(magic, MAGIC, sizeof(MAGIC));
+    }
+    catch(std::exception&)
+    {
+        return false;
+    }
+}
+
+void EvidenceCacheBatch::readTextFile(
+    const std::string& fileName, const reference::CrrFile& crr, File& file)
+{
+    boost::shared_ptr<std::istream> inStream 
+        = util::InputStream::openCompressedInputStreamByExtension(fileName);
+    util::DelimitedFile parser(*inStream, fileName);
+    EvidenceCacheDnbRecord record;
+    initCacheRecordParser(parser,record,crr);
+    file.slide_ = parser.getMetadata().get("SLIDE");
+    file.lane_ = parser.getMetadata().get("LANE");
+    file.fileNumInLane_ = parser.getMetadata().get<uint16_t>("BATCH_FILE_NUMBER");
+    while (parser.next()) 
+    {
+        file.ownRecords_.push_back(Record());
+        packRecord(record, record.alleleConcordance_, file.ownRecords_.back(), 0, file.ownStrings_);
+    }
+    std::stable_sort(file.ownRecords_.begin(), file.ownRecords_.end(), lessByDnbOffset);
+
+    file.recordCount_ = file.ownRecords_.size();
+    file.records_ = file.ownRecords_.empty() ? 0 : &file.ownRecords_[0];
+    file.strings_ = file.ownStrings_.data();
+}
+
+void EvidenceCacheBatch::readBinaryFile(
+    const std::string& fileName, const reference::CrrFile& crr, File& file)
+{
+    file.mappedFile_.open(fileName);
+    const char* data = file.mappedFile_.data();
+    size_t size = file.mappedFile_.size();
+
+    FileHeader header;
+    if (size < sizeof(header))
+        throw util::Exception("truncated evidence cache file: " + fileName);
+    std::memcpy(&header, data, sizeof(header));
+    if (CACHE_BYTE_ORDER != header.byteOrder_ || 
+        sizeof(Record) != header.recordSize_)
+        throw util::Exception("evidence cache file written on an incompatible platform: " + fileName);
+    if (VERSION != header.version_)
+        throw util::Exception("unsupported evidence cache file version: " + fileName);
+    // The counts are checked against the file size by division, so
+    // that corrupt counts cannot overflow.
+    if (header.recordCount_ > (size - sizeof(header)) / sizeof(Record) ||
+        header.stringsSize_ != size - sizeof(header) - header.recordCount_*sizeof(Record) ||
+        header.stringsSize_ < uint64_t(header.slideLength_) + header.laneLength_)
+        throw util::Exception("corrupt evidence cache file: " + fileName);
+
+    file.records_ = reinterpret_cast<const Record*>(data + sizeof(header));
+    file.recordCount_ = header.recordCount_;
+    file.strings_ = data + sizeof(header) + header.recordCount_*sizeof(Record);
+    file.slide_.assign(file.strings_, header.slideLength_);
+    file.lane_.assign(file.strings_ + header.slideLength_, header.laneLength_);
+    file.fileNumInLane_ = header.fileNumInLane_;
+
+    for (size_t ii=0; ii<file.recordCount_; ++ii)
+    {
+        const Record& r = file.records_[ii];
+        if (r.chromosome_ >= crr.listChromosomes().size())
+            throw util::Exception("corrupt evidence cache file: " + fileName);
+        for (size_t jj=0; jj<Record::ALIGNMENT_COUNT; ++jj)
         {
-            record.slide_ = slide;
-            record.lane_ = lane;
-            record.fileNumInLane_ = fileNum;
-            result.insert(BatchRecords::value_type(record.dnbOffsetInLaneFile_,record));
-            ++loadedRecords;
+            if (uint64_t(r.alignmentOffset_[jj]) + r.alignmentLength_[jj] > header.stringsSize_)
+                throw util::Exception("corrupt evidence cache file: " + fileName);
         }
+        if (ii>0 && r.dnbOffsetInLaneFile_ < file.records_[ii-1].dnbOffsetInLaneFile_)
+            throw util::Exception("unsorted evidence cache file: " + fileName);
     }
+}
+
+void EvidenceCacheReader::readBatchRecords(
+    const std::string& slide, const std::string& lane, size_t batchNo,
+    EvidenceCacheBatch& result, const reference::CrrFile& crr) const
+{
+    result.clear();
+    const InputBatchFiles& files = inputBatches_.getBatchFiles(slide, lane, batchNo);
+    BOOST_FOREACH(const boost::filesystem::path& file, files)
+        result.addFile(file.string(), crr);
     std::cerr   << "Processed evidence cache files: " << files.size() 
-                << " loaded records: " << loadedRecords << std::endl;
-}
-
-void EvidenceCacheReader::initCacheRecordParser( 
-    util::DelimitedFile &delimitedFile, EvidenceCacheDnbRecord& record, const reference::CrrFile& crr)
-{
-    delimitedFile.addField(util::ValueField<uint32_t>("DnbOffsetInLaneFile",&record.dnbOffsetInLaneFile_));
-    delimitedFile.addField(util::ValueField<int32_t>("IntervalId",&record.intervalId_));
-    delimitedFile.addField(util::ValueField<uint8_t>("AlleleIndex",&record.alleleIndex_));
-    delimitedFile.addField(reference::ChromosomeIdField("Chromosome",&record.chromosome_, crr));
-    delimitedFile.addField(util::SideField("Side",&record.side_));
-    delimitedFile.addField(util::StrandField("Strand",&(record.strand_)));
-    delimitedFile.addField(util::ValueField<int32_t>("OffsetInAllele",&record.offsetInAllele_));
-    delimitedFile.addField(util::StringField("AlleleAlignment",&record.alleleAlignment_));
-    delimitedFile.addField(util::ValueField<int32_t>("OffsetInReference",&record.offsetInReference_[0]));
-    delimitedFile.addField(util::StringField("ReferenceAlignment",&record.referenceAlignment_[0]));
-    delimitedFile.addField(util::ValueField<int32_t>("MateOffsetInReference",&record.offsetInReference_[1]));
-    delimitedFile.addField(util::StringField("MateReferenceAlignment",&record.referenceAlignment_[1]));
-    delimitedFile.addField(util::CharField("MappingQuality",(char *)&record.mappingQuality_));
-    delimitedFile.addField(util::ValueField<double>("AlleleConcordance",&record.alleleConcordance_));
+                << " loaded records: " << result.size() << std::endl;
 }
 
 } } // cgatools::mapping
@@ -22,6 +22,13 @@
 #include "cgatools/cgdata/EvidenceReader.hpp"
 #include "cgatools/mapping/LaneBatchCache.hpp"
 
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace cgatools { namespace cgdata {
     class GenomeMetadata;
 }}
@@ -37,19 +44,6 @@ namespace cgatools { namespace util {
 
 namespace cgatools { namespace mapping {
 
-class CacheOutStreams : public OutLaneBatchStreams
-{
-public:
-    CacheOutStreams(const boost::filesystem::path& outputPrefix)
-        :OutLaneBatchStreams(outputPrefix, "EVIDENCE_CACHE")
-    {}
-
-protected:
-    virtual void writeMetadata(std::ostream &output,
-        const std::string& slide, const std::string& lane, size_t batchNo) const;
-};
-
-
 class LibraryMetadataContainer;
 
 class EvidenceCacheBuilder 
@@ -57,12 +51,22 @@ class EvidenceCacheBuilder
 public:
     EvidenceCacheBuilder(const cgdata::GenomeMetadata& genomeMetadata,const reference::CrrFile& reference);
 
+    //! Writes the cache of a chromosome, holding at most about memory
+    //! bytes of records in memory (see CacheOutBatches).
     void processChrData(uint16_t chr, const boost::filesystem::path& outputPrefix, 
-        const util::FastRangeSet::RangeSet &exportRanges);
+        const util::FastRangeSet::RangeSet &exportRanges, size_t memory);
 
-    void exportRanges(const boost::filesystem::path& outputPrefix, const util::FastRangeSet& ranges);
+    //! Writes the cache of each chromosome with ranges into its own
+    //! subdirectory of outputPrefix, processing threadCount chromosomes
+    //! at a time, which share memory bytes for their records. The
+    //! output does not depend on threadCount or memory.
+    void exportRanges(const boost::filesystem::path& outputPrefix, const util::FastRangeSet& ranges,
+                      size_t threadCount, size_t memory);
 
 protected:
+    void exportChromosome(const boost::filesystem::path& outputPrefix, const util::FastRangeSet& ranges,
+                          const std::vector<uint16_t>& chromosomes, size_t memory, size_t index);
+
     boost::shared_ptr<LibraryMetadataContainer> libraries_;
 
     const cgdata::GenomeMetadata&           genomeMetadata_;
@@ -75,7 +79,162 @@ public:
     double                   alleleConcordance_;
 };
 
-typedef std::multimap<uint64_t,EvidenceCacheDnbRecord> BatchRecords;
+//! An evidence cache record of fixed size, as stored in the binary
+//! cache files. The alignments are kept in the string data that
+//! follows the records, at alignmentOffset_, so that the records of
+//! a memory-mapped file can be used in place.
+struct EvidenceCachePackedRecord
+{
+    enum Alignment
+    {
+        ALLELE_ALIGNMENT = 0,
+        REFERENCE_ALIGNMENT,
+        MATE_REFERENCE_ALIGNMENT,
+        ALIGNMENT_COUNT
+    };
+
+    double      alleleConcordance_;
+    uint32_t    dnbOffsetInLaneFile_;
+    int32_t     intervalId_;
+    int32_t     offsetInAllele_;
+    int32_t     offsetInReference_[2];
+    uint32_t    alignmentOffset_[ALIGNMENT_COUNT];
+    uint16_t    alignmentLength_[ALIGNMENT_COUNT];
+    uint16_t    chromosome_;
+    uint8_t     alleleIndex_;
+    uint8_t     side_;
+    uint8_t     strand_;
+    uint8_t     mappingQuality_;
+};
+
+//! Collects the evidence cache records of a chromosome by lane batch,
+//! and writes each lane batch into a binary cache file with the
+//! records sorted by DnbOffsetInLaneFile. The records are held in
+//! memory up to a budget; beyond it the records of each lane batch
+//! are sorted in place and written in a run to a temporary file in
+//! the output directory, and write() merges the runs of each lane
+//! batch into its cache file.
+class CacheOutBatches : boost::noncopyable
+{
+public:
+    //! The default memory budget, in bytes.
+    static const size_t DEFAULT_MEMORY = size_t(1024)*1024*1024;
+
+    //! Holds at most about memory bytes of records and alignments.
+    CacheOutBatches(const boost::filesystem::path& outputPrefix, size_t memory = DEFAULT_MEMORY);
+
+    //! Removes the temporary files that remain.
+    ~CacheOutBatches();
+
+    void add(const cgdata::EvidenceReader::DnbRecord& dnb, double alleleConcordance);
+
+    //! Writes a file per lane batch, named SLIDE-LANE_BATCH.bin, and
+    //! releases the memory of each lane batch once it is written.
+    void write();
+
+    //! The number of temporary runs written so far.
+    size_t getRunCount() const {return runCount_;}
+
+protected:
+    class Batch
+    {
+    public:
+        Batch()
+            : fileNumInLane_(0), recordCount_(0), spilledStringsSize_(0)
+        {}
+
+        std::string slide_;
+        std::string lane_;
+        uint16_t    fileNumInLane_;
+
+        //! The records and the string data not yet written to a run.
+        std::vector<EvidenceCachePackedRecord> records_;
+        std::string strings_;
+
+        //! The number of records added, and the size of the string
+        //! data written to runs.
+        uint64_t    recordCount_;
+        uint64_t    spilledStringsSize_;
+
+        //! The temporary files of the records and of the string data
+        //! of each run, in the order written.
+        std::vector<std::string> recordRuns_;
+        std::vector<std::string> stringRuns_;
+    };
+    typedef boost::ptr_map<std::string,Batch> Batches;
+
+    class RunReader;
+
+    void spill();
+    void writeBatch(Batch& batch);
+    std::string getFileName(const Batch& batch) const;
+    static void removeRuns(Batch& batch);
+
+    boost::filesystem::path outputPrefix_;
+    size_t                  memory_;
+    size_t                  usedMemory_;
+    size_t                  runCount_;
+    Batches                 batches_;
+};
+
+//! The evidence cache records of a lane batch, sorted by
+//! DnbOffsetInLaneFile, and taken from one or more cache files. The
+//! binary files are memory-mapped and their records used in place;
+//! the text files of older caches are parsed into the same format.
+class EvidenceCacheBatch : boost::noncopyable
+{
+public:
+    typedef EvidenceCachePackedRecord Record;
+
+    EvidenceCacheBatch();
+    ~EvidenceCacheBatch();
+
+    void clear();
+
+    //! Adds the records of a binary or text cache file. The records
+    //! with the same DnbOffsetInLaneFile keep the order of the files,
+    //! and of the records within each file.
+    void addFile(const std::string& fileName, const reference::CrrFile& crr);
+
+    size_t size() const
+    {
+        return index_.size();
+    }
+
+    //! The range of the indices of the records of a DNB.
+    std::pair<size_t,size_t> equalRange(uint32_t dnbOffsetInLaneFile) const;
+
+    //! Copies a record, found by equalRange(), into record.
+    void getRecord(size_t index, EvidenceCacheDnbRecord& record) const;
+
+    //! Returns true if fileName starts with the binary cache file header.
+    static bool isBinaryFile(const std::string& fileName);
+
+protected:
+    class File;
+
+    class IndexEntry
+    {
+    public:
+        IndexEntry(const Record* record, const File* file)
+            : record_(record), file_(file)
+        {}
+
+        bool operator<(const IndexEntry& other) const
+        {
+            return record_->dnbOffsetInLaneFile_ < other.record_->dnbOffsetInLaneFile_;
+        }
+
+        const Record*   record_;
+        const File*     file_;
+    };
+
+    void readTextFile(const std::string& fileName, const reference::CrrFile& crr, File& file);
+    void readBinaryFile(const std::string& fileName, const reference::CrrFile& crr, File& file);
+
+    boost::ptr_vector<File>     files_;
+    std::vector<IndexEntry>     index_;
+};
 
 class EvidenceCacheReader
 {
@@ -89,14 +248,11 @@ public:
         inputBatches_.collectFiles();
     }
 
+    //! Reads the records of a lane batch. Safe to call concurrently.
     void readBatchRecords(const std::string& slide, const std::string& lane, size_t batchNo, 
-                                            BatchRecords& result, const reference::CrrFile& crr);
+                                    EvidenceCacheBatch& result, const reference::CrrFile& crr) const;
 
 protected:
-
-    static void initCacheRecordParser(
-        util::DelimitedFile& delimitedFile, EvidenceCacheDnbRecord& record, const reference::CrrFile& crr);
-
     InLaneBatchStreams      inputBatches_;
 };
 
@@ -169,26 +169,38 @@ namespace cgatools { namespace mapping {
         size_t halfDnbSize, 
         const reference::CrrFile& reference
         ) 
-    :   
-        SamRecord(
-        evidenceRecord.getId()
-        ,true
-        ,evidenceRecord.strand_
-        ,isPrimary
-        ,(evidenceRecord.side_==mate) ? 0:1
-        ,evidenceRecord.chromosome_
-        ,evidenceRecord.offsetInReference_[mate]
-        ,evidenceRecord.referenceAlignment_[mate]
-        ,evidenceRecord.mappingQuality_-33
-        ,true
-        ,sequence
-        ,scores
-        ,std::make_pair((evidenceRecord.side_==mate) ? 0:halfDnbSize,halfDnbSize)
-        )
-        ,intervalId_(evidenceRecord.intervalId_)
-        ,alleleIndex_(evidenceRecord.alleleIndex_)
-        ,armWeight_(evidenceRecord.alleleConcordance_)
     {
+        init(evidenceRecord, sequence, scores, isPrimary, mate, halfDnbSize, reference);
+    }
+
+    void EvidenceSamRecord::init( 
+        const EvidenceCacheDnbRecord& evidenceRecord, 
+        const std::string& sequence,
+        const std::string& scores,
+        bool isPrimary, 
+        uint8_t mate, 
+        size_t halfDnbSize, 
+        const reference::CrrFile& reference
+        ) 
+    {
+        SamRecord::init(
+            evidenceRecord.getId()
+            ,true
+            ,evidenceRecord.strand_
+            ,isPrimary
+            ,(evidenceRecord.side_==mate) ? 0:1
+            ,evidenceRecord.chromosome_
+            ,evidenceRecord.offsetInReference_[mate]
+            ,evidenceRecord.referenceAlignment_[mate]
+            ,evidenceRecord.mappingQuality_-33
+            ,true
+            ,sequence
+            ,scores
+            ,std::make_pair((evidenceRecord.side_==mate) ? 0:halfDnbSize,halfDnbSize)
+            );
+        intervalId_ = evidenceRecord.intervalId_;
+        alleleIndex_ = evidenceRecord.alleleIndex_;
+        armWeight_ = evidenceRecord.alleleConcordance_;
         typeId_ = EVIDENCE_CACHE;
     }
 
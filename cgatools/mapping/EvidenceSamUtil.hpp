@@ -72,6 +72,8 @@ namespace cgatools { namespace mapping {
     class EvidenceSamRecord : public SamRecord
     {
     public:
+        EvidenceSamRecord() : intervalId_(0), alleleIndex_(0), armWeight_(-1) {}
+
         EvidenceSamRecord(
             const EvidenceDnbRecord& evidenceRecord,
             bool isPrimary,
@@ -90,6 +92,18 @@ namespace cgatools { namespace mapping {
             const reference::CrrFile& reference
             );
 
+        //! Sets the record as the evidence cache constructor does,
+        //! reusing its memory.
+        void init(
+            const EvidenceCacheDnbRecord& evidenceRecord,
+            const std::string& sequence,
+            const std::string& scores,
+            bool isPrimary,
+            uint8_t mate,
+            size_t halfDnbSize,
+            const reference::CrrFile& reference
+            );
+
         size_t  intervalId_;
         int     alleleIndex_;
         double  armWeight_;
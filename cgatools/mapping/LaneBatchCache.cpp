@@ -16,6 +16,7 @@
 #include "cgatools/util/parse.hpp"
 #include "cgatools/util/BaseUtil.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/Exception.hpp"
 #include "cgatools/util/Files.hpp"
 #include "cgatools/mapping/LaneBatchCache.hpp"
 
@@ -24,6 +25,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 
+#include <iostream>
+
 using namespace std;
 
 namespace cgatools { namespace mapping {
@@ -34,6 +37,19 @@ std::string BaseLaneBatchStreams::getBatchStreamKey(
     return slide + "-" + lane + "_" + boost::lexical_cast<string>(batchNo);
 }
 
+const size_t OutLaneBatchStreams::DEFAULT_MAX_OPEN_FILES;
+const size_t OutLaneBatchStreams::STAGING_SIZE;
+
+OutLaneBatchStreams::~OutLaneBatchStreams()
+{
+    try {
+        close();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        CGA_ASSERT(false);
+    }
+}
+
 std::ostream& OutLaneBatchStreams::getBatchStream( 
     const std::string& slide, const std::string& lane, size_t batchNo)
 {
@@ -44,11 +60,60 @@ std::ostream& OutLaneBatchStreams::getBatchStream(
         std::string fileNum = boost::lexical_cast<std::string>(batchNo);
         boost::filesystem::create_directories(outputPrefix_);
         boost::filesystem::path outputFile = outputPrefix_ / (slide+"-"+lane+"_"+fileNum+".tsv.gz");
-        it = outputLanes_.insert(it,key,
-            new util::CompressedOutputStream(outputFile.string()));
-        writeMetadata(*it->second, slide, lane, batchNo);
+        it = outputLanes_.insert(it,key,new LaneBatch(*this, outputFile.string()));
+        writeMetadata(it->second->stream_, slide, lane, batchNo);
+    }
+    return it->second->stream_;
+}
+
+void OutLaneBatchStreams::close()
+{
+    for (OutputLaneBatches::iterator it=outputLanes_.begin(); it!=outputLanes_.end(); ++it)
+    {
+        it->second->stream_.flush();
+        closeFile(*it->second);
+    }
+}
+
+std::streamsize OutLaneBatchStreams::LaneBatchSink::write(const char* s, std::streamsize n)
+{
+    owner_->write(*batch_, s, n);
+    return n;
+}
+
+void OutLaneBatchStreams::write(LaneBatch& batch, const char* s, size_t n)
+{
+    if (0 == n)
+        return;
+
+    if (batch.file_)
+    {
+        openBatches_.splice(openBatches_.begin(), openBatches_, batch.openPos_);
     }
-    return *it->second;
+    else
+    {
+        if (openBatches_.size() >= maxOpenFiles_)
+            closeFile(*openBatches_.back());
+        batch.file_.reset(new util::CompressedOutputStream());
+        if (batch.created_)
+            batch.file_->openForAppend(batch.fileName_);
+        else
+            batch.file_->open(batch.fileName_);
+        batch.created_ = true;
+        openBatches_.push_front(&batch);
+        batch.openPos_ = openBatches_.begin();
+    }
+    batch.file_->write(s, n);
+}
+
+void OutLaneBatchStreams::closeFile(LaneBatch& batch)
+{
+    if (!batch.file_)
+        return;
+    openBatches_.erase(batch.openPos_);
+    boost::scoped_ptr<util::CompressedOutputStream> file;
+    file.swap(batch.file_);
+    file->close();
 }
 
 void OutLaneBatchStreams::writeMetadata( 
@@ -77,7 +142,7 @@ void OutLaneBatchStreams::writeMetadata(
 
 void InLaneBatchStreams::collectFiles()
 {
-    boost::regex re("^(.+)-(L[0-9]+)_([0-9]+)\\.tsv(\\.bz2|\\.gz)?$");
+    boost::regex re("^(.+)-(L[0-9]+)_([0-9]+)\\.(tsv(\\.bz2|\\.gz)?|bin)$");
     std::vector<boost::filesystem::path> filesFound;
     util::files::findFiles(inputRoot_,"GS.*",filesFound,true,false);
     BOOST_FOREACH(const boost::filesystem::path& fname,filesFound)
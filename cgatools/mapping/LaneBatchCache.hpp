@@ -21,8 +21,12 @@
 #include "cgatools/util/Streams.hpp"
 
 #include <boost/filesystem/path.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
+#include <boost/scoped_ptr.hpp>
 
+#include <list>
 #include <vector>
 
 namespace cgatools { namespace util {
@@ -37,28 +41,45 @@ public:
     static std::string getBatchStreamKey(const std::string& slide, const std::string& lane, size_t batchNo);
 };
 
-//! creates a family of lane/batch files and generates standard metadata header
-class OutLaneBatchStreams : public BaseLaneBatchStreams
+//! creates a family of lane/batch files and generates standard metadata header.
+//! The output of each lane batch is staged in a buffer of STAGING_SIZE
+//! bytes, and at most maxOpenFiles files are open at a time: to write
+//! another, the least recently written file is closed, and is reopened
+//! later to append a gzip member. So the compressor states and file
+//! descriptors do not grow with the number of lane batches.
+class OutLaneBatchStreams : public BaseLaneBatchStreams, boost::noncopyable
 {
 public:
-    typedef boost::ptr_map<std::string,util::CompressedOutputStream> OutputLaneBatches;
+    static const size_t DEFAULT_MAX_OPEN_FILES = 64;
+    static const size_t STAGING_SIZE = 64*1024;
 
-    OutLaneBatchStreams(const boost::filesystem::path& outputPrefix, const std::string & fileType)
-        :outputPrefix_(outputPrefix), fileType_(fileType)
-    {}
+    OutLaneBatchStreams(const boost::filesystem::path& outputPrefix, const std::string & fileType,
+                        size_t maxOpenFiles = DEFAULT_MAX_OPEN_FILES)
+        :outputPrefix_(outputPrefix), fileType_(fileType), maxOpenFiles_(maxOpenFiles)
+    {
+        CGA_ASSERT(maxOpenFiles_ > 0);
+    }
 
     OutLaneBatchStreams(
         const boost::filesystem::path& outputPrefix, 
         const std::string & fileType,
-        const std::string & headerLine
+        const std::string & headerLine,
+        size_t maxOpenFiles = DEFAULT_MAX_OPEN_FILES
     )
-        :outputPrefix_(outputPrefix), fileType_(fileType), headerLine_(headerLine)
-    {}
+        :outputPrefix_(outputPrefix), fileType_(fileType), headerLine_(headerLine),
+         maxOpenFiles_(maxOpenFiles)
+    {
+        CGA_ASSERT(maxOpenFiles_ > 0);
+    }
 
-    virtual ~OutLaneBatchStreams() {}
+    virtual ~OutLaneBatchStreams();
 
     std::ostream& getBatchStream(const std::string& slide, const std::string& lane, size_t batchNo);
 
+    //! Writes the staged output of all lane batches and closes their
+    //! files. The destructor does the same, but cannot report errors.
+    void close();
+
 protected:
     virtual void writeMetadata(std::ostream &output,
                     const std::string& slide, const std::string& lane, size_t batchNo) const;
@@ -68,7 +89,57 @@ protected:
     boost::filesystem::path outputPrefix_;
     const std::string       fileType_;
     const std::string       headerLine_;
+
+private:
+    class LaneBatch;
+
+    //! Writes the staged output of a lane batch to its file.
+    class LaneBatchSink
+    {
+    public:
+        typedef char char_type;
+        typedef boost::iostreams::sink_tag category;
+
+        LaneBatchSink(OutLaneBatchStreams& owner, LaneBatch& batch)
+            : owner_(&owner), batch_(&batch)
+        {}
+
+        std::streamsize write(const char* s, std::streamsize n);
+
+    private:
+        OutLaneBatchStreams*    owner_;
+        LaneBatch*              batch_;
+    };
+
+    class LaneBatch
+    {
+    public:
+        LaneBatch(OutLaneBatchStreams& owner, const std::string& fileName)
+            : fileName_(fileName), created_(false)
+        {
+            stream_.open(LaneBatchSink(owner, *this), STAGING_SIZE);
+            stream_.exceptions(std::ios::badbit | std::ios::failbit);
+        }
+
+        std::string                                     fileName_;
+        //! Whether the file has been opened before, so that it is
+        //! appended to rather than replaced.
+        bool                                            created_;
+        boost::scoped_ptr<util::CompressedOutputStream> file_;
+        //! The position in openBatches_, if file_ is open.
+        std::list<LaneBatch*>::iterator                 openPos_;
+        boost::iostreams::stream<LaneBatchSink>         stream_;
+    };
+
+    typedef boost::ptr_map<std::string,LaneBatch> OutputLaneBatches;
+
+    void write(LaneBatch& batch, const char* s, size_t n);
+    void closeFile(LaneBatch& batch);
+
+    size_t                  maxOpenFiles_;
     OutputLaneBatches       outputLanes_;
+    //! The lane batches with open files, the most recently written first.
+    std::list<LaneBatch*>   openBatches_;
 };
 
 class InLaneBatchStreams : public BaseLaneBatchStreams
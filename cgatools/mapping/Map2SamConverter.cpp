@@ -14,6 +14,7 @@
 
 #include "cgatools/core.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/ThreadPool.hpp"
 #include "cgatools/cgdata/GenomeMetadata.hpp"
 #include "Map2SamConverter.hpp"
 #include "LibraryData.hpp"
@@ -30,6 +31,11 @@
 
 namespace cgatools { namespace mapping {
 
+    namespace {
+        // The number of DNBs per thread converted in parallel at once.
+        const size_t DNB_BATCH_SIZE = 256;
+    }
+
     Map2SamConverter::Map2SamConverter( const Map2SamConfig &config, std::ostream &outSamFile ) 
         : batchNumber_(0), formatVersion_(0), outSamFile_(outSamFile), config_(config)
     {
@@ -45,39 +51,66 @@ namespace cgatools { namespace mapping {
         readsRecord.initParser(*readsFile_);
         mapping::MappingsRecord mappingsRecord;
         mappingsRecord.initParser(*mappingsFile_);
-        mapping::MappingsRecords baseMappings;
+
+        // The DNBs are read and written in batches, and converted in
+        // parallel. The debug info is written while converting, so it
+        // needs a single thread.
+        util::ThreadPool pool(config_.dumpDebugInfo_ ? 1 : config_.threadCount_);
+        DnbBatch batch(1 == pool.size() ? 1 : DNB_BATCH_SIZE * pool.size());
 
         int readRecordIndex = -1;
-        while (readsFile_->next()) 
+        bool done = false;
+        while (!done)
         {
-            readsRecord.recordIndex_ = ++readRecordIndex;
-            baseMappings.clear();
-            if (!readsRecord.flags_.NoMappings()) 
+            size_t batchSize = 0;
+            while (batchSize < batch.size())
             {
-                int mappingRecordIndex = -1;
-                while (mappingsFile_->next()) {
-                    mappingsRecord.recordIndex_ = ++mappingRecordIndex;
-                    baseMappings.push_back(mappingsRecord);
-                    if (mappingsRecord.flags_.LastDnbRecord())
-                        break;
+                if (!readsFile_->next())
+                {
+                    done = true;
+                    break;
                 }
-                CGA_ASSERT_MSG(!baseMappings.empty(),
-                    "The mappings and reads files are not in sync. Excess of reads.");
-            } else {
-                // Don't output SAM records for the DNBs that have no mappings
-                if (config_.samGeneratorConfig_.skipNotMapped_)
+                readsRecord.recordIndex_ = ++readRecordIndex;
+                mapping::MappingsRecords& baseMappings = batch[batchSize].mappingsRecords_;
+                baseMappings.clear();
+                if (!readsRecord.flags_.NoMappings()) 
+                {
+                    int mappingRecordIndex = -1;
+                    while (mappingsFile_->next()) {
+                        mappingsRecord.recordIndex_ = ++mappingRecordIndex;
+                        baseMappings.push_back(mappingsRecord);
+                        if (mappingsRecord.flags_.LastDnbRecord())
+                            break;
+                    }
+                    CGA_ASSERT_MSG(!baseMappings.empty(),
+                        "The mappings and reads files are not in sync. Excess of reads.");
+                } else {
+                    // Don't output SAM records for the DNBs that have no mappings
+                    if (config_.samGeneratorConfig_.skipNotMapped_)
+                        continue;
+                }
+
+                if (size_t(readRecordIndex) < config_.recordsFrom_)
                     continue;
+                else if (size_t(readRecordIndex) >= config_.recordsTo_)
+                {
+                    done = true;
+                    break;
+                }
+
+                batch[batchSize++].readsRecord_ = readsRecord;
             }
 
-            if (size_t(readRecordIndex) < config_.recordsFrom_)
-                continue;
-            else if (size_t(readRecordIndex) >= config_.recordsTo_)
-                break;
+            pool.parallelFor(batchSize, boost::lambda::bind(
+                &Map2SamConverter::processBatchItem, this, boost::ref(batch), boost::lambda::_1));
 
-            processDnbRecord(readsRecord, baseMappings);
+            for (size_t i=0; i<batchSize; ++i)
+                mappingSamRecordGenerator_->write(batch[i].output_);
         }
         CGA_ASSERT_MSG(config_.recordsTo_ != std::numeric_limits<size_t>::max() || !mappingsFile_->next(),
             "The mappings and reads files are not in sync. Excess of mappings.");
+
+        mappingSamRecordGenerator_->close();
     }
 
     namespace {
@@ -96,7 +129,8 @@ namespace cgatools { namespace mapping {
     }
 
     void Map2SamConverter::convertBaseMappingsIntoSamMappings(const mapping::ReadsRecord& readsRecord, 
-        SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const
+        SamRecordArray& samMappings, SamRecordArena& arena,
+        const mapping::MappingsRecords& baseMappingRecords) const
     {
         std::string dnbId = generateDnbId(readsRecord);
 
@@ -105,31 +139,39 @@ namespace cgatools { namespace mapping {
         //generate records for the input mappings
         BOOST_FOREACH(const mapping::MappingsRecord &m,baseMappingRecords) 
         {
-            std::auto_ptr<BaseMappingSamRecord> samRecord(
-                new mapping::BaseMappingSamRecord(
-                    dnbId, m, library_->dnbStructure_, 
-                    readsRecord.reads_, readsRecord.scores_, 
-                    reference_)
-                );
+            BaseMappingSamRecord* samRecord = arena.baseMappings_.next();
+            samRecord->init(dnbId, m, library_->dnbStructure_, 
+                            readsRecord.reads_, readsRecord.scores_, 
+                            reference_);
             if (samRecord->correctPosition(reference_))
                 samMappings.push_back(samRecord);
         }
     }
 
+    void Map2SamConverter::processBatchItem(DnbBatch& batch, size_t index) const
+    {
+        DnbBatchItem& item = batch[index];
+        item.output_.clear();
+        item.arena_.clear();
+        processDnbRecord(item.readsRecord_, item.mappingsRecords_, item.arena_, item.output_);
+    }
+
     void Map2SamConverter::processDnbRecord( const mapping::ReadsRecord& readsRecord, 
-        const mapping::MappingsRecords& baseMappingRecords ) const
+        const mapping::MappingsRecords& baseMappingRecords,
+        SamRecordArena& arena, SamRecordGenerator::RecordBuffer& output ) const
     {
         SamRecordArray samMappings;
 
         if (!baseMappingRecords.empty())
-            processMappings(readsRecord, samMappings, baseMappingRecords);
+            processMappings(readsRecord, samMappings, arena, baseMappingRecords);
 
-        outputSamMappings(readsRecord, samMappings);
+        outputSamMappings(readsRecord, samMappings, arena, output);
     }
 
     //! The function does several modifications to the given samRecords
     void Map2SamConverter::outputSamMappings(const mapping::ReadsRecord& readsRecord, 
-        SamRecordArray& samMappings) const
+        SamRecordArray& samMappings, SamRecordArena& arena,
+        SamRecordGenerator::RecordBuffer& output) const
     {
         boost::array<size_t,MAX_SIDES> countBySide;
         countBySide.assign(0);
@@ -198,12 +240,11 @@ namespace cgatools { namespace mapping {
             for (size_t i=0; i<MAX_SIDES; ++i)
             {
                 zeroMapping.flags_.setSide(i);
-                notMappedRecords.push_back(
-                    new mapping::BaseMappingSamRecord(
-                        dnbId, zeroMapping, library_->dnbStructure_, 
-                        readsRecord.reads_, readsRecord.scores_, 
-                        reference_)
-                    );
+                BaseMappingSamRecord* notMapped = arena.baseMappings_.next();
+                notMapped->init(dnbId, zeroMapping, library_->dnbStructure_, 
+                                readsRecord.reads_, readsRecord.scores_, 
+                                reference_);
+                notMappedRecords.push_back(notMapped);
             }
 
             if (samMappings.empty()) 
@@ -230,8 +271,8 @@ namespace cgatools { namespace mapping {
         {
             if (!config_.samGeneratorConfig_.skipNotMapped_)
             {
-                writeMappingRecord(notMappedRecords[0]);
-                writeMappingRecord(notMappedRecords[1]);
+                writeMappingRecord(notMappedRecords[0], output);
+                writeMappingRecord(notMappedRecords[1], output);
             }
         } else
         {
@@ -246,20 +287,21 @@ namespace cgatools { namespace mapping {
                         && (!config_.samGeneratorConfig_.skipNotMapped_))
                     {
                         m.setArtificialMateReported(true);
-                        writeMappingRecord(m);
-                        writeMappingRecord(notMappedRecords[1-m.side_]);
+                        writeMappingRecord(m, output);
+                        writeMappingRecord(notMappedRecords[1-m.side_], output);
                     } else 
                     {
-                        writeMappingRecord(m);
+                        writeMappingRecord(m, output);
                     }
                 }
             }
         }
     }
 
-    void Map2SamConverter::writeMappingRecord(const SamRecord &m) const
+    void Map2SamConverter::writeMappingRecord(const SamRecord &m, 
+        SamRecordGenerator::RecordBuffer& output) const
     {
-        mappingSamRecordGenerator_->mappingRecordToSam(m);
+        mappingSamRecordGenerator_->mappingRecordToSam(m, output);
     }
 
 
@@ -303,6 +345,19 @@ namespace cgatools { namespace mapping {
     }
 
     void Map2SamConverter::init()
+    {
+        openInputFiles();
+
+        if (!config_.referenceFileName_.empty())
+            reference_.open(config_.referenceFileName_);
+
+        initOutput();
+
+        cgdata::GenomeMetadata gm(config_.exportRootDirName_);
+        library_.reset(new LibraryData(gm.getLibraryMetadata(gm.getLibraryName(laneId_)),true));
+    }
+
+    void Map2SamConverter::openInputFiles()
     {
         readsFileStream_ = util::InputStream::
                 openCompressedInputStreamByExtension(config_.inputReadsFileName_);
@@ -328,10 +383,10 @@ namespace cgatools { namespace mapping {
         slide_ = readsHeader.get("SLIDE");
         lane_  = readsHeader.get("LANE");
         laneId_ = slide_+"-"+lane_;
+    }
 
-        if (!config_.referenceFileName_.empty())
-            reference_.open(config_.referenceFileName_);
-
+    void Map2SamConverter::initOutput()
+    {
         //define genomic ranges. If no ranges were provided - use whole region
         exportRegions_.reset(new util::FastRangeSet(reference_));
         if (config_.exportRegions_.empty())
@@ -342,9 +397,6 @@ namespace cgatools { namespace mapping {
         mappingSamRecordGenerator_.reset(
             new mapping::SamRecordGenerator(outSamFile_,reference_,
                 config_.samGeneratorConfig_, config_.outputStreamNames_));
-
-        cgdata::GenomeMetadata gm(config_.exportRootDirName_);
-        library_.reset(new LibraryData(gm.getLibraryMetadata(gm.getLibraryName(laneId_)),true));
     }
 
     SamFileHeaderBlock Map2SamConverter::createHeader()
@@ -404,9 +456,10 @@ namespace cgatools { namespace mapping {
     }
 
     bool BaseMap2SamConverter::processMappings(const mapping::ReadsRecord& readsRecord, 
-        SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const
+        SamRecordArray& samMappings, SamRecordArena& arena,
+        const mapping::MappingsRecords& baseMappingRecords) const
     {
-        convertBaseMappingsIntoSamMappings(readsRecord, samMappings, baseMappingRecords);
+        convertBaseMappingsIntoSamMappings(readsRecord, samMappings, arena, baseMappingRecords);
 
         if (!readsRecord.flags_.NoMappings()) 
         {
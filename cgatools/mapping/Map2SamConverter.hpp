@@ -21,6 +21,7 @@
 #include "cgatools/util/RangeSet.hpp"
 #include "cgatools/reference/CrrFile.hpp"
 #include "MapSamUtils.hpp"
+#include "EvidenceSamUtil.hpp"
 
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
@@ -38,12 +39,16 @@ namespace cgatools { namespace mapping {
             ,recordsTo_(std::numeric_limits<size_t>::max())
             ,dumpDebugInfo_(true)
             ,caveat_(false)
+            ,threadCount_(1)
         {}
 
         size_t  recordsFrom_;
         size_t  recordsTo_;
         bool    dumpDebugInfo_;
         bool caveat_;
+        //! the number of threads converting DNBs, 
+        //! the output does not depend on it
+        size_t  threadCount_;
 
         util::StringVector exportRegions_;
 
@@ -63,11 +68,28 @@ namespace cgatools { namespace mapping {
 
     class LibraryData;
 
+    //! The SAM records of one DNB. The records are reused by the
+    //! following DNBs once cleared, so that converting a DNB does not
+    //! allocate once the pools have grown to the largest DNB.
+    class SamRecordArena
+    {
+    public:
+        void clear()
+        {
+            baseMappings_.clear();
+            evidence_.clear();
+        }
+
+        SamRecordPool<BaseMappingSamRecord> baseMappings_;
+        SamRecordPool<EvidenceSamRecord>    evidence_;
+    };
+
     class Map2SamConverter 
     {
     public:
         typedef boost::shared_ptr<std::istream> InStream;
-        typedef boost::ptr_vector<SamRecord> SamRecordArray;
+        //! The records are owned by a SamRecordArena.
+        typedef boost::ptr_vector<SamRecord, boost::view_clone_allocator> SamRecordArray;
         static const size_t MAX_SIDES = 2; //max number of mates in a DNB
 
         Map2SamConverter(const Map2SamConfig &config, std::ostream &outSamFile);
@@ -77,27 +99,53 @@ namespace cgatools { namespace mapping {
         void run();
 
     protected:
+        //! A DNB read from the input files, and its converted SAM records.
+        class DnbBatchItem
+        {
+        public:
+            ReadsRecord                             readsRecord_;
+            MappingsRecords                         mappingsRecords_;
+            SamRecordGenerator::RecordBuffer        output_;
+            SamRecordArena                          arena_;
+        };
+        typedef std::vector<DnbBatchItem> DnbBatch;
+
+        //! Opens the reads and mappings files and reads the lane
+        //! batch identity from their headers.
+        void openInputFiles();
+
+        //! Creates the SAM record generator and the export regions,
+        //! once the reference is open.
+        void initOutput();
+
         SamFileHeaderBlock createHeader();
 
         //Export mapping record in SAM format
-        virtual void writeMappingRecord(const SamRecord &m) const;
+        virtual void writeMappingRecord(const SamRecord &m, 
+            SamRecordGenerator::RecordBuffer& output) const;
+
+        void processBatchItem(DnbBatch& batch, size_t index) const;
 
         void processDnbRecord(const ReadsRecord& readsRecord, 
-            const mapping::MappingsRecords& mappingsRecords) const;
+            const mapping::MappingsRecords& mappingsRecords,
+            SamRecordArena& arena, SamRecordGenerator::RecordBuffer& output) const;
 
         void outputSamMappings(const mapping::ReadsRecord& readsRecord, 
-            SamRecordArray& samMappings) const;
+            SamRecordArray& samMappings, SamRecordArena& arena,
+            SamRecordGenerator::RecordBuffer& output) const;
 
         std::string generateDnbId(const mapping::ReadsRecord& readsRecord) const;
 
         void convertBaseMappingsIntoSamMappings(const mapping::ReadsRecord& readsRecord, 
-            SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const;
+            SamRecordArray& samMappings, SamRecordArena& arena,
+            const mapping::MappingsRecords& baseMappingRecords) const;
 
         //! a template function allowing functionality extension by a derived class, 
         //! such as merge additional mappings
         //! returns true if the processing has replaced the standard processing 
         virtual bool processMappings(const mapping::ReadsRecord& readsRecord, 
-            SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const = 0;
+            SamRecordArray& samMappings, SamRecordArena& arena,
+            const mapping::MappingsRecords& baseMappingRecords) const = 0;
 
         reference::Range getMappingRange(const SamRecord &mapping) const;
 
@@ -116,7 +164,7 @@ namespace cgatools { namespace mapping {
         boost::shared_ptr<util::DelimitedFile> readsFile_;
         boost::shared_ptr<util::DelimitedFile> mappingsFile_;
 
-        boost::shared_ptr<LibraryData>              library_;
+        boost::shared_ptr<const LibraryData>        library_;
 
         reference::CrrFile      reference_;
 
@@ -139,7 +187,8 @@ namespace cgatools { namespace mapping {
         //! such as merge additional mappings
         //! returns true if the processing has replaced the standard processing 
         virtual bool processMappings(const mapping::ReadsRecord& readsRecord, 
-            SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const;
+            SamRecordArray& samMappings, SamRecordArena& arena,
+            const mapping::MappingsRecords& baseMappingRecords) const;
 
         size_t detectPrimaryMapping(const MappingsRecords &mappingsRecords, 
             bool oneArmOnly, SamRecordArray& samMappings) const;
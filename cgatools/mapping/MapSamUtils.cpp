@@ -69,20 +69,42 @@ namespace cgatools { namespace mapping {
 
     std::string MappingsRecord::createCigar( const cgdata::HalfDnbStructure::Reads &readLengths ) const
     {
-        std::stringstream cigar;
+        std::string cigar;
+        createCigar(readLengths, false, cigar);
+        return cigar;
+    }
+
+    namespace {
+        void appendCigarElement(std::string& cigar, size_t length, char type)
+        {
+            char buf[16];
+            char* first = buf + sizeof(buf);
+            do
+            {
+                *--first = char('0' + length % 10);
+                length /= 10;
+            } while (0 != length);
+            cigar.append(first, buf + sizeof(buf));
+            cigar.push_back(type);
+        }
+    }
+
+    void MappingsRecord::createCigar( const cgdata::HalfDnbStructure::Reads &readLengths,
+                                      bool reversed, std::string& cigar ) const
+    {
+        cigar.clear();
         for (size_t i=0; i<readLengths.size(); ++i)
         {
             if (i>0)
             {
                 int gap = gaps_[i-1];
                 if (gap>0)
-                    cigar << gap << 'N';
+                    appendCigarElement(cigar, gap, 'N');
                 if (gap<0)
-                    cigar << -gap << 'B';
+                    appendCigarElement(cigar, -gap, 'B');
             }
-            cigar << readLengths[i] << 'M';
+            appendCigarElement(cigar, readLengths[reversed ? readLengths.size()-1-i : i], 'M');
         }
-        return cigar.str();
     }
 
 
@@ -94,8 +116,23 @@ namespace cgatools { namespace mapping {
         const std::string& fullReadScores, 
         const reference::CrrFile& reference
         ) 
-    :   
-        SamRecord(
+    {
+        init(readName, mapping, dnbStructure, fullReadSequence, fullReadScores, reference);
+    }
+
+    void BaseMappingSamRecord::init( 
+        const std::string& readName, 
+        const MappingsRecord &mapping, 
+        const cgdata::DnbStructure& dnbStructure, 
+        const std::string& fullReadSequence, 
+        const std::string& fullReadScores, 
+        const reference::CrrFile& reference
+        ) 
+    {
+        // The cigar is written into extCigar_ in place.
+        mapping.createCigar(dnbStructure.halfDnbs_[mapping.flags_.getSide()].reads_,
+                            mapping.flags_.getStrand()==1, extCigar_);
+        SamRecord::init(
             readName, 
             mapping.recordIndex_>=0, 
             mapping.flags_.getStrand()==1, 
@@ -103,8 +140,7 @@ namespace cgatools { namespace mapping {
             mapping.flags_.getSide(),
             mapping.chr_.empty()? 0 : reference.getChromosomeId(mapping.chr_), 
             mapping.offsetInChr_,
-            mapping.createCigar(dnbStructure.halfDnbs_[mapping.flags_.getSide()].
-                        getReadsForStrand(mapping.flags_.getStrand()==1)),
+            extCigar_,
             mapping.weightChar_-33,
             mapping.bestMate_!=mapping.recordIndex_,
             fullReadSequence,
@@ -112,8 +148,7 @@ namespace cgatools { namespace mapping {
             //fix if the number of hlfDNBs > 2
             UInt16Pair(mapping.flags_.getSide()==0 ? 0 : dnbStructure.halfDnbs_[0].totReadLength_,
                         dnbStructure.halfDnbs_[mapping.flags_.getSide()].totReadLength_)
-        )
-    {
+        );
         CGA_ASSERT_L(side_,2); //fix definition of sequenceStartAndLength
         typeId_ = BASE_MAPPING;
     }
@@ -85,6 +85,10 @@ namespace cgatools { namespace mapping {
         void initParser(util::DelimitedFile &delimitedFile);
 
         std::string createCigar(const cgdata::HalfDnbStructure::Reads &readLengths) const;
+        //! Writes the cigar into cigar, reusing its memory. The reads
+        //! are taken in reverse order if reversed is true.
+        void createCigar(const cgdata::HalfDnbStructure::Reads &readLengths, bool reversed,
+                         std::string& cigar) const;
 
         MappingsFlagParser  flags_;
         std::string         chr_;
@@ -103,6 +107,8 @@ namespace cgatools { namespace mapping {
     class BaseMappingSamRecord : public SamRecord
     {
     public:
+        BaseMappingSamRecord() {}
+
         BaseMappingSamRecord(
             const std::string& readName,
             const MappingsRecord &mapping,
@@ -111,6 +117,16 @@ namespace cgatools { namespace mapping {
             const std::string& fullReadScores,
             const reference::CrrFile& reference
             );
+
+        //! Sets the record as the constructor does, reusing its memory.
+        void init(
+            const std::string& readName,
+            const MappingsRecord &mapping,
+            const cgdata::DnbStructure& dnbStructure,
+            const std::string& fullReadSequence,
+            const std::string& fullReadScores,
+            const reference::CrrFile& reference
+            );
     };
 
 
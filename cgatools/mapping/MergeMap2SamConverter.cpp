@@ -13,12 +13,14 @@
 // permissions and limitations under the License.
 
 #include "cgatools/core.hpp"
+#include "cgatools/cgdata/GenomeMetadata.hpp"
 #include "MergeMap2SamConverter.hpp"
 #include "AlleleAlignment.hpp"
 #include "LibraryData.hpp"
 #include "EvidenceSamUtil.hpp"
 
 #include <boost/date_time.hpp>
+#include <boost/foreach.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/io.hpp>
 
@@ -30,26 +32,24 @@
 namespace cgatools { namespace mapping {
 
     void MergedMap2SamConverter::addEvidenceRecords( 
-        const mapping::ReadsRecord& readsRecord, SamRecordArray& records ) const
+        const mapping::ReadsRecord& readsRecord, SamRecordArray& records, SamRecordArena& arena ) const
     {
         SamRecordArray evidenceRecords;
         CGA_ASSERT(!config_.evidenceCacheRoot_.empty());
 
-        //int totalEvidenceMappings = evidenceBatchRecords_.count(readsRecord.recordIndex_);
-        std::pair<mapping::BatchRecords::const_iterator,mapping::BatchRecords::const_iterator> pii
-            = evidenceBatchRecords_.equal_range(readsRecord.recordIndex_);
-        for (mapping::BatchRecords::const_iterator it=pii.first; it!=pii.second; ++it)
+        std::pair<size_t,size_t> range = evidenceBatch_.equalRange(readsRecord.recordIndex_);
+        EvidenceCacheDnbRecord e;
+        for (size_t i=range.first; i<range.second; ++i)
         {
-            const EvidenceCacheDnbRecord &e = it->second;
+            evidenceBatch_.getRecord(i, e);
 
             const cgdata::HalfDnbStructure &hDnbStruct = 
                 library_->dnbStructure_.halfDnbs_[e.side_];
 
-            std::auto_ptr<EvidenceSamRecord> 
-                erOwner(new EvidenceSamRecord(e,readsRecord.reads_,readsRecord.scores_
-                                                ,false,0,hDnbStruct.totReadLength_,reference_)
-                );
-            EvidenceSamRecord *er = erOwner.get();
+            //the records left out stay unused in the arena
+            EvidenceSamRecord *er = arena.evidence_.next();
+            er->init(e,readsRecord.reads_,readsRecord.scores_
+                    ,false,0,hDnbStruct.totReadLength_,reference_);
             if (!er->correctPosition(reference_))
                 continue;
             
@@ -58,7 +58,7 @@ namespace cgatools { namespace mapping {
             {
                 if (findIt==evidenceRecords.end())
                 {
-                    evidenceRecords.push_back(erOwner);
+                    evidenceRecords.push_back(er);
                     break;
                 }
                 if (findIt->side_==er->side_
@@ -73,7 +73,7 @@ namespace cgatools { namespace mapping {
                             *config_.debugOutStream_ << "Remove duplicate: " 
                                 << static_cast<const EvidenceSamRecord &>(*findIt) << std::endl;
                         findIt = evidenceRecords.erase(findIt);
-                        evidenceRecords.insert(findIt,erOwner);
+                        evidenceRecords.insert(findIt,er);
                     } else
                     {
                         if (config_.dumpDebugInfo_)
@@ -684,12 +684,13 @@ namespace cgatools { namespace mapping {
 
 
     bool MergedMap2SamConverter::processMappings(const mapping::ReadsRecord& readsRecord, 
-        SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const
+        SamRecordArray& samMappings, SamRecordArena& arena,
+        const mapping::MappingsRecords& baseMappingRecords) const
     {
-        convertBaseMappingsIntoSamMappings(readsRecord, samMappings, baseMappingRecords);
+        convertBaseMappingsIntoSamMappings(readsRecord, samMappings, arena, baseMappingRecords);
 
         CGA_ASSERT(!config_.evidenceCacheRoot_.empty());
-        addEvidenceRecords(readsRecord, samMappings);
+        addEvidenceRecords(readsRecord, samMappings, arena);
         regroupMappings(readsRecord, samMappings);
 
         detectTheBestMappingAndMakeItPrimary(samMappings);
@@ -697,22 +698,67 @@ namespace cgatools { namespace mapping {
     }
 
 
-    void MergedMap2SamConverter::init()
+    MergedMap2SamSharedData::MergedMap2SamSharedData(
+        const MergedMap2SamConfig& config, const std::vector<std::string>& laneNames)
     {
-        Map2SamConverter::init();
-        cgdata::GenomeMetadata gm(config_.exportRootDirName_);
-        library_.reset(new LibraryData(gm.getLibraryMetadata(gm.getLibraryName(laneId_)),false));
+        if (!config.referenceFileName_.empty())
+            reference_.open(config.referenceFileName_);
 
-        if (!config_.evidenceCacheRoot_.empty())
+        // lanes of the same library share its data
+        cgdata::GenomeMetadata gm(config.exportRootDirName_);
+        std::map<std::string, boost::shared_ptr<const LibraryData> > libraries;
+        BOOST_FOREACH(const std::string& laneName, laneNames)
         {
-            mapping::EvidenceCacheReader cacheReader(config_.evidenceCacheRoot_);
-            cacheReader.readBatchRecords(slide_,lane_,batchNumber_,
-                                        evidenceBatchRecords_, reference_);
+            std::string libraryName = gm.getLibraryName(laneName);
+            boost::shared_ptr<const LibraryData>& library = libraries[libraryName];
+            if (!library)
+                library.reset(new LibraryData(gm.getLibraryMetadata(libraryName),false));
+            laneLibraries_[laneName] = library;
         }
+
+        if (!config.evidenceCacheRoot_.empty())
+            evidenceCache_.reset(new EvidenceCacheReader(config.evidenceCacheRoot_));
+    }
+
+    boost::shared_ptr<const LibraryData> 
+        MergedMap2SamSharedData::getLibraryData(const std::string& laneName) const
+    {
+        LaneLibraries::const_iterator it = laneLibraries_.find(laneName);
+        if (it == laneLibraries_.end())
+            CGA_ERROR_EX("No library data loaded for the lane: " << laneName);
+        return it->second;
+    }
+
+    void MergedMap2SamConverter::init()
+    {
+        if (NULL == sharedData_)
+        {
+            Map2SamConverter::init();
+            cgdata::GenomeMetadata gm(config_.exportRootDirName_);
+            library_.reset(new LibraryData(gm.getLibraryMetadata(gm.getLibraryName(laneId_)),false));
+
+            if (!config_.evidenceCacheRoot_.empty())
+            {
+                mapping::EvidenceCacheReader cacheReader(config_.evidenceCacheRoot_);
+                cacheReader.readBatchRecords(slide_,lane_,batchNumber_,
+                                            evidenceBatch_, reference_);
+            }
+            return;
+        }
+
+        openInputFiles();
+        reference_ = sharedData_->getReference();
+        initOutput();
+        library_ = sharedData_->getLibraryData(laneId_);
+
+        if (NULL != sharedData_->getEvidenceCache())
+            sharedData_->getEvidenceCache()->readBatchRecords(slide_,lane_,batchNumber_,
+                                                              evidenceBatch_, reference_);
     }
 
 
-    void MergedMap2SamConverter::writeMappingRecord(const SamRecord &m) const
+    void MergedMap2SamConverter::writeMappingRecord(const SamRecord &m, 
+        SamRecordGenerator::RecordBuffer& output) const
     {
         //CGA_ASSERT(m.mappingQuality_ == 0 || m.isPrimary_);
         if (config_.minMapQ_ > m.getMappingQuality() && !m.isPrimary_)
@@ -721,7 +767,7 @@ namespace cgatools { namespace mapping {
         if (!m.isGroupPrimary_ && !m.isPrimary_)
             return;
 
-        Map2SamConverter::writeMappingRecord(m);
+        Map2SamConverter::writeMappingRecord(m, output);
     }
 
 } } // cgatools::mapping
@@ -23,6 +23,10 @@
 #include "EvidenceCache.hpp"
 
 #include <boost/array.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <map>
 
 namespace cgatools { namespace mapping {
 
@@ -47,14 +51,53 @@ namespace cgatools { namespace mapping {
         std::ostream* debugOutStream_;
     };
 
+    //! The data that does not depend on the lane batch: the reference,
+    //! the library data (DNB structure and gap tables) and the list of
+    //! the evidence cache files. It is loaded once and shared read-only
+    //! by the converters of several lane batches, which may run
+    //! concurrently.
+    class MergedMap2SamSharedData : boost::noncopyable
+    {
+    public:
+        //! Opens the reference and the evidence cache of the config,
+        //! and loads the library data of the given lanes.
+        MergedMap2SamSharedData(const MergedMap2SamConfig& config,
+                                const std::vector<std::string>& laneNames);
+
+        const reference::CrrFile& getReference() const
+        {
+            return reference_;
+        }
+
+        //! The library data of a lane in the format "SLIDE-LANE".
+        boost::shared_ptr<const LibraryData> getLibraryData(const std::string& laneName) const;
+
+        //! NULL if no evidence cache root is configured.
+        const EvidenceCacheReader* getEvidenceCache() const
+        {
+            return evidenceCache_.get();
+        }
+
+    private:
+        typedef std::map<std::string, boost::shared_ptr<const LibraryData> > LaneLibraries;
+
+        reference::CrrFile                          reference_;
+        LaneLibraries                               laneLibraries_;
+        boost::scoped_ptr<EvidenceCacheReader>      evidenceCache_;
+    };
+
     class MergedMap2SamConverter : public Map2SamConverter 
     {
     public:
         typedef boost::array<std::vector<size_t>,2> MappingIndicesBySide;
         typedef boost::array<std::vector<double>,2> MappingWeightsBySide;
 
-        MergedMap2SamConverter(const MergedMap2SamConfig &config, std::ostream &outSamFile)
-            : Map2SamConverter(config, outSamFile), config_(config)
+        //! If sharedData is not NULL, init() takes the reference, the
+        //! library data and the evidence cache from it instead of
+        //! loading them.
+        MergedMap2SamConverter(const MergedMap2SamConfig &config, std::ostream &outSamFile,
+                               const MergedMap2SamSharedData* sharedData = NULL)
+            : Map2SamConverter(config, outSamFile), config_(config), sharedData_(sharedData)
         {}
 
         virtual void init();
@@ -62,13 +105,16 @@ namespace cgatools { namespace mapping {
     protected:
         //! override the method to merge the evidence mappings
         virtual bool processMappings(const mapping::ReadsRecord& readsRecord, 
-            SamRecordArray& samMappings, const mapping::MappingsRecords& baseMappingRecords) const;
+            SamRecordArray& samMappings, SamRecordArena& arena,
+            const mapping::MappingsRecords& baseMappingRecords) const;
 
         //! Export mapping record in SAM format
-        virtual void writeMappingRecord(const SamRecord &m) const;
+        virtual void writeMappingRecord(const SamRecord &m, 
+            SamRecordGenerator::RecordBuffer& output) const;
 
         //! Merge evidence records into the base mappings
-        void addEvidenceRecords(const mapping::ReadsRecord& readsRecord, SamRecordArray& records) const;
+        void addEvidenceRecords(const mapping::ReadsRecord& readsRecord,
+            SamRecordArray& records, SamRecordArena& arena) const;
         //! Process merged mappings: recompute MAPQ, deduplicate, select best mapping pairs
         void regroupMappings(const mapping::ReadsRecord& readsRecord, SamRecordArray& records) const;
 
@@ -113,8 +159,9 @@ namespace cgatools { namespace mapping {
         void printMatrix(const DoubleMatrix& m, std::ostream& ostr) const;
 
         const MergedMap2SamConfig & config_;
+        const MergedMap2SamSharedData* sharedData_;
 
-        mapping::BatchRecords   evidenceBatchRecords_;
+        EvidenceCacheBatch      evidenceBatch_;
     };
 
 } } // cgatools::mapping
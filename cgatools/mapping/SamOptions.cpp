@@ -50,6 +50,25 @@ void addSamConfigOptions(SamGeneratorConfig& config, boost::program_options::opt
         ("consistent-mapping-range",po::value<int>(&config.maxConsistentRange_)->default_value(1300),
         "limit the maximum distance between consistent mates")
 
+        ("output-format",po::value<std::string>(&config.outputFormat_)->default_value("sam"),
+        "The output format, one of:\n"
+        "    sam   \tSAM text.\n"
+        "    bam   \tBAM, BGZF-compressed in parallel on the threads given by "
+        "--compression-threads. Do not give the output file a .gz or .bz2 extension.")
+
+        ("sort-output", po::bool_switch(&config.sortOutput_)->default_value(false),
+        "Sort the output by coordinate, as samtools sort does, instead of writing the "
+        "records in the order they are converted. The records that do not fit in "
+        "--sort-memory are sorted in runs written to temporary files, which are merged "
+        "at the end.")
+
+        ("sort-memory", po::value<size_t>(&config.sortMemory_)->default_value(1024),
+        "The memory in MB used by --sort-output to hold records, divided among the "
+        "output files.")
+
+        ("sort-temp-dir", po::value<std::string>(&config.sortTempDir_)->default_value("."),
+        "The directory of the temporary files of --sort-output.")
+
         ;
 }
 
@@ -19,6 +19,8 @@
 
 #include "cgatools/core.hpp"
 
+#include <string>
+
 namespace boost { namespace program_options {
     class options_description;
 }}
@@ -41,6 +43,10 @@ namespace cgatools { namespace mapping {
             ,addAlternativeMappings_(false)
             ,primaryMappingsOnly_(true)
             ,maxConsistentRange_(1300)
+            ,outputFormat_("sam")
+            ,sortOutput_(false)
+            ,sortMemory_(1024)
+            ,sortTempDir_(".")
         {}
 
         bool    mateSvCandidates_;
@@ -57,6 +63,16 @@ namespace cgatools { namespace mapping {
         //generate only one mapping pair per read
         bool    primaryMappingsOnly_;
         int     maxConsistentRange_;
+        //! "sam" or "bam"
+        std::string outputFormat_;
+        //! Sort the records by coordinate, using at most about
+        //! sortMemory_ MB of memory, divided among the output files,
+        //! and temporary files in sortTempDir_.
+        bool        sortOutput_;
+        size_t      sortMemory_;
+        std::string sortTempDir_;
+
+        bool isBamOutput() const {return "bam" == outputFormat_;}
     };
 
     void addSamConfigOptions(SamGeneratorConfig& config, 
@@ -14,8 +14,13 @@
 
 #include "cgatools/core.hpp"
 #include "cgatools/mapping/SamReader.hpp"
+#include "cgatools/mapping/BamReader.hpp"
+#include "cgatools/util/ReadAheadSource.hpp"
 
+#include <cstring>
 #include <boost/foreach.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 
 namespace cgatools { namespace mapping {
 
@@ -31,7 +36,7 @@ void SamTag::parse(const char* first, const char* last)
             switch(ind)
             {
             case 1:
-                name_ = std::string(lastStart,current);
+                name_.assign(lastStart,current);
                 break;
             case 2:
                 type_ = *lastStart;
@@ -107,36 +112,124 @@ void SamFileRecord::parseQName( std::string& slide, std::string& lane, size_t& b
 }
 
 
-bool SamFileParser::next()
+SamRecordDecoder::SamRecordDecoder(const SamFileParser& parser)
+    : parser_(parser), dl_(true)
+{
+    samFileRecord_.bindToParser(dl_);
+}
+
+const SamFileRecord& SamRecordDecoder::decode(const std::string& rawRecord)
 {
-    while(in_) 
+    if (parser_.isBam())
+        parser_.bam_->decode(rawRecord, samFileRecord_);
+    else
     {
-        getline(in_,line_);
-        ++lineNo_;
+        samFileRecord_.samTags_.clear();
+        dl_.parseLine(rawRecord);
+    }
+    return samFileRecord_;
+}
 
-        if (line_.empty())
-            continue;
+SamFileParser::SamFileParser(std::istream& in, const std::string& fileName)
+    : isInitialised_(false), in_(&in), fileName_(fileName), lineNo_(0), record_(1)
+{
+    decoder_.reset(new SamRecordDecoder(*this));
+    openInput();
+}
 
-        if (line_[0]=='@')
+SamFileParser::~SamFileParser()
+{
+}
+
+void SamFileParser::openInput()
+{
+    if (0x1f == in_->peek())
+    {
+        // Compressed, as BAM is.
+        boost::shared_ptr<boost::iostreams::filtering_istream> gz(
+            new boost::iostreams::filtering_istream());
+        gz->push(boost::iostreams::gzip_decompressor(), 64*1024);
+        gz->push(*in_);
+        gz->exceptions(std::ios::badbit);
+        if (util::ReadAheadSource::ENABLED)
         {
-            header_.addLine(line_);
-            continue;
+            boost::shared_ptr<boost::iostreams::filtering_istream> readAhead(
+                new boost::iostreams::filtering_istream());
+            readAhead->push(util::ReadAheadSource(gz));
+            readAhead->exceptions(std::ios::badbit);
+            decompressed_ = readAhead;
         }
+        else
+            decompressed_ = gz;
+        in_ = decompressed_.get();
+    }
 
-        if (!isInitialised_)
+    char magic[sizeof(BamReader::MAGIC)];
+    in_->read(magic, sizeof(magic));
+    if (sizeof(magic) == size_t(in_->gcount()) &&
+        0 == std::memcmp(magic, BamReader::MAGIC, sizeof(magic)))
+        bam_.reset(new BamReader(*in_, header_));
+    else
+        firstLinePrefix_.assign(magic, in_->gcount());
+}
+
+bool SamFileParser::nextRecord(std::string& record)
+{
+    if (isBam())
+        return bam_->next(record);
+
+    while (*in_ || !firstLinePrefix_.empty())
+    {
+        record.clear();
+        getline(*in_,record);
+        ++lineNo_;
+        if (!firstLinePrefix_.empty())
         {
-            header_.initMetadata();
+            record.insert(0, firstLinePrefix_);
+            firstLinePrefix_.clear();
         }
 
-        samFileRecord_.samTags_.clear();
-        dl_.parseLine(line_);
+        if (record.empty())
+            continue;
+
+        if (record[0]=='@')
+        {
+            header_.addLine(record);
+            isInitialised_ = false;
+            continue;
+        }
 
         return true;
     }
-
     return false;
 }
 
+size_t SamFileParser::nextChunk(SamRawRecords& chunk, size_t maxCount)
+{
+    if (chunk.size() < maxCount)
+        chunk.resize(maxCount);
+
+    size_t count = 0;
+    while (count < maxCount && nextRecord(chunk[count]))
+        ++count;
+
+    if (0 != count && !isInitialised_)
+    {
+        header_.initMetadata();
+        isInitialised_ = true;
+    }
+    return count;
+}
+
+bool SamFileParser::next()
+{
+    if (0 == nextChunk(record_, 1))
+        return false;
+
+    decoder_->decode(record_[0]);
+    return true;
+}
+
 void SamFileHeader::initMetadata()
 {
     if (hasRecords("RG"))
@@ -154,7 +247,7 @@ void SamFileHeader::initMetadata()
 
 void SamFileParser::initMetadata()
 {
-    std::cout << samFileRecord_;
+    std::cout << getRecord();
     header_.initMetadata();
     isInitialised_ = true;
 }
@@ -194,13 +287,8 @@ std::ostream& operator<< (std::ostream& ost, const SamFileRecord& r)
     ost << r.qual_;
 
     
-    BOOST_FOREACH(const SamTags<SamTag>::SamTagMap::value_type & t, r.samTags_.samTags_)
-    {
-        ost << '\t' << t.second.name_ 
-            << ':' << t.second.type_ 
-            << ':' << t.second.value_ 
-            ;
-    }
+    for (size_t i=0; i<r.samTags_.size(); ++i)
+        ost << '\t' << r.samTags_[i];
 
     return ost;
 }
@@ -21,7 +21,11 @@
 #include "cgatools/util/Exception.hpp"
 #include "cgatools/util/DelimitedLineParser.hpp"
 
+#include <algorithm>
 #include <map>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace cgatools { namespace mapping {
 
@@ -46,43 +50,94 @@ public:
     std::string value_;
 };
 
+//! The tags of a record or a header line, in the order they were
+//! added. The tags are kept by clear(), so that parsing the next record
+//! reuses their strings instead of allocating new ones.
 template <class SamTag>
 class SamTags
 {
 public:
-    typedef typename std::map<std::string, SamTag> SamTagMap;
+    typedef typename std::vector<SamTag> SamTagVector;
+
+    SamTags() : size_(0) {}
+
+    size_t size() const {return size_;}
+    bool empty() const {return 0 == size_;}
+
+    const SamTag& operator[](size_t i) const
+    {
+        return samTags_[i];
+    }
+
+    //! Returns the tag, or 0 if there is none. Unlike hasTag() and
+    //! getTag(), this doesn't build a std::string from a literal.
+    const SamTag* findTag(const char* t) const
+    {
+        for (size_t i=0; i<size_; ++i)
+        {
+            if (samTags_[i].name_ == t)
+                return &samTags_[i];
+        }
+        return 0;
+    }
 
     bool hasTag(const std::string& t) const
     {
-        return samTags_.find(t) != samTags_.end();
+        return 0 != findTag(t.c_str());
     }
 
     const SamTag& getTag(const std::string& t) const
     {
-        typename SamTagMap::const_iterator it = samTags_.find(t);
-        CGA_ASSERT_MSG(it!=samTags_.end(), "The tag '" << t << "' not found.");
-        return it->second;
+        const SamTag* tag = findTag(t.c_str());
+        CGA_ASSERT_MSG(0 != tag, "The tag '" << t << "' not found.");
+        return *tag;
     }
 
     void addTag(const SamTag& t)
     {
-        samTags_[t.name_] = t;
+        nextTag() = t;
+        commitTag();
+    }
+
+    //! Returns an unused tag, to be filled in and added by commitTag().
+    SamTag& nextTag()
+    {
+        if (size_ == samTags_.size())
+            samTags_.push_back(SamTag());
+        return samTags_[size_];
+    }
+
+    //! Adds the tag returned by nextTag(), replacing the tag of the
+    //! same name if there is one.
+    void commitTag()
+    {
+        SamTag& t = samTags_[size_];
+        for (size_t i=0; i<size_; ++i)
+        {
+            if (samTags_[i].name_ == t.name_)
+            {
+                std::swap(samTags_[i], t);
+                return;
+            }
+        }
+        ++size_;
     }
 
     void print(std::ostream& ost) const
     {
-        for (typename SamTagMap::const_iterator it=samTags_.begin(),
-                itEnd = samTags_.end(); it!=itEnd; ++it)
+        for (size_t i=0; i<size_; ++i)
         {
-            if (it != samTags_.begin())
+            if (i != 0)
                 ost << '\t';
-            ost << it->second;
+            ost << samTags_[i];
         }
     }
 
-    void clear() {samTags_.clear();}
+    void clear() {size_ = 0;}
 
-    SamTagMap samTags_;
+private:
+    SamTagVector samTags_;
+    size_t       size_;
 };
 
 template <class SamTag>
@@ -100,10 +155,9 @@ public:
     }
 
     void parse(const char* first, const char* last) {
-        CGA_ASSERT_MSG((!isFirst_) || samTags_.samTags_.empty(), "samTags map was not cleaned");
-        SamTag tag;
-        tag.parse(first, last);
-        samTags_.addTag(tag);
+        CGA_ASSERT_MSG((!isFirst_) || samTags_.empty(), "samTags map was not cleaned");
+        samTags_.nextTag().parse(first, last);
+        samTags_.commitTag();
     }
 
 private:
@@ -222,32 +276,76 @@ protected:
     HeaderRecordIndex   readGroups_;
 };
 
-class SamFileParser {
+class BamReader;
+class SamFileParser;
+
+//! The records read by SamFileParser::nextChunk(): SAM text lines, or
+//! BAM alignment records that have not been decoded.
+typedef std::vector<std::string> SamRawRecords;
+
+//! Parses the records read by SamFileParser::nextChunk(). The records
+//! of a chunk may be parsed on several threads, each with its own
+//! decoder.
+class SamRecordDecoder : boost::noncopyable
+{
+public:
+    explicit SamRecordDecoder(const SamFileParser& parser);
+
+    const SamFileRecord& decode(const std::string& rawRecord);
+
+    //! The record last decoded.
+    const SamFileRecord& getRecord() const {return samFileRecord_;}
+
+protected:
+    const SamFileParser&        parser_;
+    SamFileRecord               samFileRecord_;
+    util::DelimitedLineParser   dl_;
+};
+
+//! Reads SAM or BAM files. The format is found from the data, and
+//! gzip-compressed input, such as BAM, is decompressed on a read-ahead
+//! thread.
+class SamFileParser : boost::noncopyable
+{
+    friend class SamRecordDecoder;
 public:
-    SamFileParser(std::istream& in, const std::string& fileName)
-        : isInitialised_(false), in_(in), fileName_(fileName),lineNo_(0), dl_(true) 
-    {
-        samFileRecord_.bindToParser(dl_);
-    }
+    SamFileParser(std::istream& in, const std::string& fileName);
+
+    ~SamFileParser();
 
     bool next();
 
-    const SamFileRecord & getRecord() const {return samFileRecord_;}
+    const SamFileRecord & getRecord() const {return decoder_->getRecord();}
+
+    //! Reads up to maxCount records, without parsing them, into the
+    //! first elements of chunk, and returns the number read. The header
+    //! lines found on the way are added to header_.
+    size_t nextChunk(SamRawRecords& chunk, size_t maxCount);
+
+    bool isBam() const {return 0 != bam_.get();}
 
     void initMetadata();
 
     SamFileHeader   header_;
 
 protected:
+    void openInput();
+    bool nextRecord(std::string& record);
+
     bool            isInitialised_;
 
-    std::istream&   in_;
+    std::istream*   in_;
     std::string     fileName_;
+    boost::shared_ptr<std::istream> decompressed_;
+    boost::shared_ptr<BamReader>    bam_;
+
+    //! The start of the first SAM line, read while looking for the BAM
+    //! magic number.
+    std::string     firstLinePrefix_;
 
-    std::string     line_;
     size_t          lineNo_;
-    SamFileRecord               samFileRecord_;
-    util::DelimitedLineParser   dl_;
+    SamRawRecords   record_;
+    boost::shared_ptr<SamRecordDecoder> decoder_;
 };
 
 } } // cgatools::mapping
@@ -20,10 +20,14 @@
 #include "cgatools/reference/CrrFile.hpp"
 #include "Cigar.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <cmath>
+#include <exception>
+#include <iostream>
+#include <sstream>
 
 namespace cgatools { namespace mapping {
 
@@ -43,6 +47,23 @@ namespace cgatools { namespace mapping {
 
     }
 
+    SamRecord::SamRecord()
+    :
+        typeId_(DEFAULT)
+        ,isMapped_(false)
+        ,onNegativeStrand_(false)
+        ,isPrimary_(false)
+        ,isGroupPrimary_(false)
+        ,side_(0)
+        ,chr_(0)
+        ,position_(0)
+        ,isSvCandidate_(false)
+        ,mappingQuality_(0)
+        ,isConsistentMapQ_(false)
+        ,isArtificialMateReported_(false)
+    {
+    }
+
     SamRecord::SamRecord( 
         const std::string& readName, 
         bool isMapped, 
@@ -57,24 +78,46 @@ namespace cgatools { namespace mapping {
         const std::string& fullReadSequence, 
         const std::string& fullReadScores, 
         UInt16Pair sequenceStartAndLength) 
-    :
-        typeId_(DEFAULT)
-        ,readName_(readName)
-        ,isMapped_(isMapped)
-        ,onNegativeStrand_(onNegativeStrand)
-        ,isPrimary_(isPrimary)
-        ,isGroupPrimary_(false)
-        ,side_(side)
-        ,chr_(chr)
-        ,position_(position)
-        ,extCigar_(extCigar)
-        ,fullReadSequence_(fullReadSequence)
-        ,fullReadScores_(fullReadScores)
-        ,isSvCandidate_(false)
-        ,mappingQuality_(mappingQuality)
-        ,isConsistentMapQ_(isConsistentMapQ)
-        ,isArtificialMateReported_(false)
     {
+        init(readName, isMapped, onNegativeStrand, isPrimary, side, chr, position, extCigar,
+             mappingQuality, isConsistentMapQ, fullReadSequence, fullReadScores,
+             sequenceStartAndLength);
+    }
+
+    void SamRecord::init( 
+        const std::string& readName, 
+        bool isMapped, 
+        bool onNegativeStrand, 
+        bool isPrimary, 
+        uint8_t side, 
+        uint16_t chr, 
+        int32_t position, 
+        const std::string& extCigar, 
+        uint8_t mappingQuality, 
+        bool    isConsistentMapQ, 
+        const std::string& fullReadSequence, 
+        const std::string& fullReadScores, 
+        UInt16Pair sequenceStartAndLength) 
+    {
+        typeId_ = DEFAULT;
+        readName_.assign(readName);
+        isMapped_ = isMapped;
+        onNegativeStrand_ = onNegativeStrand;
+        isPrimary_ = isPrimary;
+        isGroupPrimary_ = false;
+        side_ = side;
+        chr_ = chr;
+        position_ = position;
+        extCigar_.assign(extCigar);
+        fullReadSequence_.assign(fullReadSequence);
+        fullReadScores_.assign(fullReadScores);
+        isSvCandidate_ = false;
+        mates_.clear();
+        alternatives_.clear();
+        mappingQuality_ = mappingQuality;
+        isConsistentMapQ_ = isConsistentMapQ;
+        isArtificialMateReported_ = false;
+
         sequenceStartAndLength_[0] = sequenceStartAndLength;
 
         if (sequenceStartAndLength.first==0)
@@ -127,79 +170,146 @@ namespace cgatools { namespace mapping {
         return true;
     }
 
+    SamRecordGenerator::OutputFileDescriptor::OutputFileDescriptor(std::ostream &  outStream, bool bam,
+        size_t sortMemory, const std::string& sortTempDir)
+        :hasHeader_(false), hasRecords_(false), closed_(false), outStream_(outStream),
+        sortMemory_(sortMemory), sortTempDir_(sortTempDir)
+    {
+        if (bam)
+            bamWriter_.reset(new BamWriter(outStream));
+    }
+
     void SamRecordGenerator::OutputFileDescriptor::writeHeader(const SamFileHeaderBlock& header)
     {
         CGA_ASSERT(!hasHeader_);
-        outStream_ << header << std::endl;
+        SamFileHeaderBlock h = header;
+        if (0 != sortMemory_)
+        {
+            h.get(SamFileHeaderBlock("@HD","@HD","",""))
+                .get(SamFileHeaderBlock("SO","SO","\t","coordinate"));
+            sorter_.reset(new SamSorter(h, sortMemory_, sortTempDir_));
+        }
+        if (bamWriter_)
+            bamWriter_->writeHeader(h);
+        else
+            outStream_ << h << std::endl;
         hasHeader_ = true;
     }
 
-    SamRecordGenerator::OutputFileDescriptor::~OutputFileDescriptor()
+    void SamRecordGenerator::OutputFileDescriptor::write(const SamAlignment& alignment)
     {
-        if (hasHeader_ && !hasRecords_)
+        hasRecords_ = true;
+        if (sorter_)
+            sorter_->add(alignment);
+        else
+            writeAlignment(alignment);
+    }
+
+    void SamRecordGenerator::OutputFileDescriptor::writeAlignment(const SamAlignment& alignment)
+    {
+        if (bamWriter_)
+            bamWriter_->write(alignment);
+        else
+            alignment.writeSam(outStream_);
+    }
+
+    void SamRecordGenerator::OutputFileDescriptor::close()
+    {
+        if (closed_)
+            return;
+        closed_ = true;
+        if (sorter_)
+        {
+            sorter_->finish(boost::bind(&OutputFileDescriptor::writeAlignment, this, _1));
+            sorter_.reset();
+        }
+        // a BAM file with no records is valid, a SAM file has a dummy record
+        if (bamWriter_)
+            bamWriter_->close();
+        else if (hasHeader_ && !hasRecords_)
             outStream_ << "empty\t0\t*\t0\t0\t0M\t*\t0\t0\t\t" << std::endl;
     }
 
-    void SamRecordGenerator::printMateSequence(OutputFileDescriptor& out, 
-        const std::string &mateSeq, const std::string &mateScore )
+    SamRecordGenerator::OutputFileDescriptor::~OutputFileDescriptor()
+    {
+        try
+        {
+            sorter_.reset();
+            close();
+        }
+        catch(std::exception& ee)
+        {
+            std::cerr << ee.what() << std::endl;
+            // A failure while another exception unwinds the generator is
+            // only logged; that exception is the one to report.
+            if (!std::uncaught_exception())
+                CGA_ASSERT(false);
+        }
+    }
+
+    void SamRecordGenerator::printMateSequence(SamAlignment& out, 
+        const std::string &mateSeq, const std::string &mateScore ) const
     {
-        out.outStream_  << SAM_SEPARATOR << "R2:Z:" << mateSeq;         // TAG R2:Z:Mate sequence
-        out.outStream_  << SAM_SEPARATOR << "Q2:Z:" << mateScore;       // TAG Q2:Z:Mate scores
+        out.addTag("R2", mateSeq);                  // TAG R2:Z:Mate sequence
+        out.addTag("Q2", mateScore);                // TAG Q2:Z:Mate scores
     }
 
-    void SamRecordGenerator::flagAsSVCandidate(OutputFileDescriptor& out)
+    void SamRecordGenerator::flagAsSVCandidate(SamAlignment& out) const
     {
-        out.outStream_  << SAM_SEPARATOR << "XS:I:1";                   // TAG XS:i:SVCandidate
+        out.addTag("XS", int64_t(1));               // TAG XS:i:SVCandidate
     }
 
-    void SamRecordGenerator::printNegativeGapTag(OutputFileDescriptor& out, 
-        const mapping::SamSequenceSplitter &splitter)
+    void SamRecordGenerator::printNegativeGapTag(SamAlignment& out, 
+        const mapping::SamSequenceSplitter &splitter) const
     {
         std::string tagReadsStr(splitter.tagSequence_.str());
         if (!tagReadsStr.empty()) {
-            out.outStream_ << SAM_SEPARATOR << "GC:Z:" << splitter.tagCigar_;       // TAG GC:Z:NEGATIVE GAPS
-            out.outStream_ << SAM_SEPARATOR << "GS:Z:" << tagReadsStr;              // TAG GS:Z:NEGATIVE GAPS
-            out.outStream_ << SAM_SEPARATOR << "GQ:Z:" << splitter.tagScores_.str();// TAG GQ:Z:NEGATIVE GAPS
+            std::ostringstream tagCigar;
+            tagCigar << splitter.tagCigar_;
+            out.addTag("GC", tagCigar.str());                   // TAG GC:Z:NEGATIVE GAPS
+            out.addTag("GS", tagReadsStr);                      // TAG GS:Z:NEGATIVE GAPS
+            out.addTag("GQ", splitter.tagScores_.str());        // TAG GQ:Z:NEGATIVE GAPS
         }
     }
 
-    void SamRecordGenerator::printAlleleInfoTag(OutputFileDescriptor& out, 
-        const mapping::EvidenceSamRecord& evidenceRecord)
+    void SamRecordGenerator::printAlleleInfoTag(SamAlignment& out, 
+        const mapping::EvidenceSamRecord& evidenceRecord) const
     {
-        out.outStream_ << SAM_SEPARATOR << "ZI:I:" << evidenceRecord.intervalId_;
-        out.outStream_ << SAM_SEPARATOR << "ZA:I:" << evidenceRecord.alleleIndex_;
+        out.addTag("ZI", int64_t(evidenceRecord.intervalId_));
+        out.addTag("ZA", int64_t(evidenceRecord.alleleIndex_));
     }
 
-    void SamRecordGenerator::printReadGroup(OutputFileDescriptor& out)
+    void SamRecordGenerator::printReadGroup(SamAlignment& out) const
     {
-        out.outStream_ << SAM_SEPARATOR << "RG:Z:" << readGroup_;
+        out.addTag("RG", readGroup_);
     }
 
     void SamRecordGenerator::printAlternatives(
-        OutputFileDescriptor& out,
+        SamAlignment& out,
         const std::string& tag, 
         const mapping::SamRecord::SamRecords& samRecords,
         size_t startFrom
-    )
+    ) const
     {
         if (samRecords.size() <= startFrom)
             return;
 
-        out.outStream_ << SAM_SEPARATOR << tag << ":Z:";
+        std::ostringstream value;
         for (size_t i=startFrom; i<samRecords.size(); ++i)
         {
             const mapping::SamRecord& m = *samRecords[i];
             if (!m.isMapped_)
                 continue;
 
-            out.outStream_ << getSamChr(m.chr_) << ",";
-            out.outStream_ << getAdjustedSamPosition(m) << ",";
+            value << getSamChr(m.chr_) << ",";
+            value << getAdjustedSamPosition(m) << ",";
 
             SamRecordSequenceSplitter s(m);
 
-            out.outStream_ << s.cigar_ << ",";
-            out.outStream_ << int(m.getMappingQuality()) << ";";
+            value << s.cigar_ << ",";
+            value << int(m.getMappingQuality()) << ";";
         }
+        out.addTag(tag, value.str());
     }
 
     std::string SamRecordGenerator::getSamChr(uint16_t chr) const
@@ -207,9 +317,9 @@ namespace cgatools { namespace mapping {
         return reference_.listChromosomes()[chr].getName();
     }
 
-    SamRecordGenerator::OutputFileDescriptor& SamRecordGenerator::getOutputStream(const std::string &id)
+    SamRecordGenerator::OutputFileDescriptor& SamRecordGenerator::getOutputStream(const std::string &id) const
     {
-        OutStreamMap::iterator it = outFiles_.find(id);
+        OutStreamMap::const_iterator it = outFiles_.find(id);
         if (it==outFiles_.end())
             it = outFiles_.find("all");
         CGA_ASSERT_MSG(it!=outFiles_.end(),
@@ -222,10 +332,36 @@ namespace cgatools { namespace mapping {
     }
 
     void SamRecordGenerator::mappingRecordToSam(const SamRecord& record)
+    {
+        OutputFileDescriptor* outFile = fillAlignment(record, alignment_);
+        if (NULL != outFile)
+            outFile->write(alignment_);
+    }
+
+    void SamRecordGenerator::mappingRecordToSam(const SamRecord& record, RecordBuffer& buffer) const
+    {
+        if (buffer.size_ == buffer.alignments_.size())
+        {
+            buffer.alignments_.push_back(SamAlignment());
+            buffer.outFiles_.push_back(NULL);
+        }
+        OutputFileDescriptor* outFile = fillAlignment(record, buffer.alignments_[buffer.size_]);
+        if (NULL != outFile)
+            buffer.outFiles_[buffer.size_++] = outFile;
+    }
+
+    void SamRecordGenerator::write(const RecordBuffer& buffer)
+    {
+        for (size_t i=0; i<buffer.size_; ++i)
+            buffer.outFiles_[i]->write(buffer.alignments_[i]);
+    }
+
+    SamRecordGenerator::OutputFileDescriptor* SamRecordGenerator::fillAlignment(
+        const SamRecord& record, SamAlignment& out) const
     {
         // apply primary mappings only filter
         if (samGeneratorConfig_.primaryMappingsOnly_ && !record.isPrimary_)
-            return;
+            return NULL;
 
         CGA_ASSERT(!record.mates_.empty());
         const SamRecord* mate = record.mates_[0];
@@ -237,14 +373,14 @@ namespace cgatools { namespace mapping {
                                             : (mate->isMapped_ ? getSamChr(mate->chr_) : "*"));
 
         CGA_ASSERT_L(0,outFiles_.size());
-        OutputFileDescriptor& out = getOutputStream(chr);
-        out.hasRecords_ = true;
+        OutputFileDescriptor& outFile = getOutputStream(chr);
+        out.clear();
 
         mapping::SamRecordSequenceSplitter splitter(record);
 
         bool consistent = record.isConsistent();
 
-        size_t flag = 0x0001;                       //FLAG: the read is paired in sequencing
+        uint16_t flag = 0x0001;                       //FLAG: the read is paired in sequencing
 
         if (consistent)
             flag |= 0x0002;                         //FLAG: both mates are mapped consistently
@@ -275,31 +411,27 @@ namespace cgatools { namespace mapping {
             flag = flag | 0x0100;                   //FLAG: the alignment is not primary
 
 
-        out.outStream_ << record.readName_;                                      // QNAME
-        out.outStream_ << SAM_SEPARATOR << flag;                                 // FLAG
+        out.qname_ = record.readName_;                                          // QNAME
+        out.flag_ = flag;                                                       // FLAG
 
-        out.outStream_ << SAM_SEPARATOR << chr;                                  // RNAME
+        out.rname_ = chr;                                                       // RNAME
 
-        out.outStream_ << SAM_SEPARATOR << (record.isMapped_ ?
-            getAdjustedSamPosition(record) : getAdjustedSamPosition(*mate));     // POS (1-based)
+        out.pos_ = (record.isMapped_ ?
+            getAdjustedSamPosition(record) : getAdjustedSamPosition(*mate));    // POS (1-based)
 
-        out.outStream_ << SAM_SEPARATOR << (record.isMapped_ ?
-            int(record.getMappingQuality()) : 0);                                // MAPQ
+        out.mapq_ = (record.isMapped_ ?
+            int(record.getMappingQuality()) : 0);                               // MAPQ
 
-        if (record.isMapped_)                                                    // CIGAR
+        if (record.isMapped_)                                                   // CIGAR
         {
-            Cigar outCigar = samGeneratorConfig_.packCigar_ 
+            out.cigar_ = samGeneratorConfig_.packCigar_ 
                 ? splitter.cigar_.pack() 
                 : splitter.cigar_;
 
             if (samGeneratorConfig_.removePaddingAtCigarEnds_)
-                outCigar.trancatePaddings();
+                out.cigar_.trancatePaddings();
 
-            out.outStream_ 
-                << SAM_SEPARATOR 
-                << (outCigar);
-        } else {
-            out.outStream_ << SAM_SEPARATOR << "*";  
+            out.hasCigar_ = true;
         }
 
         if (record.isMapped_ 
@@ -317,24 +449,23 @@ namespace cgatools { namespace mapping {
             || mate == &record
             ;
 
-        out.outStream_ << SAM_SEPARATOR << ((!printMatePosition)
+        out.mrnm_ = ((!printMatePosition)
             ? "*" :
               (mate->chr_==record.chr_ || record.chr_==0) ?
                                                       "=" :
                                                       getSamChr(mate->chr_));     // MRNM
 
-        out.outStream_ << SAM_SEPARATOR << 
-            (printMatePosition ? getAdjustedSamPosition(*mate) : 0);              // MPOS (1-based)
+        out.mpos_ = (printMatePosition ? getAdjustedSamPosition(*mate) : 0);      // MPOS (1-based)
 
-        out.outStream_ << SAM_SEPARATOR << 
+        out.isize_ = 
             ((mate->chr_!=record.chr_ || (!consistent) || (!record.isMapped_))
             ? 0 : int(getAdjustedSamPosition(*mate))
                     -int(getAdjustedSamPosition(record)));                        // ISIZE
 
         mate = NULL; //the mate could be overridden above to the record in a case it wasn't mapped
 
-        out.outStream_ << SAM_SEPARATOR << splitter.sequence_.str();              // SEQ
-        out.outStream_ << SAM_SEPARATOR << splitter.scores_.str();                // QUAL
+        out.seq_ = splitter.sequence_.str();                                      // SEQ
+        out.qual_ = splitter.scores_.str();                                       // QUAL
 
         if (!readGroup_.empty())
             printReadGroup(out);
@@ -376,7 +507,7 @@ namespace cgatools { namespace mapping {
         if (samGeneratorConfig_.addAlternativeMates_)
             printAlternatives(out,"ZM",record.mates_,1);
 
-        out.outStream_ << std::endl;
+        return &outFile;
     }
 
     uint32_t SamRecordGenerator::getAdjustedSamPosition(const SamRecord& record) const
@@ -430,7 +561,25 @@ namespace cgatools { namespace mapping {
         ) 
     :   reference_(reference), samGeneratorConfig_(config)
     {
+        if (config.outputFormat_!="sam" && config.outputFormat_!="bam")
+            CGA_ERROR_EX("Unknown output format: " << config.outputFormat_ << ". Use sam or bam.");
+        bool bam = config.isBamOutput();
+
         bool allStreamIsDefined = false;
+        BOOST_FOREACH(const std::string s, outStreams)
+        {
+            if (s.substr(0, s.find(','))=="all")
+                allStreamIsDefined = true;
+        }
+
+        // the sort memory is shared by the output files
+        size_t sortMemory = 0;
+        if (config.sortOutput_)
+        {
+            size_t fileCount = outStreams.size() + (allStreamIsDefined ? 0 : 1);
+            sortMemory = std::max(size_t(1), config.sortMemory_ * 1024 * 1024 / fileCount);
+        }
+
         if (!outStreams.empty())
         {
             BOOST_FOREACH(const std::string s, outStreams)
@@ -441,18 +590,24 @@ namespace cgatools { namespace mapping {
                     CGA_ERROR_EX("The output stream format should be 'chrName,filePath', got instead:" << s);
                 const std::string& chr = parsedStr[0];
                 const std::string& path = parsedStr[1];
-                if (chr=="all")
-                    allStreamIsDefined = true;
 
                 OpenStreamPtr ostr = util::OutputStream::openCompressedOutputStreamByExtension(path);
                 openStreams_.push_back(ostr);
 
-                outFiles_.insert(std::make_pair(chr, new OutputFileDescriptor(*ostr)));
+                outFiles_.insert(std::make_pair(chr,
+                    new OutputFileDescriptor(*ostr, bam, sortMemory, config.sortTempDir_)));
             }
         }
 
         if (!allStreamIsDefined)
-            outFiles_.insert(std::make_pair("all", new OutputFileDescriptor(outSamFile)));
+            outFiles_.insert(std::make_pair("all",
+                new OutputFileDescriptor(outSamFile, bam, sortMemory, config.sortTempDir_)));
+    }
+
+    void SamRecordGenerator::close()
+    {
+        BOOST_FOREACH(OutStreamMap::value_type &os, outFiles_)
+            os.second->close();
     }
 
     SamRecordGenerator::~SamRecordGenerator()
@@ -19,11 +19,15 @@
 
 #include "cgatools/core.hpp"
 #include "SamOptions.hpp"
+#include "BamWriter.hpp"
+#include "SamSorter.hpp"
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <map>
 #include <boost/shared_ptr.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 namespace cgatools { namespace reference {
     class CrrFile;
@@ -48,6 +52,9 @@ namespace cgatools { namespace mapping {
         typedef std::vector<SamRecord *> SamRecords;
         typedef std::vector<const SamRecord *> ConstSamRecords;
 
+        //! An empty record, to be set by init().
+        SamRecord();
+
         SamRecord(
             const std::string& readName, bool isMapped, bool onNegativeStrand, bool isPrimary,
             uint8_t side, uint16_t chr, int32_t position,
@@ -61,6 +68,20 @@ namespace cgatools { namespace mapping {
 
         virtual ~SamRecord() {}
 
+        //! Sets the record as the constructor does. The strings and
+        //! vectors keep their memory, so that a reused record does not
+        //! allocate.
+        void init(
+            const std::string& readName, bool isMapped, bool onNegativeStrand, bool isPrimary,
+            uint8_t side, uint16_t chr, int32_t position,
+            const std::string& extCigar,
+            uint8_t mappingQuality,
+            bool    isConsistentMapQ, 
+            const std::string& fullReadSequence,
+            const std::string& fullReadScores,
+            UInt16Pair sequenceStartAndLength
+            );
+
         bool correctPosition(const reference::CrrFile& reference);
 
         RecordType  typeId_;
@@ -100,6 +121,29 @@ namespace cgatools { namespace mapping {
         bool        isConsistentMapQ_;
         bool        isArtificialMateReported_;
     };
+
+    //! Records of one type that are reused from one DNB to the next: the
+    //! records handed out by next() keep their address until clear(),
+    //! and then are handed out again, to be set by their init().
+    template <class Record>
+    class SamRecordPool
+    {
+    public:
+        SamRecordPool() : size_(0) {}
+
+        Record* next()
+        {
+            if (size_ == records_.size())
+                records_.push_back(new Record());
+            return &records_[size_++];
+        }
+
+        void clear() {size_ = 0;}
+
+    private:
+        size_t                      size_;
+        boost::ptr_vector<Record>   records_;
+    };
     
     //! Used to manage sections of the SAM file header
     //! use "operator <<" to serialize the content into a SAM file
@@ -151,16 +195,60 @@ namespace cgatools { namespace mapping {
         class OutputFileDescriptor
         {
         public:
-            OutputFileDescriptor(std::ostream &  outStream)
-                :hasHeader_(false), hasRecords_(false), outStream_(outStream)
-            {}
+            //! Writes SAM text to outStream, or BAM if bam is true. If
+            //! sortMemory is not 0, the records are sorted by coordinate
+            //! with a SamSorter using sortMemory bytes and temporary
+            //! files in sortTempDir.
+            OutputFileDescriptor(std::ostream &  outStream, bool bam = false,
+                size_t sortMemory = 0, const std::string& sortTempDir = ".");
             ~OutputFileDescriptor();
 
             void writeHeader(const SamFileHeaderBlock& header);
+            void write(const SamAlignment& alignment);
+
+            //! Writes the sorted records, and ends the file. Called by
+            //! the destructor if not called before, except that the
+            //! records of a sorted file are then dropped.
+            void close();
 
             bool            hasHeader_;
             bool            hasRecords_;
+            bool            closed_;
             std::ostream &  outStream_;
+            boost::shared_ptr<BamWriter> bamWriter_;
+            size_t          sortMemory_;
+            std::string     sortTempDir_;
+            boost::shared_ptr<SamSorter> sorter_;
+
+        private:
+            void writeAlignment(const SamAlignment& alignment);
+        };
+
+        //! Holds converted records until they are written, so that
+        //! records can be converted on several threads and written in
+        //! order on one.
+        class RecordBuffer
+        {
+            friend class SamRecordGenerator;
+        public:
+            RecordBuffer() : size_(0) {}
+
+            void clear() {size_ = 0;}
+            size_t size() const {return size_;}
+
+            void swap(RecordBuffer& other)
+            {
+                std::swap(size_, other.size_);
+                alignments_.swap(other.alignments_);
+                outFiles_.swap(other.outFiles_);
+            }
+
+        private:
+            //! The alignments are reused between batches, so only the
+            //! first size_ are valid.
+            size_t size_;
+            std::vector<SamAlignment> alignments_;
+            std::vector<OutputFileDescriptor*> outFiles_;
         };
 
         static const char SAM_SEPARATOR = '\t';
@@ -176,27 +264,44 @@ namespace cgatools { namespace mapping {
 
         void mappingRecordToSam(const SamRecord& record);
 
+        //! Converts a record and appends it to the buffer. Unlike
+        //! mappingRecordToSam, this may be called concurrently once the
+        //! header is set.
+        void mappingRecordToSam(const SamRecord& record, RecordBuffer& buffer) const;
+
+        //! Writes the records in the buffer, in order.
+        void write(const RecordBuffer& buffer);
+
         void setHeader(const SamFileHeaderBlock& header);
+
+        //! Ends the output files. With --sort-output, this is where the
+        //! records are written, so it must be called once all the
+        //! records are converted.
+        void close();
     protected:
         //obsolete function to detect consistency
         bool isConsistent(const SamRecord &r) const;
 
-        OutputFileDescriptor& getOutputStream(const std::string &id);
+        OutputFileDescriptor& getOutputStream(const std::string &id) const;
+
+        //! Converts the record into out, and returns the stream it
+        //! goes to, or NULL if the record is filtered out.
+        OutputFileDescriptor* fillAlignment(const SamRecord& record, SamAlignment& out) const;
 
         //! Generate additional tags: mate sequence
-        void printMateSequence(OutputFileDescriptor& out, 
-            const std::string &mateSeq, const std::string &mateScore);
+        void printMateSequence(SamAlignment& out, 
+            const std::string &mateSeq, const std::string &mateScore) const;
 
-        void printReadGroup(OutputFileDescriptor& out);
-        void printNegativeGapTag(OutputFileDescriptor& out, const mapping::SamSequenceSplitter &splitter);
+        void printReadGroup(SamAlignment& out) const;
+        void printNegativeGapTag(SamAlignment& out, const mapping::SamSequenceSplitter &splitter) const;
     
         //! Generate inconsistent mapping tag
-        void flagAsSVCandidate(OutputFileDescriptor& out);
+        void flagAsSVCandidate(SamAlignment& out) const;
         //! print allele info for EvidenceRecords
-        void printAlleleInfoTag(OutputFileDescriptor& out, const mapping::EvidenceSamRecord& evidenceRecord);
+        void printAlleleInfoTag(SamAlignment& out, const mapping::EvidenceSamRecord& evidenceRecord) const;
         //! print alternative mappings or mates
-        void printAlternatives(OutputFileDescriptor& out, const std::string& tag, 
-            const mapping::SamRecord::SamRecords& samRecords, size_t startFrom);
+        void printAlternatives(SamAlignment& out, const std::string& tag, 
+            const mapping::SamRecord::SamRecords& samRecords, size_t startFrom) const;
 
         uint32_t getAdjustedSamPosition(const SamRecord& record ) const;
         std::string getSamChr(uint16_t chr) const;
@@ -212,6 +317,7 @@ namespace cgatools { namespace mapping {
         SamFileHeaderBlock          header_;
         std::string                 readGroup_;
         const SamGeneratorConfig &  samGeneratorConfig_;
+        SamAlignment                alignment_;
     };
 
 } } // cgatools::mapping
@@ -0,0 +1,396 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/SamSorter.hpp"
+#include "cgatools/mapping/SamRecord.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <boost/filesystem/operations.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/mutex.hpp>
+
+#ifdef CGA_USE_WIN_API
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace cgatools { namespace mapping {
+
+    using util::Exception;
+
+    namespace {
+        // The temporary runs are written for speed rather than size.
+        const int RUN_COMPRESSION = 1;
+
+        // Numbers the sorters of the process, so that their temporary
+        // files have different names.
+        boost::mutex sorterCountMutex;
+        size_t sorterCount = 0;
+
+        size_t getProcessId()
+        {
+#ifdef CGA_USE_WIN_API
+            return size_t(_getpid());
+#else
+            return size_t(getpid());
+#endif
+        }
+
+        template <class T>
+        void append(std::string& out, const T& val)
+        {
+            out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+        }
+
+        void appendString(std::string& out, const std::string& val)
+        {
+            append(out, uint32_t(val.size()));
+            out.append(val);
+        }
+
+        // Writes a serialized record to a run, after its length.
+        void writeRecord(std::ostream& out, const char* record, size_t length)
+        {
+            uint32_t length32 = uint32_t(length);
+            out.write(reinterpret_cast<const char*>(&length32), sizeof(length32));
+            out.write(record, length);
+        }
+
+        template <class T>
+        void extract(const char*& in, T& val)
+        {
+            std::memcpy(&val, in, sizeof(val));
+            in += sizeof(val);
+        }
+
+        void extractString(const char*& in, std::string& val)
+        {
+            uint32_t size;
+            extract(in, size);
+            val.assign(in, size);
+            in += size;
+        }
+    }
+
+    //! Reads the records of a run in turn.
+    class SamSorter::RunReader
+    {
+    public:
+        explicit RunReader(const std::string& fileName)
+            : in_(fileName)
+        {
+        }
+
+        //! Reads the next record, returning false at the end of the run.
+        bool next()
+        {
+            uint32_t length;
+            if (!in_.read(reinterpret_cast<char*>(&length), sizeof(length)))
+                return false;
+            record_.resize(length);
+            if (!in_.read(&record_[0], length))
+                throw Exception("truncated temporary sort file");
+            key_ = SamSorter::getKey(record_.data());
+            return true;
+        }
+
+        const Key& getKey() const {return key_;}
+        const std::string& getRecord() const {return record_;}
+
+    private:
+        util::CompressedInputStream in_;
+        std::string record_;
+        Key key_;
+    };
+
+    namespace {
+        template <class Reader>
+        class GreaterKey
+        {
+        public:
+            bool operator()(const Reader* lhs, const Reader* rhs) const
+            {
+                return rhs->getKey() < lhs->getKey();
+            }
+        };
+    }
+
+    SamSorter::SamSorter(const SamFileHeaderBlock& header, size_t memory, const std::string& tempDir)
+        : memory_(memory),
+          tempDir_(tempDir),
+          runCount_(0),
+          recordCount_(0)
+    {
+        BOOST_FOREACH(const SamFileHeaderBlock& b, header.children_)
+        {
+            if ("@SQ" == b.type_)
+            {
+                uint32_t index = uint32_t(refIndexes_.size());
+                refIndexes_[b.getChild("SN").value_] = index;
+            }
+        }
+
+        size_t sorterId;
+        {
+            boost::mutex::scoped_lock lock(sorterCountMutex);
+            sorterId = sorterCount++;
+        }
+        runPrefix_ = "cgatools-sort-" + boost::lexical_cast<std::string>(getProcessId()) +
+            "-" + boost::lexical_cast<std::string>(sorterId) + "-";
+    }
+
+    SamSorter::~SamSorter()
+    {
+        try
+        {
+            removeRuns();
+        }
+        catch (std::exception&)
+        {
+        }
+    }
+
+    void SamSorter::add(const SamAlignment& a)
+    {
+        Key key;
+        if ("*" == a.rname_)
+            key.refIndex_ = std::numeric_limits<uint32_t>::max();
+        else
+        {
+            std::map<std::string, uint32_t>::const_iterator it = refIndexes_.find(a.rname_);
+            if (refIndexes_.end() == it)
+                throw Exception("reference sequence not in the SAM header: "+a.rname_);
+            key.refIndex_ = it->second;
+        }
+        key.pos_ = a.pos_;
+        key.order_ = recordCount_++;
+
+        Entry entry;
+        entry.key_ = key;
+        entry.offset_ = records_.size();
+        serialize(key, a, records_);
+        entry.length_ = records_.size() - entry.offset_;
+        entries_.push_back(entry);
+
+        if (records_.size() + entries_.size()*sizeof(Entry) >= memory_)
+            spill();
+    }
+
+    void SamSorter::finish(const Output& out)
+    {
+        if (runs_.empty())
+        {
+            std::sort(entries_.begin(), entries_.end());
+            BOOST_FOREACH(const Entry& entry, entries_)
+            {
+                deserialize(records_.data() + entry.offset_, entry.length_, alignment_);
+                out(alignment_);
+            }
+        }
+        else
+        {
+            if (!entries_.empty())
+                spill();
+
+            // merge the oldest runs into new ones until few enough remain
+            while (runs_.size() > MAX_MERGED_RUNS)
+            {
+                std::vector<std::string> merged(runs_.begin(), runs_.begin() + MAX_MERGED_RUNS);
+                runs_.push_back(createRunFileName());
+                mergeRuns(merged, runs_.back(), out);
+                runs_.erase(runs_.begin(), runs_.begin() + MAX_MERGED_RUNS);
+                BOOST_FOREACH(const std::string& run, merged)
+                    boost::filesystem::remove(run);
+            }
+            mergeRuns(runs_, "", out);
+            removeRuns();
+        }
+
+        records_.clear();
+        entries_.clear();
+    }
+
+    void SamSorter::spill()
+    {
+        std::sort(entries_.begin(), entries_.end());
+
+        runs_.push_back(createRunFileName());
+        util::CompressedOutputStream run(runs_.back(), RUN_COMPRESSION);
+        BOOST_FOREACH(const Entry& entry, entries_)
+            writeRecord(run, records_.data() + entry.offset_, entry.length_);
+        run.close();
+
+        // keep the memory, to be filled again
+        records_.clear();
+        entries_.clear();
+    }
+
+    std::string SamSorter::createRunFileName()
+    {
+        boost::filesystem::path fn(tempDir_);
+        fn /= runPrefix_ + boost::lexical_cast<std::string>(runCount_++) + ".gz";
+        return fn.string();
+    }
+
+    //! Merges the runs into the run file target, or into out if target
+    //! is empty.
+    void SamSorter::mergeRuns(const std::vector<std::string>& runs,
+                              const std::string& target, const Output& out)
+    {
+        boost::ptr_vector<RunReader> readers;
+        std::priority_queue<RunReader*, std::vector<RunReader*>, GreaterKey<RunReader> > heap;
+        BOOST_FOREACH(const std::string& run, runs)
+        {
+            readers.push_back(new RunReader(run));
+            if (readers.back().next())
+                heap.push(&readers.back());
+        }
+
+        boost::shared_ptr<util::CompressedOutputStream> merged;
+        if (!target.empty())
+            merged.reset(new util::CompressedOutputStream(target, RUN_COMPRESSION));
+
+        while (!heap.empty())
+        {
+            RunReader* reader = heap.top();
+            heap.pop();
+            const std::string& record = reader->getRecord();
+            if (merged)
+                writeRecord(*merged, record.data(), record.size());
+            else
+            {
+                deserialize(record.data(), record.size(), alignment_);
+                out(alignment_);
+            }
+            if (reader->next())
+                heap.push(reader);
+        }
+
+        if (merged)
+            merged->close();
+    }
+
+    void SamSorter::removeRuns()
+    {
+        BOOST_FOREACH(const std::string& run, runs_)
+            boost::filesystem::remove(run);
+        runs_.clear();
+    }
+
+    void SamSorter::serialize(const Key& key, const SamAlignment& a, std::string& out)
+    {
+        append(out, key);
+        appendString(out, a.qname_);
+        append(out, a.flag_);
+        appendString(out, a.rname_);
+        append(out, a.pos_);
+        append(out, int32_t(a.mapq_));
+        append(out, uint8_t(a.hasCigar_));
+        const Cigar::ParsedCigar& cigar = a.cigar_.getParsedCigar();
+        append(out, uint32_t(cigar.size()));
+        BOOST_FOREACH(const Cigar::CigarElement& e, cigar)
+        {
+            append(out, e.type_);
+            append(out, uint32_t(e.length_));
+        }
+        appendString(out, a.mrnm_);
+        append(out, a.mpos_);
+        append(out, int32_t(a.isize_));
+        appendString(out, a.seq_);
+        appendString(out, a.qual_);
+        append(out, uint32_t(a.tags_.size()));
+        BOOST_FOREACH(const SamAlignment::Tag& tag, a.tags_)
+        {
+            appendString(out, tag.name_);
+            append(out, tag.type_);
+            if ('Z' == tag.type_)
+                appendString(out, tag.string_);
+            else
+                append(out, tag.int_);
+        }
+    }
+
+    SamSorter::Key SamSorter::getKey(const char* record)
+    {
+        Key key;
+        extract(record, key);
+        return key;
+    }
+
+    void SamSorter::deserialize(const char* record, size_t length, SamAlignment& a)
+    {
+        const char* in = record;
+        a.clear();
+        Key key;
+        extract(in, key);
+        extractString(in, a.qname_);
+        extract(in, a.flag_);
+        extractString(in, a.rname_);
+        extract(in, a.pos_);
+        int32_t mapq;
+        extract(in, mapq);
+        a.mapq_ = mapq;
+        uint8_t hasCigar;
+        extract(in, hasCigar);
+        a.hasCigar_ = 0 != hasCigar;
+        uint32_t cigarSize;
+        extract(in, cigarSize);
+        for(uint32_t ii=0; ii<cigarSize; ii++)
+        {
+            char type;
+            uint32_t elementLength;
+            extract(in, type);
+            extract(in, elementLength);
+            a.cigar_.push_back(Cigar::CigarElement(type, elementLength));
+        }
+        extractString(in, a.mrnm_);
+        extract(in, a.mpos_);
+        int32_t isize;
+        extract(in, isize);
+        a.isize_ = isize;
+        extractString(in, a.seq_);
+        extractString(in, a.qual_);
+        uint32_t tagCount;
+        extract(in, tagCount);
+        for(uint32_t ii=0; ii<tagCount; ii++)
+        {
+            std::string name;
+            char type;
+            extractString(in, name);
+            extract(in, type);
+            if ('Z' == type)
+            {
+                std::string value;
+                extractString(in, value);
+                a.addTag(name, value);
+            }
+            else
+            {
+                int64_t value;
+                extract(in, value);
+                a.addTag(name, value);
+            }
+        }
+        CGA_ASSERT_EQ(size_t(in - record), length);
+    }
+
+} } // cgatools::mapping
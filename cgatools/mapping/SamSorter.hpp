@@ -0,0 +1,124 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGA_TOOLS_SAM_SORTER_HPP_
+#define CGA_TOOLS_SAM_SORTER_HPP_ 1
+
+//! @file SamSorter.hpp
+//! File containing the definition of SamSorter.
+
+#include "cgatools/core.hpp"
+#include "BamWriter.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace cgatools { namespace mapping {
+
+    //! Sorts SAM records by coordinate, as samtools sort does: by the
+    //! order of their reference in the @SQ lines of the header, then by
+    //! position, with the records that have no reference ("*") last.
+    //! Records with the same coordinate keep the order in which they
+    //! were added. The records are held in memory up to a budget; beyond
+    //! it they are written in sorted runs to gzip-compressed temporary
+    //! files, which finish() merges.
+    class SamSorter : boost::noncopyable
+    {
+    public:
+        //! Called by finish() on each record, in order.
+        typedef boost::function<void (const SamAlignment&)> Output;
+
+        //! The number of runs merged at once. If there are more, they
+        //! are first merged into larger runs, so that the number of
+        //! files open at once stays bounded.
+        static const size_t MAX_MERGED_RUNS = 64;
+
+        //! Sorts by the reference order of header, holding at most
+        //! about memory bytes of records in memory, and writing the
+        //! temporary files into tempDir.
+        SamSorter(const SamFileHeaderBlock& header, size_t memory, const std::string& tempDir);
+
+        //! Removes the temporary files that remain.
+        ~SamSorter();
+
+        void add(const SamAlignment& a);
+
+        //! Calls out on all the records added, in order.
+        void finish(const Output& out);
+
+        //! The number of temporary runs written so far.
+        size_t getRunCount() const {return runCount_;}
+
+    private:
+        //! The sort key, stored at the start of each serialized record.
+        struct Key
+        {
+            uint32_t refIndex_;
+            uint32_t pos_;
+            uint64_t order_;
+
+            bool operator<(const Key& other) const
+            {
+                if (refIndex_ != other.refIndex_)
+                    return refIndex_ < other.refIndex_;
+                if (pos_ != other.pos_)
+                    return pos_ < other.pos_;
+                return order_ < other.order_;
+            }
+        };
+
+        //! A record in memory: its key and where it is in records_.
+        struct Entry
+        {
+            Key     key_;
+            size_t  offset_;
+            size_t  length_;
+
+            bool operator<(const Entry& other) const {return key_ < other.key_;}
+        };
+
+        class RunReader;
+
+        void spill();
+        std::string createRunFileName();
+        void mergeRuns(const std::vector<std::string>& runs,
+                       const std::string& target, const Output& out);
+        void removeRuns();
+
+        static void serialize(const Key& key, const SamAlignment& a, std::string& out);
+        static Key getKey(const char* record);
+        static void deserialize(const char* record, size_t length, SamAlignment& a);
+
+        std::map<std::string, uint32_t> refIndexes_;
+        size_t memory_;
+        std::string tempDir_;
+        std::string runPrefix_;
+        size_t runCount_;
+        uint64_t recordCount_;
+
+        //! The serialized records in memory, and their entries.
+        std::string records_;
+        std::vector<Entry> entries_;
+
+        //! The temporary runs not yet merged, in the order written.
+        std::vector<std::string> runs_;
+        SamAlignment alignment_;
+    };
+
+} } // cgatools::mapping
+
+#endif // CGA_TOOLS_SAM_SORTER_HPP_
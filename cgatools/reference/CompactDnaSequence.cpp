@@ -18,6 +18,7 @@
 #include "cgatools/util/BaseUtil.hpp"
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <cstring>
 
 namespace cgatools { namespace reference {
 
@@ -35,6 +36,33 @@ namespace cgatools { namespace reference {
         }
     };
 
+    namespace {
+        // The four unpacked bases for every packed byte value, first base
+        // in the high-order bits.
+        class UnpackTable
+        {
+        public:
+            UnpackTable()
+            {
+                for(uint32_t packed=0; packed<256; packed++)
+                {
+                    for(uint32_t ii=0; ii<4; ii++)
+                        bases_[packed][ii] = bu::unpack( (packed >> (6-2*ii)) & 0x3 );
+                }
+            }
+
+            const char* operator[](uint8_t packed) const
+            {
+                return bases_[packed];
+            }
+
+        private:
+            char bases_[256][4];
+        };
+
+        const UnpackTable UNPACK_TABLE;
+    }
+
     CompactDnaSequence::CompactDnaSequence(const std::string& name,
                                            bool circular,
                                            const void* packedData,
@@ -96,9 +124,79 @@ namespace cgatools { namespace reference {
     {
         if (length < 0 || length > length_)
             throw Exception("failed to get reference sequence: position out of range");
-        seq.reserve(seq.size()+length);
-        for(int64_t ii=0; ii<length; ii++)
-            seq.push_back(getUnambiguousBase(pos+ii));
+        if (0 == length)
+            return;
+
+        size_t startLength = seq.size();
+        seq.resize(startLength+length);
+        try
+        {
+            getUnambiguousSequence(&seq[startLength], pos, length);
+        }
+        catch(...)
+        {
+            seq.resize(startLength);
+            throw;
+        }
+    }
+
+    void CompactDnaSequence::getSequence(char* out, int64_t pos, int64_t length) const
+    {
+        getUnambiguousSequence(out, pos, length);
+        applyAmbiguity(out, pos, length);
+    }
+
+    void CompactDnaSequence::getUnambiguousSequence(char* out, int64_t pos, int64_t length) const
+    {
+        if (length < 0 || length > length_)
+            throw Exception("failed to get reference sequence: position out of range");
+        if (0 == length)
+            return;
+
+        // Every position in between is valid if both ends are.
+        fixCircularPos(pos+length-1);
+        pos = fixCircularPos(pos);
+
+        if (pos+length > length_)
+        {
+            // Wraps around the end of a circular chromosome.
+            int64_t headLength = length_-pos;
+            unpackBases(out, pos, headLength);
+            unpackBases(out+headLength, 0, length-headLength);
+        }
+        else
+            unpackBases(out, pos, length);
+    }
+
+    void CompactDnaSequence::unpackBases(char* out, int64_t pos, int64_t length) const
+    {
+        const uint8_t* packed = packedData_ + pos/4;
+
+        // Partial leading byte.
+        size_t skip = pos & 0x3;
+        if (0 != skip)
+        {
+            size_t count = std::min(int64_t(4-skip), length);
+            std::memcpy(out, UNPACK_TABLE[*packed]+skip, count);
+            out += count;
+            length -= count;
+            packed++;
+        }
+
+        // Whole bytes, several at a time.
+        for(; length>=16; length-=16, out+=16, packed+=4)
+        {
+            std::memcpy(out,    UNPACK_TABLE[packed[0]], 4);
+            std::memcpy(out+4,  UNPACK_TABLE[packed[1]], 4);
+            std::memcpy(out+8,  UNPACK_TABLE[packed[2]], 4);
+            std::memcpy(out+12, UNPACK_TABLE[packed[3]], 4);
+        }
+        for(; length>=4; length-=4, out+=4, packed++)
+            std::memcpy(out, UNPACK_TABLE[*packed], 4);
+
+        // Partial trailing byte.
+        if (length > 0)
+            std::memcpy(out, UNPACK_TABLE[*packed], length);
     }
 
     char CompactDnaSequence::getBase(int64_t pos) const
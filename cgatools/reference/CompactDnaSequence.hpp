@@ -80,6 +80,19 @@ namespace cgatools { namespace reference {
         //! CompactDnaSequence::getUnambiguousBase().
         void appendUnambiguousSequence(std::string& seq, int64_t pos, int64_t length) const;
 
+        //! Copy the sequence of IUPAC codes as if by repeatedly
+        //! calling CompactDnaSequence::getBase() into out, which must
+        //! have room for length characters. No terminating null
+        //! character is written.
+        void getSequence           (char* out, int64_t pos, int64_t length) const;
+
+        //! Copy an unambiguous sequence of base calls as if by
+        //! repeatedly calling
+        //! CompactDnaSequence::getUnambiguousBase() into out, which
+        //! must have room for length characters. No terminating null
+        //! character is written.
+        void getUnambiguousSequence(char* out, int64_t pos, int64_t length) const;
+
         //! Get the IUPAC code for this chromosome at position pos. For
         //! circular chromosomes, pos is allowed to range from -length
         //! to 2*length-1.
@@ -144,6 +157,7 @@ namespace cgatools { namespace reference {
 
     private:
         inline int64_t fixCircularPos(int64_t pos) const;
+        void unpackBases(char* out, int64_t pos, int64_t length) const;
         void applyAmbiguity(char* seq, int64_t pos, int64_t length) const;
 
         std::string name_;
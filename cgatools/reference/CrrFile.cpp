@@ -99,6 +99,14 @@ namespace cgatools { namespace reference {
         return chromosomes_[range.chromosome_].getSequence(range.begin_, range.length());
     }
 
+    void CrrFile::getSequence(const Range& range, char* out) const
+    {
+        if (range.chromosome_ >= chromosomes_.size())
+            throw Exception( (boost::format("unrecognized chromosome id: %d") % range.chromosome_)
+                             .str());
+        chromosomes_[range.chromosome_].getSequence(out, range.begin_, range.length());
+    }
+
     char CrrFile::getBase(const Location& loc) const
     {
         if (loc.chromosome_ >= chromosomes_.size())
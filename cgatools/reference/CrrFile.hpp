@@ -49,6 +49,10 @@ namespace cgatools { namespace reference {
         //! Get the reference sequence for the given range.
         std::string getSequence(const Range& range) const;
 
+        //! Copy the reference sequence for the given range into out,
+        //! which must have room for range.length() characters.
+        void getSequence(const Range& range, char* out) const;
+
         //! Get the reference sequence for the given location.
         char getBase(const Location& loc) const;
 
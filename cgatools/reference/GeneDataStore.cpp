@@ -60,6 +60,7 @@ void GeneDataStore::load(const reference::CrrFile& crr, const std::string& fn)
         data.genomeCodingRange_ = Range(range.chromosome_, genomeCdsStart, genomeCdsEnd);
         tree_.put(range, data);
     }
+    tree_.index();
 }
 
 }}
@@ -35,11 +35,11 @@ struct GeneDescriptionData
 class GeneDataStore
 {
 private:
-    typedef util::IntervalTree<Range,
-                               Location,
-                               GeneDescriptionData,
-                               RangeOverlap,
-                               GetRangeBoundary > DataStore;
+    typedef util::StaticIntervalTree<Range,
+                                     Location,
+                                     GeneDescriptionData,
+                                     RangeOverlap,
+                                     GetRangeBoundary > DataStore;
 public:
     typedef DataStore::QueryResultType QueryResultType;
 
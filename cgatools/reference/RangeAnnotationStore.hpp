@@ -35,21 +35,26 @@ using cgatools::util::InputStream;
 namespace cgatools { namespace reference {
 
 
-//! Front end to IntervalTree based on reference ranges that allows
+//! Front end to an interval index based on reference ranges that allows
 //! to load annotations from a file. To build your own annotation store,
 //! derive from this class and provide an implementation for bindColumns
 //! method to associate column names to fields of the TValue structure.
 //! See class RepMaskStore in VarFileCombine.cpp for an example.
-template <typename Derived, typename TValue>
+//! The index is a StaticIntervalTree by default, which is indexed once
+//! the file is loaded; a store whose ranges are added to after loading
+//! may pass an IntervalTree as TDataStore instead.
+template <typename Derived,
+          typename TValue,
+          typename TDataStore = util::StaticIntervalTree<reference::Range,
+                                                         reference::Location,
+                                                         TValue,
+                                                         reference::RangeOverlap,
+                                                         reference::GetRangeBoundary> >
 class RangeAnnotationStore
 {
 private:
 public:
-    typedef util::IntervalTree<reference::Range,
-                               reference::Location,
-                               TValue,
-                               reference::RangeOverlap,
-                               reference::GetRangeBoundary > DataStore;
+    typedef TDataStore DataStore;
     typedef typename DataStore::QueryResultType QueryResultType;
 
     RangeAnnotationStore(const reference::CrrFile& crr)
@@ -70,6 +75,12 @@ public:
         data_.intersect(range, result);
     }
 
+    //! Returns the number of ranges in the store.
+    size_t size() const
+    {
+        return data_.size();
+    }
+
 #if 0
     //! Derived class must implement this function to add column parsers for
     //! the range and association columns.
@@ -82,7 +93,7 @@ protected:
 
     //! Typedef for this class to simplify constructor invocation
     //! in descendants
-    typedef RangeAnnotationStore<Derived, TValue> Base;
+    typedef RangeAnnotationStore<Derived, TValue, TDataStore> Base;
 
     //! Load data from the file with a given name.
     void load(const std::string& fn, char delimiter = '\t')
@@ -98,6 +109,7 @@ protected:
 
         while (df.next())
             data_.put(range, payload);
+        data_.index();
     }
 
 
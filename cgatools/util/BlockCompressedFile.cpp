@@ -0,0 +1,205 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/BlockCompressedFile.hpp"
+#include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+namespace cgatools { namespace util {
+
+    namespace bio = boost::iostreams;
+
+    namespace {
+        class BlockLastKeyLess
+        {
+        public:
+            bool operator()(const BlockCompressedIndex::Block& lhs, int64_t rhs) const
+            {
+                return lhs.lastKey_ < rhs;
+            }
+        };
+    }
+
+    BlockCompressedIndex::BlockCompressedIndex(uint64_t compressedSize)
+        : compressedSize_(compressedSize)
+    {
+    }
+
+    std::string BlockCompressedIndex::getIndexFileName(const std::string& fn)
+    {
+        return fn + ".idx";
+    }
+
+    boost::shared_ptr<BlockCompressedIndex> BlockCompressedIndex::open(const std::string& fn)
+    {
+        boost::shared_ptr<BlockCompressedIndex> result;
+        std::string idxFn = getIndexFileName(fn);
+        if (!InputStream::isReadable(idxFn))
+            return result;
+
+        result.reset(new BlockCompressedIndex());
+        InputStream in(idxFn);
+        result->read(in, idxFn);
+
+        uint64_t size = boost::filesystem::file_size(fn);
+        if (size != result->compressedSize_)
+            throw Exception("index does not match block-compressed file: "+idxFn);
+        return result;
+    }
+
+    boost::shared_ptr<std::istream>
+    BlockCompressedIndex::openBlock(const std::string& fn, size_t blockOffset) const
+    {
+        CGA_ASSERT(blockOffset < blocks_.size());
+        boost::shared_ptr<CompressedInputStream> result(new CompressedInputStream());
+        result->openAtMember(fn, blocks_[blockOffset].offset_);
+        return result;
+    }
+
+    size_t BlockCompressedIndex::findBlock(int64_t key) const
+    {
+        return std::lower_bound(blocks_.begin(), blocks_.end(), key, BlockLastKeyLess())
+            - blocks_.begin();
+    }
+
+    void BlockCompressedIndex::addBlock(int64_t lastKey, uint64_t offset)
+    {
+        if (!blocks_.empty() && lastKey < blocks_.back().lastKey_)
+            throw Exception("block-compressed file keys out of order");
+        blocks_.push_back(Block(lastKey, offset));
+    }
+
+    void BlockCompressedIndex::write(std::ostream& out) const
+    {
+        out << "#COMPRESSED_SIZE\t" << compressedSize_ << "\n";
+        out << "\n";
+        out << ">lastKey\toffset\n";
+        for(size_t ii=0; ii<blocks_.size(); ii++)
+            out << blocks_[ii].lastKey_ << "\t" << blocks_[ii].offset_ << "\n";
+    }
+
+    void BlockCompressedIndex::read(std::istream& in, const std::string& fn)
+    {
+        DelimitedFile df(in, fn);
+        compressedSize_ = df.getMetadata().get<uint64_t>("COMPRESSED_SIZE");
+
+        Block block;
+        df.addField(ValueField<int64_t>("lastKey", &block.lastKey_));
+        df.addField(ValueField<uint64_t>("offset", &block.offset_));
+        while (df.next())
+            addBlock(block.lastKey_, block.offset_);
+    }
+
+    const size_t BlockCompressedWriter::DEFAULT_BLOCK_SIZE;
+
+    BlockCompressedWriter::BlockCompressedWriter(const std::string& fn,
+                                                 size_t blockSize,
+                                                 int clev)
+        : fn_(fn),
+          blockSize_(blockSize),
+          clev_(clev),
+          out_(new OutputStream(fn)),
+          offset_(0),
+          hasLines_(false),
+          lastKey_(0)
+    {
+    }
+
+    BlockCompressedWriter::~BlockCompressedWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch(std::exception& ee)
+        {
+            std::cerr << ee.what() << std::endl;
+            CGA_ASSERT(false);
+        }
+    }
+
+    void BlockCompressedWriter::writeHeader(const std::string& text)
+    {
+        CGA_ASSERT(!hasLines_);
+        block_ += text;
+    }
+
+    void BlockCompressedWriter::writeLine(const std::string& line, int64_t key)
+    {
+        CGA_ASSERT(0 != out_.get());
+        if (hasLines_ && key < lastKey_)
+            throw Exception("failed to write block-compressed file: keys out of order: "+line);
+
+        if (!hasLines_)
+        {
+            // The header gets a block of its own, so that every
+            // indexed block starts with a data line.
+            if (!block_.empty())
+                flushBlock();
+        }
+        else if (block_.size() + line.size() >= blockSize_)
+        {
+            index_.addBlock(lastKey_, offset_);
+            flushBlock();
+        }
+
+        block_ += line;
+        block_.push_back('\n');
+        hasLines_ = true;
+        lastKey_ = key;
+    }
+
+    void BlockCompressedWriter::close()
+    {
+        if (0 == out_.get())
+            return;
+
+        if (hasLines_ && !block_.empty())
+            index_.addBlock(lastKey_, offset_);
+        // A gzip member is written even for an empty file, so that
+        // the output is a valid gzip file.
+        if (!block_.empty() || 0 == offset_)
+            flushBlock();
+        out_->close();
+        out_.reset();
+
+        index_.setCompressedSize(offset_);
+        OutputStream idx(BlockCompressedIndex::getIndexFileName(fn_));
+        index_.write(idx);
+        idx.close();
+    }
+
+    void BlockCompressedWriter::flushBlock()
+    {
+        compressed_.clear();
+        {
+            bio::filtering_ostream gz;
+            gz.push(bio::gzip_compressor(clev_));
+            gz.push(bio::back_inserter(compressed_));
+            gz.write(block_.data(), block_.size());
+            gz.reset();
+        }
+        out_->write(compressed_.data(), compressed_.size());
+        offset_ += compressed_.size();
+        block_.clear();
+    }
+
+} } // cgatools::util
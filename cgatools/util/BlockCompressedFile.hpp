@@ -0,0 +1,156 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_UTIL_BLOCKCOMPRESSEDFILE_HPP_
+#define CGATOOLS_UTIL_BLOCKCOMPRESSEDFILE_HPP_ 1
+
+//! @file BlockCompressedFile.hpp
+//! File containing definitions of BlockCompressedIndex and
+//! BlockCompressedWriter classes.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace cgatools { namespace util {
+
+    //! Index of a block-compressed text file. A block-compressed file
+    //! is a gzip file made of independently compressed gzip members,
+    //! each holding whole lines, so that it can be read by any gzip
+    //! reader, or decompressed starting at any block. Every data line
+    //! has an integer key, and keys are non-decreasing through the
+    //! file. The index lists, for each block, its offset in the
+    //! compressed file and the largest key in the block. The index of
+    //! file foo.tsv.gz is foo.tsv.gz.idx.
+    class BlockCompressedIndex
+    {
+    public:
+        struct Block
+        {
+            Block()
+                : lastKey_(0),
+                  offset_(0)
+            {
+            }
+
+            Block(int64_t lastKey, uint64_t offset)
+                : lastKey_(lastKey),
+                  offset_(offset)
+            {
+            }
+
+            int64_t lastKey_;
+            uint64_t offset_;
+        };
+
+        //! Constructs an empty index for a compressed file of the
+        //! given size.
+        explicit BlockCompressedIndex(uint64_t compressedSize = 0);
+
+        //! Returns the index file name for the given block-compressed
+        //! file name.
+        static std::string getIndexFileName(const std::string& fn);
+
+        //! Returns the index of fn if it has one, or an empty pointer
+        //! if it does not. Throws if the index does not match fn.
+        static boost::shared_ptr<BlockCompressedIndex> open(const std::string& fn);
+
+        //! Returns a stream reading fn from the beginning of the given
+        //! block to the end of the file.
+        boost::shared_ptr<std::istream> openBlock(const std::string& fn, size_t blockOffset) const;
+
+        //! Returns the offset of the first block whose last key is
+        //! greater than or equal to key, or getBlocks().size() if there
+        //! is no such block. This is the block holding the first line
+        //! with a key greater than or equal to key.
+        size_t findBlock(int64_t key) const;
+
+        void addBlock(int64_t lastKey, uint64_t offset);
+
+        void setCompressedSize(uint64_t compressedSize)
+        {
+            compressedSize_ = compressedSize;
+        }
+
+        uint64_t getCompressedSize() const
+        {
+            return compressedSize_;
+        }
+
+        const std::vector<Block>& getBlocks() const
+        {
+            return blocks_;
+        }
+
+        void write(std::ostream& out) const;
+
+    private:
+        void read(std::istream& in, const std::string& fn);
+
+        uint64_t compressedSize_;
+        std::vector<Block> blocks_;
+    };
+
+    //! Writes a block-compressed text file and its
+    //! BlockCompressedIndex. Example:
+    //! @code
+    //! BlockCompressedWriter out("foo.tsv.gz");
+    //! out.writeHeader(">offset\tvalue\n");
+    //! out.writeLine("10\tx", 10);
+    //! out.close();
+    //! @endcode
+    class BlockCompressedWriter : boost::noncopyable
+    {
+    public:
+        static const size_t DEFAULT_BLOCK_SIZE = 64*1024;
+
+        explicit BlockCompressedWriter(const std::string& fn,
+                                       size_t blockSize = DEFAULT_BLOCK_SIZE,
+                                       int clev = CompressedOutputStream::DEFAULT_COMPRESSION);
+        ~BlockCompressedWriter();
+
+        //! Writes text that is not part of any indexed block, such as
+        //! the metadata and column headers of a delimited file. Must
+        //! be called before the first writeLine().
+        void writeHeader(const std::string& text);
+
+        //! Writes a line, which should not include the newline, with
+        //! the given key. Keys must be non-decreasing.
+        void writeLine(const std::string& line, int64_t key);
+
+        //! Writes the last block and the index.
+        void close();
+
+    private:
+        void flushBlock();
+
+        std::string fn_;
+        size_t blockSize_;
+        int clev_;
+        boost::shared_ptr<OutputStream> out_;
+        uint64_t offset_;
+        std::string block_;
+        std::string compressed_;
+        bool hasLines_;
+        int64_t lastKey_;
+        BlockCompressedIndex index_;
+    };
+
+} } // cgatools::util
+
+#endif // CGATOOLS_UTIL_BLOCKCOMPRESSEDFILE_HPP_
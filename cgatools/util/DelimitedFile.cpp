@@ -20,6 +20,7 @@
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstring>
 #include <sstream>
 #include "cgatools/util/StringSet.hpp"
 
@@ -202,6 +203,11 @@ namespace cgatools { namespace util {
           delimiter_(delimiter),
           emptyHandling_(emptyHandling),
           strictnessChecking_(strictnessChecking),
+          lineCopied_(true),
+          lineFirst_(0),
+          lineLast_(0),
+          buf_(0),
+          mapped_(0),
           lineNo_(0),
           activeLineSetId_(),
           withinActiveLineSet_(true)
@@ -227,7 +233,7 @@ namespace cgatools { namespace util {
     {
         for (;;)
         {
-            bool ok = InputStream::getline(in_, line_);
+            bool ok = readLine();
             if (!ok)
                 return false;
             ++lineNo_;
@@ -235,13 +241,13 @@ namespace cgatools { namespace util {
             if (DelimitedLineParser::STRICT_CHECKING == strictnessChecking_)
                 break;
 
-            if (!line_.empty())
+            if (lineFirst_ != lineLast_)
             {
                 if (activeLineSetId_.empty())
                     break;
-                else if (line_ == "#ON " + activeLineSetId_)
+                else if (getLine() == "#ON " + activeLineSetId_)
                     withinActiveLineSet_ = true;
-                else if (line_ == "#OFF " + activeLineSetId_)
+                else if (getLine() == "#OFF " + activeLineSetId_)
                     withinActiveLineSet_ = false;
                 else if (withinActiveLineSet_)
                     break;
@@ -252,16 +258,63 @@ namespace cgatools { namespace util {
         {
             try
             {
-                lp_.parseLine(line_, delimiter_, emptyHandling_, strictnessChecking_);
+                lp_.parseLine(lineFirst_, lineLast_, delimiter_, emptyHandling_, strictnessChecking_);
             }
             catch(std::exception& ee)
             {
-                reportError(std::string(ee.what()) + ": " + line_);
+                reportError(std::string(ee.what()) + ": " + getLine());
             }
         }
         return true;
     }
 
+    bool DelimitedFile::readLine()
+    {
+        if (in_.rdbuf() != buf_)
+        {
+            buf_ = in_.rdbuf();
+            mapped_ = dynamic_cast<MappedFileBuffer*>(buf_);
+        }
+
+        if (0 == mapped_)
+        {
+            if (!InputStream::getline(in_, line_))
+                return false;
+            lineFirst_ = line_.data();
+            lineLast_ = lineFirst_ + line_.size();
+            lineCopied_ = true;
+            return true;
+        }
+
+        // Same semantics as InputStream::getline(), but the line is
+        // left in the mapped file.
+        if (!in_.good())
+            return false;
+        const char* first = mapped_->getCurrent();
+        const char* end = mapped_->getEnd();
+        if (first == end)
+        {
+            in_.setstate(std::ios::eofbit | std::ios::failbit);
+            return false;
+        }
+        const char* last = static_cast<const char*>(std::memchr(first, '\n', end-first));
+        if (0 == last)
+        {
+            last = end;
+            mapped_->advance(end);
+            in_.setstate(std::ios::eofbit);
+        }
+        else
+            mapped_->advance(last+1);
+        if (last != first && '\r' == last[-1])
+            --last;
+
+        lineFirst_ = first;
+        lineLast_ = last;
+        lineCopied_ = false;
+        return true;
+    }
+
     size_t DelimitedFile::getFieldOffset(const std::string& fieldName) const
     {
         size_t result = columnHeaders_.size();
@@ -24,6 +24,8 @@
 
 namespace cgatools { namespace util {
 
+    class MappedFileBuffer;
+
     class DelimitedFileMetadata
     {
     public:
@@ -99,7 +101,9 @@ namespace cgatools { namespace util {
     std::ostream& operator<< (std::ostream& out, const DelimitedFileMetadata& meta);
 
     //! Used to parse files delimited in the way found in a typical
-    //! Complete Genomics data file. Example:
+    //! Complete Genomics data file. If the stream reads a memory-mapped
+    //! file (see MappedInputStream), lines are parsed in place, without
+    //! copying them. Example:
     //! @code
     //! string chromosome;
     //! uint32_t offset;
@@ -169,12 +173,19 @@ namespace cgatools { namespace util {
             return lp_;
         }
 
+        //! Returns the current line.
         const std::string& getLine() const
         {
+            if (!lineCopied_)
+            {
+                line_.assign(lineFirst_, lineLast_);
+                lineCopied_ = true;
+            }
             return line_;
         }
 
     private:
+        bool readLine();
         void readHeader();
         void reportError(const std::string& error) const;
         bool columnHeadersEqual(const std::string& h1, const std::string& h2) const;
@@ -184,10 +195,17 @@ namespace cgatools { namespace util {
         Metadata metadata_;
         std::vector<std::string> columnHeaders_;
         DelimitedLineParser lp_;
-        std::string line_;
         char delimiter_;
         EmptyFieldHandling emptyHandling_;
         StrictnessChecking strictnessChecking_;
+        //! The current line is [lineFirst_,lineLast_), which points
+        //! either into line_ or into the mapped file.
+        mutable std::string line_;
+        mutable bool lineCopied_;
+        const char* lineFirst_;
+        const char* lineLast_;
+        std::streambuf* buf_;
+        MappedFileBuffer* mapped_;
         size_t lineNo_;
         std::string activeLineSetId_;
         bool withinActiveLineSet_;
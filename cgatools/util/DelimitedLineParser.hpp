@@ -24,6 +24,7 @@
 #include "cgatools/util/Exception.hpp"
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
@@ -169,6 +170,30 @@ namespace cgatools { namespace util {
         std::string* val_;
     };
 
+    //! A DelimitedFieldParser that records the bounds of the field,
+    //! without copying it. The bounds are only valid until the next
+    //! line is parsed.
+    class StringRangeField : public DelimitedFieldParser
+    {
+    public:
+        typedef std::pair<const char*, const char*> Range;
+
+        StringRangeField(const std::string& name, Range* val)
+            : DelimitedFieldParser(name),
+              val_(val)
+        {
+        }
+
+        void parse(const char* first, const char* last)
+        {
+            val_->first = first;
+            val_->second = last;
+        }
+
+    private:
+        Range* val_;
+    };
+
     //! A DelimitedFieldParser that records a character (not an unsigned integer).
     class CharField : public DelimitedFieldParser
     {
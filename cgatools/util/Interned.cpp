@@ -0,0 +1,32 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/Interned.hpp"
+
+namespace cgatools { namespace util {
+
+    void InternedStringField::parse(const char* first, const char* last)
+    {
+        const Interned<std::string>* cached = cache_.find(first, last);
+        if (0 != cached)
+        {
+            *val_ = *cached;
+            return;
+        }
+        *val_ = Interned<std::string>(std::string(first, last));
+        cache_.add(first, last, *val_);
+    }
+
+} } // cgatools::util
@@ -0,0 +1,247 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_UTIL_INTERNED_HPP_
+#define CGATOOLS_UTIL_INTERNED_HPP_ 1
+
+//! @file Interned.hpp
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/DelimitedLineParser.hpp"
+
+#include <cstring>
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+namespace cgatools { namespace util {
+
+    //! A read-only value stored once in a process-wide pool, for
+    //! values drawn from a small vocabulary such as variant types or
+    //! filters. An Interned<T> is a single pointer into the pool, so
+    //! copying it allocates nothing and two of them are equal iff they
+    //! point to the same value. The empty value is the null pointer.
+    //! The pool is never freed, and interning locks it, so values from
+    //! a large or unbounded vocabulary should stay plain T's.
+    template <class T>
+    class Interned
+    {
+    public:
+        typedef typename T::const_iterator const_iterator;
+        typedef const_iterator iterator;
+        typedef typename T::const_reference const_reference;
+
+        Interned()
+            : value_(0)
+        {
+        }
+
+        Interned(const T& value)
+            : value_(intern(value))
+        {
+        }
+
+        Interned(const char* value)
+            : value_(intern(T(value)))
+        {
+        }
+
+        const T& get() const
+        {
+            return 0 == value_ ? emptyValue() : *value_;
+        }
+
+        operator const T&() const
+        {
+            return get();
+        }
+
+        void clear()
+        {
+            value_ = 0;
+        }
+
+        bool empty() const
+        {
+            return 0 == value_;
+        }
+
+        size_t size() const
+        {
+            return get().size();
+        }
+
+        const_iterator begin() const
+        {
+            return get().begin();
+        }
+
+        const_iterator end() const
+        {
+            return get().end();
+        }
+
+        const_reference operator[](size_t ii) const
+        {
+            return get()[ii];
+        }
+
+        const char* c_str() const
+        {
+            return get().c_str();
+        }
+
+        bool operator==(const Interned& other) const
+        {
+            return value_ == other.value_;
+        }
+
+        bool operator!=(const Interned& other) const
+        {
+            return value_ != other.value_;
+        }
+
+    private:
+        static const T& emptyValue()
+        {
+            static const T EMPTY;
+            return EMPTY;
+        }
+
+        static const T* intern(const T& value)
+        {
+            if (value.empty())
+                return 0;
+            static boost::mutex mutex;
+            static std::set<T> pool;
+            boost::mutex::scoped_lock lock(mutex);
+            return &*pool.insert(value).first;
+        }
+
+        const T* value_;
+    };
+
+    template <class T>
+    bool operator==(const Interned<T>& lhs, const T& rhs)
+    {
+        return lhs.get() == rhs;
+    }
+
+    template <class T>
+    bool operator==(const T& lhs, const Interned<T>& rhs)
+    {
+        return lhs == rhs.get();
+    }
+
+    template <class T>
+    bool operator!=(const Interned<T>& lhs, const T& rhs)
+    {
+        return lhs.get() != rhs;
+    }
+
+    template <class T>
+    bool operator!=(const T& lhs, const Interned<T>& rhs)
+    {
+        return lhs != rhs.get();
+    }
+
+    template <class T>
+    bool operator<(const Interned<T>& lhs, const Interned<T>& rhs)
+    {
+        return lhs.get() < rhs.get();
+    }
+
+    inline bool operator==(const Interned<std::string>& lhs, const char* rhs)
+    {
+        return lhs.get() == rhs;
+    }
+
+    inline bool operator==(const char* lhs, const Interned<std::string>& rhs)
+    {
+        return lhs == rhs.get();
+    }
+
+    inline bool operator!=(const Interned<std::string>& lhs, const char* rhs)
+    {
+        return lhs.get() != rhs;
+    }
+
+    inline bool operator!=(const char* lhs, const Interned<std::string>& rhs)
+    {
+        return lhs != rhs.get();
+    }
+
+    inline std::ostream& operator<<(std::ostream& out, const Interned<std::string>& val)
+    {
+        return out << val.get();
+    }
+
+    //! The values a field parser has interned, keyed by the text of
+    //! the field, so that a parser reading a small vocabulary seldom
+    //! locks the pool. Each parser owns its cache.
+    template <class T>
+    class InternedFieldCache
+    {
+    public:
+        //! Returns the value cached for the text [first,last), or 0.
+        const Interned<T>* find(const char* first, const char* last) const
+        {
+            size_t size = last-first;
+            for(size_t ii=0; ii<entries_.size(); ii++)
+            {
+                const std::string& text = entries_[ii].first;
+                if (text.size() == size && 0 == std::memcmp(text.data(), first, size))
+                    return &entries_[ii].second;
+            }
+            return 0;
+        }
+
+        //! Caches the value for the text [first,last), unless the
+        //! cache is full.
+        void add(const char* first, const char* last, const Interned<T>& value)
+        {
+            if (entries_.size() < MAX_ENTRIES)
+                entries_.push_back(std::make_pair(std::string(first, last), value));
+        }
+
+    private:
+        enum { MAX_ENTRIES = 32 };
+
+        std::vector< std::pair<std::string, Interned<T> > > entries_;
+    };
+
+    //! A DelimitedFieldParser for a field drawn from a small
+    //! vocabulary, which it interns.
+    class InternedStringField : public DelimitedFieldParser
+    {
+    public:
+        InternedStringField(const std::string& name, Interned<std::string>* val)
+            : DelimitedFieldParser(name),
+              val_(val)
+        {
+        }
+
+        void parse(const char* first, const char* last);
+
+    private:
+        Interned<std::string>* val_;
+        InternedFieldCache<std::string> cache_;
+    };
+
+} } // cgatools::util
+
+#endif // CGATOOLS_UTIL_INTERNED_HPP_
@@ -0,0 +1,412 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace cgatools { namespace util {
+
+    namespace bio = boost::iostreams;
+
+    size_t ParallelCompression::THREAD_COUNT = 1;
+
+    namespace {
+        // The uncompressed size of a BGZF block, chosen as in htslib
+        // so that a compressed block always fits in 64KB.
+        const size_t BGZF_BLOCK_SIZE = 0xff00;
+        const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+        const size_t BGZF_HEADER_SIZE = 18;
+
+        // Gzip header with FEXTRA, holding the BGZF "BC" subfield. The
+        // last two bytes are the block size minus one.
+        const unsigned char BGZF_HEADER[BGZF_HEADER_SIZE] =
+        {
+            31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 0, 0
+        };
+
+        // An empty BGZF block, which marks the end of the file.
+        const unsigned char BGZF_EOF[28] =
+        {
+            31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0,
+            27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        };
+
+        const size_t BZIP2_BLOCK_SIZE = 900*1000;
+
+        // The number of blocks per thread handed to the threads at
+        // once.
+        const size_t BGZF_BLOCKS_PER_THREAD = 8;
+        const size_t BZIP2_BLOCKS_PER_THREAD = 1;
+
+        boost::mutex poolMutex;
+        boost::scoped_ptr<ThreadPool> pool;
+
+        void appendUInt32(std::string& out, uint32_t val)
+        {
+            for(size_t ii=0; ii<4; ii++)
+                out.push_back(char((val >> (8*ii)) & 0xff));
+        }
+
+        uint32_t getUInt32(const char* data)
+        {
+            const unsigned char* udata = reinterpret_cast<const unsigned char*>(data);
+            return uint32_t(udata[0]) | (uint32_t(udata[1]) << 8) |
+                (uint32_t(udata[2]) << 16) | (uint32_t(udata[3]) << 24);
+        }
+
+        void writeFully(FileSinkDevice& out, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                std::streamsize count = out.write(data, size);
+                data += count;
+                size -= count;
+            }
+        }
+
+        size_t readFully(FileSourceDevice& in, char* data, size_t size)
+        {
+            size_t result = 0;
+            while (result < size)
+            {
+                std::streamsize count = in.read(data+result, size-result);
+                if (count < 0)
+                    break;
+                result += count;
+            }
+            return result;
+        }
+    }
+
+    size_t ParallelCompression::getThreadCount()
+    {
+        if (0 == THREAD_COUNT)
+            return ThreadPool::hardwareThreadCount();
+        return THREAD_COUNT;
+    }
+
+    void ParallelCompression::parallelFor(size_t count, const ThreadPool::WorkFunction& fn)
+    {
+        boost::unique_lock<boost::mutex> lock(poolMutex);
+        if (0 == pool.get() || pool->size() != getThreadCount())
+            pool.reset(new ThreadPool(getThreadCount()));
+        pool->parallelFor(count, fn);
+    }
+
+    //-----------------------------------------------------------------------
+    // ParallelCompressorSink
+    //-----------------------------------------------------------------------
+    struct ParallelCompressorSink::Impl
+    {
+        Impl(FileSinkDevice* file, std::ostream* stream, Format format, int clev)
+            : file_(file),
+              stream_(stream),
+              format_(format),
+              clev_(clev),
+              blockSize_(GZIP == format ? BGZF_BLOCK_SIZE : BZIP2_BLOCK_SIZE),
+              blocks_(0),
+              closed_(false)
+        {
+            size_t batchSize = ParallelCompression::getThreadCount() *
+                (GZIP == format ? BGZF_BLOCKS_PER_THREAD : BZIP2_BLOCKS_PER_THREAD);
+            input_.resize(batchSize);
+            output_.resize(batchSize);
+        }
+
+        void compressBlock(size_t ii)
+        {
+            const std::string& in = input_[ii];
+            std::string& out = output_[ii];
+            out.clear();
+
+            if (BZIP2 == format_)
+            {
+                bio::filtering_ostream bzOut;
+                bzOut.push(bio::bzip2_compressor());
+                bzOut.push(bio::back_inserter(out));
+                bzOut.write(in.data(), in.size());
+                bzOut.reset();
+                return;
+            }
+
+            out.append(reinterpret_cast<const char*>(BGZF_HEADER), BGZF_HEADER_SIZE);
+            bio::zlib_params params(clev_);
+            params.noheader = true;
+            params.calculate_crc = true;
+            bio::zlib_compressor deflater(params);
+            {
+                bio::filtering_ostream zOut;
+                zOut.push(deflater);
+                zOut.push(bio::back_inserter(out));
+                zOut.write(in.data(), in.size());
+                zOut.reset();
+            }
+            appendUInt32(out, deflater.crc());
+            appendUInt32(out, uint32_t(in.size()));
+            if (out.size() > BGZF_MAX_BLOCK_SIZE)
+                throw Exception("failed to compress BGZF block: block too large");
+            out[16] = char((out.size()-1) & 0xff);
+            out[17] = char((out.size()-1) >> 8);
+        }
+
+        void flushBatch()
+        {
+            ParallelCompression::parallelFor(
+                blocks_, boost::bind(&Impl::compressBlock, this, _1));
+            for(size_t ii=0; ii<blocks_; ii++)
+                writeOutput(output_[ii].data(), output_[ii].size());
+            blocks_ = 0;
+        }
+
+        void writeOutput(const char* data, size_t size)
+        {
+            if (0 != file_.get())
+            {
+                writeFully(*file_, data, size);
+                return;
+            }
+            stream_->write(data, size);
+            if (!stream_->good())
+                throw Exception("failed to write compressed output");
+        }
+
+        boost::scoped_ptr<FileSinkDevice> file_;
+        std::ostream* stream_;
+        Format format_;
+        int clev_;
+        size_t blockSize_;
+        std::vector<std::string> input_;
+        std::vector<std::string> output_;
+        size_t blocks_;
+        bool closed_;
+    };
+
+    ParallelCompressorSink::ParallelCompressorSink(
+        const std::string& fn, Format format, int clev, bool append)
+        : pimpl_(new Impl(new FileSinkDevice(fn, append ? BOOST_IOS::app : BOOST_IOS::out),
+                          0, format, clev))
+    {
+    }
+
+    ParallelCompressorSink::ParallelCompressorSink(
+        std::ostream& out, Format format, int clev)
+        : pimpl_(new Impl(0, &out, format, clev))
+    {
+    }
+
+    std::streamsize ParallelCompressorSink::write(const char* s, std::streamsize n)
+    {
+        Impl& impl = *pimpl_;
+        std::streamsize written = 0;
+        while (written < n)
+        {
+            if (0 == impl.blocks_ || impl.input_[impl.blocks_-1].size() == impl.blockSize_)
+            {
+                if (impl.input_.size() == impl.blocks_)
+                    impl.flushBatch();
+                impl.input_[impl.blocks_++].clear();
+            }
+            std::string& block = impl.input_[impl.blocks_-1];
+            size_t count = std::min(size_t(n - written), impl.blockSize_ - block.size());
+            block.append(s+written, count);
+            written += count;
+        }
+        return n;
+    }
+
+    void ParallelCompressorSink::close()
+    {
+        Impl& impl = *pimpl_;
+        if (impl.closed_)
+            return;
+        impl.closed_ = true;
+        impl.flushBatch();
+        if (GZIP == impl.format_)
+            impl.writeOutput(reinterpret_cast<const char*>(BGZF_EOF), sizeof(BGZF_EOF));
+        if (0 != impl.file_.get())
+            impl.file_->close();
+        else
+            impl.stream_->flush();
+    }
+
+    //-----------------------------------------------------------------------
+    // BgzfSource
+    //-----------------------------------------------------------------------
+    struct BgzfSource::Impl
+    {
+        explicit Impl(const std::string& fn)
+            : fn_(fn),
+              in_(fn),
+              blocks_(0),
+              current_(0),
+              offset_(0)
+        {
+            size_t batchSize = ParallelCompression::getThreadCount() * BGZF_BLOCKS_PER_THREAD;
+            input_.resize(batchSize);
+            output_.resize(batchSize);
+        }
+
+        bool readBlock(std::string& block)
+        {
+            char header[BGZF_MAX_BLOCK_SIZE];
+            size_t count = readFully(in_, header, 12);
+            if (0 == count)
+                return false;
+            if (12 != count)
+                throw Exception("truncated BGZF block in file "+fn_);
+            size_t xlen = size_t(uint8_t(header[10])) | (size_t(uint8_t(header[11])) << 8);
+            if ( 31 != uint8_t(header[0]) || 139 != uint8_t(header[1]) ||
+                 8 != header[2] || 0 == (header[3] & 4) ||
+                 12 + xlen > sizeof(header) )
+                throw Exception("invalid BGZF block in file "+fn_);
+            if (readFully(in_, header+12, xlen) != xlen)
+                throw Exception("truncated BGZF block in file "+fn_);
+
+            // The BSIZE subfield holds the block size minus one.
+            size_t blockSize = 0;
+            for(size_t offset=12; offset+4<=12+xlen; )
+            {
+                size_t slen = size_t(uint8_t(header[offset+2])) |
+                    (size_t(uint8_t(header[offset+3])) << 8);
+                if (offset+4+slen > 12+xlen)
+                    break;
+                if ('B' == header[offset] && 'C' == header[offset+1] && 2 == slen)
+                {
+                    blockSize = 1 + ( size_t(uint8_t(header[offset+4])) |
+                                      (size_t(uint8_t(header[offset+5])) << 8) );
+                    break;
+                }
+                offset += 4 + slen;
+            }
+            if (0 == blockSize)
+                throw Exception("BGZF block without BSIZE subfield in file "+fn_);
+            if (blockSize < 12 + xlen + 8)
+                throw Exception("invalid BGZF block size in file "+fn_);
+
+            block.assign(header, 12 + xlen);
+            block.resize(blockSize);
+            size_t rest = blockSize - 12 - xlen;
+            if (readFully(in_, &block[12 + xlen], rest) != rest)
+                throw Exception("truncated BGZF block in file "+fn_);
+            return true;
+        }
+
+        void decompressBlock(size_t ii)
+        {
+            // The block is a gzip header, raw deflate data, the CRC
+            // and the uncompressed size.
+            const std::string& in = input_[ii];
+            std::string& out = output_[ii];
+            size_t headerSize = 12 + (size_t(uint8_t(in[10])) | (size_t(uint8_t(in[11])) << 8));
+            uint32_t outSize = getUInt32(&in[in.size()-4]);
+            if (outSize > BGZF_MAX_BLOCK_SIZE)
+                throw Exception("invalid BGZF block in file "+fn_);
+            out.resize(outSize);
+            if (out.empty())
+                return;
+
+            bio::zlib_params params;
+            params.noheader = true;
+            params.calculate_crc = true;
+            bio::zlib_decompressor inflater(params);
+            bio::filtering_istream zIn;
+            zIn.push(inflater, BGZF_MAX_BLOCK_SIZE);
+            zIn.push(bio::array_source(in.data()+headerSize, in.size()-headerSize-8));
+            zIn.read(&out[0], out.size());
+            if ( size_t(zIn.gcount()) != out.size() ||
+                 inflater.crc() != getUInt32(&in[in.size()-8]) )
+                throw Exception("invalid BGZF block in file "+fn_);
+        }
+
+        bool fillBatch()
+        {
+            blocks_ = current_ = offset_ = 0;
+            while (blocks_ < input_.size() && readBlock(input_[blocks_]))
+                blocks_++;
+            ParallelCompression::parallelFor(
+                blocks_, boost::bind(&Impl::decompressBlock, this, _1));
+            return blocks_ > 0;
+        }
+
+        std::string fn_;
+        FileSourceDevice in_;
+        std::vector<std::string> input_;
+        std::vector<std::string> output_;
+        size_t blocks_;
+        size_t current_;
+        size_t offset_;
+    };
+
+    BgzfSource::BgzfSource(const std::string& fn)
+        : pimpl_(new Impl(fn))
+    {
+    }
+
+    std::streamsize BgzfSource::read(char* s, std::streamsize n)
+    {
+        Impl& impl = *pimpl_;
+        std::streamsize result = 0;
+        while (result < n)
+        {
+            if (impl.current_ == impl.blocks_)
+            {
+                if (!impl.fillBatch())
+                    break;
+                continue;
+            }
+
+            const std::string& block = impl.output_[impl.current_];
+            size_t count = std::min(size_t(n - result), block.size() - impl.offset_);
+            std::memcpy(s+result, block.data()+impl.offset_, count);
+            result += count;
+            impl.offset_ += count;
+            if (impl.offset_ == block.size())
+            {
+                impl.current_++;
+                impl.offset_ = 0;
+            }
+        }
+        return (0 == result && n > 0) ? -1 : result;
+    }
+
+    void BgzfSource::close()
+    {
+        pimpl_->in_.close();
+    }
+
+    bool BgzfSource::isBgzf(const std::string& fn)
+    {
+        FileSourceDevice in(fn);
+        char header[BGZF_HEADER_SIZE];
+        if (readFully(in, header, BGZF_HEADER_SIZE) != BGZF_HEADER_SIZE)
+            return false;
+        return 0 == std::memcmp(header, BGZF_HEADER, 4) &&
+            0 == std::memcmp(header+10, BGZF_HEADER+10, 6);
+    }
+
+} } // cgatools::util
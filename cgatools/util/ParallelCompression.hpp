@@ -0,0 +1,122 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_UTIL_PARALLELCOMPRESSION_HPP_
+#define CGATOOLS_UTIL_PARALLELCOMPRESSION_HPP_ 1
+
+//! @file ParallelCompression.hpp
+//! File containing definitions of ParallelCompression,
+//! ParallelCompressorSink, and BgzfSource.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/ThreadPool.hpp"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/categories.hpp>
+
+namespace cgatools { namespace util {
+
+    //! Process-wide settings for parallel compression and
+    //! decompression by CompressedInputStream and
+    //! CompressedOutputStream.
+    class ParallelCompression
+    {
+    public:
+        //! The number of threads used to compress and decompress
+        //! files. With 1, the default, compressed streams run on the
+        //! calling thread, exactly as they always have. With more, gzip
+        //! files are written in BGZF format and bzip2 files as a series
+        //! of bzip2 streams, compressed in parallel, and BGZF files are
+        //! decompressed in parallel. 0 means one thread per hardware
+        //! thread. Set this before opening any stream.
+        static size_t THREAD_COUNT;
+
+        //! Returns THREAD_COUNT, with 0 replaced by the number of
+        //! hardware threads.
+        static size_t getThreadCount();
+
+        //! Calls fn(ii) for each ii in [0,count) on the process-wide
+        //! compression threads. Concurrent calls are serialized.
+        static void parallelFor(size_t count, const ThreadPool::WorkFunction& fn);
+    };
+
+    //! A boost::iostreams sink that compresses its input in blocks, on
+    //! the ParallelCompression threads, and writes the compressed blocks
+    //! in order to a file or stream. Gzip output is BGZF, as written by bgzip and
+    //! samtools: a series of gzip members of at most 64KB with their
+    //! size in a header extra field, followed by an empty member as an
+    //! end-of-file marker. Bzip2 output is a series of complete bzip2
+    //! streams. Either is readable by any gzip or bzip2 reader.
+    class ParallelCompressorSink
+    {
+    public:
+        enum Format
+        {
+            GZIP = 0,
+            BZIP2 = 1
+        };
+
+        typedef char char_type;
+        struct category
+            : boost::iostreams::sink_tag,
+              boost::iostreams::closable_tag
+        { };
+
+        //! Writes the compressed blocks to fn, replacing it, or adding
+        //! them to its end if append is true.
+        ParallelCompressorSink(const std::string& fn, Format format, int clev,
+                               bool append = false);
+
+        //! Writes the compressed blocks to out, which must outlive the
+        //! sink. Closing the sink flushes out but does not close it.
+        ParallelCompressorSink(std::ostream& out, Format format, int clev);
+
+        std::streamsize write(const char* s, std::streamsize n);
+        void close();
+
+    private:
+        struct Impl;
+        boost::shared_ptr<Impl> pimpl_;
+    };
+
+    //! A boost::iostreams source that reads a BGZF file, decompressing
+    //! its blocks on the ParallelCompression threads.
+    class BgzfSource
+    {
+    public:
+        typedef char char_type;
+        struct category
+            : boost::iostreams::source_tag,
+              boost::iostreams::closable_tag
+        { };
+
+        explicit BgzfSource(const std::string& fn);
+
+        std::streamsize read(char* s, std::streamsize n);
+        void close();
+
+        //! Returns true if fn starts with a BGZF block.
+        static bool isBgzf(const std::string& fn);
+
+    private:
+        struct Impl;
+        boost::shared_ptr<Impl> pimpl_;
+    };
+
+} } // cgatools::util
+
+#endif // CGATOOLS_UTIL_PARALLELCOMPRESSION_HPP_
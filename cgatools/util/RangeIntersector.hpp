@@ -107,6 +107,12 @@ namespace cgatools { namespace util {
             root_ = doInsert(root_, range, value);
         }
 
+        //! Does nothing, since the tree is kept indexed by put(); for
+        //! interchangeability with StaticIntervalTree.
+        void index()
+        {
+        }
+
         //! Find the intersection of the given range with all the ranges
         //! in the set.
         void intersect(const TRange& range,
@@ -323,6 +329,193 @@ namespace cgatools { namespace util {
         }
     };
 
+    //! Interval index with the same template parameters and intersect()
+    //! results as IntervalTree, for sets of ranges that are loaded once
+    //! and then only queried. The ranges are kept in a vector sorted on
+    //! left boundary, which doubles as a balanced binary search tree:
+    //! the node for the subarray [lo, hi) is its middle element, and a
+    //! parallel vector holds the maximum upper boundary of each
+    //! subtree. There is no per-range allocation and no pointer, so the
+    //! index takes a fraction of the memory of IntervalTree and queries
+    //! touch far fewer cache lines.
+    //!
+    //! Ranges added with put() are not visible to intersect() until
+    //! index() is called. Like IntervalTree, intersect() returns ranges
+    //! in left boundary order, and ranges with equal left boundaries in
+    //! the order they were added.
+    template < typename TRange,
+               typename TBoundary,
+               typename TValue,
+               typename Overlap,
+               typename GetBoundary,
+               typename BoundaryLess = std::less<TBoundary> >
+    class StaticIntervalTree
+    {
+    public:
+        typedef StaticIntervalTree<TRange, TBoundary, TValue,
+                                   Overlap, GetBoundary, BoundaryLess> MyType;
+        typedef std::pair<TRange, TValue> value_type;
+        typedef const value_type* QueryResultType;
+
+        //! Creates empty index.
+        StaticIntervalTree(const Overlap& overlap = Overlap(),
+                           const GetBoundary& getBoundary = GetBoundary(),
+                           const BoundaryLess& boundaryLess = BoundaryLess())
+            :   overlap_(overlap),
+                getBoundary_(getBoundary),
+                boundaryLess_(boundaryLess),
+                indexed_(true)
+        {
+        }
+
+        //! Add a range to the set. The range is not found by
+        //! intersect() until index() is called.
+        void put(const TRange& range, const TValue& value)
+        {
+            data_.push_back(value_type(range, value));
+            indexed_ = false;
+        }
+
+        //! Sorts the ranges added by put() and builds the index.
+        void index()
+        {
+            if (indexed_)
+                return;
+            std::stable_sort(data_.begin(), data_.end(), LeftBoundaryLess(*this));
+            rmax_.clear();
+            rmax_.reserve(data_.size());
+            for (size_t ii = 0; ii < data_.size(); ++ii)
+                rmax_.push_back(getBoundary_(data_[ii].first, 1));
+            doIndex(0, data_.size());
+            indexed_ = true;
+        }
+
+        //! Find the intersection of the given range with all the ranges
+        //! in the set.
+        void intersect(const TRange& range,
+                       std::vector< QueryResultType >& result ) const
+        {
+            CGA_ASSERT(indexed_);
+            result.clear();
+            doSearch(0, data_.size(), range, result);
+        }
+
+        //! Number of ranges in the index.
+        size_t size() const { return data_.size(); }
+
+        //! Swaps the internals of this index with another.
+        void swap(MyType& rhs)
+        {
+            std::swap(overlap_, rhs.overlap_);
+            std::swap(getBoundary_, rhs.getBoundary_);
+            std::swap(boundaryLess_, rhs.boundaryLess_);
+            data_.swap(rhs.data_);
+            rmax_.swap(rhs.rmax_);
+            std::swap(indexed_, rhs.indexed_);
+        }
+
+        //! Clear all data.
+        void clear()
+        {
+            MyType t(overlap_, getBoundary_, boundaryLess_);
+            swap(t);
+        }
+
+        //! Debug function: returns tree depth and validates the
+        //! index structure.
+        size_t getMaxDepth() const
+        {
+            CGA_ASSERT(indexed_);
+            return doGetDepth(0, data_.size());
+        }
+
+    private:
+        struct LeftBoundaryLess
+        {
+            LeftBoundaryLess(const MyType& tree)
+                : tree_(tree)
+            {
+            }
+
+            bool operator()(const value_type& a, const value_type& b) const
+            {
+                return tree_.boundaryLess_( tree_.getBoundary_(a.first, 0),
+                                            tree_.getBoundary_(b.first, 0) );
+            }
+
+            const MyType& tree_;
+        };
+
+        Overlap overlap_;
+        GetBoundary getBoundary_;
+        BoundaryLess boundaryLess_;
+        std::vector<value_type> data_;
+        std::vector<TBoundary> rmax_;
+        bool indexed_;
+
+        static size_t middle(size_t lo, size_t hi)
+        {
+            return lo + (hi - lo) / 2;
+        }
+
+        void setRangeMax(size_t node, size_t lo, size_t hi)
+        {
+            if (lo < hi && boundaryLess_(rmax_[node], rmax_[middle(lo, hi)]))
+                rmax_[node] = rmax_[middle(lo, hi)];
+        }
+
+        void doIndex(size_t lo, size_t hi)
+        {
+            if (lo >= hi)
+                return;
+            size_t mid = middle(lo, hi);
+            doIndex(lo, mid);
+            doIndex(mid+1, hi);
+            setRangeMax(mid, lo, mid);
+            setRangeMax(mid, mid+1, hi);
+        }
+
+        void doSearch(size_t lo, size_t hi, const TRange& k,
+                      std::vector< QueryResultType >& result) const
+        {
+            if (lo >= hi)
+                return;
+
+            size_t mid = middle(lo, hi);
+            if (boundaryLess_( rmax_[mid], getBoundary_(k, 0) ))
+                return;
+
+            doSearch(lo, mid, k, result);
+
+            if ( boundaryLess_( getBoundary_(k, 1), getBoundary_(data_[mid].first, 0)) )
+                return;
+
+            if (overlap_(data_[mid].first, k))
+                result.push_back(&data_[mid]);
+
+            doSearch(mid+1, hi, k, result);
+        }
+
+        size_t doGetDepth(size_t lo, size_t hi) const
+        {
+            if (lo >= hi)
+                return 0;
+
+            size_t mid = middle(lo, hi);
+            CGA_ASSERT(!boundaryLess_(rmax_[mid], getBoundary_(data_[mid].first, 1)));
+            if (lo < mid)
+            {
+                CGA_ASSERT(!boundaryLess_(rmax_[mid], rmax_[middle(lo, mid)]));
+                CGA_ASSERT(!boundaryLess_(getBoundary_(data_[mid].first, 0),
+                                          getBoundary_(data_[mid-1].first, 0)));
+            }
+            if (mid+1 < hi)
+                CGA_ASSERT(!boundaryLess_(rmax_[mid], rmax_[middle(mid+1, hi)]));
+
+            return 1 + std::max(doGetDepth(lo, mid), doGetDepth(mid+1, hi));
+        }
+    };
+
 } } // cgatools::util
 
 #endif // CGATOOLS_UTIL_RANGE_INTERSECTOR_HPP_
@@ -14,9 +14,12 @@
 
 #include "cgatools/core.hpp"
 #include "cgatools/util/RangeSet.hpp"
+#include "cgatools/util/DelimitedFile.hpp"
 #include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
 #include "cgatools/util/parse.hpp"
 
+#include "cgatools/reference/ChromosomeIdField.hpp"
 #include "cgatools/reference/CrrFile.hpp"
 #include "cgatools/reference/range.hpp"
 
@@ -88,6 +91,68 @@ namespace cgatools { namespace util {
             add(st);
     }
 
+    void FastRangeSet::addFile( const std::string &fn )
+    {
+        boost::shared_ptr<std::istream> in = InputStream::openCompressedInputStreamByExtension(fn);
+        DelimitedFile df(*in, fn);
+        reference::Range r;
+        df.addField(reference::ChromosomeIdField("chromosome", &r.chromosome_, reference_));
+        df.addField(ValueField<uint32_t>("begin", &r.begin_));
+        df.addField(ValueField<uint32_t>("end", &r.end_));
+        while (df.next())
+        {
+            if (r.end_ < r.begin_)
+                throw Exception("range end precedes begin: "+df.getLine());
+            add(r);
+        }
+    }
+
+    void FastRangeSet::merge()
+    {
+        BOOST_FOREACH(RangeSet &s, ranges_)
+        {
+            RangeSet merged;
+            BOOST_FOREACH(const Range &r, s)
+            {
+                if (!merged.empty() && r.first <= merged.rbegin()->second)
+                {
+                    Range last = *merged.rbegin();
+                    merged.erase(--merged.end());
+                    merged.insert(std::make_pair(last.first, std::max(last.second, r.second)));
+                }
+                else
+                    merged.insert(r);
+            }
+            s.swap(merged);
+        }
+    }
+
+    bool FastRangeSet::findNext( const reference::Location& loc, reference::Location& next ) const
+    {
+        CGA_ASSERT_L(loc.chromosome_,ranges_.size());
+        uint32_t offset = loc.offset_;
+        for (size_t chr=loc.chromosome_; chr<ranges_.size(); ++chr, offset=0)
+        {
+            const RangeSet &s = ranges_[chr];
+            RangeSet::const_iterator it = s.lower_bound(std::make_pair(offset,offset));
+            if (it!=s.begin())
+            {
+                RangeSet::const_iterator prev = it;
+                if (offset < (--prev)->second)
+                {
+                    next = reference::Location(chr, offset);
+                    return true;
+                }
+            }
+            if (it!=s.end())
+            {
+                next = reference::Location(chr, it->first);
+                return true;
+            }
+        }
+        return false;
+    }
+
     FastRangeSet::FastRangeSet( const reference::CrrFile &ref ) 
         : reference_(ref), ranges_(ref.listChromosomes().size())
     {
@@ -68,6 +68,21 @@ namespace cgatools { namespace util {
         void add(const std::string &rangeStr);
         void add(const StringVector &rangeStrSet);
 
+        //! add the ranges of a tab-delimited file with chromosome,
+        //! begin and end columns
+        void addFile(const std::string &fn);
+
+        //! Merges the overlapping and adjacent ranges of each
+        //! chromosome, so that intersects() and contains() also hold
+        //! for ranges added in any order and overlapping each other.
+        void merge();
+
+        //! Finds the first location at or after loc that is contained
+        //! by a range of this set, or that is the location of an empty
+        //! range of this set. Returns false if there is no such
+        //! location. The set must be merged.
+        bool findNext(const reference::Location& loc, reference::Location& next) const;
+
         //! Fills the range set to cover the whole reference
         //@param extendRangeLength - can be used to extend the chr length beyond the reference length
         void addWholeReference(size_t extendRangeLength=0);
@@ -0,0 +1,205 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/ReadAheadSource.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace cgatools { namespace util {
+
+    bool ReadAheadSource::ENABLED = false;
+
+    struct ReadAheadSource::Impl
+    {
+        Impl(const boost::shared_ptr<std::istream>& in, size_t bufferCount, size_t bufferSize)
+            : in_(in),
+              buffers_(std::max(bufferCount, size_t(2)), std::vector<char>(std::max(bufferSize, size_t(1)))),
+              sizes_(buffers_.size(), 0),
+              readIndex_(0),
+              writeIndex_(0),
+              filled_(0),
+              offset_(0),
+              eof_(false),
+              stop_(false),
+              failed_(false)
+        {
+            thread_ = boost::thread(boost::bind(&Impl::run, this));
+        }
+
+        ~Impl()
+        {
+            stop();
+        }
+
+        void stop()
+        {
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                stop_ = true;
+            }
+            bufferFreed_.notify_all();
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        // Producer: fills free buffers from in_ until end of file, an
+        // error, or stop().
+        void run()
+        {
+            for(;;)
+            {
+                size_t index;
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    while (filled_ == buffers_.size() && !stop_)
+                        bufferFreed_.wait(lock);
+                    if (stop_)
+                        return;
+                    index = writeIndex_;
+                }
+
+                // The buffer at writeIndex_ is not visible to the reader
+                // until filled_ is incremented, so fill it unlocked.
+                std::vector<char>& buffer = buffers_[index];
+                size_t count = 0;
+                bool eof = false;
+                std::string error;
+                try
+                {
+                    while (count < buffer.size())
+                    {
+                        in_->read(&buffer[count], buffer.size() - count);
+                        count += in_->gcount();
+                        if (!*in_)
+                        {
+                            eof = true;
+                            break;
+                        }
+                    }
+                }
+                catch(std::exception& ee)
+                {
+                    error = ee.what();
+                    if (error.empty())
+                        error = "read-ahead failed";
+                    eof = true;
+                }
+
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    if (count > 0)
+                    {
+                        sizes_[index] = count;
+                        writeIndex_ = (writeIndex_ + 1) % buffers_.size();
+                        filled_++;
+                    }
+                    if (eof)
+                    {
+                        eof_ = true;
+                        failed_ = !error.empty();
+                        error_ = error;
+                    }
+                }
+                bufferFilled_.notify_one();
+                if (eof)
+                    return;
+            }
+        }
+
+        boost::shared_ptr<std::istream> in_;
+        std::vector< std::vector<char> > buffers_;
+        std::vector<size_t> sizes_;
+        size_t readIndex_;
+        size_t writeIndex_;
+        size_t filled_;
+        size_t offset_;
+        bool eof_;
+        bool stop_;
+        bool failed_;
+        std::string error_;
+
+        boost::mutex mutex_;
+        boost::condition_variable bufferFilled_;
+        boost::condition_variable bufferFreed_;
+        boost::thread thread_;
+    };
+
+    ReadAheadSource::ReadAheadSource(
+        const boost::shared_ptr<std::istream>& in, size_t bufferCount, size_t bufferSize)
+        : pimpl_(new Impl(in, bufferCount, bufferSize))
+    {
+    }
+
+    std::streamsize ReadAheadSource::read(char* s, std::streamsize n)
+    {
+        Impl& impl = *pimpl_;
+        std::streamsize result = 0;
+        boost::mutex::scoped_lock lock(impl.mutex_);
+        while (result < n)
+        {
+            if (0 == impl.filled_)
+            {
+                // Return what we have rather than wait for more.
+                if (result > 0)
+                    break;
+                if (impl.eof_ || impl.stop_)
+                {
+                    if (impl.failed_)
+                    {
+                        impl.failed_ = false;
+                        throw Exception(impl.error_);
+                    }
+                    break;
+                }
+                impl.bufferFilled_.wait(lock);
+                continue;
+            }
+
+            // The buffer at readIndex_ is not touched by the producer
+            // while it is filled, so copy from it unlocked.
+            size_t index = impl.readIndex_;
+            const std::vector<char>& buffer = impl.buffers_[index];
+            size_t count = std::min(size_t(n - result), impl.sizes_[index] - impl.offset_);
+            lock.unlock();
+            std::memcpy(s+result, &buffer[impl.offset_], count);
+            lock.lock();
+            result += count;
+            impl.offset_ += count;
+            if (impl.offset_ == impl.sizes_[index])
+            {
+                impl.offset_ = 0;
+                impl.readIndex_ = (impl.readIndex_ + 1) % impl.buffers_.size();
+                impl.filled_--;
+                impl.bufferFreed_.notify_one();
+            }
+        }
+        return (0 == result && n > 0) ? -1 : result;
+    }
+
+    void ReadAheadSource::close()
+    {
+        pimpl_->stop();
+    }
+
+} } // cgatools::util
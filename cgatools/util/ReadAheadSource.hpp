@@ -0,0 +1,65 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_UTIL_READAHEADSOURCE_HPP_
+#define CGATOOLS_UTIL_READAHEADSOURCE_HPP_ 1
+
+//! @file ReadAheadSource.hpp
+//! File containing the definition of ReadAheadSource.
+
+#include "cgatools/core.hpp"
+
+#include <istream>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/categories.hpp>
+
+namespace cgatools { namespace util {
+
+    //! A boost::iostreams source that reads another stream on a
+    //! background thread, into a bounded ring of buffers, so that
+    //! decompression overlaps with the parsing done by the reader. An
+    //! exception thrown by the underlying stream is rethrown, as an
+    //! Exception, once the data read before it has been consumed.
+    class ReadAheadSource
+    {
+    public:
+        typedef char char_type;
+        struct category
+            : boost::iostreams::source_tag,
+              boost::iostreams::closable_tag
+        { };
+
+        //! If true, CompressedInputStream decompresses files on a
+        //! read-ahead thread. Set this before opening any stream.
+        static bool ENABLED;
+
+        //! Starts reading in on a background thread, into bufferCount
+        //! buffers of bufferSize bytes.
+        explicit ReadAheadSource(const boost::shared_ptr<std::istream>& in,
+                                 size_t bufferCount = 8,
+                                 size_t bufferSize = 256*1024);
+
+        std::streamsize read(char* s, std::streamsize n);
+
+        //! Stops the background thread.
+        void close();
+
+    private:
+        struct Impl;
+        boost::shared_ptr<Impl> pimpl_;
+    };
+
+} } // cgatools::util
+
+#endif // CGATOOLS_UTIL_READAHEADSOURCE_HPP_
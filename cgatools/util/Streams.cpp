@@ -15,10 +15,14 @@
 #include "cgatools/core.hpp"
 #include "cgatools/util/Streams.hpp"
 #include "cgatools/util/Exception.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+#include "cgatools/util/ReadAheadSource.hpp"
+#include "cgatools/util/WriteBehindSink.hpp"
 
 #include <cerrno>
 #include <cstdio>                                 // SEEK_SET, etc.
 #include <boost/config.hpp>                       // BOOST_JOIN
+#include <boost/filesystem.hpp>
 #include <boost/iostreams/detail/error.hpp>
 #include <boost/iostreams/detail/config/dyn_link.hpp>
 #include <boost/iostreams/detail/config/rtl.hpp>  // BOOST_IOSTREAMS_FD_*
@@ -43,6 +47,7 @@
 # endif
 #else
 # include <sys/types.h>  // mode_t.
+# include <sys/mman.h>   // madvise.
 # include <unistd.h>
 # include <string.h>
 # include <errno.h>
@@ -68,6 +73,8 @@ namespace cgatools { namespace util {
         return buf;
     }
 
+    bool FileDescriptorDevice::SKIP_FSYNC_ON_CLOSE = false;
+
     FileDescriptorDevice::FileDescriptorDevice() : pimpl_(new impl) { }
 
     FileDescriptorDevice::FileDescriptorDevice(handle_type fd, bool close_on_exit)
@@ -336,7 +343,8 @@ namespace cgatools { namespace util {
     #ifdef CGA_USE_WIN_API
         if (i.handle_ != reinterpret_cast<handle_type>(-1)) {
             try {
-                fsync_impl(i);
+                if (!SKIP_FSYNC_ON_CLOSE)
+                    fsync_impl(i);
             } catch (const std::exception&) {
                 ::CloseHandle(i.handle_);
                 i.handle_ = reinterpret_cast<handle_type>(-1);
@@ -355,7 +363,8 @@ namespace cgatools { namespace util {
     #else
         if (i.handle_ != -1) {
             try {
-                fsync_impl(i);
+                if (!SKIP_FSYNC_ON_CLOSE)
+                    fsync_impl(i);
             } catch (const std::exception&) {
                 BOOST_IOSTREAMS_FD_CLOSE(i.handle_);
                 i.handle_ = -1;
@@ -410,7 +419,22 @@ namespace cgatools { namespace util {
             in->openBZ2(fn);
         }
         else
-            result.reset(new InputStream(fn));
+        {
+            if (MappedInputStream::isMappable(fn))
+            {
+                try
+                {
+                    result.reset(new MappedInputStream(fn));
+                }
+                catch(const std::exception&)
+                {
+                    // Fall back to reading, for example if there's
+                    // not enough address space to map the file.
+                }
+            }
+            if (0 == result.get())
+                result.reset(new InputStream(fn));
+        }
         return result;
     }
 
@@ -443,34 +467,158 @@ namespace cgatools { namespace util {
         }
     }
 
+    //-----------------------------------------------------------------------
+    // MappedFileBuffer, MappedInputStream
+    //-----------------------------------------------------------------------
+    MappedFileBuffer::MappedFileBuffer(const std::string& fn)
+    {
+        try
+        {
+            file_.open(fn);
+        }
+        catch(const std::exception&)
+        {
+            throw Exception(formatErrorMessage(fn, "map failed"));
+        }
+
+        char* data = const_cast<char*>(file_.data());
+#ifndef CGA_USE_WIN_API
+        // Most readers parse the file front to back.
+        ::madvise(data, file_.size(), MADV_SEQUENTIAL);
+#endif
+        setg(data, data, data + file_.size());
+    }
+
+    MappedFileBuffer::pos_type MappedFileBuffer::seekoff(
+        off_type off, std::ios_base::seekdir way, std::ios_base::openmode which)
+    {
+        off_type base = 0;
+        if (std::ios_base::cur == way)
+            base = gptr() - eback();
+        else if (std::ios_base::end == way)
+            base = egptr() - eback();
+        return seekpos(pos_type(base + off), which);
+    }
+
+    MappedFileBuffer::pos_type MappedFileBuffer::seekpos(
+        pos_type pos, std::ios_base::openmode which)
+    {
+        off_type off = pos;
+        if (0 == (which & std::ios_base::in) || off < 0 || off > egptr() - eback())
+            return pos_type(off_type(-1));
+        setg(eback(), eback() + off, egptr());
+        return pos;
+    }
+
+    MappedInputStream::MappedInputStream(const std::string& fn)
+        : std::istream(0),
+          buf_(fn)
+    {
+        rdbuf(&buf_);
+        exceptions(std::ios::badbit);
+    }
+
+    bool MappedInputStream::isMappable(const std::string& fn)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::path path(fn);
+        return boost::filesystem::is_regular_file(path, ec) &&
+            boost::filesystem::file_size(path, ec) > 0 && !ec;
+    }
+
     //-----------------------------------------------------------------------
     // CompressedInput/OutputStream
     //-----------------------------------------------------------------------
     void CompressedInputStream::open(const char* fn)
     {
+        openWithReadAhead(fn, false);
+    }
+
+    void CompressedInputStream::openAtMember(const std::string& fn, uint64_t offset)
+    {
+        FileSourceDevice source(fn);
+        source.seek(offset, BOOST_IOS::beg);
         base_type::push(boost::iostreams::gzip_decompressor(), 4*1024);
-        base_type::push(FileSourceDevice(fn));
+        base_type::push(source);
         base_type::exceptions(std::ios::badbit);
     }
 
     void CompressedInputStream::openBZ2(const char* fn)
     {
-        base_type::push(boost::iostreams::bzip2_decompressor(), 4*1024);
-        base_type::push(FileSourceDevice(fn));
+        openWithReadAhead(fn, true);
+    }
+
+    void CompressedInputStream::openWithReadAhead(const char* fn, bool bz2)
+    {
+        if (ReadAheadSource::ENABLED)
+        {
+            // Decompress on the read-ahead thread.
+            boost::shared_ptr<CompressedInputStream> in(new CompressedInputStream());
+            in->pushDecompressor(fn, bz2);
+            base_type::push(ReadAheadSource(in));
+        }
+        else
+            pushDecompressor(fn, bz2);
+        base_type::exceptions(std::ios::badbit);
+    }
+
+    void CompressedInputStream::pushDecompressor(const char* fn, bool bz2)
+    {
+        if (bz2)
+        {
+            base_type::push(boost::iostreams::bzip2_decompressor(), 4*1024);
+            base_type::push(FileSourceDevice(fn));
+        }
+        else if (ParallelCompression::getThreadCount() > 1 && BgzfSource::isBgzf(fn))
+        {
+            base_type::push(BgzfSource(fn), 64*1024);
+        }
+        else
+        {
+            base_type::push(boost::iostreams::gzip_decompressor(), 4*1024);
+            base_type::push(FileSourceDevice(fn));
+        }
         base_type::exceptions(std::ios::badbit);
     }
 
     void CompressedOutputStream::open(const char* fn, int clev)
     {
-        base_type::push(boost::iostreams::gzip_compressor(clev), 4*1024);
-        base_type::push(FileSinkDevice(fn));
+        openGzip(fn, clev, false);
+    }
+
+    void CompressedOutputStream::openForAppend(const std::string& fn, int clev)
+    {
+        openGzip(fn, clev, true);
+    }
+
+    void CompressedOutputStream::openGzip(const std::string& fn, int clev, bool append)
+    {
+        if (ParallelCompression::getThreadCount() > 1)
+        {
+            base_type::push(
+                ParallelCompressorSink(fn, ParallelCompressorSink::GZIP, clev, append),
+                64*1024);
+        }
+        else
+        {
+            base_type::push(boost::iostreams::gzip_compressor(clev), 4*1024);
+            base_type::push(FileSinkDevice(fn, append ? BOOST_IOS::app : BOOST_IOS::out));
+        }
         base_type::exceptions(std::ios::badbit | std::ios::failbit);
     }
 
     void CompressedOutputStream::openBZ2(const char* fn)
     {
-        base_type::push(boost::iostreams::bzip2_compressor(), 4*1024);
-        base_type::push(FileSinkDevice(fn));
+        if (ParallelCompression::getThreadCount() > 1)
+        {
+            base_type::push(ParallelCompressorSink(fn, ParallelCompressorSink::BZIP2, 0),
+                            64*1024);
+        }
+        else
+        {
+            base_type::push(boost::iostreams::bzip2_compressor(), 4*1024);
+            base_type::push(FileSinkDevice(fn));
+        }
         base_type::exceptions(std::ios::badbit | std::ios::failbit);
     }
 
@@ -478,7 +626,9 @@ namespace cgatools { namespace util {
     OutputStream::openCompressedOutputStreamByExtension(const std::string& fn)
     {
         boost::shared_ptr<std::ostream> result;
-        if (fn.size() >= 3 && fn.compare(fn.size() - 3, 3, ".gz") == 0)
+        if (WriteBehindSink::ENABLED)
+            result.reset(new WriteBehindOutputStream(fn));
+        else if (fn.size() >= 3 && fn.compare(fn.size() - 3, 3, ".gz") == 0)
             result.reset(new CompressedOutputStream(fn));
         else if (fn.size() >= 4 && fn.compare(fn.size() - 4, 4, ".bz2") == 0)
         {
@@ -502,6 +652,39 @@ namespace cgatools { namespace util {
         }
     }
 
+    WriteBehindOutputStream::WriteBehindOutputStream(const std::string& fn)
+    {
+        boost::shared_ptr<base_type> out;
+        if (fn.size() >= 3 && fn.compare(fn.size() - 3, 3, ".gz") == 0)
+            out.reset(new CompressedOutputStream(fn));
+        else if (fn.size() >= 4 && fn.compare(fn.size() - 4, 4, ".bz2") == 0)
+        {
+            CompressedOutputStream* bz2Out = new CompressedOutputStream();
+            out.reset(bz2Out);
+            bz2Out->openBZ2(fn);
+        }
+        else
+        {
+            out.reset(new base_type());
+            out->push(FileSinkDevice(fn));
+            out->exceptions(std::ios::badbit | std::ios::failbit);
+        }
+        // The sink does its own buffering, so keep the chain's small.
+        base_type::push(WriteBehindSink(out), 4*1024);
+        base_type::exceptions(std::ios::badbit | std::ios::failbit);
+    }
+
+    WriteBehindOutputStream::~WriteBehindOutputStream()
+    {
+        try {
+            // pop and close all elements of the pipeline
+            reset();
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            CGA_ASSERT(false);
+        }
+    }
+
     void writeBinaryBool(std::ostream& out, bool val)
     {
         char cVal = val ? 1 : 0;
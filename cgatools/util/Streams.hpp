@@ -17,12 +17,15 @@
 
 //! @file Streams.hpp
 //! File containing definitions of InputStream, OutputStream,
-//! CompressedInputStream, and CompressedOutputStream.
+//! CompressedInputStream, CompressedOutputStream,
+//! WriteBehindOutputStream, and MappedInputStream.
 
 #include "cgatools/core.hpp"
 #include "cgatools/util/Exception.hpp"
 
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 
@@ -73,6 +76,10 @@ namespace cgatools { namespace util {
         bool fsync();
         void close();
         handle_type handle() const { return pimpl_->handle_; }
+
+        //! If true, close() does not fsync(2) the file. An explicit
+        //! fsync() call still does.
+        static bool SKIP_FSYNC_ON_CLOSE;
         const std::string& fn() const { return pimpl_->fn_; }
     private:
         struct impl {
@@ -203,12 +210,13 @@ namespace cgatools { namespace util {
 
         static bool isReadable(const std::string& fn);
 
-        //! Returns a pointer to an InputStream or
+        //! Returns a pointer to an InputStream, MappedInputStream or
         //! CompressedInputStream, depending on the file extension. File
         //! extensions supported:
         //! - .gz -> gzip format
         //! - .bz2 -> bzip2 format
-        //! - other -> straight InputStream
+        //! - other -> MappedInputStream for regular files, or straight
+        //!   InputStream if the file can't be mapped
         static boost::shared_ptr<std::istream>
         openCompressedInputStreamByExtension(const std::string& fn);
 
@@ -264,7 +272,8 @@ namespace cgatools { namespace util {
 
         //! Returns a pointer to an OutputStream or
         //! CompressedOutputStream, depending on the file
-        //! extension. File extensions supported:
+        //! extension, or to a WriteBehindOutputStream if
+        //! WriteBehindSink::ENABLED is set. File extensions supported:
         //! - .gz -> gzip format
         //! - .bz2 -> bzip2 format
         //! - other -> straight InputStream
@@ -295,6 +304,9 @@ namespace cgatools { namespace util {
         }
         //! Open a gzip-compressed file.
         void open(const char* fn);
+        //! Open a gzip-compressed file made of several gzip members,
+        //! starting at the member at the given offset.
+        void openAtMember(const std::string& fn, uint64_t offset);
         //! Open a bzip2-compressed file.
         void openBZ2(const std::string& fn)
         {
@@ -309,6 +321,9 @@ namespace cgatools { namespace util {
         }
     private:
         typedef boost::iostreams::filtering_istream base_type;
+
+        void openWithReadAhead(const char* fn, bool bz2);
+        void pushDecompressor(const char* fn, bool bz2);
     };
 
     class CompressedOutputStream:
@@ -336,6 +351,9 @@ namespace cgatools { namespace util {
         }
         //! Open a gzip-compressed file.
         void open(const char* fn, int clev = DEFAULT_COMPRESSION);
+        //! Open a gzip-compressed file to add a gzip member to its
+        //! end. Readers of the file see the concatenated contents.
+        void openForAppend(const std::string& fn, int clev = DEFAULT_COMPRESSION);
         //! Open a bzip2-compressed file.
         void openBZ2(const std::string& fn)
         {
@@ -350,6 +368,78 @@ namespace cgatools { namespace util {
         }
     private:
         typedef boost::iostreams::filtering_ostream base_type;
+
+        void openGzip(const std::string& fn, int clev, bool append);
+    };
+
+    //! A std::ostream that collects its output into large buffers and
+    //! writes them, compressed according to the file extension as by
+    //! OutputStream::openCompressedOutputStreamByExtension(), on a
+    //! background thread. See WriteBehindSink.
+    class WriteBehindOutputStream:
+        public boost::iostreams::filtering_ostream
+    {
+    public:
+        explicit WriteBehindOutputStream(const std::string& fn);
+
+        ~WriteBehindOutputStream();
+
+        void close()
+        {
+            reset();
+        }
+    private:
+        typedef boost::iostreams::filtering_ostream base_type;
+    };
+
+    //! A read-only std::streambuf over a memory-mapped file. Readers
+    //! that know about it, such as DelimitedFile, may parse the data
+    //! in place, between getCurrent() and getEnd(), and then advance()
+    //! past what they have consumed.
+    class MappedFileBuffer : public std::streambuf, boost::noncopyable
+    {
+    public:
+        explicit MappedFileBuffer(const std::string& fn);
+
+        const char* getCurrent() const
+        {
+            return gptr();
+        }
+
+        const char* getEnd() const
+        {
+            return egptr();
+        }
+
+        //! Moves the read position to pos, which must be between
+        //! getCurrent() and getEnd().
+        void advance(const char* pos)
+        {
+            CGA_ASSERT(gptr() <= pos && pos <= egptr());
+            setg(eback(), const_cast<char*>(pos), egptr());
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir way,
+                         std::ios_base::openmode which = std::ios_base::in);
+        pos_type seekpos(pos_type pos,
+                         std::ios_base::openmode which = std::ios_base::in);
+
+    private:
+        boost::iostreams::mapped_file_source file_;
+    };
+
+    //! A std::istream reading a memory-mapped file.
+    class MappedInputStream : public std::istream
+    {
+    public:
+        explicit MappedInputStream(const std::string& fn);
+
+        //! Returns true if fn is a non-empty regular file.
+        static bool isMappable(const std::string& fn);
+
+    private:
+        MappedFileBuffer buf_;
     };
 
     //! Writes a '\\0' for false or '\\001' for true.
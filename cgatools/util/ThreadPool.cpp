@@ -0,0 +1,144 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/ThreadPool.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <exception>
+#include <boost/bind.hpp>
+
+namespace cgatools { namespace util {
+
+    ThreadPool::ThreadPool(size_t threadCount)
+        : threadCount_(std::max(threadCount, size_t(1))),
+          fn_(0),
+          count_(0),
+          next_(0),
+          pending_(0),
+          generation_(0),
+          shutdown_(false)
+    {
+        // The calling thread also processes work items, so it is not
+        // counted among the worker threads.
+        for(size_t ii=1; ii<threadCount_; ii++)
+            threads_.create_thread(boost::bind(&ThreadPool::workerLoop, this));
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        workReady_.notify_all();
+        threads_.join_all();
+    }
+
+    void ThreadPool::parallelFor(size_t count, const WorkFunction& fn)
+    {
+        if (0 == count)
+            return;
+
+        if (1 == threadCount_)
+        {
+            for(size_t ii=0; ii<count; ii++)
+                fn(ii);
+            return;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        fn_ = &fn;
+        count_ = count;
+        next_ = 0;
+        pending_ = count;
+        error_.clear();
+        generation_++;
+        workReady_.notify_all();
+
+        processItems(lock);
+        while (pending_ > 0)
+            workDone_.wait(lock);
+
+        fn_ = 0;
+        count_ = next_ = 0;
+        if (!error_.empty())
+        {
+            std::string message;
+            message.swap(error_);
+            throw Exception(message);
+        }
+    }
+
+    size_t ThreadPool::hardwareThreadCount()
+    {
+        size_t result = boost::thread::hardware_concurrency();
+        return 0 == result ? 1 : result;
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        uint64_t seenGeneration = 0;
+        for(;;)
+        {
+            while (!shutdown_ && seenGeneration == generation_)
+                workReady_.wait(lock);
+            if (shutdown_)
+                return;
+            seenGeneration = generation_;
+            processItems(lock);
+        }
+    }
+
+    // Processes work items until the current batch has been handed
+    // out. Called with the lock held; returns with the lock held.
+    void ThreadPool::processItems(boost::unique_lock<boost::mutex>& lock)
+    {
+        while (next_ < count_)
+        {
+            size_t ii = next_++;
+            std::string error;
+
+            lock.unlock();
+            try
+            {
+                (*fn_)(ii);
+            }
+            catch(const std::exception& ee)
+            {
+                error = ee.what();
+                if (error.empty())
+                    error = "unknown error in worker thread";
+            }
+            catch(...)
+            {
+                error = "unknown error in worker thread";
+            }
+            lock.lock();
+
+            if (!error.empty())
+            {
+                if (error_.empty())
+                    error_ = error;
+                // Skip the work items that have not been started.
+                pending_ -= count_ - next_;
+                next_ = count_;
+            }
+            if (0 == --pending_)
+                workDone_.notify_all();
+        }
+    }
+
+} } // cgatools::util
@@ -0,0 +1,86 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_UTIL_THREADPOOL_HPP_
+#define CGATOOLS_UTIL_THREADPOOL_HPP_ 1
+
+//! @file ThreadPool.hpp
+
+#include "cgatools/core.hpp"
+
+#include <string>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace cgatools { namespace util {
+
+    //! A fixed set of worker threads used to process a batch of
+    //! independent work items. The calling thread blocks until the
+    //! whole batch is done, so callers that read their input and write
+    //! their output serially get deterministic output regardless of the
+    //! thread count. Example:
+    //! @code
+    //! ThreadPool pool(threadCount);
+    //! pool.parallelFor(items.size(), boost::bind(&process, boost::ref(items), _1));
+    //! @endcode
+    class ThreadPool : private boost::noncopyable
+    {
+    public:
+        typedef boost::function<void (size_t)> WorkFunction;
+
+        //! Creates a pool that processes work items on threadCount
+        //! threads. A threadCount of 0 or 1 creates no threads, and
+        //! work items are processed on the calling thread.
+        explicit ThreadPool(size_t threadCount);
+        ~ThreadPool();
+
+        //! Returns the number of threads that process work items.
+        size_t size() const
+        {
+            return threadCount_;
+        }
+
+        //! Calls fn(ii) for each ii in [0,count), and returns when all
+        //! calls have completed. If any call throws, the remaining work
+        //! items are skipped and an Exception carrying the first error
+        //! message is thrown on the calling thread.
+        void parallelFor(size_t count, const WorkFunction& fn);
+
+        //! Returns the number of hardware threads, or 1 if unknown.
+        static size_t hardwareThreadCount();
+
+    private:
+        void workerLoop();
+        void processItems(boost::unique_lock<boost::mutex>& lock);
+
+        size_t threadCount_;
+        boost::thread_group threads_;
+        boost::mutex mutex_;
+        boost::condition_variable workReady_;
+        boost::condition_variable workDone_;
+        const WorkFunction* fn_;
+        size_t count_;
+        size_t next_;
+        size_t pending_;
+        uint64_t generation_;
+        bool shutdown_;
+        std::string error_;
+    };
+
+} } // cgatools::util
+
+#endif // CGATOOLS_UTIL_THREADPOOL_HPP_
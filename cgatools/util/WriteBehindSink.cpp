@@ -0,0 +1,216 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/WriteBehindSink.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace cgatools { namespace util {
+
+    bool WriteBehindSink::ENABLED = false;
+    size_t WriteBehindSink::BUFFER_SIZE = 1024*1024;
+
+    struct WriteBehindSink::Impl
+    {
+        Impl(const boost::shared_ptr<boost::iostreams::filtering_ostream>& out,
+             size_t bufferSize, size_t bufferCount)
+            : out_(out),
+              bufferSize_(std::max(bufferSize, size_t(1))),
+              bufferCount_(std::max(bufferCount, size_t(1))),
+              stop_(false),
+              failed_(false),
+              closed_(false)
+        {
+            current_.reserve(bufferSize_);
+            thread_ = boost::thread(boost::bind(&Impl::run, this));
+        }
+
+        ~Impl()
+        {
+            stop();
+        }
+
+        // Hands current_ to the background thread, waiting while the
+        // queue is full.
+        void submit()
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (queue_.size() >= bufferCount_ && !failed_)
+                queueChanged_.wait(lock);
+            checkFailed();
+            queue_.push_back(std::string());
+            queue_.back().swap(current_);
+            if (spare_.empty())
+                current_.reserve(bufferSize_);
+            else
+            {
+                current_.swap(spare_.back());
+                spare_.pop_back();
+            }
+            queueChanged_.notify_all();
+        }
+
+        void stop()
+        {
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                stop_ = true;
+            }
+            queueChanged_.notify_all();
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        // The error stays set, so that every later write() or close()
+        // fails too: the data queued after it was dropped.
+        void checkFailed()
+        {
+            if (failed_)
+                throw Exception(error_);
+        }
+
+        void checkFailedLocked()
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            checkFailed();
+        }
+
+        void fail(const std::string& error)
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            failed_ = true;
+            error_ = error.empty() ? "write-behind failed" : error;
+        }
+
+        // Consumer: writes queued buffers, in order, until stop() is
+        // called with an empty queue, or on error.
+        void run()
+        {
+            std::string buffer;
+            for(;;)
+            {
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    while (queue_.empty() && !stop_)
+                        queueChanged_.wait(lock);
+                    if (queue_.empty())
+                        return;
+                    // The front buffer stays queued while it is
+                    // written, so that it counts against bufferCount_.
+                    buffer.swap(queue_.front());
+                }
+
+                std::string error;
+                try
+                {
+                    out_->write(buffer.data(), buffer.size());
+                }
+                catch(std::exception& ee)
+                {
+                    error = ee.what();
+                    if (error.empty())
+                        error = "write-behind failed";
+                }
+
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    queue_.pop_front();
+                    buffer.clear();
+                    spare_.push_back(std::string());
+                    spare_.back().swap(buffer);
+                    if (!error.empty())
+                    {
+                        failed_ = true;
+                        error_ = error;
+                        queue_.clear();
+                    }
+                }
+                queueChanged_.notify_all();
+                if (!error.empty())
+                    return;
+            }
+        }
+
+        boost::shared_ptr<boost::iostreams::filtering_ostream> out_;
+        size_t bufferSize_;
+        size_t bufferCount_;
+        std::string current_;
+        std::deque<std::string> queue_;
+        std::vector<std::string> spare_;
+        bool stop_;
+        bool failed_;
+        bool closed_;
+        std::string error_;
+
+        boost::mutex mutex_;
+        boost::condition_variable queueChanged_;
+        boost::thread thread_;
+    };
+
+    WriteBehindSink::WriteBehindSink(
+        const boost::shared_ptr<boost::iostreams::filtering_ostream>& out,
+        size_t bufferSize, size_t bufferCount)
+        : pimpl_(new Impl(out, bufferSize, bufferCount))
+    {
+    }
+
+    std::streamsize WriteBehindSink::write(const char* s, std::streamsize n)
+    {
+        Impl& impl = *pimpl_;
+        impl.checkFailedLocked();
+        impl.current_.append(s, n);
+        if (impl.current_.size() >= impl.bufferSize_)
+            impl.submit();
+        return n;
+    }
+
+    void WriteBehindSink::close()
+    {
+        Impl& impl = *pimpl_;
+        if (impl.closed_)
+        {
+            impl.checkFailedLocked();
+            return;
+        }
+        impl.closed_ = true;
+
+        if (!impl.current_.empty())
+            impl.submit();
+        impl.stop();
+        impl.checkFailed();
+
+        // Pop and close the underlying chain on this thread, so that
+        // errors from closing the file reach the caller.
+        try
+        {
+            impl.out_->reset();
+        }
+        catch(std::exception& ee)
+        {
+            impl.fail(ee.what());
+            throw;
+        }
+    }
+
+} } // cgatools::util
@@ -0,0 +1,69 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_UTIL_WRITEBEHINDSINK_HPP_
+#define CGATOOLS_UTIL_WRITEBEHINDSINK_HPP_ 1
+
+//! @file WriteBehindSink.hpp
+//! File containing the definition of WriteBehindSink.
+
+#include "cgatools/core.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace cgatools { namespace util {
+
+    //! A boost::iostreams sink that collects its input into large
+    //! buffers and writes them to another stream on a background
+    //! thread, so that formatting overlaps with compression and disk
+    //! writes. At most a few buffers are queued; write() blocks while
+    //! the queue is full. An error from the underlying stream is
+    //! rethrown, as an Exception, from a later write() or from close(),
+    //! and from every write() and close() after that.
+    class WriteBehindSink
+    {
+    public:
+        typedef char char_type;
+        struct category
+            : boost::iostreams::sink_tag,
+              boost::iostreams::closable_tag
+        { };
+
+        //! If true, OutputStream::openCompressedOutputStreamByExtension()
+        //! returns a stream that writes on a background thread. Set this
+        //! before opening any stream.
+        static bool ENABLED;
+
+        //! The size of the buffers handed to the background thread.
+        static size_t BUFFER_SIZE;
+
+        //! Starts a background thread writing to out. close() flushes
+        //! the remaining data and resets out, closing its devices.
+        explicit WriteBehindSink(const boost::shared_ptr<boost::iostreams::filtering_ostream>& out,
+                                 size_t bufferSize = BUFFER_SIZE,
+                                 size_t bufferCount = 4);
+
+        std::streamsize write(const char* s, std::streamsize n);
+        void close();
+
+    private:
+        struct Impl;
+        boost::shared_ptr<Impl> pimpl_;
+    };
+
+} } // cgatools::util
+
+#endif // CGATOOLS_UTIL_WRITEBEHINDSINK_HPP_
@@ -83,4 +83,19 @@ namespace cgatools { namespace util {
         }
     }
 
+    void appendInt(std::string& out, int64_t val)
+    {
+        char buf[24];
+        char* first = buf + sizeof(buf);
+        uint64_t absVal = val < 0 ? uint64_t(-(val+1)) + 1 : uint64_t(val);
+        do
+        {
+            *--first = char('0' + absVal % 10);
+            absVal /= 10;
+        } while (0 != absVal);
+        if (val < 0)
+            *--first = '-';
+        out.append(first, buf + sizeof(buf));
+    }
+
 } } // cgatools::util
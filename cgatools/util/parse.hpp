@@ -175,6 +175,11 @@ namespace cgatools { namespace util {
         bool trimWhitespace = false, 
         bool compressEmpty = false);
 
+    //! Appends the decimal text of val to out, as parseValue() would
+    //! read it back. Much faster than boost::lexical_cast or an
+    //! ostream, for writers that format records into a string.
+    void appendInt(std::string& out, int64_t val);
+
 } } // cgatools::util
 
 #endif // CGATOOLS_UTIL_PARSE_HPP_
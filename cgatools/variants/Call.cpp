@@ -32,7 +32,7 @@ namespace cgatools { namespace variants {
     const uint16_t Call::UNKNOWN_PLOIDY = 0;
     const int32_t  Call::EMPTY_SCORE    = 0;
 
-    Call::VarQualityField::VarQualityField(const std::string& name, std::vector<std::string>* varFilter)
+    Call::VarQualityField::VarQualityField(const std::string& name, VarFilter* varFilter)
         : DelimitedFieldParser(name),
           varFilter_(varFilter)
     {
@@ -40,14 +40,23 @@ namespace cgatools { namespace variants {
 
     void Call::VarQualityField::parse(const char* first, const char* last)
     {
-        varFilter_->clear();
+        const VarFilter* cached = cache_.find(first, last);
+        if (0 != cached)
+        {
+            *varFilter_ = *cached;
+            return;
+        }
+
+        vector<string> varFilter;
         if (first+6==last && boost::iequals(string(first,last), "VQHIGH"))
-            varFilter_->push_back("PASS");
+            varFilter.push_back("PASS");
         else
-            Call::parseVarFilter(first, last, *varFilter_);
+            Call::parseVarFilter(first, last, varFilter);
+        *varFilter_ = varFilter;
+        cache_.add(first, last, *varFilter_);
     }
 
-    Call::VarFilterField::VarFilterField(const std::string& name, std::vector<std::string>* varFilter)
+    Call::VarFilterField::VarFilterField(const std::string& name, VarFilter* varFilter)
         : DelimitedFieldParser(name),
           varFilter_(varFilter)
     {
@@ -55,13 +64,24 @@ namespace cgatools { namespace variants {
 
     void Call::VarFilterField::parse(const char* first, const char* last)
     {
-        varFilter_->clear();
-        Call::parseVarFilter(first, last, *varFilter_);
+        const VarFilter* cached = cache_.find(first, last);
+        if (0 != cached)
+        {
+            *varFilter_ = *cached;
+            return;
+        }
+
+        vector<string> varFilter;
+        Call::parseVarFilter(first, last, varFilter);
+        *varFilter_ = varFilter;
+        cache_.add(first, last, *varFilter_);
     }
 
 
     void Call::addVarFilter(const std::string& filter){
-        varFilter_.push_back(filter);
+        vector<string> varFilter(varFilter_.begin(), varFilter_.end());
+        varFilter.push_back(filter);
+        varFilter_ = varFilter;
     }
 
 
@@ -157,7 +177,7 @@ namespace cgatools { namespace variants {
         df.addField(ChromosomeIdField("chromosome", &range_.chromosome_, crr));
         df.addField(ValueField<uint32_t>("begin", &range_.begin_));
         df.addField(ValueField<uint32_t>("end", &range_.end_));
-        df.addField(StringField("varType", &varType_));
+        df.addField(InternedStringField("varType", &varType_));
         df.addField(StringField("reference", &reference_));
         df.addField(StringField("alleleSeq", &alleleSeq_));
         if ( df.hasField("totalScore") &&
@@ -20,6 +20,7 @@
 #include "cgatools/core.hpp"
 #include "cgatools/reference/CrrFile.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/util/Interned.hpp"
 #include <string>
 
 namespace cgatools { namespace variants {
@@ -29,26 +30,31 @@ namespace cgatools { namespace variants {
     struct Call
     {
     public:
+        //! The interned list of filters of a call.
+        typedef util::Interned< std::vector<std::string> > VarFilter;
+
         class VarQualityField : public util::DelimitedFieldParser
         {
         public:
-            VarQualityField(const std::string& name, std::vector<std::string>* varFilter);
+            VarQualityField(const std::string& name, VarFilter* varFilter);
 
             void parse(const char* first, const char* last);
 
         private:
-            std::vector<std::string>* varFilter_;
+            VarFilter* varFilter_;
+            util::InternedFieldCache< std::vector<std::string> > cache_;
         };
 
         class VarFilterField : public util::DelimitedFieldParser
         {
         public:
-            VarFilterField(const std::string& name, std::vector<std::string>* varFilter);
+            VarFilterField(const std::string& name, VarFilter* varFilter);
 
             void parse(const char* first, const char* last);
 
         private:
-            std::vector<std::string>* varFilter_;
+            VarFilter* varFilter_;
+            util::InternedFieldCache< std::vector<std::string> > cache_;
         };
 
         class TotalScoreField : public util::DelimitedFieldParser
@@ -161,8 +167,8 @@ namespace cgatools { namespace variants {
         //! The chromosome, begin, and end columns in the variant file.
         reference::Range range_;
 
-        //! The varType column in the variant file.
-        std::string varType_;
+        //! The varType column in the variant file, interned.
+        util::Interned<std::string> varType_;
 
         //! The reference column in the variant file.
         std::string reference_;
@@ -182,8 +188,9 @@ namespace cgatools { namespace variants {
         //! The varFilter column in the variant file. For old var files
         //! that have no varFilter or varQuality, this field is
         //! empty. For old var files with varQuality instead of
-        //! varFilter, this field may be empty, VQLOW or PASS.
-        std::vector<std::string> varFilter_;
+        //! varFilter, this field may be empty, VQLOW or PASS. The list
+        //! is interned, since few distinct lists occur in a file.
+        VarFilter varFilter_;
 
         //! The hapLink column in the variant file.
         std::string hapLink_;
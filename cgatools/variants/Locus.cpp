@@ -393,7 +393,17 @@ namespace cgatools { namespace variants {
         }
 
         validateCalls(relaxedReferenceValidation);
+        initAlleles();
+    }
+
+    void Locus::initFromValidatedCalls()
+    {
+        CGA_ASSERT(calls_.size() > 0);
+        initAlleles();
+    }
 
+    void Locus::initAlleles()
+    {
         alleles_.resize(calls_[0].ploidy_, Allele(this));
         for(size_t ii=0; ii<alleles_.size(); ii++)
         {
@@ -705,7 +715,7 @@ namespace cgatools { namespace variants {
             return "ref";
     }
 
-    void Locus::setType(const std::string& olplType)
+    void Locus::setType(const util::Interned<std::string>& olplType)
     {
         olplType_ = olplType;
     }
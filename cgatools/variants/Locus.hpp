@@ -192,6 +192,11 @@ namespace cgatools { namespace variants {
         //! be called to prepare the Locus for use.
         void initFromCalls(bool relaxedReferenceValidation = true);
 
+        //! Like Locus::initFromCalls(), but without validating the calls
+        //! against the reference, for calls that were validated when
+        //! they were first read (see VariantBinaryFileReader).
+        void initFromValidatedCalls();
+
         //! Returns in the calls parameter the bases called by this
         //! locus at the specified location (or - or ., in accordance
         //! with snpdiff interpretation of those values), as well as the
@@ -202,7 +207,13 @@ namespace cgatools { namespace variants {
         std::string getType() const;
 
         //! Sets the masterVar varType for this locus.
-        void setType(const std::string& olplType);
+        void setType(const util::Interned<std::string>& olplType);
+
+        //! Returns the masterVar varType set by Locus::setType().
+        const std::string& getOlplType() const
+        {
+            return olplType_.get();
+        }
 
         //! Returns locus zygosity, as specified for simplified variation files.
         std::string getZygosity() const;
@@ -238,6 +249,7 @@ namespace cgatools { namespace variants {
             std::ostream& out, bool alleleSpecificXRef, char sep = '\t');
     private:
         void validateCalls(bool relaxedReferenceValidation) const;
+        void initAlleles();
         void validateAllelesAndInitRange();
         void callError (const std::string&, const Call&) const;
         void locusError(const std::string&) const;
@@ -246,7 +258,7 @@ namespace cgatools { namespace variants {
         const CrrFile* crr_;
         std::vector<Call> calls_;
         std::vector<Allele> alleles_;
-        std::string olplType_; // varType, from olpl file
+        util::Interned<std::string> olplType_; // varType, from olpl file
         boost::shared_ptr< LocusAnnotations > ann_;
 
         // For each interval allele, true if it's compatible to the object
@@ -33,6 +33,14 @@ namespace cgatools { namespace variants {
         loci_.push_back(&locus);
     }
 
+    void PhasedAllele::reserve(size_t callCount, size_t length)
+    {
+        allele_.reserve(length);
+        pos_.reserve(callCount+1);
+        calls_.reserve(callCount);
+        loci_.reserve(callCount);
+    }
+
     bool PhasedAllele::hasHapLink(const std::string& hapLink) const
     {
         CGA_ASSERT(hapLink.size() != 0);
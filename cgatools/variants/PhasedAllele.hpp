@@ -42,6 +42,10 @@ namespace cgatools { namespace variants {
         //! or ref call.
         void addSequence(const Call& call, const Locus& locus, const std::string& sequence);
 
+        //! Reserves room for the given number of calls and length of
+        //! allele sequence.
+        void reserve(size_t callCount, size_t length);
+
         //! Returns true if any call in this PhasedAllele has the hapLink.
         bool hasHapLink(const std::string& hapLink) const;
 
@@ -18,6 +18,8 @@
 #include "cgatools/variants/CallDiffResult.hpp"
 #include "cgatools/variants/Superlocus.hpp"
 
+#include <algorithm>
+#include <map>
 #include <boost/foreach.hpp>
 
 namespace cgatools { namespace variants {
@@ -27,6 +29,272 @@ namespace cgatools { namespace variants {
 
     using reference::Range;
 
+    namespace {
+        // The score of an allele pair of a given match type; the score
+        // of a phasing is the sum over its allele pairs.
+        int getMatchScore(cdmt::MatchType mt)
+        {
+            switch(mt)
+            {
+            case cdmt::REF_IDENTICAL:
+                return 1012;
+            case cdmt::ALT_IDENTICAL:
+                return 1010;
+            case cdmt::REF_CONSISTENT:
+                return 1001;
+            case cdmt::ALT_CONSISTENT:
+                return 1000;
+            default:
+                return 0;
+            }
+        }
+
+        // The match types of the alleles of two lists of hypotheses,
+        // computed once for each pair of distinct allele sequences.
+        class AlleleMatchMatrix
+        {
+        public:
+            AlleleMatchMatrix(const vector<PhasedHypothesis>& lhs,
+                              const vector<PhasedHypothesis>& rhs,
+                              const string& refSequence)
+                : ploidy_(lhs[0].size())
+            {
+                vector<const string*> lhsSeqs, rhsSeqs;
+                indexSequences(lhs, lhsIds_, lhsSeqs);
+                indexSequences(rhs, rhsIds_, rhsSeqs);
+
+                vector<bool> lhsRefMatch(lhsSeqs.size()), lhsCalled(lhsSeqs.size());
+                for(size_t ii=0; ii<lhsSeqs.size(); ii++)
+                {
+                    lhsRefMatch[ii] = bu::isConsistent(*lhsSeqs[ii], refSequence);
+                    lhsCalled[ii] = bu::isCalledSequence(*lhsSeqs[ii]);
+                }
+
+                rhsSeqCount_ = rhsSeqs.size();
+                matchTypes_.resize(lhsSeqs.size() * rhsSeqCount_);
+                for(size_t jj=0; jj<rhsSeqCount_; jj++)
+                {
+                    bool rhsRefMatch = bu::isConsistent(*rhsSeqs[jj], refSequence);
+                    bool rhsCalled = bu::isCalledSequence(*rhsSeqs[jj]);
+                    for(size_t ii=0; ii<lhsSeqs.size(); ii++)
+                    {
+                        matchTypes_[ii*rhsSeqCount_ + jj] = getMatchType(
+                            *lhsSeqs[ii], lhsRefMatch[ii], lhsCalled[ii],
+                            *rhsSeqs[jj], rhsRefMatch, rhsCalled);
+                    }
+                }
+            }
+
+            size_t getPloidy() const
+            {
+                return ploidy_;
+            }
+
+            //! Returns the match type of allele lhsAllele of
+            //! hypothesis lhsHyp and allele rhsAllele of hypothesis
+            //! rhsHyp.
+            cdmt::MatchType operator()(size_t lhsHyp, size_t lhsAllele,
+                                       size_t rhsHyp, size_t rhsAllele) const
+            {
+                return matchTypes_[lhsIds_[lhsHyp*ploidy_ + lhsAllele] * rhsSeqCount_ +
+                                   rhsIds_[rhsHyp*ploidy_ + rhsAllele]];
+            }
+
+        private:
+            // Numbers the distinct allele sequences of hyps, and sets
+            // ids to the number of each allele of each hypothesis.
+            void indexSequences(const vector<PhasedHypothesis>& hyps,
+                                vector<size_t>& ids,
+                                vector<const string*>& seqs) const
+            {
+                map<string, size_t> seqIds;
+                ids.resize(hyps.size() * ploidy_);
+                for(size_t ii=0; ii<hyps.size(); ii++)
+                {
+                    CGA_ASSERT(hyps[ii].size() == ploidy_);
+                    for(size_t jj=0; jj<ploidy_; jj++)
+                    {
+                        const string& seq = hyps[ii][jj].allele();
+                        map<string, size_t>::const_iterator it =
+                            seqIds.insert(make_pair(seq, seqs.size())).first;
+                        if (it->second == seqs.size())
+                            seqs.push_back(&seq);
+                        ids[ii*ploidy_ + jj] = it->second;
+                    }
+                }
+            }
+
+            static cdmt::MatchType getMatchType(const string& lhs, bool lhsRefMatch, bool lhsCalled,
+                                                const string& rhs, bool rhsRefMatch, bool rhsCalled)
+            {
+                if (!bu::isConsistent(lhs, rhs))
+                {
+                    if (lhsRefMatch && rhsRefMatch)
+                    {
+                        // This case happens, for example, if fileA is A,
+                        // fileB is C, and reference is N.
+                        return cdmt::MISMATCH;
+                    }
+                    else if (lhsRefMatch)
+                        return cdmt::ONLY_B;
+                    else if (rhsRefMatch)
+                        return cdmt::ONLY_A;
+                    else
+                        return cdmt::MISMATCH;
+                }
+
+                if (lhsCalled && rhsCalled)
+                {
+                    CGA_ASSERT(lhsRefMatch == rhsRefMatch);
+                    if (lhsRefMatch && rhsRefMatch)
+                        return cdmt::REF_IDENTICAL;
+                    else
+                        return cdmt::ALT_IDENTICAL;
+                }
+
+                if (lhsRefMatch && rhsRefMatch)
+                    return cdmt::REF_CONSISTENT;
+                else
+                    return cdmt::ALT_CONSISTENT;
+            }
+
+            size_t ploidy_;
+            vector<size_t> lhsIds_;
+            vector<size_t> rhsIds_;
+            size_t rhsSeqCount_;
+            vector<cdmt::MatchType> matchTypes_;
+        };
+
+        // A phasing of a lhs and a rhs hypothesis: allele perm_[ii] of
+        // the lhs hypothesis is compared with allele ii of the rhs.
+        struct Phasing
+        {
+            Phasing(const vector<size_t>& perm, size_t lhs, size_t rhs)
+                : perm_(perm), lhs_(lhs), rhs_(rhs)
+            {
+            }
+
+            // The order in which the phasings are enumerated by
+            // next_permutation in the outer loop.
+            bool operator<(const Phasing& other) const
+            {
+                if (perm_ != other.perm_)
+                    return perm_ < other.perm_;
+                if (lhs_ != other.lhs_)
+                    return lhs_ < other.lhs_;
+                return rhs_ < other.rhs_;
+            }
+
+            vector<size_t> perm_;
+            size_t lhs_;
+            size_t rhs_;
+        };
+
+        // Finds the phasings of best score by a depth-first search of
+        // the permutations of each pair of hypotheses, skipping the
+        // permutations that cannot reach the best score found so far.
+        class BestPhasingSearch
+        {
+        public:
+            BestPhasingSearch(const AlleleMatchMatrix& matches)
+                : matches_(matches),
+                  bestScore_(-1),
+                  perm_(matches.getPloidy()),
+                  used_(matches.getPloidy()),
+                  bound_(matches.getPloidy()+1)
+            {
+            }
+
+            void search(size_t lhs, size_t rhs)
+            {
+                lhs_ = lhs;
+                rhs_ = rhs;
+
+                // bound_[ii] is the best score positions ii and above
+                // could add.
+                size_t ploidy = perm_.size();
+                bound_[ploidy] = 0;
+                for(size_t ii=ploidy; ii>0; ii--)
+                {
+                    int best = 0;
+                    for(size_t jj=0; jj<ploidy; jj++)
+                        best = std::max(best, getMatchScore(matches_(lhs_, jj, rhs_, ii-1)));
+                    bound_[ii-1] = bound_[ii] + best;
+                }
+
+                std::fill(used_.begin(), used_.end(), false);
+                searchFrom(0, 0);
+            }
+
+            //! Returns the phasings of best score, in the order of
+            //! Phasing::operator<.
+            const vector<Phasing>& getBest()
+            {
+                std::sort(best_.begin(), best_.end());
+                return best_;
+            }
+
+        private:
+            void searchFrom(size_t pos, int score)
+            {
+                // Phasings of equal score are all kept.
+                if (score + bound_[pos] < bestScore_)
+                    return;
+
+                if (perm_.size() == pos)
+                {
+                    if (score > bestScore_)
+                    {
+                        best_.clear();
+                        bestScore_ = score;
+                    }
+                    best_.push_back(Phasing(perm_, lhs_, rhs_));
+                    return;
+                }
+
+                for(size_t ii=0; ii<perm_.size(); ii++)
+                {
+                    if (used_[ii])
+                        continue;
+                    used_[ii] = true;
+                    perm_[pos] = ii;
+                    searchFrom(pos+1, score + getMatchScore(matches_(lhs_, ii, rhs_, pos)));
+                    used_[ii] = false;
+                }
+            }
+
+            const AlleleMatchMatrix& matches_;
+            int bestScore_;
+            vector<Phasing> best_;
+            size_t lhs_;
+            size_t rhs_;
+            vector<size_t> perm_;
+            vector<bool> used_;
+            vector<int> bound_;
+        };
+
+        // Returns true if some permutation of the alleles of hypothesis
+        // lhs is consistent with hypothesis rhs, allele by allele.
+        bool hasConsistentPhasing(const AlleleMatchMatrix& matches,
+                                  size_t lhs, size_t rhs,
+                                  size_t pos, vector<bool>& used)
+        {
+            if (used.size() == pos)
+                return true;
+            for(size_t ii=0; ii<used.size(); ii++)
+            {
+                if (used[ii] || matches(lhs, ii, rhs, pos) >= cdmt::ONLY_A)
+                    continue;
+                used[ii] = true;
+                bool found = hasConsistentPhasing(matches, lhs, rhs, pos+1, used);
+                used[ii] = false;
+                if (found)
+                    return true;
+            }
+            return false;
+        }
+    }
+
     PhasedHypothesis::PhasedHypothesis()
     {
     }
@@ -50,7 +318,6 @@ namespace cgatools { namespace variants {
                                         const reference::CrrFile& crr,
                                         CallDiffResult& result)
     {
-        int bestScore = -1;
         vector<CallDiffResult> bestResults;
 
         if (0 == lhs.size() || 0 == rhs.size() ||
@@ -89,50 +356,35 @@ namespace cgatools { namespace variants {
 
         CGA_ASSERT(lhs[0].getRange() == rhs[0].getRange());
 
-        vector<size_t> perm(lhs[0].size());
-        for(size_t ii=0; ii<perm.size(); ii++)
-            perm[ii] = ii;
-
         string refSequence = crr.getSequence(lhs[0].getRange());
 
-        do
+        // Only the phasings of best score are made into results, in
+        // the order of the permutations, then of the hypotheses.
         {
+            AlleleMatchMatrix matches(lhs, rhs, refSequence);
+            BestPhasingSearch search(matches);
             for(size_t ii=0; ii<lhs.size(); ii++)
             {
                 for(size_t jj=0; jj<rhs.size(); jj++)
-                {
-                    using std::count;
-                    CallDiffResult dr;
-                    diffHypotheses(lhs[ii], rhs[jj], refSequence, perm, dr.matchType_);
-                    int countRefIdentical =
-                        count(dr.matchType_.begin(), dr.matchType_.end(), cdmt::REF_IDENTICAL);
-                    int countAltIdentical =
-                        count(dr.matchType_.begin(), dr.matchType_.end(), cdmt::ALT_IDENTICAL);
-                    int countRefConsistent =
-                        count(dr.matchType_.begin(), dr.matchType_.end(), cdmt::REF_CONSISTENT);
-                    int countAltConsistent =
-                        count(dr.matchType_.begin(), dr.matchType_.end(), cdmt::ALT_CONSISTENT);
-                    int score = 1000 * countAltConsistent + 1010 * countAltIdentical +
-                        1001 * countRefConsistent + 1012 * countRefIdentical;
-                    if ( score > bestScore )
-                    {
-                        dr.setHypotheses(lhs[ii], rhs[jj], perm);
-                        bestResults.clear();
-                        bestResults.push_back(dr);
-                        bestScore = score;
-                    }
-                    else if (score == bestScore)
-                    {
-                        dr.setHypotheses(lhs[ii], rhs[jj], perm);
-                        bestResults.push_back(dr);
-                    }
-                }
+                    search.search(ii, jj);
+            }
+
+            const vector<Phasing>& best = search.getBest();
+            bestResults.resize(best.size());
+            for(size_t ii=0; ii<best.size(); ii++)
+            {
+                CallDiffResult& dr = bestResults[ii];
+                const Phasing& phasing = best[ii];
+                dr.matchType_.resize(phasing.perm_.size());
+                for(size_t jj=0; jj<phasing.perm_.size(); jj++)
+                    dr.matchType_[jj] = matches(phasing.lhs_, phasing.perm_[jj], phasing.rhs_, jj);
+                dr.setHypotheses(lhs[phasing.lhs_], rhs[phasing.rhs_], phasing.perm_);
             }
-        } while (std::next_permutation(perm.begin(), perm.end()));
+        }
 
         // Determine call-level classifications, and use them to
         // make the final decision about which phasing is best.
-        bestScore = -1;
+        int bestScore = -1;
         bool hasMismatch = false;
         for(size_t ii=0; ii<bestResults.size(); ii++)
         {
@@ -189,34 +441,14 @@ namespace cgatools { namespace variants {
             CGA_ASSERT ( 0 != lhs2.size() && 0 != rhs2.size() &&
                          lhs2[0].size() == rhs2[0].size() );
 
-            for(size_t ii=0; ii<perm.size(); ii++)
-                perm[ii] = ii;
-
+            AlleleMatchMatrix matches(lhs2, rhs2, refSequence);
+            vector<bool> used(lhs2[0].size());
             bool isPhaseMismatch = false;
-            vector<cdmt::MatchType> mt2;
-            do
+            for(size_t ii=0; ii<lhs2.size() && !isPhaseMismatch; ii++)
             {
-                for(size_t ii=0; ii<lhs2.size() && !isPhaseMismatch; ii++)
-                {
-                    for(size_t jj=0; jj<rhs2.size() && !isPhaseMismatch; jj++)
-                    {
-                        mt2.clear();
-                        diffHypotheses(lhs2[ii], rhs2[jj], refSequence, perm, mt2);
-
-                        bool mm = false;
-                        for(size_t kk=0; kk<mt2.size(); kk++)
-                        {
-                            if (mt2[kk] >= cdmt::ONLY_A)
-                            {
-                                mm = true;
-                                break;
-                            }
-                        }
-                        if (!mm)
-                            isPhaseMismatch = true;
-                    }
-                }
-            } while (std::next_permutation(perm.begin(), perm.end()) && !isPhaseMismatch);
+                for(size_t jj=0; jj<rhs2.size() && !isPhaseMismatch; jj++)
+                    isPhaseMismatch = hasConsistentPhasing(matches, ii, jj, 0, used);
+            }
 
             if (isPhaseMismatch)
             {
@@ -766,50 +998,4 @@ namespace cgatools { namespace variants {
         return call.alleleSeq_.size() == call.range_.length();
     }
 
-    void PhasedHypothesis::diffHypotheses(const PhasedHypothesis& lhs,
-                                          const PhasedHypothesis& rhs,
-                                          const std::string& refSequence,
-                                          const std::vector<size_t>& perm,
-                                          std::vector<cdmt::MatchType>& result)
-    {
-        result.resize(perm.size());
-        for(size_t ii=0; ii<perm.size(); ii++)
-        {
-            bool lhsRefMatch = bu::isConsistent(lhs[perm[ii]].allele(), refSequence);
-            bool rhsRefMatch = bu::isConsistent(rhs[ii].allele(), refSequence);
-            if (!bu::isConsistent(lhs[perm[ii]].allele(), rhs[ii].allele()))
-            {
-                if (lhsRefMatch && rhsRefMatch)
-                {
-                    // This case happens, for example, if fileA is A,
-                    // fileB is C, and reference is N.
-                    result[ii] = cdmt::MISMATCH;
-                }
-                else if (lhsRefMatch)
-                    result[ii] = cdmt::ONLY_B;
-                else if (rhsRefMatch)
-                    result[ii] = cdmt::ONLY_A;
-                else
-                    result[ii] = cdmt::MISMATCH;
-                continue;
-            }
-
-            if (bu::isCalledSequence(lhs[perm[ii]].allele()) &&
-                bu::isCalledSequence(rhs[ii].allele()))
-            {
-                CGA_ASSERT(lhsRefMatch == rhsRefMatch);
-                if (lhsRefMatch && rhsRefMatch)
-                    result[ii] = cdmt::REF_IDENTICAL;
-                else
-                    result[ii] = cdmt::ALT_IDENTICAL;
-                continue;
-            }
-
-            if (lhsRefMatch && rhsRefMatch)
-                result[ii] = cdmt::REF_CONSISTENT;
-            else
-                result[ii] = cdmt::ALT_CONSISTENT;                
-        }
-    }
-
 } } // cgatools::variants
@@ -80,11 +80,6 @@ namespace cgatools { namespace variants {
                                 std::string& result);
 
     private:
-        static void diffHypotheses(const PhasedHypothesis& lhs,
-                                   const PhasedHypothesis& rhs,
-                                   const std::string& refSequence,
-                                   const std::vector<size_t>& perm,
-                                   std::vector<cdmt::MatchType>& result);
         static void testVariantOneHypothesis(
             const PhasedHypothesis& hyp,
             const PhasedAllele& rhs,
@@ -15,6 +15,8 @@
 #include "cgatools/core.hpp"
 #include "cgatools/variants/Superlocus.hpp"
 
+#include <algorithm>
+#include <deque>
 #include <boost/foreach.hpp>
 
 namespace cgatools { namespace variants {
@@ -107,6 +109,417 @@ namespace cgatools { namespace variants {
             buildPhasedHypotheses(hypotheses[ii], maxHypothesisCount, useHapLinks, ii);
     }
 
+    //! The phasings of a Superlocus while they are built, one locus at
+    //! a time. Each hypothesis is a node that holds the permutation of
+    //! the alleles of one locus, under the node of the loci before it,
+    //! so that hypotheses share the phasing of the loci they have in
+    //! common, and the sequence of each call is computed once. Each
+    //! node keeps the hash of its allele sequences, so the hypotheses
+    //! beyond maxHypothesisCount are dropped before anything is copied,
+    //! and only the remaining ones are made into PhasedHypothesis
+    //! objects at the end.
+    class Superlocus::HypothesisTree
+    {
+    public:
+        HypothesisTree(const Superlocus& sl, size_t ploidy)
+            : sl_(sl),
+              ploidy_(ploidy),
+              locus_(0),
+              locusCallSequences_(0),
+              perm_(ploidy)
+        {
+            Node root;
+            root.parent_ = ROOT;
+            root.locus_ = 0;
+            root.callSequences_ = 0;
+            root.permutationsEqual_ = true;
+            root.callCountsEqual_ = true;
+            nodes_.push_back(root);
+            NodeAllele allele = { 0, 0, 1, 0, 0 };
+            nodeAlleles_.resize(ploidy_, allele);
+            hypotheses_.push_back(0);
+        }
+
+        size_t size() const
+        {
+            return hypotheses_.size();
+        }
+
+        //! Adds the calls of a locus within the superlocus, for all the
+        //! allele permutations consistent with the hapLinks.
+        void addLocus(const Locus& locus, bool useHapLinks, size_t maxHypothesisCount)
+        {
+            setLocusAlleles(locus, 0);
+            bool locusPermutationsEqual = sl_.allelePermutationsAreEqual(locus);
+
+            size_t count = hypotheses_.size(), appendedCount = 0;
+            for(size_t ii=0; ii<count; ii++)
+            {
+                size_t parent = hypotheses_[ii];
+                resetPerm();
+                if (locusPermutationsEqual || hypothesisPermutationsAreEqual(parent))
+                {
+                    addCandidate(parent, ii);
+                    continue;
+                }
+
+                // Add all allele permutations that are consistent with
+                // the haplinks. The first one takes the place of the
+                // parent, the others go after the current hypotheses.
+                size_t consistentCount = 0;
+                do
+                {
+                    if ( (!useHapLinks) || areHapLinksConsistent(parent) )
+                    {
+                        addCandidate(parent, 0 == consistentCount ? ii : count + appendedCount++);
+                        consistentCount++;
+                    }
+                } while (std::next_permutation(perm_.begin(), perm_.end()));
+            }
+
+            // Hypotheses with no permutation consistent with hapLinks
+            // are dropped. Don't drop *all* hypotheses. Due to down
+            // sampling, it's possible no remaining hypotheses are
+            // consistent with hapLinks. In that case, just do a best
+            // effort (i.e. possibly return a hypothesis that is
+            // inconsistent with hapLinks).
+            if (candidates_.empty())
+            {
+                resetPerm();
+                addCandidate(hypotheses_[0], 0);
+            }
+
+            selectCandidates(maxHypothesisCount);
+        }
+
+        //! Adds the part of a ref or no-call locus that overlaps the
+        //! superlocus, as the given sequence for every allele.
+        void addSequence(const Locus& locus, const std::string& sequence, size_t maxHypothesisCount)
+        {
+            setLocusAlleles(locus, &sequence);
+            resetPerm();
+            for(size_t ii=0; ii<hypotheses_.size(); ii++)
+                addCandidate(hypotheses_[ii], ii);
+            selectCandidates(maxHypothesisCount);
+        }
+
+        //! Makes the PhasedHypothesis of each remaining hypothesis.
+        void build(std::vector<PhasedHypothesis>& hypotheses, const Range& range)
+        {
+            hypotheses.resize(hypotheses_.size());
+            for(size_t ii=0; ii<hypotheses_.size(); ii++)
+                build(hypotheses_[ii], range, hypotheses[ii]);
+        }
+
+    private:
+        static const size_t ROOT = ~size_t(0);
+
+        //! The state of one allele of a node: the offset of the locus
+        //! allele in the permutation, and the djb2 hash polynomial,
+        //! 33 to the power of the length, the length, and the number of
+        //! calls of the allele sequence up to and including the node.
+        struct NodeAllele
+        {
+            uint32_t alleleOffset_;
+            uint32_t hash_;
+            uint32_t scale_;
+            uint32_t length_;
+            uint32_t callCount_;
+        };
+
+        struct Node
+        {
+            size_t parent_;
+            const Locus* locus_;
+            //! The offset in callSequences_ of the sequences of the
+            //! calls of the locus.
+            size_t callSequences_;
+            //! True if permuting the alleles gives an equal hypothesis,
+            //! provided callCountsEqual_.
+            bool permutationsEqual_;
+            //! True if all the alleles of this node and its ancestors
+            //! have the same number of calls.
+            bool callCountsEqual_;
+        };
+
+        //! A child a hypothesis may get, with its alleles in
+        //! candidateAlleles_. The order is the one of the hypothesis
+        //! vector before downsampling.
+        struct Candidate
+        {
+            uint32_t hash_;
+            size_t order_;
+            size_t parent_;
+            size_t alleles_;
+
+            bool operator<(const Candidate& other) const
+            {
+                if (hash_ != other.hash_)
+                    return hash_ < other.hash_;
+                return order_ < other.order_;
+            }
+        };
+
+        class LessOrder
+        {
+        public:
+            bool operator()(const Candidate& lhs, const Candidate& rhs) const
+            {
+                return lhs.order_ < rhs.order_;
+            }
+        };
+
+        void resetPerm()
+        {
+            for(size_t ii=0; ii<perm_.size(); ii++)
+                perm_[ii] = ii;
+        }
+
+        static void appendHash(NodeAllele& allele, const std::string& sequence)
+        {
+            for(size_t ii=0; ii<sequence.size(); ii++)
+            {
+                allele.hash_ = ((allele.hash_ << 5) + allele.hash_) + uint8_t(sequence[ii]);
+                allele.scale_ = (allele.scale_ << 5) + allele.scale_;
+            }
+            allele.length_ += uint32_t(sequence.size());
+        }
+
+        //! Sets locusAlleles_ to what each allele of the locus adds to
+        //! a hypothesis, and stores the sequence of each call of the
+        //! locus: the given sequence if not null, else the called
+        //! sequence.
+        void setLocusAlleles(const Locus& locus, const std::string* sequence)
+        {
+            locus_ = &locus;
+            locusCallSequences_ = callSequences_.size();
+            const vector<Call>& calls = locus.getCalls();
+            for(size_t ii=0; ii<calls.size(); ii++)
+            {
+                if (0 != sequence)
+                    callSequences_.push_back(*sequence);
+                else
+                    callSequences_.push_back(calls[ii].calledSequence(locus.getReference()));
+            }
+
+            const vector<Allele>& alleles = locus.getAlleles();
+            locusAlleles_.resize(alleles.size());
+            for(size_t ii=0; ii<alleles.size(); ii++)
+            {
+                NodeAllele& la = locusAlleles_[ii];
+                const vector<size_t>& offsets = alleles[ii].getCallOffsets();
+                la.alleleOffset_ = uint32_t(ii);
+                la.hash_ = 0;
+                la.scale_ = 1;
+                la.length_ = 0;
+                la.callCount_ = uint32_t(offsets.size());
+                if (0 != sequence)
+                    CGA_ASSERT(1 == offsets.size());
+                BOOST_FOREACH(size_t offset, offsets)
+                    appendHash(la, callSequences_[locusCallSequences_ + offset]);
+            }
+            candidates_.clear();
+            candidateAlleles_.clear();
+        }
+
+        //! Adds the child of parent for the current permutation.
+        void addCandidate(size_t parent, size_t order)
+        {
+            Candidate candidate;
+            candidate.order_ = order;
+            candidate.parent_ = parent;
+            candidate.alleles_ = candidateAlleles_.size();
+
+            // based on djb2 hash, as if over the concatenated alleles
+            uint32_t hash = 5381;
+            for(size_t jj=0; jj<ploidy_; jj++)
+            {
+                const NodeAllele& pa = nodeAlleles_[parent*ploidy_ + jj];
+                const NodeAllele& la = locusAlleles_[perm_[jj]];
+                NodeAllele allele;
+                allele.alleleOffset_ = la.alleleOffset_;
+                allele.hash_ = pa.hash_ * la.scale_ + la.hash_;
+                allele.scale_ = pa.scale_ * la.scale_;
+                allele.length_ = pa.length_ + la.length_;
+                allele.callCount_ = pa.callCount_ + la.callCount_;
+                candidateAlleles_.push_back(allele);
+
+                hash = ((hash << 5) + hash) + 17;
+                hash = hash * allele.scale_ + allele.hash_;
+            }
+            candidate.hash_ = hash;
+            candidates_.push_back(candidate);
+        }
+
+        //! Makes nodes of the candidates, keeping the
+        //! maxHypothesisCount of lowest hash if there are more.
+        void selectCandidates(size_t maxHypothesisCount)
+        {
+            if (candidates_.size() > maxHypothesisCount)
+            {
+                std::partial_sort(candidates_.begin(), candidates_.begin() + maxHypothesisCount,
+                                  candidates_.end());
+                candidates_.resize(maxHypothesisCount);
+            }
+            else
+                std::sort(candidates_.begin(), candidates_.end(), LessOrder());
+
+            hypotheses_.clear();
+            BOOST_FOREACH(const Candidate& candidate, candidates_)
+                hypotheses_.push_back(addNode(candidate));
+        }
+
+        size_t addNode(const Candidate& candidate)
+        {
+            const Node& parent = nodes_[candidate.parent_];
+            const NodeAllele* alleles = &candidateAlleles_[candidate.alleles_];
+            Node node;
+            node.parent_ = candidate.parent_;
+            node.locus_ = locus_;
+            node.callSequences_ = locusCallSequences_;
+            node.callCountsEqual_ = parent.callCountsEqual_;
+            for(size_t jj=1; jj<ploidy_; jj++)
+            {
+                if (alleles[jj].callCount_ != alleles[0].callCount_)
+                    node.callCountsEqual_ = false;
+            }
+            node.permutationsEqual_ = node.callCountsEqual_ && parent.permutationsEqual_ &&
+                addedCallPermutationsAreEqual(alleles);
+
+            nodes_.push_back(node);
+            nodeAlleles_.insert(nodeAlleles_.end(), alleles, alleles + ploidy_);
+            return nodes_.size() - 1;
+        }
+
+        //! Returns true if the calls the locus adds to each allele are
+        //! equivalent to the ones it adds to the first allele.
+        bool addedCallPermutationsAreEqual(const NodeAllele* alleles) const
+        {
+            const vector<Allele>& locusAlleles = locus_->getAlleles();
+            const vector<Call>& calls = locus_->getCalls();
+            const vector<size_t>& offsets0 = locusAlleles[alleles[0].alleleOffset_].getCallOffsets();
+            for(size_t jj=1; jj<ploidy_; jj++)
+            {
+                const vector<size_t>& offsets = locusAlleles[alleles[jj].alleleOffset_].getCallOffsets();
+                for(size_t kk=0; kk<offsets.size(); kk++)
+                {
+                    if (!sl_.callPermutationsAreEqual(calls[offsets[kk]], calls[offsets0[kk]]))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        bool hypothesisPermutationsAreEqual(size_t node)
+        {
+            if (nodes_[node].callCountsEqual_)
+                return nodes_[node].permutationsEqual_;
+
+            // The alleles have had different numbers of calls at some
+            // locus, so compare them whole, as built.
+            const NodeAllele* alleles = &nodeAlleles_[node*ploidy_];
+            for(size_t jj=1; jj<ploidy_; jj++)
+            {
+                if (alleles[jj].callCount_ != alleles[0].callCount_ ||
+                    alleles[jj].hash_ != alleles[0].hash_ ||
+                    alleles[jj].scale_ != alleles[0].scale_)
+                    return false;
+            }
+            build(node, Range(), hypothesis_);
+            return sl_.hypothesisPermutationsAreEqual(hypothesis_);
+        }
+
+        bool areHapLinksConsistent(size_t parent) const
+        {
+            const vector<Allele>& alleles = locus_->getAlleles();
+
+            for(size_t jj=0; jj<ploidy_; jj++)
+            {
+                const string& hapLink = alleles[perm_[jj]].getHapLink();
+                if (hapLink.size() > 0)
+                {
+                    for(size_t ii=0; ii<ploidy_; ii++)
+                    {
+                        if (ii == jj)
+                            continue;
+
+                        if (hasHapLink(parent, ii, hapLink))
+                            return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        //! Returns true if any call of the given allele of the node or
+        //! its ancestors has the hapLink.
+        bool hasHapLink(size_t node, size_t allele, const std::string& hapLink) const
+        {
+            for(; ROOT != nodes_[node].parent_; node = nodes_[node].parent_)
+            {
+                const Locus& locus = *nodes_[node].locus_;
+                const Allele& la = locus.getAlleles()[nodeAlleles_[node*ploidy_ + allele].alleleOffset_];
+                BOOST_FOREACH(size_t offset, la.getCallOffsets())
+                {
+                    if (locus.getCalls()[offset].hapLink_ == hapLink)
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        void build(size_t node, const Range& range, PhasedHypothesis& hypothesis)
+        {
+            path_.clear();
+            for(size_t ii=node; ROOT != nodes_[ii].parent_; ii = nodes_[ii].parent_)
+                path_.push_back(ii);
+
+            PhasedHypothesis(range, ploidy_).swap(hypothesis);
+            for(size_t jj=0; jj<ploidy_; jj++)
+            {
+                const NodeAllele& allele = nodeAlleles_[node*ploidy_ + jj];
+                hypothesis[jj].reserve(allele.callCount_, allele.length_);
+            }
+            for(size_t ii=path_.size(); ii>0; ii--)
+            {
+                const Node& n = nodes_[path_[ii-1]];
+                const vector<Allele>& alleles = n.locus_->getAlleles();
+                const vector<Call>& calls = n.locus_->getCalls();
+                for(size_t jj=0; jj<ploidy_; jj++)
+                {
+                    const Allele& allele = alleles[nodeAlleles_[path_[ii-1]*ploidy_ + jj].alleleOffset_];
+                    BOOST_FOREACH(size_t offset, allele.getCallOffsets())
+                    {
+                        hypothesis[jj].addSequence(calls[offset], *n.locus_,
+                                                   callSequences_[n.callSequences_ + offset]);
+                    }
+                }
+            }
+        }
+
+        const Superlocus& sl_;
+        size_t ploidy_;
+
+        std::vector<Node> nodes_;
+        std::vector<NodeAllele> nodeAlleles_;
+        std::deque<std::string> callSequences_;
+
+        //! The nodes of the current hypotheses.
+        std::vector<size_t> hypotheses_;
+
+        //! The locus being added.
+        const Locus* locus_;
+        size_t locusCallSequences_;
+        std::vector<NodeAllele> locusAlleles_;
+        std::vector<size_t> perm_;
+        std::vector<Candidate> candidates_;
+        std::vector<NodeAllele> candidateAlleles_;
+
+        std::vector<size_t> path_;
+        PhasedHypothesis hypothesis_;
+    };
+
     void Superlocus::buildPhasedHypotheses(std::vector<PhasedHypothesis>& hypotheses,
                                            size_t maxHypothesisCount,
                                            bool useHapLinks,
@@ -132,12 +545,11 @@ namespace cgatools { namespace variants {
         {
             return;
         }
-        hypotheses.resize(1, PhasedHypothesis(range_, ploidy));
-        vector<size_t> perm(ploidy);
+        HypothesisTree tree(*this, ploidy);
 
         for(; qIter!=qLast; ++qIter)
         {
-            if (0 == hypotheses.size())
+            if (0 == tree.size())
                 break;
 
             if (range_.endLocation() < qIter->getRange().endLocation() &&
@@ -148,71 +560,13 @@ namespace cgatools { namespace variants {
             if (locus.getPloidy() != ploidy)
             {
                 // Ploidy mismatch.
-                hypotheses.clear();
                 return;
             }
 
-            for(size_t ii=0; ii<perm.size(); ii++)
-                perm[ii] = ii;
-
             if (range_.beginLocation() <= locus.getRange().beginLocation() &&
                 range_.endLocation() >= locus.getRange().endLocation())
             {
-                size_t hypothesisCount = hypotheses.size();
-
-                vector<size_t> deletedHypotheses;
-                for(size_t ii=0; ii<hypothesisCount; ii++)
-                {
-                    if (hypothesisPermutationsAreEqual(hypotheses[ii]) || allelePermutationsAreEqual(locus))
-                        addCalls(hypotheses[ii], locus, perm);
-                    else
-                    {
-                        // Add sequence for all allele permutations that
-                        // are consistent with the haplinks.
-                        size_t consistentCount = 0;
-                        PhasedHypothesis hypothesis = hypotheses[ii]; // intentional copy
-                        do
-                        {
-                            if ( (!useHapLinks) || areHapLinksConsistent(hypothesis, locus, perm) )
-                            {
-                                if (0 == consistentCount)
-                                {
-                                    addCalls(hypotheses[ii], locus, perm);
-                                }
-                                else
-                                {
-                                    hypotheses.push_back(hypothesis);
-                                    addCalls(hypotheses.back(), locus, perm);
-                                }
-                                consistentCount++;
-                            }
-                        } while (std::next_permutation(perm.begin(), perm.end()));
-                        if (0 == consistentCount)
-                        {
-                            // No permutations were consistent with
-                            // haplinks. Mark this hypothesis as
-                            // deleted.
-                            deletedHypotheses.push_back(ii);
-
-                            if (0 == ii)
-                            {
-                                addCalls(hypotheses[ii], locus, perm);
-                            }
-                        }
-                    }
-                }
-
-                // Delete hypotheses, starting from end.
-                for(int ii=deletedHypotheses.size()-1; ii>=0; ii--)
-                {
-                    // Don't delete *all* hypotheses. Due to down
-                    // sampling, it's possible no remaining hypotheses
-                    // are consistent with hapLinks. In that case, just
-                    // do a best effort (i.e. possibly return a
-                    // hypothesis that is inconsistent with hapLinks).
-                    if (hypotheses.size() > 1)
-                        hypotheses.erase(hypotheses.begin() + deletedHypotheses[ii]);
-                }
+                tree.addLocus(locus, useHapLinks, maxHypothesisCount);
             }
             else
             {
@@ -224,18 +578,14 @@ namespace cgatools { namespace variants {
                 string sequence = "?";
                 if (locus.isRefCallLocus())
                     sequence = locus.getReference().getSequence(rg);
-                BOOST_FOREACH(PhasedHypothesis& hypothesis, hypotheses)
-                {
-                    addSequence(hypothesis, locus, perm, sequence);
-                }
+                tree.addSequence(locus, sequence, maxHypothesisCount);
             }
-
-            if (hypotheses.size() > maxHypothesisCount)
-                downSample(hypotheses, maxHypothesisCount);
         }
 
-        if (0 == hypotheses.size())
+        if (0 == tree.size())
             throw Exception("failed to phase loci: no permutations were consistent with hapLinks");
+
+        tree.build(hypotheses, range_);
     }
 
     // Returns true if permuting the PhasedAlleles of the hypothesis
@@ -295,91 +645,4 @@ namespace cgatools { namespace variants {
         return true;
     }
 
-    void Superlocus::addCalls(PhasedHypothesis& hypothesis,
-                              const Locus& locus,
-                              const std::vector<size_t>& perm) const
-    {
-        const vector<Allele>& alleles = locus.getAlleles();
-        const vector<Call>& calls = locus.getCalls();
-        for(size_t jj=0; jj<hypothesis.size(); jj++)
-        {
-            const vector<size_t>& offsets = alleles[perm[jj]].getCallOffsets();
-            BOOST_FOREACH(size_t offset, offsets)
-            {
-                hypothesis[jj].addCall(calls[offset], locus, locus.getReference());
-            }
-        }
-    }
-
-    void Superlocus::addSequence(PhasedHypothesis& hypothesis,
-                                 const Locus& locus,
-                                 const std::vector<size_t>& perm,
-                                 const std::string& sequence) const
-    {
-        const vector<Allele>& alleles = locus.getAlleles();
-        const vector<Call>& calls = locus.getCalls();
-        for(size_t jj=0; jj<hypothesis.size(); jj++)
-        {
-            const vector<size_t>& offsets = alleles[perm[jj]].getCallOffsets();
-            CGA_ASSERT(1 == offsets.size());
-            hypothesis[jj].addSequence(calls[offsets[0]], locus, sequence);
-        }
-    }
-
-    bool Superlocus::areHapLinksConsistent(const PhasedHypothesis& hypothesis,
-                                           const Locus& locus,
-                                           const std::vector<size_t>& perm) const
-    {
-        const vector<Allele>& alleles = locus.getAlleles();
-
-        for(size_t jj=0; jj<hypothesis.size(); jj++)
-        {
-            const string& hapLink = alleles[perm[jj]].getHapLink();
-            if (hapLink.size() > 0)
-            {
-                for(size_t ii=0; ii<hypothesis.size(); ii++)
-                {
-                    if (ii == jj)
-                        continue;
-
-                    if (hypothesis[ii].hasHapLink(hapLink))
-                        return false;
-                }
-            }
-        }
-
-        return true;
-    }
-
-    void Superlocus::downSample(std::vector<PhasedHypothesis>& hypotheses,
-                                size_t maxHypothesisCount) const
-    {
-        vector< pair<uint32_t, size_t> > hypHashes;
-        for(size_t ii=0; ii<hypotheses.size(); ii++)
-            hypHashes.push_back( make_pair(hashHypothesis(hypotheses[ii]), ii) );
-        std::sort(hypHashes.begin(), hypHashes.end());
-        vector<PhasedHypothesis> tmp;
-        tmp.reserve(2*maxHypothesisCount);
-        tmp.resize(maxHypothesisCount, PhasedHypothesis(Range(), 0));
-        tmp.swap(hypotheses);
-        for(size_t ii=0; ii<maxHypothesisCount; ii++)
-            hypotheses[ii].swap(tmp[hypHashes[ii].second]);
-    }
-
-    uint32_t Superlocus::hashHypothesis(const PhasedHypothesis& hyp) const
-    {
-        // based on djb2 hash
-        uint32_t hash = 5381;
-
-        for(size_t ii=0; ii<hyp.size(); ii++)
-        {
-            hash = ((hash << 5) + hash) + 17;
-            const string& allele = hyp[ii].allele();
-            for(size_t jj=0; jj<allele.size(); jj++)
-                hash = ((hash << 5) + hash) + uint8_t(allele[jj]);
-        }
-
-        return hash;
-    }
-
 } } // cgatools::variants
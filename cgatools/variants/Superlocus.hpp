@@ -68,6 +68,8 @@ namespace cgatools { namespace variants {
             const reference::CrrFile& crr, const reference::Location& loc, const std::string& sequence);
 
     private:
+        class HypothesisTree;
+
         void buildPhasedHypotheses(std::vector<PhasedHypothesis>& hypotheses,
                                    size_t maxHypothesisCount,
                                    bool useHapLinks,
@@ -75,19 +77,6 @@ namespace cgatools { namespace variants {
         bool hypothesisPermutationsAreEqual(const PhasedHypothesis& hypothesis) const;
         bool callPermutationsAreEqual(const Call& lhs, const Call& rhs) const;
         bool allelePermutationsAreEqual(const Locus& locus) const;
-        void addCalls(PhasedHypothesis& hypothesis,
-                      const Locus& locus,
-                      const std::vector<size_t>& perm) const;
-        void addSequence(PhasedHypothesis& hypothesis,
-                         const Locus& locus,
-                         const std::vector<size_t>& perm,
-                         const std::string& sequence) const;
-        bool areHapLinksConsistent(const PhasedHypothesis& hypothesis,
-                                   const Locus& locus,
-                                   const std::vector<size_t>& perm) const;
-        void downSample(std::vector<PhasedHypothesis>& hypotheses,
-                        size_t maxHypothesisCount) const;
-        uint32_t hashHypothesis(const PhasedHypothesis& hyp) const;
 
         std::vector< std::deque<Locus> > queues_;
         reference::Range range_;
@@ -218,6 +218,24 @@ namespace cgatools { namespace variants {
         extendVariant();
     }
 
+    void SuperlocusIterator::seek(const Location& loc)
+    {
+        if (0 == iters_.size())
+            throw Exception("failed to iterate: SuperlocusIterator has no variant files");
+
+        if (loc <= sl_.searchRange_.endLocation())
+            return;
+
+        for(size_t ii=0; ii<queues_.size(); ii++)
+        {
+            if (!queues_[ii].empty() && queues_[ii].back().getRange().endLocation() >= loc)
+                continue;
+            countRetired_[ii] += queues_[ii].size();
+            queues_[ii].clear();
+            iters_[ii]->seek(loc);
+        }
+    }
+
     // Finds the first Locus L that is not consistent with the
     // reference, such that L.getRange().endLocation() >= loc. Returns
     // true for success, in which case range is set to L.getRange() and
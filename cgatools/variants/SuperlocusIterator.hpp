@@ -79,6 +79,13 @@ namespace cgatools { namespace variants {
         //! stream in reference order.
         void skipToVariant(const reference::Range& range, const std::string& alleleSeq);
 
+        //! Moves the variant files forward to loc, dropping the queued
+        //! loci that end before loc, so that the loci in between are
+        //! not read; for use before skipToVariant(). Does nothing
+        //! while loc is within the search range of the current
+        //! superlocus, whose loci may still be needed.
+        void seek(const reference::Location& loc);
+
         //! Do the initial seek, in the case where you're iterating via ++.
         void seekFirst();
 
@@ -0,0 +1,669 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/variants/VariantBinaryFile.hpp"
+#include "cgatools/variants/VariantFileIterator.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Interned.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace cgatools { namespace variants {
+
+    using std::string;
+    using std::vector;
+    using namespace cgatools::util;
+    namespace bio = boost::iostreams;
+
+    namespace {
+        const char MAGIC[4] = { 'C', 'V', 'B', '\n' };
+        const uint32_t VERSION = 1;
+
+        // The columns of a block, followed by one column per
+        // annotation. Locus columns have one value per locus, and call
+        // columns one value per call.
+        enum Column
+        {
+            COL_CALL_COUNT = 0,     // locus
+            COL_LOCUS_TYPE,         // locus, dictionary
+            COL_LOCUS_ID,           // call, delta from previous call
+            COL_PLOIDY,
+            COL_HAPLOTYPE,
+            COL_BEGIN,              // delta from previous call
+            COL_LENGTH,
+            COL_VAR_TYPE,           // dictionary
+            COL_REFERENCE,
+            COL_ALLELE_SEQ,
+            COL_VAR_SCORE_VAF,
+            COL_VAR_SCORE_EAF,
+            COL_VAR_FILTER,         // count, then dictionary
+            COL_HAP_LINK,
+            COL_XREF,
+            COL_ALLELE_FREQ,
+            COL_ALTERNATIVE_CALLS,  // count, then sequence and score
+            FIXED_COLUMN_COUNT
+        };
+
+        // Appends val in the format of writeBinaryUIntZC().
+        void putUInt(string& out, uint64_t val)
+        {
+            char bytes[10];
+            char* ptr = bytes + sizeof(bytes);
+            *--ptr = char(val & 0x7f);
+            for(val >>= 7; 0 != val; val >>= 7)
+                *--ptr = char((val & 0x7f) | 0x80);
+            out.append(ptr, bytes+sizeof(bytes)-ptr);
+        }
+
+        // Zigzag-encodes val, so that small negative values stay short.
+        void putInt(string& out, int64_t val)
+        {
+            putUInt(out, (uint64_t(val) << 1) ^ uint64_t(val >> 63));
+        }
+
+        void putString(string& out, const string& val)
+        {
+            putUInt(out, val.size());
+            out.append(val);
+        }
+
+        class ColumnReader
+        {
+        public:
+            ColumnReader()
+                : fn_(0),
+                  pos_(0),
+                  end_(0)
+            {
+            }
+
+            void reset(const string& fn, const char* first, const char* last)
+            {
+                fn_ = &fn;
+                pos_ = first;
+                end_ = last;
+            }
+
+            size_t remaining() const
+            {
+                return end_ - pos_;
+            }
+
+            uint64_t getUInt()
+            {
+                uint64_t val = 0;
+                for(;;)
+                {
+                    if (pos_ == end_)
+                        corrupt();
+                    uint8_t ch = uint8_t(*pos_++);
+                    val |= ch & 0x7f;
+                    if (0 == (ch & 0x80))
+                        return val;
+                    val <<= 7;
+                }
+            }
+
+            int64_t getInt()
+            {
+                uint64_t val = getUInt();
+                return int64_t(val >> 1) ^ -int64_t(val & 1);
+            }
+
+            void getString(string& val)
+            {
+                size_t size = getUInt();
+                if (size > remaining())
+                    corrupt();
+                val.assign(pos_, size);
+                pos_ += size;
+            }
+
+            size_t getDictId(size_t dictSize)
+            {
+                uint64_t id = getUInt();
+                if (id >= dictSize)
+                    corrupt();
+                return size_t(id);
+            }
+
+            template <class T>
+            const T& getDict(const vector<T>& dict)
+            {
+                return dict[getDictId(dict.size())];
+            }
+
+            void corrupt() const
+            {
+                throw Exception("invalid binary var file: "+*fn_);
+            }
+
+        private:
+            const string* fn_;
+            const char* pos_;
+            const char* end_;
+        };
+    }
+
+    //-----------------------------------------------------------------------
+    // VariantBinaryFileWriter
+    //-----------------------------------------------------------------------
+    const size_t VariantBinaryFileWriter::DEFAULT_BLOCK_LOCUS_COUNT;
+
+    struct VariantBinaryFileWriter::Impl
+    {
+        Impl(const std::string& fn,
+             const reference::CrrFile& crr,
+             const VariantFileIterator& source,
+             size_t blockLocusCount)
+            : out_(fn),
+              blockLocusCount_(std::max(blockLocusCount, size_t(1))),
+              columns_(FIXED_COLUMN_COUNT + source.getAnnotationColumnHeaders().size()),
+              chromosome_(0),
+              locusCount_(0),
+              lastLocusId_(0),
+              lastBegin_(0),
+              closed_(false)
+        {
+            out_.write(MAGIC, sizeof(MAGIC));
+            writeBinaryInt(out_, VERSION);
+
+            writeBinaryUIntZC(out_, crr.listChromosomes().size());
+            BOOST_FOREACH(const reference::CompactDnaSequence& chr, crr.listChromosomes())
+                writeBinaryString(out_, chr.getName());
+
+            typedef std::pair<string, string> KeyValue;
+            const vector<KeyValue>& meta = source.getMetadata().getMap();
+            writeBinaryUIntZC(out_, meta.size());
+            BOOST_FOREACH(const KeyValue& kv, meta)
+            {
+                writeBinaryString(out_, kv.first);
+                writeBinaryString(out_, kv.second);
+            }
+            writeStrings(source.getColumnHeaders());
+            writeStrings(source.getAnnotationColumnHeaders());
+            writeBinaryBool(out_, source.isOlpl());
+            writeBinaryBool(out_, source.xRefIsAlleleSpecific());
+        }
+
+        void writeStrings(const vector<string>& strings)
+        {
+            writeBinaryUIntZC(out_, strings.size());
+            BOOST_FOREACH(const string& str, strings)
+                writeBinaryString(out_, str);
+        }
+
+        void putDict(Column column, const string& val)
+        {
+            std::map<string, uint32_t>::const_iterator it = dictIds_.find(val);
+            if (it == dictIds_.end())
+            {
+                it = dictIds_.insert(std::make_pair(val, uint32_t(dict_.size()))).first;
+                dict_.push_back(val);
+            }
+            putUInt(columns_[column], it->second);
+        }
+
+        void putCall(const Call& c)
+        {
+            if (c.range_.chromosome_ != chromosome_ || c.range_.end_ < c.range_.begin_)
+                throw Exception("failed to write binary var file: bad call range");
+
+            putInt(columns_[COL_LOCUS_ID], int64_t(c.locus_) - lastLocusId_);
+            lastLocusId_ = c.locus_;
+            putUInt(columns_[COL_PLOIDY], c.ploidy_);
+            putUInt(columns_[COL_HAPLOTYPE], c.haplotype_);
+            putInt(columns_[COL_BEGIN], int64_t(c.range_.begin_) - lastBegin_);
+            lastBegin_ = c.range_.begin_;
+            putUInt(columns_[COL_LENGTH], c.range_.length());
+            putDict(COL_VAR_TYPE, c.varType_);
+            putString(columns_[COL_REFERENCE], c.reference_);
+            putString(columns_[COL_ALLELE_SEQ], c.alleleSeq_);
+            putInt(columns_[COL_VAR_SCORE_VAF], c.varScoreVAF_);
+            putInt(columns_[COL_VAR_SCORE_EAF], c.varScoreEAF_);
+            putUInt(columns_[COL_VAR_FILTER], c.varFilter_.size());
+            BOOST_FOREACH(const string& filter, c.varFilter_)
+                putDict(COL_VAR_FILTER, filter);
+            putString(columns_[COL_HAP_LINK], c.hapLink_);
+            putString(columns_[COL_XREF], c.xRef_);
+            putString(columns_[COL_ALLELE_FREQ], c.alleleFreq_);
+            putUInt(columns_[COL_ALTERNATIVE_CALLS], c.alternativeCalls_.size());
+            BOOST_FOREACH(const Call::AlternativeCall& ac, c.alternativeCalls_)
+            {
+                putString(columns_[COL_ALTERNATIVE_CALLS], ac.alleleSeq_);
+                putInt(columns_[COL_ALTERNATIVE_CALLS], ac.score_);
+            }
+        }
+
+        void flushBlock()
+        {
+            string block;
+            putUInt(block, dict_.size());
+            BOOST_FOREACH(const string& val, dict_)
+                putString(block, val);
+            putUInt(block, columns_.size());
+            BOOST_FOREACH(const string& column, columns_)
+                putUInt(block, column.size());
+            BOOST_FOREACH(const string& column, columns_)
+                block.append(column);
+
+            string compressed;
+            {
+                bio::filtering_ostream zOut;
+                zOut.push(bio::zlib_compressor());
+                zOut.push(bio::back_inserter(compressed));
+                zOut.write(block.data(), block.size());
+                zOut.reset();
+            }
+
+            writeBinaryUIntZC(out_, locusCount_);
+            writeBinaryUIntZC(out_, chromosome_);
+            writeBinaryUIntZC(out_, block.size());
+            writeBinaryUIntZC(out_, compressed.size());
+            out_.write(compressed.data(), compressed.size());
+
+            BOOST_FOREACH(string& column, columns_)
+                column.clear();
+            dictIds_.clear();
+            dict_.clear();
+            locusCount_ = 0;
+            lastLocusId_ = 0;
+            lastBegin_ = 0;
+        }
+
+        OutputStream out_;
+        size_t blockLocusCount_;
+        vector<string> columns_;
+        std::map<string, uint32_t> dictIds_;
+        vector<string> dict_;
+        uint16_t chromosome_;
+        size_t locusCount_;
+        int64_t lastLocusId_;
+        int64_t lastBegin_;
+        bool closed_;
+    };
+
+    VariantBinaryFileWriter::VariantBinaryFileWriter(
+        const std::string& fn,
+        const reference::CrrFile& crr,
+        const VariantFileIterator& source,
+        size_t blockLocusCount)
+        : pimpl_(new Impl(fn, crr, source, blockLocusCount))
+    {
+    }
+
+    VariantBinaryFileWriter::~VariantBinaryFileWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch(std::exception& ee)
+        {
+            std::cerr << ee.what() << std::endl;
+            // While unwinding, the file is abandoned anyway; let the
+            // pending exception report the failure.
+            if (!std::uncaught_exception())
+                CGA_ASSERT(false);
+        }
+    }
+
+    void VariantBinaryFileWriter::write(const Locus& locus)
+    {
+        Impl& impl = *pimpl_;
+        CGA_ASSERT(!impl.closed_);
+        CGA_ASSERT(locus.extras_.size() + FIXED_COLUMN_COUNT == impl.columns_.size());
+
+        // Blocks hold loci of one chromosome.
+        if ( impl.locusCount_ > 0 &&
+             (impl.locusCount_ == impl.blockLocusCount_ ||
+              locus.getRange().chromosome_ != impl.chromosome_) )
+            impl.flushBlock();
+        impl.chromosome_ = locus.getRange().chromosome_;
+        impl.locusCount_++;
+
+        putUInt(impl.columns_[COL_CALL_COUNT], locus.getCalls().size());
+        impl.putDict(COL_LOCUS_TYPE, locus.getOlplType());
+        BOOST_FOREACH(const Call& call, locus.getCalls())
+            impl.putCall(call);
+        for(size_t ii=0; ii<locus.extras_.size(); ii++)
+            putString(impl.columns_[FIXED_COLUMN_COUNT+ii], locus.extras_[ii]);
+    }
+
+    void VariantBinaryFileWriter::close()
+    {
+        Impl& impl = *pimpl_;
+        if (impl.closed_)
+            return;
+        impl.closed_ = true;
+        if (impl.locusCount_ > 0)
+            impl.flushBlock();
+        writeBinaryUIntZC(impl.out_, 0);
+        impl.out_.close();
+    }
+
+    //-----------------------------------------------------------------------
+    // VariantBinaryFileReader
+    //-----------------------------------------------------------------------
+    struct VariantBinaryFileReader::Impl
+    {
+        Impl(const std::string& fn, const reference::CrrFile& crr)
+            : fn_(fn),
+              in_(fn),
+              olpl_(false),
+              xRefIsAlleleSpecific_(true),
+              chromosome_(0),
+              chromosomeCount_(0),
+              locusCount_(0),
+              next_(0),
+              lastLocusId_(0),
+              lastBegin_(0),
+              eof_(false)
+        {
+            try
+            {
+                char magic[sizeof(MAGIC)];
+                in_.read(magic, sizeof(magic));
+                uint32_t version;
+                if ( size_t(in_.gcount()) != sizeof(magic) ||
+                     0 != std::memcmp(magic, MAGIC, sizeof(MAGIC)) )
+                    throw Exception("not a binary var file");
+                readBinaryInt(in_, &version);
+                if (VERSION != version)
+                    throw Exception("unsupported binary var file version");
+
+                vector<string> chromosomes;
+                readStrings(chromosomes);
+                const vector<reference::CompactDnaSequence>& crrChromosomes = crr.listChromosomes();
+                bool sameReference = chromosomes.size() == crrChromosomes.size();
+                for(size_t ii=0; sameReference && ii<chromosomes.size(); ii++)
+                    sameReference = chromosomes[ii] == crrChromosomes[ii].getName();
+                if (!sameReference)
+                    throw Exception("file was written with a different reference");
+                chromosomeCount_ = chromosomes.size();
+
+                size_t metaCount;
+                readBinaryUIntZC(in_, &metaCount);
+                for(size_t ii=0; ii<metaCount; ii++)
+                {
+                    string key, value;
+                    readBinaryString(in_, &key);
+                    readBinaryString(in_, &value);
+                    meta_.add(key, value);
+                }
+                meta_.setFileName(fn_);
+                readStrings(columnHeaders_);
+                readStrings(annotationColumnHeaders_);
+                readBinaryBool(in_, &olpl_);
+                readBinaryBool(in_, &xRefIsAlleleSpecific_);
+            }
+            catch(std::exception& ee)
+            {
+                throw Exception("failed to open binary var file "+fn_+": "+ee.what());
+            }
+            columns_.resize(FIXED_COLUMN_COUNT + annotationColumnHeaders_.size());
+        }
+
+        void readStrings(vector<string>& strings)
+        {
+            size_t count;
+            readBinaryUIntZC(in_, &count);
+            strings.resize(count);
+            for(size_t ii=0; ii<count; ii++)
+                readBinaryString(in_, &strings[ii]);
+        }
+
+        bool readBlock()
+        {
+            try
+            {
+                readBinaryUIntZC(in_, &locusCount_);
+                if (0 == locusCount_)
+                    return false;
+                size_t rawSize, compressedSize;
+                readBinaryUIntZC(in_, &chromosome_);
+                if (chromosome_ >= chromosomeCount_)
+                    throw Exception("bad chromosome id");
+                readBinaryUIntZC(in_, &rawSize);
+                readBinaryUIntZC(in_, &compressedSize);
+                compressed_.resize(compressedSize);
+                in_.read(&compressed_[0], compressedSize);
+                if (size_t(in_.gcount()) != compressedSize)
+                    throw Exception("unexpected eof");
+
+                raw_.resize(rawSize);
+                bio::filtering_istream zIn;
+                zIn.push(bio::zlib_decompressor());
+                zIn.push(bio::array_source(compressed_.data(), compressed_.size()));
+                zIn.read(&raw_[0], raw_.size());
+                if (size_t(zIn.gcount()) != raw_.size())
+                    throw Exception("bad block size");
+            }
+            catch(std::exception& ee)
+            {
+                throw Exception("failed to read binary var file "+fn_+": "+ee.what());
+            }
+
+            ColumnReader header;
+            header.reset(fn_, raw_.data(), raw_.data()+raw_.size());
+            dict_.resize(header.getUInt());
+            string val;
+            BOOST_FOREACH(Interned<string>& interned, dict_)
+            {
+                header.getString(val);
+                interned = val;
+            }
+            filterDict_.assign(dict_.size(), Call::VarFilter());
+            if (header.getUInt() != columns_.size())
+                header.corrupt();
+            vector<size_t> sizes(columns_.size());
+            size_t total = 0;
+            for(size_t ii=0; ii<sizes.size(); ii++)
+            {
+                sizes[ii] = header.getUInt();
+                total += sizes[ii];
+            }
+            if (total != header.remaining())
+                header.corrupt();
+            const char* pos = raw_.data() + raw_.size() - total;
+            for(size_t ii=0; ii<columns_.size(); ii++)
+            {
+                columns_[ii].reset(fn_, pos, pos+sizes[ii]);
+                pos += sizes[ii];
+            }
+
+            next_ = 0;
+            lastLocusId_ = 0;
+            lastBegin_ = 0;
+            return true;
+        }
+
+        void readCall(Call& c)
+        {
+            lastLocusId_ += columns_[COL_LOCUS_ID].getInt();
+            c.locus_ = uint32_t(lastLocusId_);
+            c.ploidy_ = uint16_t(columns_[COL_PLOIDY].getUInt());
+            c.haplotype_ = uint16_t(columns_[COL_HAPLOTYPE].getUInt());
+            lastBegin_ += columns_[COL_BEGIN].getInt();
+            c.range_.chromosome_ = chromosome_;
+            c.range_.begin_ = uint32_t(lastBegin_);
+            c.range_.end_ = uint32_t(lastBegin_ + columns_[COL_LENGTH].getUInt());
+            c.varType_ = columns_[COL_VAR_TYPE].getDict(dict_);
+            columns_[COL_REFERENCE].getString(c.reference_);
+            columns_[COL_ALLELE_SEQ].getString(c.alleleSeq_);
+            c.varScoreVAF_ = int32_t(columns_[COL_VAR_SCORE_VAF].getInt());
+            c.varScoreEAF_ = int32_t(columns_[COL_VAR_SCORE_EAF].getInt());
+            readVarFilter(c.varFilter_);
+            columns_[COL_HAP_LINK].getString(c.hapLink_);
+            columns_[COL_XREF].getString(c.xRef_);
+            columns_[COL_ALLELE_FREQ].getString(c.alleleFreq_);
+            c.alternativeCalls_.resize(columns_[COL_ALTERNATIVE_CALLS].getUInt());
+            BOOST_FOREACH(Call::AlternativeCall& ac, c.alternativeCalls_)
+            {
+                columns_[COL_ALTERNATIVE_CALLS].getString(ac.alleleSeq_);
+                ac.score_ = int32_t(columns_[COL_ALTERNATIVE_CALLS].getInt());
+            }
+        }
+
+        void readVarFilter(Call::VarFilter& varFilter)
+        {
+            ColumnReader& column = columns_[COL_VAR_FILTER];
+            size_t count = column.getUInt();
+            if (0 == count)
+            {
+                varFilter.clear();
+            }
+            else if (1 == count)
+            {
+                size_t id = column.getDictId(dict_.size());
+                if (filterDict_[id].empty())
+                    filterDict_[id] = vector<string>(1, dict_[id]);
+                varFilter = filterDict_[id];
+            }
+            else
+            {
+                vector<string> filters(count);
+                BOOST_FOREACH(string& filter, filters)
+                    filter = column.getDict(dict_);
+                varFilter = filters;
+            }
+        }
+
+        string fn_;
+        InputStream in_;
+        util::DelimitedFile::Metadata meta_;
+        vector<string> columnHeaders_;
+        vector<string> annotationColumnHeaders_;
+        bool olpl_;
+        bool xRefIsAlleleSpecific_;
+
+        string compressed_;
+        string raw_;
+        vector< Interned<string> > dict_;
+        // For each dict_ entry, the interned filter list holding only
+        // that entry, filled when first read.
+        vector<Call::VarFilter> filterDict_;
+        vector<ColumnReader> columns_;
+        uint16_t chromosome_;
+        size_t chromosomeCount_;
+        size_t locusCount_;
+        size_t next_;
+        int64_t lastLocusId_;
+        int64_t lastBegin_;
+        bool eof_;
+        Call call_;
+    };
+
+    VariantBinaryFileReader::VariantBinaryFileReader(
+        const std::string& fn, const reference::CrrFile& crr)
+        : pimpl_(new Impl(fn, crr))
+    {
+    }
+
+    VariantBinaryFileReader::~VariantBinaryFileReader()
+    {
+    }
+
+    bool VariantBinaryFileReader::isVariantBinaryFile(const std::string& fn)
+    {
+        // Only a regular file is probed, since the probe consumes the
+        // start of a pipe, which could not be opened again.
+        boost::system::error_code ec;
+        if (!boost::filesystem::is_regular_file(boost::filesystem::path(fn), ec) || ec)
+            return false;
+        try
+        {
+            InputStream in(fn);
+            char magic[sizeof(MAGIC)];
+            in.read(magic, sizeof(magic));
+            return size_t(in.gcount()) == sizeof(magic) &&
+                0 == std::memcmp(magic, MAGIC, sizeof(MAGIC));
+        }
+        catch(std::exception&)
+        {
+            return false;
+        }
+    }
+
+    bool VariantBinaryFileReader::read(Locus& locus)
+    {
+        Impl& impl = *pimpl_;
+        while (impl.next_ == impl.locusCount_)
+        {
+            if (impl.eof_ || !impl.readBlock())
+            {
+                impl.eof_ = true;
+                return false;
+            }
+        }
+        impl.next_++;
+
+        if (locus.extras_.size() != impl.annotationColumnHeaders_.size())
+            throw Exception("binary var file annotations do not match locus: "+impl.fn_);
+
+        size_t callCount = impl.columns_[COL_CALL_COUNT].getUInt();
+        const Interned<string>& type = impl.columns_[COL_LOCUS_TYPE].getDict(impl.dict_);
+        if (0 == callCount)
+            impl.columns_[COL_CALL_COUNT].corrupt();
+        locus.clearCalls();
+        for(size_t ii=0; ii<callCount; ii++)
+        {
+            impl.readCall(impl.call_);
+            locus.addCall(impl.call_);
+        }
+        locus.initFromValidatedCalls();
+        locus.setType(type);
+        for(size_t ii=0; ii<locus.extras_.size(); ii++)
+            impl.columns_[FIXED_COLUMN_COUNT+ii].getString(locus.extras_[ii]);
+        return true;
+    }
+
+    const util::DelimitedFile::Metadata& VariantBinaryFileReader::getMetadata() const
+    {
+        return pimpl_->meta_;
+    }
+
+    const std::vector<std::string>& VariantBinaryFileReader::getColumnHeaders() const
+    {
+        return pimpl_->columnHeaders_;
+    }
+
+    const std::vector<std::string>& VariantBinaryFileReader::getAnnotationColumnHeaders() const
+    {
+        return pimpl_->annotationColumnHeaders_;
+    }
+
+    bool VariantBinaryFileReader::isOlpl() const
+    {
+        return pimpl_->olpl_;
+    }
+
+    bool VariantBinaryFileReader::xRefIsAlleleSpecific() const
+    {
+        return pimpl_->xRefIsAlleleSpecific_;
+    }
+
+} } // cgatools::variants
@@ -0,0 +1,102 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef CGATOOLS_VARIANTS_VARIANTBINARYFILE_HPP_
+#define CGATOOLS_VARIANTS_VARIANTBINARYFILE_HPP_ 1
+
+//! @file VariantBinaryFile.hpp
+//! File containing definitions of VariantBinaryFileWriter and
+//! VariantBinaryFileReader.
+
+#include "cgatools/core.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/DelimitedFile.hpp"
+#include "cgatools/variants/Locus.hpp"
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace cgatools { namespace variants {
+
+    class VariantFileIterator;
+
+    //! Writes the loci of a var or masterVar file, as read by
+    //! VariantFileIterator, to a compact binary file that
+    //! VariantFileIterator reads back without parsing or validating
+    //! them again. The file holds the metadata and column headers of
+    //! the original file, followed by blocks of loci of one chromosome
+    //! each. Each block is compressed with zlib and stored by column,
+    //! with varType, filters and the masterVar varType encoded through
+    //! a dictionary of the block's distinct values.
+    class VariantBinaryFileWriter : boost::noncopyable
+    {
+    public:
+        static const size_t DEFAULT_BLOCK_LOCUS_COUNT = 16384;
+
+        //! Creates fn, taking the metadata and headers from source.
+        VariantBinaryFileWriter(const std::string& fn,
+                                const reference::CrrFile& crr,
+                                const VariantFileIterator& source,
+                                size_t blockLocusCount = DEFAULT_BLOCK_LOCUS_COUNT);
+
+        //! Closes the file if close() was not called. An error from
+        //! closing is reported on stderr, and is fatal unless an
+        //! exception is already unwinding the stack.
+        ~VariantBinaryFileWriter();
+
+        void write(const Locus& locus);
+
+        //! Writes the last block and the end-of-file marker.
+        void close();
+
+    private:
+        struct Impl;
+        boost::shared_ptr<Impl> pimpl_;
+    };
+
+    //! Reads a file written by VariantBinaryFileWriter.
+    class VariantBinaryFileReader : boost::noncopyable
+    {
+    public:
+        //! Opens fn, which must have been written with the same
+        //! reference as crr.
+        VariantBinaryFileReader(const std::string& fn, const reference::CrrFile& crr);
+
+        ~VariantBinaryFileReader();
+
+        //! Returns true if fn is a regular file that starts with the
+        //! binary var file header. Pipes are never binary var files.
+        static bool isVariantBinaryFile(const std::string& fn);
+
+        //! Reads the next locus into locus, whose annotations must
+        //! have been set to match getAnnotationColumnHeaders(). Returns
+        //! false at the end of the file.
+        bool read(Locus& locus);
+
+        const util::DelimitedFile::Metadata& getMetadata() const;
+        const std::vector<std::string>& getColumnHeaders() const;
+        const std::vector<std::string>& getAnnotationColumnHeaders() const;
+        bool isOlpl() const;
+        bool xRefIsAlleleSpecific() const;
+
+    private:
+        struct Impl;
+        boost::shared_ptr<Impl> pimpl_;
+    };
+
+} } // cgatools::variants
+
+#endif // CGATOOLS_VARIANTS_VARIANTBINARYFILE_HPP_
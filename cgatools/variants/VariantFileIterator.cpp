@@ -13,10 +13,14 @@
 // permissions and limitations under the License.
 
 #include "cgatools/core.hpp"
+#include "cgatools/util/BlockCompressedFile.hpp"
+#include "cgatools/util/Interned.hpp"
+#include "cgatools/util/RangeSet.hpp"
 #include "cgatools/util/Streams.hpp"
 #include "cgatools/util/StringSet.hpp"
 #include "cgatools/reference/ChromosomeIdField.hpp"
 #include "cgatools/variants/VariantFileIterator.hpp"
+#include "cgatools/variants/VariantBinaryFile.hpp"
 
 #include <sstream>
 #include <boost/foreach.hpp>
@@ -33,6 +37,21 @@ namespace cgatools { namespace variants {
     using namespace util;
     using namespace cgatools::cgdata;
 
+    namespace
+    {
+        // The values assigned while filling loci, interned once so that
+        // assigning or comparing them does not lock the pool.
+        const Interned<string> VAR_TYPE_NO_CALL("no-call");
+        const Interned<string> VAR_TYPE_REF("ref");
+        const Interned<string> VAR_TYPE_COMPLEX("complex");
+        const Interned<string> VAR_TYPE_DEL("del");
+        const Interned<string> VAR_TYPE_INS("ins");
+        const Interned<string> VAR_TYPE_SNP("snp");
+        const Interned<string> VAR_TYPE_SUB("sub");
+        const Interned<string> ZYGOSITY_HOM("hom");
+        const Interned<string> ZYGOSITY_HAP("hap");
+    }
+
     class XRefField : public DelimitedFieldParser
     {
     public:
@@ -92,7 +111,7 @@ namespace cgatools { namespace variants {
         }
 
     private:
-        std::string varType_;
+        Interned<std::string> varType_;
     };
 
     class VarScoreVafCallFilter : public VariantFileIterator::CallFilter
@@ -205,8 +224,22 @@ namespace cgatools { namespace variants {
         // Parse filters.
         parseFilters(fnWithFilters);
 
+        if (VariantBinaryFileReader::isVariantBinaryFile(name_))
+        {
+            openBinary();
+            return;
+        }
+
         istream_ = InputStream::openCompressedInputStreamByExtension(name_);
-        df_.reset(new DelimitedFile(*istream_, name_));
+        index_ = BlockCompressedIndex::open(name_);
+        if (0 != index_.get())
+        {
+            blockIn_.reset(new std::istream(istream_->rdbuf()));
+            blockIn_->exceptions(istream_->exceptions());
+            df_.reset(new DelimitedFile(*blockIn_, name_));
+        }
+        else
+            df_.reset(new DelimitedFile(*istream_, name_));
         detectFileType();
         if (oneLinePerLocus_)
         {
@@ -233,6 +266,37 @@ namespace cgatools { namespace variants {
         readLocus();
     }
 
+    void VariantFileIterator::openBinary()
+    {
+        bin_.reset(new VariantBinaryFileReader(name_, *crr_));
+        oneLinePerLocus_ = bin_->isOlpl();
+        annotationColumnHeaders_ = bin_->getAnnotationColumnHeaders();
+        locus_.setLocusAnnotations(
+            LocusAnnotations(annotationColumnHeaders_, bin_->xRefIsAlleleSpecific()));
+        allele1ReadCountOffset_ = getAnnotationIndex("allele1ReadCount");
+        allele2ReadCountOffset_ = getAnnotationIndex("allele2ReadCount");
+        referenceAlleleReadCountOffset_ = getAnnotationIndex("referenceAlleleReadCount");
+        totalReadCountOffset_ = getAnnotationIndex("totalReadCount");
+        eof_ = false;
+
+        readLocus();
+        emptyFile_ = eof_;
+    }
+
+    const util::DelimitedFile::Metadata& VariantFileIterator::getMetadata() const
+    {
+        if (0 != bin_.get())
+            return bin_->getMetadata();
+        return df_->getMetadata();
+    }
+
+    const std::vector<std::string>& VariantFileIterator::getColumnHeaders() const
+    {
+        if (0 != bin_.get())
+            return bin_->getColumnHeaders();
+        return df_->getColumnHeaders();
+    }
+
     void VariantFileIterator::parseFilters(const std::string& fnWithFilters)
     {
         try
@@ -294,10 +358,72 @@ namespace cgatools { namespace variants {
 
     void VariantFileIterator::close()
     {
+        bin_.reset(static_cast<VariantBinaryFileReader*>(0));
         df_.reset(static_cast<DelimitedFile*>(0));
+        index_.reset(static_cast<BlockCompressedIndex*>(0));
+        blockIn_.reset(static_cast<std::istream*>(0));
         istream_.reset(static_cast<std::istream*>(0));
     }
 
+    void VariantFileIterator::seek(const reference::Location& loc)
+    {
+        if (eof_ || locus_.getRange().endLocation() >= loc)
+            return;
+        jumpForward(loc);
+        while (!eof_ && locus_.getRange().endLocation() < loc)
+            readLocus();
+    }
+
+    void VariantFileIterator::seek(const util::FastRangeSet& regions)
+    {
+        while (!eof_ && !regions.intersects(locus_.getRange()))
+        {
+            reference::Location next;
+            if (!regions.findNext(locus_.getRange().endLocation(), next))
+            {
+                eof_ = true;
+                return;
+            }
+            if (locus_.getRange().endLocation() < next)
+                seek(next);
+            else
+                readLocus();
+        }
+    }
+
+    // Moves the stream to the block holding the first locus that ends
+    // at or after loc, if that block is past the current locus, and
+    // reads the first locus of the block. Returns true if the stream
+    // was moved.
+    bool VariantFileIterator::jumpForward(const reference::Location& loc)
+    {
+        if (0 == index_.get())
+            return false;
+
+        const std::vector<BlockCompressedIndex::Block>& blocks = index_->getBlocks();
+        size_t block = index_->findBlock(getIndexKey(loc));
+        if (0 == block || block == blocks.size() ||
+            getIndexKey(locus_.getRange().endLocation()) >= blocks[block-1].lastKey_)
+            return false;
+
+        istream_ = index_->openBlock(name_, block);
+        blockIn_->rdbuf(istream_->rdbuf());
+        blockIn_->clear();
+
+        // The one-line-per-locus reader fills the gap between the
+        // current locus and the next line with a no-call locus, so the
+        // current locus becomes an empty locus at the end of the last
+        // locus of the preceding block.
+        int64_t lastKey = blocks[block-1].lastKey_;
+        if (oneLinePerLocus_)
+            createNoCallLocus(reference::Range(uint16_t(lastKey >> 32),
+                                               uint32_t(lastKey & 0xffffffff),
+                                               uint32_t(lastKey & 0xffffffff)));
+        readPending();
+        readLocus();
+        return true;
+    }
+
     void VariantFileIterator::readPending()
     {
         hasPending_ = df_->next();
@@ -307,13 +433,28 @@ namespace cgatools { namespace variants {
 
     void VariantFileIterator::readLocus()
     {
-        if (oneLinePerLocus_)
+        if (0 != bin_.get())
+            readBinaryLocus();
+        else if (oneLinePerLocus_)
             readOlplLocus();
         else
             readMultilineLocus();
         applyFilters();
     }
 
+    void VariantFileIterator::readBinaryLocus()
+    {
+        try
+        {
+            if (!bin_->read(locus_))
+                eof_ = true;
+        }
+        catch(std::exception& ee)
+        {
+            error(ee.what());
+        }
+    }
+
     void VariantFileIterator::applyFilters()
     {
         for(bool noCallApplied=true; noCallApplied; )
@@ -351,7 +492,7 @@ namespace cgatools { namespace variants {
 
     void VariantFileIterator::applyNoCall(Call& call)
     {
-        call.varType_ = "no-call";
+        call.varType_ = VAR_TYPE_NO_CALL;
         call.alleleSeq_ = "?";
         call.varScoreVAF_ = Call::EMPTY_SCORE;
         call.varScoreEAF_ = Call::EMPTY_SCORE;
@@ -612,10 +753,11 @@ namespace cgatools { namespace variants {
             c.varFilter_.clear();
             c.alternativeCalls_.clear();
             c.hapLink_.clear();
-            c.varType_ = d.varType_ == "complex" ? "no-call" : d.varType_;
+            c.varType_ = d.varType_ == VAR_TYPE_COMPLEX ? VAR_TYPE_NO_CALL : d.varType_;
             locus_.addCall(c);
         }
-        else if (d.varType_ == "ref" && (d.zygosity_ == "hom" || d.zygosity_ == "hap"))
+        else if (d.varType_ == VAR_TYPE_REF &&
+                 (d.zygosity_ == ZYGOSITY_HOM || d.zygosity_ == ZYGOSITY_HAP))
         {
             c.haplotype_ = Call::ALL_HAPLOTYPES;
             c.alleleSeq_ = "=";
@@ -643,19 +785,19 @@ namespace cgatools { namespace variants {
 
                 if (c.alleleSeq_.find('N') != std::string::npos ||
                     c.alleleSeq_.find('?') != std::string::npos )
-                    c.varType_ = "no-call";
+                    c.varType_ = VAR_TYPE_NO_CALL;
                 else if (c.alleleSeq_ == c.reference_)
-                    c.varType_ = "ref";
-                else if (d.varType_ != "complex")
+                    c.varType_ = VAR_TYPE_REF;
+                else if (d.varType_ != VAR_TYPE_COMPLEX)
                     c.varType_ = d.varType_;
                 else if (c.alleleSeq_.empty())
-                    c.varType_ = "del";
+                    c.varType_ = VAR_TYPE_DEL;
                 else if (c.reference_.empty())
-                    c.varType_ = "ins";
+                    c.varType_ = VAR_TYPE_INS;
                 else if (1 == c.range_.length() && 1 == c.alleleSeq_.size())
-                    c.varType_ = "snp";
+                    c.varType_ = VAR_TYPE_SNP;
                 else
-                    c.varType_ = "sub";
+                    c.varType_ = VAR_TYPE_SUB;
                 locus_.addCall(c);
             }
         }
@@ -690,7 +832,7 @@ namespace cgatools { namespace variants {
         c.ploidy_ = 1;
         c.haplotype_ = Call::ALL_HAPLOTYPES;
         c.range_ = r;
-        c.varType_ = "no-call";
+        c.varType_ = VAR_TYPE_NO_CALL;
         c.reference_ = "=";
         c.alleleSeq_ = "?";
         c.varScoreVAF_ = Call::EMPTY_SCORE;
@@ -719,8 +861,8 @@ namespace cgatools { namespace variants {
         df.addField(reference::ChromosomeIdField("chromosome", &d.range_.chromosome_, *crr_));
         df.addField(ValueField<uint32_t>("begin", &d.range_.begin_));
         df.addField(ValueField<uint32_t>("end", &d.range_.end_));
-        df.addField(StringField("zygosity", &d.zygosity_));
-        df.addField(StringField("varType", &d.varType_));
+        df.addField(InternedStringField("zygosity", &d.zygosity_));
+        df.addField(InternedStringField("varType", &d.varType_));
         df.addField(StringField("reference", &d.reference_));
         df.addField(StringField("allele1Seq", &d.alleleSeq_[0]));
         df.addField(StringField("allele2Seq", &d.alleleSeq_[1]));
@@ -825,7 +967,7 @@ namespace cgatools { namespace variants {
 
     void VariantFileIterator::fillOlplFileMetadata(util::DelimitedFile::Metadata& meta) const
     {
-        const util::DelimitedFile::Metadata& vfMeta = df_->getMetadata();
+        const util::DelimitedFile::Metadata& vfMeta = getMetadata();
 
         // Transfer all keys over from the original file
         meta = vfMeta;
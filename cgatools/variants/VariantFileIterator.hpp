@@ -21,8 +21,20 @@
 #include "cgatools/util/DelimitedFile.hpp"
 #include "cgatools/variants/Locus.hpp"
 
+namespace cgatools { namespace util {
+    class BlockCompressedIndex;
+    class FastRangeSet;
+} }
+
 namespace cgatools { namespace variants {
 
+    class VariantBinaryFileReader;
+
+    //! Iterates over the loci of a var file, a masterVar file, or a
+    //! binary var file written by var2bin (see VariantBinaryFileWriter).
+    //! A var or masterVar file indexed by indexvar (see
+    //! util::BlockCompressedIndex) is read from the block holding the
+    //! target of a seek, instead of parsing every locus in between.
     class VariantFileIterator : boost::noncopyable
     {
         typedef reference::CrrFile CrrFile;
@@ -53,6 +65,30 @@ namespace cgatools { namespace variants {
             return *this;
         }
 
+        //! Moves forward to the first locus that ends at or after loc.
+        //! Never moves backwards.
+        void seek(const reference::Location& loc);
+
+        //! Moves forward to the first locus that intersects a range of
+        //! regions, which must be merged (see
+        //! util::FastRangeSet::merge()), or to the end of the file if
+        //! there is no such locus.
+        void seek(const util::FastRangeSet& regions);
+
+        //! Returns true if the file has an index, so that seek() does
+        //! not parse the loci it skips.
+        bool isIndexed() const
+        {
+            return 0 != index_.get();
+        }
+
+        //! Returns the key of loc in the index of a var or masterVar
+        //! file. Loci are indexed by the key of their end.
+        static int64_t getIndexKey(const reference::Location& loc)
+        {
+            return (int64_t(loc.chromosome_) << 32) + loc.offset_;
+        }
+
         const std::string& getFileName()
         {
             return name_;
@@ -67,15 +103,9 @@ namespace cgatools { namespace variants {
             referenceCoverValidation_ = validate;
         }
 
-        const util::DelimitedFile::Metadata& getMetadata() const
-        {
-            return df_->getMetadata();
-        }
+        const util::DelimitedFile::Metadata& getMetadata() const;
 
-        const std::vector<std::string>& getColumnHeaders() const
-        {
-            return df_->getColumnHeaders();
-        }
+        const std::vector<std::string>& getColumnHeaders() const;
 
         const std::vector<std::string>& getAnnotationColumnHeaders() const
         {
@@ -141,13 +171,13 @@ namespace cgatools { namespace variants {
             uint32_t locus_;
             uint16_t ploidy_;
             reference::Range range_;
-            std::string zygosity_;
-            std::string varType_;
+            util::Interned<std::string> zygosity_;
+            util::Interned<std::string> varType_;
             std::string reference_;
             boost::array<std::string, 2> alleleSeq_;
             boost::array<int32_t, 2> alleleVarScoreVAF_;
             boost::array<int32_t, 2> alleleVarScoreEAF_;
-            boost::array<std::vector<std::string>, 2> alleleVarFilter_;
+            boost::array<Call::VarFilter, 2> alleleVarFilter_;
             boost::array<std::string, 2> hapLink_;
             boost::array<std::string, 2> xRef_;
             boost::array<std::string, 2> alleleFreq_;
@@ -162,6 +192,9 @@ namespace cgatools { namespace variants {
         parseFilter(const std::string& andPart) const;
         void readPending();
         void readLocus();
+        bool jumpForward(const reference::Location& loc);
+        void readBinaryLocus();
+        void openBinary();
         void readMultilineLocus();
         void readOlplLocus();
         void fillOlplLocus();
@@ -172,7 +205,12 @@ namespace cgatools { namespace variants {
 
         const CrrFile* crr_;
         boost::shared_ptr<std::istream> istream_;
+        //! For an indexed file, the stream df_ reads through, so that a
+        //! jump to another block only replaces its stream buffer.
+        boost::shared_ptr<std::istream> blockIn_;
+        boost::shared_ptr<util::BlockCompressedIndex> index_;
         boost::shared_ptr<util::DelimitedFile> df_;
+        boost::shared_ptr<VariantBinaryFileReader> bin_;
         std::string name_;
         std::string filterStr_;
         Locus locus_;
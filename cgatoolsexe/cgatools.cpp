@@ -26,6 +26,7 @@
 #include "cgatools/command/MergedMap2Sam.hpp"
 #include "cgatools/command/Evidence2Sam.hpp"
 #include "cgatools/command/Evidence2Cache.hpp"
+#include "cgatools/command/IndexEvidence.hpp"
 #include "cgatools/command/Sam2Reads.hpp"
 #include "cgatools/command/Join.hpp"
 #include "cgatools/command/JunctionDiff.hpp"
@@ -33,6 +34,8 @@
 #include "cgatools/command/JunctionType.hpp"
 #include "cgatools/command/VarFileCombine.hpp"
 #include "cgatools/command/VarFilter.hpp"
+#include "cgatools/command/Var2Bin.hpp"
+#include "cgatools/command/IndexVar.hpp"
 #include "cgatools/command/MkVcf.hpp"
 #include "cgatools/command/Junction2Vcf.hpp"
 
@@ -31,6 +31,7 @@ CGA_COMMAND_MAP("map2sam",        cgatools::command::Map2Sam)
 CGA_COMMAND_MAP("mergedmap2sam",  cgatools::command::MergedMap2Sam)
 #endif // CGA_TOOLS_IS_PIPELINE
 CGA_COMMAND_MAP("evidence2sam",   cgatools::command::Evidence2Sam)
+CGA_COMMAND_MAP("indexevidence",  cgatools::command::IndexEvidence)
 #if CGA_TOOLS_IS_PIPELINE
 CGA_COMMAND_MAP("evidence2cache", cgatools::command::Evidence2Cache)
 CGA_COMMAND_MAP("sam2reads",      cgatools::command::Sam2Reads)
@@ -43,6 +44,8 @@ CGA_COMMAND_MAP("junctioncmp",   cgatools::command::JunctionCmp)
 CGA_COMMAND_MAP("junctions2events",   cgatools::command::JunctionType)
 CGA_COMMAND_MAP("generatemastervar",     cgatools::command::VarFileCombine)
 CGA_COMMAND_MAP("varfilter",      cgatools::command::VarFilter)
+CGA_COMMAND_MAP("var2bin",        cgatools::command::Var2Bin)
+CGA_COMMAND_MAP("indexvar",       cgatools::command::IndexVar)
 #if CGA_TOOLS_IS_PIPELINE
 CGA_COMMAND_MAP("junction2vcf",   cgatools::command::Junction2Vcf)
 #endif // CGA_TOOLS_IS_PIPELINE
@@ -0,0 +1,107 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/command/Sam2Reads.hpp"
+#include "cgatools/util/Streams.hpp"
+#include "cgatools/util/ThreadPool.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace cgatools;
+
+namespace pt = boost::posix_time;
+
+namespace {
+    // Writes a SAM file of about megabytes MB, of mate pairs of 4
+    // lane batches, as written by map2sam.
+    int64_t writeSam(const string& fn, int64_t megabytes)
+    {
+        util::OutputStream out(fn);
+        out << "@HD\tVN:1.3\n"
+            << "@SQ\tSN:chr1\tLN:250000000\n";
+        for(int lane=1; lane<=4; lane++)
+            out << "@RG\tID:GS1-FS1-L0" << lane << "\tLB:LIB1\tSM:SAMPLE1\tDS:460800\n";
+
+        const string seq = "AGATCATACGTACGTAGCTAGCTTGACCGTAGCTA";
+        const string qual = "6:;78<:89;;:<7:977:89:;:89<<;9:7<9:";
+        int64_t size = 0;
+        srand(12345);
+        for(int64_t offset=0; size < (megabytes << 20); offset++)
+        {
+            int lane = 1 + (offset >> 16) % 4;
+            int pos = 1 + rand() % 240000000;
+            for(int side=0; side<2; side++)
+            {
+                string line =
+                    "GS1-FS1-L0" + boost::lexical_cast<string>(lane) + "-" +
+                    boost::lexical_cast<string>(1 + (offset >> 18)) + ":" +
+                    boost::lexical_cast<string>(offset) + "\t" +
+                    (0 == side ? "99" : "147") + "\tchr1\t" +
+                    boost::lexical_cast<string>(pos + 300*side) +
+                    "\t50\t10M5N25M\t=\t" + boost::lexical_cast<string>(pos + 300*(1-side)) +
+                    "\t" + (0 == side ? "335" : "-335") + "\t" + seq + "\t" + qual +
+                    "\tRG:Z:GS1-FS1-L0" + boost::lexical_cast<string>(lane) +
+                    "\tGC:Z:3S2G30S\tGS:Z:ATCC\tGQ:Z:8989\n";
+                out << line;
+                size += line.size();
+            }
+        }
+        return size;
+    }
+}
+
+// Reports the MB per second converted by sam2reads with 1 thread, and
+// with as many threads as there are hardware threads, for a generated
+// SAM file of 512 MB (default) or of the size given as the first
+// argument after the data and output directories.
+int BenchSam2Reads(int argc, char* argv[])
+{
+    int64_t megabytes = argc > 3 ? atoi(argv[3]) : 512;
+    CGA_ASSERT(megabytes > 0);
+
+    int64_t size = writeSam("bench.sam", megabytes);
+
+    vector<size_t> threadCounts;
+    threadCounts.push_back(1);
+    if (util::ThreadPool::hardwareThreadCount() > 1)
+        threadCounts.push_back(util::ThreadPool::hardwareThreadCount());
+
+    for(size_t ii=0; ii<threadCounts.size(); ii++)
+    {
+        string outDir = "bench-reads-" + boost::lexical_cast<string>(threadCounts[ii]);
+        boost::filesystem::remove_all(outDir);
+        string threads = "--threads=" + boost::lexical_cast<string>(threadCounts[ii]);
+        string output = "--output=" + outDir;
+        const char* args[] = {
+            "cgatools", "sam2reads", "--input-sam=bench.sam", output.c_str(), threads.c_str() };
+
+        pt::ptime start = pt::microsec_clock::universal_time();
+        command::Sam2Reads cmd("sam2reads");
+        CGA_ASSERT_EQ(0, cmd(sizeof(args)/sizeof(args[0]), const_cast<char**>(args)));
+        double seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+        cout << "sam2reads " << threads << "\t" << (size >> 20) << " MB\t" << seconds << " s\t"
+             << (seconds > 0 ? (size >> 20) / seconds : 0.0) << " MB/s" << endl;
+    }
+
+    return 0;
+}
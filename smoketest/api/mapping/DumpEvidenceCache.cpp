@@ -0,0 +1,59 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/EvidenceCache.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/Exception.hpp"
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using cgatools::reference::CrrFile;
+using cgatools::mapping::EvidenceCacheBatch;
+using cgatools::mapping::EvidenceCacheDnbRecord;
+
+// Prints the records of an evidence cache file, as loaded by
+// EvidenceCacheBatch, in the columns of the text cache files.
+// Arguments: the reference crr file and the cache file.
+int DumpEvidenceCache(int argc, char* argv[])
+{
+    CGA_ASSERT_EQ(3, argc);
+    CrrFile crr(argv[1]);
+    EvidenceCacheBatch batch;
+    batch.addFile(argv[2], crr);
+
+    EvidenceCacheDnbRecord record;
+    cout << setprecision(6);
+    for(size_t ii=0; ii<batch.size(); ii++)
+    {
+        batch.getRecord(ii, record);
+        cout << record.dnbOffsetInLaneFile_
+             << '\t' << record.intervalId_
+             << '\t' << crr.listChromosomes()[record.chromosome_].getName()
+             << '\t' << "LR"[record.side_]
+             << '\t' << "+-"[size_t(record.strand_)]
+             << '\t' << record.offsetInAllele_
+             << '\t' << record.alleleAlignment_
+             << '\t' << record.offsetInReference_[0]
+             << '\t' << record.referenceAlignment_[0]
+             << '\t' << record.offsetInReference_[1]
+             << '\t' << record.referenceAlignment_[1]
+             << '\t' << record.mappingQuality_
+             << '\t' << record.alleleConcordance_
+             << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/EvidenceCache.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/reference/CrrFileWriter.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace cgatools::util;
+using namespace cgatools::reference;
+using namespace cgatools::mapping;
+
+namespace {
+    // The expected records of one source file: interval ids by DNB offset.
+    typedef map<uint32_t, vector<int32_t> > Expected;
+
+    // Records are tagged with the index of their source file in the
+    // allele index, since the reader may take the files in any order.
+    cgatools::cgdata::EvidenceReader::DnbRecord makeRecord(
+        uint32_t dnbOffset, int32_t intervalId, uint16_t chr, uint8_t source, uint16_t fileNum)
+    {
+        cgatools::cgdata::EvidenceReader::DnbRecord dnb;
+        dnb.slide_ = "GS1";
+        dnb.lane_ = "L01";
+        dnb.fileNumInLane_ = fileNum;
+        dnb.dnbOffsetInLaneFile_ = dnbOffset;
+        dnb.intervalId_ = intervalId;
+        dnb.alleleIndex_ = source;
+        dnb.chromosome_ = chr;
+        dnb.side_ = intervalId % 2;
+        dnb.strand_ = 0 == intervalId % 3;
+        dnb.offsetInAllele_ = intervalId + 1;
+        dnb.alleleAlignment_ = boost::lexical_cast<string>(intervalId) + "M";
+        dnb.offsetInReference_[0] = intervalId + 2;
+        dnb.referenceAlignment_[0] = "10M2N" + boost::lexical_cast<string>(intervalId) + "M";
+        dnb.offsetInReference_[1] = intervalId + 3;
+        dnb.referenceAlignment_[1] = boost::lexical_cast<string>(intervalId) + "M1B5M";
+        dnb.mappingQuality_ = '!' + intervalId % 40;
+        return dnb;
+    }
+
+    void checkRecord(const EvidenceCacheDnbRecord& r, uint32_t dnbOffset, uint16_t fileNum)
+    {
+        cgatools::cgdata::EvidenceReader::DnbRecord e =
+            makeRecord(dnbOffset, r.intervalId_, r.chromosome_, r.alleleIndex_, fileNum);
+        CGA_ASSERT_EQ(e.slide_, r.slide_);
+        CGA_ASSERT_EQ(e.lane_, r.lane_);
+        CGA_ASSERT_EQ(e.fileNumInLane_, r.fileNumInLane_);
+        CGA_ASSERT_EQ(e.dnbOffsetInLaneFile_, r.dnbOffsetInLaneFile_);
+        CGA_ASSERT_EQ(int(e.side_), int(r.side_));
+        CGA_ASSERT_EQ(e.strand_, r.strand_);
+        CGA_ASSERT_EQ(e.offsetInAllele_, r.offsetInAllele_);
+        CGA_ASSERT_EQ(e.alleleAlignment_, r.alleleAlignment_);
+        CGA_ASSERT_EQ(e.offsetInReference_[0], r.offsetInReference_[0]);
+        CGA_ASSERT_EQ(e.referenceAlignment_[0], r.referenceAlignment_[0]);
+        CGA_ASSERT_EQ(e.offsetInReference_[1], r.offsetInReference_[1]);
+        CGA_ASSERT_EQ(e.referenceAlignment_[1], r.referenceAlignment_[1]);
+        CGA_ASSERT_EQ(int(e.mappingQuality_), int(r.mappingQuality_));
+        CGA_ASSERT_EQ(0.5 + r.intervalId_, r.alleleConcordance_);
+    }
+
+    string readFile(const string& fn)
+    {
+        InputStream in(fn);
+        return string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // Copies the binary cache file fn with the bytes at offset replaced
+    // by value, and checks that loading the copy fails.
+    void checkCorruptFile(const string& fn, const CrrFile& crr, size_t offset, const string& value)
+    {
+        string data = readFile(fn);
+        CGA_ASSERT(offset + value.size() <= data.size());
+        data.replace(offset, value.size(), value);
+        {
+            OutputStream out("corrupt.bin");
+            out << data;
+        }
+        EvidenceCacheBatch batch;
+        bool failed = false;
+        try
+        {
+            batch.addFile("corrupt.bin", crr);
+        }
+        catch (std::exception&)
+        {
+            failed = true;
+        }
+        CGA_ASSERT(failed);
+    }
+
+    void writeTextFile(const string& fn, const CrrFile& crr, uint16_t fileNum,
+                       const vector<cgatools::cgdata::EvidenceReader::DnbRecord>& dnbs)
+    {
+        OutputStream out(fn);
+        out << "#TYPE\tEVIDENCE_CACHE\n"
+            << "#SLIDE\tGS1\n"
+            << "#LANE\tL01\n"
+            << "#BATCH_FILE_NUMBER\t" << fileNum << "\n\n"
+            << ">DnbOffsetInLaneFile\tIntervalId\tAlleleIndex\tChromosome\tSide\tStrand\t"
+            << "OffsetInAllele\tAlleleAlignment\tOffsetInReference\tReferenceAlignment\t"
+            << "MateOffsetInReference\tMateReferenceAlignment\tMappingQuality\tAlleleConcordance\n";
+        for(size_t ii=0; ii<dnbs.size(); ii++)
+        {
+            const cgatools::cgdata::EvidenceReader::DnbRecord& dnb = dnbs[ii];
+            out << dnb.dnbOffsetInLaneFile_
+                << '\t' << dnb.intervalId_
+                << '\t' << int(dnb.alleleIndex_)
+                << '\t' << crr.listChromosomes()[dnb.chromosome_].getName()
+                << '\t' << "LR"[dnb.side_]
+                << '\t' << "+-"[size_t(dnb.strand_)]
+                << '\t' << dnb.offsetInAllele_
+                << '\t' << dnb.alleleAlignment_
+                << '\t' << dnb.offsetInReference_[0]
+                << '\t' << dnb.referenceAlignment_[0]
+                << '\t' << dnb.offsetInReference_[1]
+                << '\t' << dnb.referenceAlignment_[1]
+                << '\t' << dnb.mappingQuality_
+                << '\t' << 0.5 + dnb.intervalId_
+                << '\n';
+        }
+    }
+}
+
+int TestEvidenceCache(int argc, char* argv[])
+{
+    {
+        OutputStream out("TestEvidenceCache.crr");
+        CrrFileWriter writer(&out);
+        writer.newChromosome("chr1", false);
+        writer.addSequence("CATGACCCGCAAATCTGAAACTATCTGGCCCTTGGCAGGGGAAGTTTGCC");
+        writer.newChromosome("chr2", false);
+        writer.addSequence("AACCCCTGCTCTAGAGAACCCTGAAACCAACCCTTGGCACCTGGGGTACT");
+    }
+    CrrFile crr("TestEvidenceCache.crr");
+
+    // Three files for batch 3: binary for chr1 and chr2, as written
+    // by evidence2cache, and text as written by older versions. Batch
+    // 4 has one record. The offsets are unsorted and repeat.
+    const uint16_t FILE_NUM = 3;
+    vector<Expected> expected(3);
+    vector<cgatools::cgdata::EvidenceReader::DnbRecord> textDnbs;
+    CacheOutBatches chr1("cache/chr1");
+    CacheOutBatches chr2("cache/chr2");
+    CacheOutBatches spilled("spilled/chr1", 2000);
+    for(int32_t ii=0; ii<1000; ii++)
+    {
+        uint32_t dnbOffset = (ii * 7919) % 300;
+        uint8_t source = ii % 3;
+        uint16_t chr = 1 == source ? 1 : 0;
+        cgatools::cgdata::EvidenceReader::DnbRecord dnb =
+            makeRecord(dnbOffset, ii, chr, source, FILE_NUM);
+        if (0 == source)
+        {
+            chr1.add(dnb, 0.5 + ii);
+            spilled.add(dnb, 0.5 + ii);
+        }
+        else if (1 == source)
+            chr2.add(dnb, 0.5 + ii);
+        else
+            textDnbs.push_back(dnb);
+        expected[source][dnbOffset].push_back(ii);
+    }
+    chr1.add(makeRecord(5, 2000, 0, 0, FILE_NUM+1), 2000.5);
+    spilled.add(makeRecord(5, 2000, 0, 0, FILE_NUM+1), 2000.5);
+    chr1.write();
+    chr2.write();
+    CGA_ASSERT_EQ(0u, chr1.getRunCount());
+
+    // With a small memory budget, the records are written in runs that
+    // are merged into the same files.
+    spilled.write();
+    CGA_ASSERT(spilled.getRunCount() > 10);
+    CGA_ASSERT_EQ(readFile("cache/chr1/GS1-L01_3.bin"), readFile("spilled/chr1/GS1-L01_3.bin"));
+    CGA_ASSERT_EQ(readFile("cache/chr1/GS1-L01_4.bin"), readFile("spilled/chr1/GS1-L01_4.bin"));
+    size_t fileCount = 0;
+    for (boost::filesystem::directory_iterator it("spilled/chr1");
+         it != boost::filesystem::directory_iterator(); ++it)
+        fileCount++;
+    CGA_ASSERT_EQ(2u, fileCount);
+    boost::filesystem::create_directories("cache/text");
+    writeTextFile("cache/text/GS1-L01_3.tsv", crr, FILE_NUM, textDnbs);
+
+    CGA_ASSERT(EvidenceCacheBatch::isBinaryFile("cache/chr1/GS1-L01_3.bin"));
+    CGA_ASSERT(!EvidenceCacheBatch::isBinaryFile("cache/text/GS1-L01_3.tsv"));
+
+    EvidenceCacheReader reader("cache");
+    EvidenceCacheBatch batch;
+    reader.readBatchRecords("GS1", "L01", FILE_NUM, batch, crr);
+    CGA_ASSERT_EQ(1000u, batch.size());
+
+    EvidenceCacheDnbRecord record;
+    for(uint32_t dnbOffset=0; dnbOffset<310; dnbOffset++)
+    {
+        vector< vector<int32_t> > found(3);
+        std::pair<size_t,size_t> range = batch.equalRange(dnbOffset);
+        for(size_t ii=range.first; ii<range.second; ii++)
+        {
+            batch.getRecord(ii, record);
+            checkRecord(record, dnbOffset, FILE_NUM);
+            found[record.alleleIndex_].push_back(record.intervalId_);
+        }
+        for(size_t source=0; source<3; source++)
+            CGA_ASSERT(expected[source][dnbOffset] == found[source]);
+    }
+
+    reader.readBatchRecords("GS1", "L01", FILE_NUM+1, batch, crr);
+    CGA_ASSERT_EQ(1u, batch.size());
+    CGA_ASSERT(std::make_pair(size_t(0), size_t(1)) == batch.equalRange(5));
+    batch.getRecord(0, record);
+    checkRecord(record, 5, FILE_NUM+1);
+
+    reader.readBatchRecords("GS1", "L01", FILE_NUM+2, batch, crr);
+    CGA_ASSERT_EQ(0u, batch.size());
+    CGA_ASSERT(std::make_pair(size_t(0), size_t(0)) == batch.equalRange(5));
+
+    // Corrupt counts in the header, which starts with four 4-byte
+    // fields followed by the record count and the strings size, and a
+    // corrupt chromosome id in the only record of batch 4.
+    const string corruptFile = "cache/chr1/GS1-L01_4.bin";
+    const string allOnes(8, char(0xff));
+    const size_t HEADER_SIZE = 40;
+    checkCorruptFile(corruptFile, crr, 16, allOnes);
+    checkCorruptFile(corruptFile, crr, 24, allOnes);
+    checkCorruptFile(corruptFile, crr,
+                     HEADER_SIZE + offsetof(EvidenceCachePackedRecord, chromosome_),
+                     string("\x02\x00", 2));
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/LaneBatchCache.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace cgatools::util;
+using namespace cgatools::mapping;
+
+namespace {
+    const size_t BATCH_COUNT = 5;
+
+    string makeLine(size_t batchNo, size_t ii)
+    {
+        return boost::lexical_cast<string>(ii) + "\t" + boost::lexical_cast<string>(batchNo) +
+            "\tACGTACGTTGCAACGTAGGCTAGCTAACGTACG\n";
+    }
+
+    // Writes the batches in turn, with at most two files open, so
+    // that each file is closed and appended to several times.
+    void writeBatches(const string& dir, size_t lineCount)
+    {
+        OutLaneBatchStreams out(dir, "TEST", ">offset\tbatch\tseq", 2);
+        for(size_t ii=0; ii<lineCount; ii++)
+        {
+            for(size_t batchNo=0; batchNo<BATCH_COUNT; batchNo++)
+                out.getBatchStream("GS1-FS1", "L01", batchNo) << makeLine(batchNo, ii);
+        }
+        out.close();
+    }
+
+    void checkBatches(const string& dir, size_t lineCount)
+    {
+        for(size_t batchNo=0; batchNo<BATCH_COUNT; batchNo++)
+        {
+            string fn = dir + "/GS1-FS1-L01_" + boost::lexical_cast<string>(batchNo) + ".tsv.gz";
+            CompressedInputStream in(fn);
+            string line;
+            size_t typeCount = 0;
+            while (getline(in, line) && ">offset\tbatch\tseq" != line)
+            {
+                if ("#TYPE\tTEST" == line)
+                    typeCount++;
+            }
+            CGA_ASSERT_EQ(1u, typeCount);
+            for(size_t ii=0; ii<lineCount; ii++)
+            {
+                CGA_ASSERT(getline(in, line));
+                CGA_ASSERT_EQ(makeLine(batchNo, ii), line + "\n");
+            }
+            CGA_ASSERT(!getline(in, line));
+        }
+    }
+}
+
+int TestOutLaneBatchStreams(int argc, char* argv[])
+{
+    // Enough lines to fill the staging buffer of each batch many times.
+    const size_t lineCount = 20 * OutLaneBatchStreams::STAGING_SIZE / makeLine(0, 0).size();
+
+    writeBatches("serial", lineCount);
+    checkBatches("serial", lineCount);
+
+    ParallelCompression::THREAD_COUNT = 2;
+    writeBatches("parallel", lineCount);
+    checkBatches("parallel", lineCount);
+    ParallelCompression::THREAD_COUNT = 1;
+
+    return 0;
+}
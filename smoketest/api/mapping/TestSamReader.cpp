@@ -0,0 +1,204 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/BamWriter.hpp"
+#include "cgatools/mapping/SamReader.hpp"
+#include "cgatools/mapping/SamRecord.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace cgatools::util;
+using namespace cgatools::mapping;
+
+namespace {
+    vector<SamAlignment> makeAlignments()
+    {
+        vector<SamAlignment> result;
+        for(int ii=0; ii<100; ii++)
+        {
+            SamAlignment a;
+            a.qname_ = "GS1-L01-3:" + boost::lexical_cast<string>(ii);
+            a.flag_ = uint16_t(ii % 3 == 0 ? 0x4 | 0x40 | 0x1 : 0x10 | 0x80 | 0x1);
+            if (0 == ii % 3)
+            {
+                a.rname_ = "*";
+                a.mrnm_ = "*";
+            }
+            else
+            {
+                a.rname_ = 0 == ii % 2 ? "chr1" : "chr2";
+                a.pos_ = ii * 17 + 1;
+                a.mapq_ = ii % 60;
+                a.cigar_ = Cigar(boost::lexical_cast<string>(10 + ii % 5) + "M2N3I20M");
+                a.hasCigar_ = true;
+                a.mrnm_ = 0 == ii % 4 ? "chr2" : "=";
+                a.mpos_ = ii * 13 + 1;
+                a.isize_ = ii % 4 == 1 ? -ii * 100 : ii * 100;
+            }
+            if (ii % 10 == 9)
+            {
+                a.seq_ = "*";
+                a.qual_ = "*";
+            }
+            else
+            {
+                string seq = "ACGTNACGTTGCAACGTAGGCTAGCTAACGTACG";
+                a.seq_ = seq.substr(ii % 7);
+                a.qual_.clear();
+                for(size_t jj=0; jj<a.seq_.size(); jj++)
+                    a.qual_.push_back(char('!' + (ii + jj) % 41));
+            }
+            a.addTag("RG", "GS1-L01");
+            if (ii % 2 == 0)
+                a.addTag("GC", "3S2G28S");
+            a.addTag("XS", int64_t(ii) * 100003 - 2000000);
+            a.addTag("XN", int64_t(ii % 7) - 3);
+            result.push_back(a);
+        }
+        return result;
+    }
+
+    SamFileHeaderBlock makeHeader()
+    {
+        SamFileHeaderBlock h("");
+        h.get(SamFileHeaderBlock("@HD","@HD","","")).add(SamFileHeaderBlock("VN","VN","\t","1.3"));
+        h.get(SamFileHeaderBlock("chr1","@SQ","\n",""))
+            .add(SamFileHeaderBlock("SN","\t","chr1"))
+            .add(SamFileHeaderBlock("LN","\t","100000"));
+        h.get(SamFileHeaderBlock("chr2","@SQ","\n",""))
+            .add(SamFileHeaderBlock("SN","\t","chr2"))
+            .add(SamFileHeaderBlock("LN","\t","200000"));
+        h.get(SamFileHeaderBlock("@RG","@RG","\n",""))
+            .add(SamFileHeaderBlock("ID","\t","GS1-L01"))
+            .add(SamFileHeaderBlock("LB","\t","LIB1"))
+            .add(SamFileHeaderBlock("SM","\t","SAMPLE1"));
+        return h;
+    }
+
+    // Checks a parsed record against the alignment it was written from.
+    // SAM text and BAM may have integer tags of different types.
+    void checkRecord(const SamAlignment& a, const SamFileRecord& r)
+    {
+        CGA_ASSERT_EQ(a.qname_, r.qname_);
+        CGA_ASSERT_EQ(a.flag_, r.flag_);
+        CGA_ASSERT_EQ(a.rname_, r.rname_);
+        CGA_ASSERT_EQ(a.pos_, r.pos_);
+        CGA_ASSERT_EQ(uint32_t(a.mapq_), r.mapq_);
+        ostringstream cigar;
+        if (a.hasCigar_)
+            cigar << a.cigar_;
+        else
+            cigar << "*";
+        CGA_ASSERT_EQ(cigar.str(), r.cigar_);
+        string rnext = a.mrnm_ == a.rname_ && "*" != a.mrnm_ ? string("=") : a.mrnm_;
+        CGA_ASSERT_EQ(rnext, r.rnext_);
+        CGA_ASSERT_EQ(a.mpos_, r.pnext_);
+        CGA_ASSERT_EQ(a.isize_, r.tlen_);
+        CGA_ASSERT_EQ(a.seq_, r.seq_);
+        CGA_ASSERT_EQ(a.qual_, r.qual_);
+        CGA_ASSERT_EQ(a.tags_.size(), r.samTags_.size());
+        for(size_t ii=0; ii<a.tags_.size(); ii++)
+        {
+            const SamTag* tag = r.samTags_.findTag(a.tags_[ii].name_.c_str());
+            CGA_ASSERT(0 != tag);
+            if ('Z' == a.tags_[ii].type_)
+            {
+                CGA_ASSERT_EQ('Z', tag->type_);
+                CGA_ASSERT_EQ(a.tags_[ii].string_, tag->value_);
+            }
+            else
+                CGA_ASSERT_EQ(boost::lexical_cast<string>(a.tags_[ii].int_), tag->value_);
+        }
+    }
+
+    void checkFile(const string& fn, const vector<SamAlignment>& alignments, bool isBam)
+    {
+        // One record at a time.
+        {
+            InputStream in(fn);
+            SamFileParser parser(in, fn);
+            CGA_ASSERT_EQ(isBam, parser.isBam());
+            for(size_t ii=0; ii<alignments.size(); ii++)
+            {
+                CGA_ASSERT(parser.next());
+                checkRecord(alignments[ii], parser.getRecord());
+            }
+            CGA_ASSERT(!parser.next());
+            CGA_ASSERT_EQ(2u, parser.header_.getRecords("SQ").size());
+            CGA_ASSERT_EQ("LIB1", parser.header_.getReadGroup("GS1-L01").tags_.getTag("LB").value_);
+        }
+
+        // In chunks, decoded in any order.
+        {
+            InputStream in(fn);
+            SamFileParser parser(in, fn);
+            SamRecordDecoder decoder(parser);
+            SamRawRecords chunk;
+            size_t count = 0;
+            for(;;)
+            {
+                size_t chunkSize = parser.nextChunk(chunk, 7);
+                if (0 == chunkSize)
+                    break;
+                CGA_ASSERT(chunkSize <= 7);
+                for(size_t ii=chunkSize; ii>0; ii--)
+                    checkRecord(alignments[count+ii-1], decoder.decode(chunk[ii-1]));
+                count += chunkSize;
+            }
+            CGA_ASSERT_EQ(alignments.size(), count);
+        }
+    }
+}
+
+int TestSamReader(int argc, char* argv[])
+{
+    vector<SamAlignment> alignments = makeAlignments();
+    SamFileHeaderBlock header = makeHeader();
+
+    {
+        OutputStream out("test.sam");
+        out << header << '\n';
+        for(size_t ii=0; ii<alignments.size(); ii++)
+            alignments[ii].writeSam(out);
+    }
+    {
+        OutputStream out("test.bam");
+        BamWriter writer(out);
+        writer.writeHeader(header);
+        for(size_t ii=0; ii<alignments.size(); ii++)
+            writer.write(alignments[ii]);
+    }
+
+    checkFile("test.sam", alignments, false);
+    checkFile("test.bam", alignments, true);
+
+    // SAM text without a header.
+    {
+        OutputStream out("noheader.sam");
+        alignments[1].writeSam(out);
+    }
+    InputStream in("noheader.sam");
+    SamFileParser parser(in, "noheader.sam");
+    CGA_ASSERT(parser.next());
+    checkRecord(alignments[1], parser.getRecord());
+    CGA_ASSERT(!parser.next());
+
+    return 0;
+}
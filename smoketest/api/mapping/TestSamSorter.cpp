@@ -0,0 +1,163 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/mapping/SamRecord.hpp"
+#include "cgatools/mapping/SamSorter.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Files.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace cgatools::util;
+using namespace cgatools::mapping;
+
+namespace {
+    const size_t RECORD_COUNT = 20000;
+
+    string toSam(const SamAlignment& a)
+    {
+        ostringstream out;
+        a.writeSam(out);
+        return out.str();
+    }
+
+    // Records on two chromosomes and unmapped, with many positions
+    // repeated, so that the order of equal records is checked.
+    vector<SamAlignment> makeAlignments()
+    {
+        vector<SamAlignment> result;
+        for(size_t ii=0; ii<RECORD_COUNT; ii++)
+        {
+            SamAlignment a;
+            size_t hash = (ii * 7919) % 1009;
+            a.qname_ = "GS1-L01-3:" + boost::lexical_cast<string>(ii);
+            if (0 == hash % 5)
+            {
+                a.flag_ = 0x4 | 0x1;
+                a.rname_ = "*";
+                a.mrnm_ = "*";
+            }
+            else
+            {
+                a.flag_ = 0x1;
+                // chr2 is first in the header
+                a.rname_ = 0 == hash % 2 ? "chr1" : "chr2";
+                a.pos_ = uint32_t(hash % 97 + 1);
+                a.mapq_ = int(ii % 60);
+                a.cigar_ = Cigar(boost::lexical_cast<string>(10 + ii % 5) + "M2N3I20M");
+                a.hasCigar_ = true;
+                a.mrnm_ = "=";
+                a.mpos_ = uint32_t(hash % 89 + 1);
+                a.isize_ = int(a.mpos_) - int(a.pos_);
+            }
+            a.seq_ = string("ACGTNACGTTGCAACGTAGGCTAGCTAACGTACG").substr(ii % 7);
+            a.qual_.assign(a.seq_.size(), char('!' + ii % 41));
+            a.addTag("RG", "GS1-L01");
+            a.addTag("XS", int64_t(ii) * 100003 - 2000000);
+            result.push_back(a);
+        }
+        return result;
+    }
+
+    SamFileHeaderBlock makeHeader()
+    {
+        SamFileHeaderBlock h("");
+        h.get(SamFileHeaderBlock("@HD","@HD","","")).add(SamFileHeaderBlock("VN","VN","\t","1.3"));
+        h.get(SamFileHeaderBlock("chr2","@SQ","\n",""))
+            .add(SamFileHeaderBlock("SN","\t","chr2"))
+            .add(SamFileHeaderBlock("LN","\t","200000"));
+        h.get(SamFileHeaderBlock("chr1","@SQ","\n",""))
+            .add(SamFileHeaderBlock("SN","\t","chr1"))
+            .add(SamFileHeaderBlock("LN","\t","100000"));
+        return h;
+    }
+
+    class CoordinateLess
+    {
+    public:
+        bool operator()(const SamAlignment& lhs, const SamAlignment& rhs) const
+        {
+            if (lhs.rname_ != rhs.rname_)
+                return getRank(lhs.rname_) < getRank(rhs.rname_);
+            return lhs.pos_ < rhs.pos_;
+        }
+
+    private:
+        static int getRank(const string& rname)
+        {
+            return "chr2" == rname ? 0 : ("chr1" == rname ? 1 : 2);
+        }
+    };
+
+    void collect(vector<string>& out, const SamAlignment& a)
+    {
+        out.push_back(toSam(a));
+    }
+
+    // Sorts the alignments with the given memory, and returns the
+    // number of temporary runs.
+    size_t checkSort(const vector<SamAlignment>& alignments, size_t memory)
+    {
+        vector<SamAlignment> expected(alignments);
+        std::stable_sort(expected.begin(), expected.end(), CoordinateLess());
+
+        boost::filesystem::create_directories("tmp");
+        vector<string> sorted;
+        size_t runCount;
+        {
+            SamSorter sorter(makeHeader(), memory, "tmp");
+            for(size_t ii=0; ii<alignments.size(); ii++)
+                sorter.add(alignments[ii]);
+            sorter.finish(boost::bind(&collect, boost::ref(sorted), _1));
+            runCount = sorter.getRunCount();
+        }
+
+        CGA_ASSERT_EQ(expected.size(), sorted.size());
+        for(size_t ii=0; ii<expected.size(); ii++)
+            CGA_ASSERT_EQ(toSam(expected[ii]), sorted[ii]);
+        CGA_ASSERT(files::listDir("tmp", ".*").empty());
+        return runCount;
+    }
+}
+
+int TestSamSorter(int argc, char* argv[])
+{
+    vector<SamAlignment> alignments = makeAlignments();
+
+    // in memory
+    CGA_ASSERT_EQ(0u, checkSort(alignments, 100000000));
+
+    // in a few runs, merged at once
+    size_t runCount = checkSort(alignments, 200000);
+    CGA_ASSERT(1u < runCount);
+    CGA_ASSERT(runCount <= SamSorter::MAX_MERGED_RUNS);
+
+    // in so many runs that some are merged into larger runs first
+    CGA_ASSERT(SamSorter::MAX_MERGED_RUNS + 1 < checkSort(alignments, 10000));
+
+    ParallelCompression::THREAD_COUNT = 2;
+    CGA_ASSERT(SamSorter::MAX_MERGED_RUNS + 1 < checkSort(alignments, 10000));
+    ParallelCompression::THREAD_COUNT = 1;
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/reference/CompactDnaSequence.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace std;
+using namespace cgatools::reference;
+using cgatools::util::Md5Digest;
+
+namespace pt = boost::posix_time;
+
+namespace {
+    void report(const char* name, const pt::ptime& start, int64_t baseCount)
+    {
+        double seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+        cout << name << "\t" << baseCount << " bases\t" << seconds << " s\t"
+             << (seconds > 0 ? baseCount / seconds : 0.0) << " bases/s" << endl;
+    }
+}
+
+// Reports the bases per second decoded by the per-base and the bulk
+// sequence accessors of CompactDnaSequence, for a random 64 Mb
+// chromosome read in windows of 100 bases (default) or of the size
+// given as the first argument after the data and output directories.
+int BenchCompactDnaSequence(int argc, char* argv[])
+{
+    int64_t window = argc > 3 ? atoi(argv[3]) : 100;
+    CGA_ASSERT(window > 0);
+
+    const int64_t length = 64 << 20;
+    srand(12345);
+    vector<uint8_t> packed(length/4);
+    for(size_t ii=0; ii<packed.size(); ii++)
+        packed[ii] = rand() & 0xff;
+    vector<AmbiguousRegion> amb;
+    for(int64_t pos=0; pos+1000<length; pos+=100000)
+        amb.push_back(AmbiguousRegion('N', pos, 1000));
+    CompactDnaSequence cds("chr", false, &packed[0], Md5Digest(), length, amb);
+
+    // Sums of bases keep the loops from being optimized away.
+    size_t checksum[3] = { 0, 0, 0 };
+
+    pt::ptime start = pt::microsec_clock::universal_time();
+    for(int64_t pos=0; pos+window<=length; pos+=window)
+    {
+        for(int64_t ii=0; ii<window; ii++)
+            checksum[0] += cds.getUnambiguousBase(pos+ii);
+    }
+    report("getUnambiguousBase", start, length);
+
+    start = pt::microsec_clock::universal_time();
+    vector<char> buf(window);
+    for(int64_t pos=0; pos+window<=length; pos+=window)
+    {
+        cds.getUnambiguousSequence(&buf[0], pos, window);
+        for(int64_t ii=0; ii<window; ii++)
+            checksum[1] += buf[ii];
+    }
+    report("getUnambiguousSequence", start, length);
+
+    start = pt::microsec_clock::universal_time();
+    for(int64_t pos=0; pos+window<=length; pos+=window)
+    {
+        string seq = cds.getSequence(pos, window);
+        for(int64_t ii=0; ii<window; ii++)
+            checksum[2] += seq[ii];
+    }
+    report("getSequence", start, length);
+
+    CGA_ASSERT(checksum[0] == checksum[1]);
+    return 0;
+}
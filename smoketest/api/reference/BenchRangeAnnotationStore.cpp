@@ -0,0 +1,146 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/reference/RepeatMaskerStore.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/random.hpp>
+
+using namespace std;
+using namespace cgatools::reference;
+using namespace cgatools::util;
+
+namespace pt = boost::posix_time;
+
+namespace {
+    typedef IntervalTree<Range, Location, RepeatMaskerAnnotation,
+                         RangeOverlap, GetRangeBoundary> TreeStore;
+    typedef StaticIntervalTree<Range, Location, RepeatMaskerAnnotation,
+                               RangeOverlap, GetRangeBoundary> StaticStore;
+
+    // RepeatMaskerStore, with the data store as a parameter.
+    template <typename TDataStore>
+    class BenchStore :
+        public RangeAnnotationStore<BenchStore<TDataStore>, RepeatMaskerAnnotation, TDataStore>
+    {
+    public:
+        typedef RangeAnnotationStore<BenchStore<TDataStore>,
+                                     RepeatMaskerAnnotation, TDataStore> MyBase;
+
+        BenchStore(const CrrFile& crr, const string& fn)
+            : MyBase(crr)
+        {
+            this->load(fn);
+        }
+
+        void bindColumns(DelimitedFile& df, Range& range, RepeatMaskerAnnotation& data)
+        {
+            this->bindRangeColumns(df, range);
+            df.addField(StringField("repName", &data.name_));
+            df.addField(StringField("repFamily", &data.family_));
+            df.addField(ValueField<double>("divergence", &data.divergence_));
+            df.addField(StrandField("strand", &data.strand_));
+        }
+    };
+
+    // Bytes used by the index for n ranges, not counting the strings
+    // of the annotations. IntervalTree nodes hold the range and
+    // annotation, the subtree maximum, a color and two child pointers,
+    // plus the allocator's overhead of about two words per allocation.
+    size_t treeBytes(size_t n)
+    {
+        size_t node = sizeof(TreeStore::value_type) + sizeof(Location) + 3*sizeof(void*);
+        return n * (node + 2*sizeof(void*));
+    }
+
+    size_t staticBytes(size_t n)
+    {
+        return n * (sizeof(StaticStore::value_type) + sizeof(Location));
+    }
+
+    double elapsed(const pt::ptime& start)
+    {
+        return (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+    }
+
+    template <typename Store>
+    size_t query(const Store& store, const vector<Range>& queries, const char* name)
+    {
+        pt::ptime start = pt::microsec_clock::universal_time();
+        size_t hitCount = 0;
+        vector<typename Store::QueryResultType> result;
+        for(size_t ii=0; ii<queries.size(); ii++)
+        {
+            store.intersect(queries[ii], result);
+            hitCount += result.size();
+        }
+        double seconds = elapsed(start);
+        cout << name << "\tquery\t" << queries.size() << " queries\t" << seconds << " s\t"
+             << (seconds > 0 ? queries.size() / seconds : 0.0) << " queries/s\t"
+             << hitCount << " hits" << endl;
+        return hitCount;
+    }
+}
+
+// Reports the load time, query throughput and index footprint of a
+// RangeAnnotationStore backed by IntervalTree and by
+// StaticIntervalTree, given as the reference crr file and a
+// repeatmasker file after the data and output directories, optionally
+// followed by the number of random 1 kb queries (default 1000000).
+int BenchRangeAnnotationStore(int argc, char* argv[])
+{
+    if (argc < 5)
+    {
+        cerr << "usage: BenchRangeAnnotationStore dataDir outputDir crr rmskFile [queries]" << endl;
+        return 1;
+    }
+    CrrFile crr(argv[3]);
+    size_t queryCount = argc > 5 ? atoi(argv[5]) : 1000000;
+
+    vector<Range> contigs = crr.listContigs();
+    CGA_ASSERT(!contigs.empty());
+    boost::mt19937 rng(12345);
+    boost::uniform_int<size_t> pickContig(0, contigs.size()-1);
+    vector<Range> queries;
+    for(size_t ii=0; ii<queryCount; ii++)
+    {
+        const Range& contig = contigs[pickContig(rng)];
+        boost::uniform_int<uint32_t> pickPos(contig.begin_, contig.end_-1);
+        uint32_t pos = pickPos(rng);
+        queries.push_back(Range(contig.chromosome_, pos, std::min(pos+1000, contig.end_)));
+    }
+
+    pt::ptime start = pt::microsec_clock::universal_time();
+    BenchStore<TreeStore> tree(crr, argv[4]);
+    cout << "IntervalTree\tload\t" << elapsed(start) << " s\t"
+         << treeBytes(tree.size()) << " index bytes" << endl;
+    size_t treeHits = query(tree, queries, "IntervalTree");
+
+    start = pt::microsec_clock::universal_time();
+    BenchStore<StaticStore> flat(crr, argv[4]);
+    cout << "StaticIntervalTree\tload\t" << elapsed(start) << " s\t"
+         << staticBytes(flat.size()) << " index bytes" << endl;
+    size_t staticHits = query(flat, queries, "StaticIntervalTree");
+
+    CGA_ASSERT(treeHits == staticHits);
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/reference/CompactDnaSequence.hpp"
+#include "cgatools/util/BaseUtil.hpp"
+#include "cgatools/util/Exception.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cgatools::reference;
+using cgatools::util::Md5Digest;
+
+namespace bu = cgatools::util::baseutil;
+
+namespace {
+    // Packs a sequence of A, C, G, T four bases per byte, first base
+    // in the high-order bits, as in a crr file.
+    vector<uint8_t> packSequence(const string& seq)
+    {
+        vector<uint8_t> packed( (seq.size()+3)/4, 0 );
+        for(size_t ii=0; ii<seq.size(); ii++)
+            packed[ii/4] |= bu::pack(seq[ii]) << (6 - 2*(ii & 0x3));
+        return packed;
+    }
+
+    // Compares the bulk sequence accessors against getBase() and
+    // getUnambiguousBase().
+    void checkRange(const CompactDnaSequence& cds, int64_t pos, int64_t length)
+    {
+        string expected, expectedUnambiguous;
+        for(int64_t ii=0; ii<length; ii++)
+        {
+            expected.push_back(cds.getBase(pos+ii));
+            expectedUnambiguous.push_back(cds.getUnambiguousBase(pos+ii));
+        }
+
+        CGA_ASSERT(cds.getSequence(pos, length) == expected);
+        CGA_ASSERT(cds.getUnambiguousSequence(pos, length) == expectedUnambiguous);
+
+        string prefixed("xy");
+        cds.appendSequence(prefixed, pos, length);
+        CGA_ASSERT(prefixed == "xy" + expected);
+
+        vector<char> buf(length+1, '!');
+        cds.getSequence(&buf[0], pos, length);
+        CGA_ASSERT(string(&buf[0], length) == expected);
+        CGA_ASSERT('!' == buf[length]);
+        cds.getUnambiguousSequence(&buf[0], pos, length);
+        CGA_ASSERT(string(&buf[0], length) == expectedUnambiguous);
+        CGA_ASSERT('!' == buf[length]);
+    }
+
+    bool throwsOutOfRange(const CompactDnaSequence& cds, int64_t pos, int64_t length)
+    {
+        try
+        {
+            string seq("xy");
+            cds.appendSequence(seq, pos, length);
+        }
+        catch(const std::exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int TestCompactDnaSequence(int argc, char* argv[])
+{
+    srand(12345);
+    const char* bases = "ACGT";
+    string seq;
+    for(size_t ii=0; ii<203; ii++)
+        seq.push_back(bases[rand() % 4]);
+    vector<uint8_t> packed = packSequence(seq);
+
+    vector<AmbiguousRegion> amb;
+    amb.push_back(AmbiguousRegion('N', 0, 3));
+    amb.push_back(AmbiguousRegion('R', 50, 1));
+    amb.push_back(AmbiguousRegion('N', 97, 20));
+    amb.push_back(AmbiguousRegion('Y', 200, 3));
+
+    for(size_t circular=0; circular<2; circular++)
+    {
+        CompactDnaSequence cds("chr", 0 != circular, &packed[0], Md5Digest(), seq.size(), amb);
+        CGA_ASSERT(cds.getUnambiguousSequence(0, seq.size()) == seq);
+
+        int64_t length = seq.size();
+        int64_t minPos = circular ? -length : 0;
+        int64_t endPos = circular ? 2*length : length;
+        for(int64_t pos=minPos; pos<endPos; pos++)
+        {
+            for(int64_t count=0; count<=40 && pos+count<=endPos; count++)
+                checkRange(cds, pos, count);
+        }
+        checkRange(cds, 0, length);
+        checkRange(cds, 1, length-1);
+        if (circular)
+            checkRange(cds, length-1, length);
+
+        CGA_ASSERT(throwsOutOfRange(cds, endPos-1, 2));
+        CGA_ASSERT(throwsOutOfRange(cds, minPos-1, 2));
+        CGA_ASSERT(throwsOutOfRange(cds, 0, length+1));
+    }
+
+    return 0;
+}
@@ -15,6 +15,7 @@
 #include "cgatools/core.hpp"
 #include "cgatools/util/DelimitedFile.hpp"
 #include "cgatools/util/Exception.hpp"
+#include "cgatools/util/Streams.hpp"
 
 #include <iostream>
 #include <sstream>
@@ -155,6 +156,45 @@ namespace cgatools { namespace {
             CGA_ASSERT("acdee758f0fa4a7cf91b66e1df472f0d" == md5);
             CGA_ASSERT(!df.next());
         }
+
+        // Memory-mapped file, parsed in place. CR-LF line endings and
+        // no newline at the end of the file.
+        {
+            string str("#ASSEMBLY_ID\tt00\r\n"
+                       "\r\n"
+                       ">chromosome\toffset\tname\r\n"
+                       "chr1\t123\tfoo\r\n"
+                       "\r\n"
+                       "chrX\t456\tbarbaz");
+            {
+                OutputStream out("mapped.tsv");
+                out << str;
+            }
+
+            boost::shared_ptr<std::istream> in =
+                InputStream::openCompressedInputStreamByExtension("mapped.tsv");
+            CGA_ASSERT(0 != dynamic_cast<MappedInputStream*>(in.get()));
+
+            string chromosome;
+            uint32_t offset;
+            StringRangeField::Range name;
+            DelimitedFile df(*in, "mapped.tsv");
+            CGA_ASSERT(df.getMetadata().get("ASSEMBLY_ID") == "t00");
+            df.addField(StringField("chromosome", &chromosome));
+            df.addField(ValueField<uint32_t>("offset", &offset));
+            df.addField(StringRangeField("name", &name));
+            CGA_ASSERT(df.next());
+            CGA_ASSERT("chr1" == chromosome);
+            CGA_ASSERT(123 == offset);
+            CGA_ASSERT("foo" == string(name.first, name.second));
+            CGA_ASSERT("chr1\t123\tfoo" == df.getLine());
+            CGA_ASSERT(df.next());
+            CGA_ASSERT("chrX" == chromosome);
+            CGA_ASSERT(456 == offset);
+            CGA_ASSERT("barbaz" == string(name.first, name.second));
+            CGA_ASSERT("chrX\t456\tbarbaz" == df.getLine());
+            CGA_ASSERT(!df.next());
+        }
     }
 
 } } // cgatools::anonymous
@@ -0,0 +1,92 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/Interned.hpp"
+#include "cgatools/util/ThreadPool.hpp"
+#include "cgatools/util/Exception.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using cgatools::util::Interned;
+using cgatools::util::InternedStringField;
+using cgatools::util::ThreadPool;
+
+namespace {
+    void internValue(vector< Interned<string> >& out, size_t offset)
+    {
+        out[offset] = "value" + boost::lexical_cast<string>(offset % 7);
+    }
+}
+
+int TestInterned(int argc, char* argv[])
+{
+    Interned<string> empty;
+    CGA_ASSERT(empty.empty());
+    CGA_ASSERT(0 == empty.size());
+    CGA_ASSERT(empty == Interned<string>(""));
+    CGA_ASSERT(empty == string());
+    CGA_ASSERT("" == empty);
+
+    Interned<string> snp1("snp");
+    Interned<string> snp2(string("sn")+"p");
+    Interned<string> ref("ref");
+    CGA_ASSERT(snp1 == snp2);
+    CGA_ASSERT(&snp1.get() == &snp2.get());
+    CGA_ASSERT(snp1 != ref);
+    CGA_ASSERT(ref < snp1);
+    CGA_ASSERT("snp" == snp1 && snp1 == "snp" && snp1 != "sub");
+    CGA_ASSERT(string("snp") == snp1 && snp1 != string("ref"));
+    CGA_ASSERT(3 == snp1.size() && 's' == snp1[0]);
+
+    std::ostringstream out;
+    out << snp1 << ref;
+    CGA_ASSERT("snpref" == out.str());
+
+    vector<string> filters;
+    filters.push_back("VQLOW");
+    filters.push_back("AMB");
+    Interned< vector<string> > varFilter1(filters);
+    Interned< vector<string> > varFilter2(filters);
+    CGA_ASSERT(varFilter1 == varFilter2);
+    CGA_ASSERT(2 == varFilter1.size() && "AMB" == varFilter1[1]);
+    CGA_ASSERT(filters == vector<string>(varFilter1.begin(), varFilter1.end()));
+    varFilter1.clear();
+    CGA_ASSERT(varFilter1.empty() && varFilter1 == Interned< vector<string> >(vector<string>()));
+
+    Interned<string> parsed;
+    InternedStringField field("varType", &parsed);
+    const char* text = "no-call";
+    for(size_t ii=0; ii<3; ii++)
+    {
+        field.parse(text, text+7);
+        CGA_ASSERT(parsed == Interned<string>("no-call"));
+        field.parse(text, text+2);
+        CGA_ASSERT(parsed == Interned<string>("no"));
+        field.parse(text, text);
+        CGA_ASSERT(parsed.empty());
+    }
+
+    ThreadPool pool(4);
+    vector< Interned<string> > values(10000);
+    pool.parallelFor(values.size(), boost::bind(&internValue, boost::ref(values), _1));
+    for(size_t ii=0; ii<values.size(); ii++)
+        CGA_ASSERT(values[ii] == values[ii % 7]);
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/ParallelCompression.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace cgatools::util;
+
+namespace {
+    string makeText(size_t lineCount)
+    {
+        ostringstream out;
+        uint32_t seed = 1;
+        for(size_t ii=0; ii<lineCount; ii++)
+        {
+            seed = seed*1103515245 + 12345;
+            out << ii << "\tchr" << (seed >> 24) % 23 << "\t" << (seed >> 8) << "\tACGT\n";
+        }
+        return out.str();
+    }
+
+    void writeFile(const string& fn, const string& text)
+    {
+        boost::shared_ptr<std::ostream> out = OutputStream::openCompressedOutputStreamByExtension(fn);
+        out->write(text.data(), text.size());
+    }
+
+    string readFile(const string& fn)
+    {
+        boost::shared_ptr<std::istream> in = InputStream::openCompressedInputStreamByExtension(fn);
+        ostringstream result;
+        result << in->rdbuf();
+        return result.str();
+    }
+
+    void testRoundTrip(const string& text)
+    {
+        const char* fns[] = { "test.gz", "test.bz2" };
+        for(size_t ii=0; ii<2; ii++)
+        {
+            for(size_t writeThreads=1; writeThreads<=4; writeThreads+=3)
+            {
+                ParallelCompression::THREAD_COUNT = writeThreads;
+                writeFile(fns[ii], text);
+                if (0 == ii)
+                    CGA_ASSERT(BgzfSource::isBgzf(fns[ii]) == (writeThreads > 1));
+
+                for(size_t readThreads=1; readThreads<=4; readThreads+=3)
+                {
+                    ParallelCompression::THREAD_COUNT = readThreads;
+                    CGA_ASSERT(text == readFile(fns[ii]));
+                }
+            }
+        }
+    }
+
+    // Corrupts the header of the second block of a BGZF file at the
+    // given offset in the block, which the reader must reject.
+    void testCorruptBlock(size_t offset, char value0, char value1)
+    {
+        ParallelCompression::THREAD_COUNT = 4;
+        writeFile("test.gz", makeText(10*1000));
+        string data;
+        {
+            std::ifstream in("test.gz", std::ios::binary);
+            ostringstream buf;
+            buf << in.rdbuf();
+            data = buf.str();
+        }
+        size_t second = 1 + ( size_t(uint8_t(data[16])) | (size_t(uint8_t(data[17])) << 8) );
+        CGA_ASSERT(second + 18 < data.size());
+        data[second+offset] = value0;
+        data[second+offset+1] = value1;
+        {
+            std::ofstream out("corrupt.gz", std::ios::binary);
+            out.write(data.data(), data.size());
+        }
+
+        bool exn = false;
+        try
+        {
+            boost::shared_ptr<std::istream> in =
+                InputStream::openCompressedInputStreamByExtension("corrupt.gz");
+            in->exceptions(std::ios::badbit);
+            char buf[4096];
+            while (in->read(buf, sizeof(buf)))
+                ;
+        }
+        catch(const std::exception&)
+        {
+            exn = true;
+        }
+        CGA_ASSERT(exn);
+    }
+}
+
+int TestParallelCompression(int argc, char* argv[])
+{
+    testRoundTrip("");
+    testRoundTrip("a\n");
+    testRoundTrip(makeText(100*1000));
+
+    // XLEN beyond the largest block, no BSIZE subfield, and a BSIZE
+    // smaller than the header.
+    testCorruptBlock(10, char(0xff), char(0xff));
+    testCorruptBlock(12, 'X', 'X');
+    testCorruptBlock(16, 0, 0);
+    ParallelCompression::THREAD_COUNT = 1;
+
+    return 0;
+}
@@ -20,6 +20,7 @@
 #include <boost/foreach.hpp>
 
 using namespace std;
+using cgatools::util::appendInt;
 using cgatools::util::parseValue;
 
 namespace cgatools { namespace {
@@ -186,6 +187,19 @@ namespace cgatools { namespace {
             testParseFloat<double>(floatTestCase);
         }
 
+        const int64_t intValues[] =
+            {
+                0, 1, -1, 9, 10, -10, 127, -128, 2147483647, -2147483647-1,
+                std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min()
+            };
+        BOOST_FOREACH(int64_t intValue, intValues)
+        {
+            std::string text("x");
+            appendInt(text, intValue);
+            CGA_ASSERT("x" + boost::lexical_cast<std::string>(intValue) == text);
+            CGA_ASSERT(intValue == parseValue<int64_t>(text.substr(1)));
+        }
+
         // Selective uncomment for perf test.
 //         std::string val("12345678");
 //         for(size_t ii=0; ii<100000000; ii++)
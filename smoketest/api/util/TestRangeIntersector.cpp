@@ -67,6 +67,9 @@ namespace {
     typedef IntervalTree<Range, Location, int,
                          RangeOverlap,
                          GetRangeBoundary> ST;
+    typedef StaticIntervalTree<Range, Location, int,
+                               RangeOverlap,
+                               GetRangeBoundary> SST;
 
     void testRI(cgatools::uint32_t seed,
                 int rangeCount,
@@ -82,6 +85,7 @@ namespace {
         boost::variate_generator<RandomGenerator&, boost::uniform_real<double> > gen(rng, uu);
 
         ST ri;
+        SST sri2;
         SimpleRangeIntersector sri;
         for(int ii=0; ii<rangeCount; ii++)
         {
@@ -95,10 +99,14 @@ namespace {
 //                  << range.end_ << endl;
             ri.put(range, ii);
 //            cout << ii << ":" << ri.getMaxDepth() << endl;
+            sri2.put(range, ii);
             sri.put(range, ii);
         }
+        sri2.index();
 
         cout << "Size: " << ri.size() << ", Max. Depth: " << ri.getMaxDepth() << endl;
+        cout << "Static size: " << sri2.size() << ", Max. Depth: " << sri2.getMaxDepth() << endl;
+        CGA_ASSERT(sri2.size() == ri.size());
 
         for(int ii=0; ii<testCount; ii++)
         {
@@ -118,6 +126,19 @@ namespace {
             {
                 v0.push_back(rvals[jj]->second);
             }
+
+            // The static tree returns the same ranges in the same order.
+            vector<SST::QueryResultType> rvals2;
+            sri2.intersect(range, rvals2);
+            vector<int> v2;
+            for(size_t jj=0; jj<rvals2.size(); jj++)
+                v2.push_back(rvals2[jj]->second);
+            if (v0 != v2)
+            {
+                cout << "tree: " << v0 << endl;
+                cout << "static: " << v2 << endl;
+                CGA_ASSERT(false);
+            }
             std::sort(v0.begin(), v0.end());
 
             vector<SimpleRangeIntersector::MapType::const_iterator> svals;
@@ -136,11 +157,12 @@ namespace {
         }
     }
 
-    void testIntersection(const ST& st,
+    template <typename V>
+    void testIntersection(const V& st,
                           const Range& range,
                           const std::vector<int>& expected)
     {
-        vector<const ST::value_type*> results;
+        vector<typename V::QueryResultType> results;
         st.intersect(range, results);
         // CGA_ASSERT( st.intersects(range) == (0 != results.size()) );
         vector<int> actual;
@@ -181,6 +203,37 @@ namespace {
         { int aray[] = { 1, 2, 4, 5 }; TEST_INTERSECTION(st, Range(0, 0, 10), aray); }
     }
 
+    void basicTestSST()
+    {
+        SST st;
+
+        st.put(Range(0, 0, 10), 1);
+        st.put(Range(0, 10, 10), 2);
+        st.put(Range(0, 10, 20), 3);
+        st.put(Range(0, 5, 15), 4);
+        st.put(Range(0, 5, 25), 5);
+        st.index();
+
+        { int aray[] = { 1, 2, 4, 5 }; TEST_INTERSECTION(st, Range(0, 0, 10), aray); }
+        { int aray[] = { 1, 2, 3, 4, 5 }; TEST_INTERSECTION(st, Range(0, 10, 10), aray); }
+        { int aray[] = { 2, 3, 4, 5 }; TEST_INTERSECTION(st, Range(0, 10, 11), aray); }
+
+        // test that ranges added after indexing are found once indexed again
+        st.put(Range(0, 8, 9), 6);
+        st.index();
+        { int aray[] = { 1, 2, 4, 5, 6 }; TEST_INTERSECTION(st, Range(0, 0, 10), aray); }
+
+        // test that assignment is a deep copy
+        SST st2;
+        st2 = st;
+        st2.clear();
+        CGA_ASSERT(0 == st2.size());
+        { int aray[] = { 1, 2, 4, 5, 6 }; TEST_INTERSECTION(st, Range(0, 0, 10), aray); }
+
+        SST empty;
+        testIntersection(empty, Range(0, 0, 10), vector<int>());
+    }
+
     double log2(double s)
     {
         return std::log(s) / std::log(2.0);
@@ -349,6 +402,7 @@ namespace {
 int TestRangeIntersector(int argc, char* argv[])
 {
     basicTestST();
+    basicTestSST();
 
     for(size_t ii=0; ii<10; ii++)
         testRI(ii*12345, 5000, 1500, 2, 100000, 3.0, 1000);
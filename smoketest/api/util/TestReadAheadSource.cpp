@@ -0,0 +1,134 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/util/ReadAheadSource.hpp"
+#include "cgatools/util/Streams.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace cgatools::util;
+
+namespace {
+    string makeText(size_t lineCount)
+    {
+        ostringstream out;
+        for(size_t ii=0; ii<lineCount; ii++)
+            out << ii << "\tchr" << ii % 23 << "\t" << ii*7919 << "\tACGT\n";
+        return out.str();
+    }
+
+    string readAll(std::istream& in)
+    {
+        ostringstream result;
+        result << in.rdbuf();
+        return result.str();
+    }
+
+    void testSource(const string& text, size_t bufferCount, size_t bufferSize)
+    {
+        boost::shared_ptr<std::istream> in(new istringstream(text));
+        boost::iostreams::filtering_istream ra;
+        ra.push(ReadAheadSource(in, bufferCount, bufferSize), 7);
+        CGA_ASSERT(text == readAll(ra));
+    }
+
+    void testRoundTrip(const string& text)
+    {
+        const char* fns[] = { "test.gz", "test.bz2" };
+        for(size_t ii=0; ii<2; ii++)
+        {
+            {
+                boost::shared_ptr<std::ostream> out =
+                    OutputStream::openCompressedOutputStreamByExtension(fns[ii]);
+                out->write(text.data(), text.size());
+            }
+            ReadAheadSource::ENABLED = true;
+            boost::shared_ptr<std::istream> in =
+                InputStream::openCompressedInputStreamByExtension(fns[ii]);
+            CGA_ASSERT(text == readAll(*in));
+            ReadAheadSource::ENABLED = false;
+        }
+    }
+
+    void testTruncated(const string& text)
+    {
+        {
+            boost::shared_ptr<std::ostream> out =
+                OutputStream::openCompressedOutputStreamByExtension("test.gz");
+            out->write(text.data(), text.size());
+        }
+        string gz;
+        {
+            std::ifstream in("test.gz", ios::binary);
+            gz = readAll(in);
+        }
+        {
+            std::ofstream out("test.gz", ios::binary);
+            out.write(gz.data(), gz.size()/2);
+        }
+
+        ReadAheadSource::ENABLED = true;
+        bool threw = false;
+        try
+        {
+            boost::shared_ptr<std::istream> in =
+                InputStream::openCompressedInputStreamByExtension("test.gz");
+            string line;
+            while (std::getline(*in, line))
+                ;
+        }
+        catch(std::exception&)
+        {
+            threw = true;
+        }
+        ReadAheadSource::ENABLED = false;
+        CGA_ASSERT(threw);
+    }
+
+    void testEarlyClose(const string& text)
+    {
+        // Closing before the reader has drained the ring must stop the
+        // read-ahead thread.
+        boost::shared_ptr<std::istream> in(new istringstream(text));
+        boost::iostreams::filtering_istream ra;
+        ra.push(ReadAheadSource(in, 2, 16));
+        string line;
+        std::getline(ra, line);
+        CGA_ASSERT("0\tchr0\t0\tACGT" == line);
+        ra.reset();
+    }
+}
+
+int TestReadAheadSource(int argc, char* argv[])
+{
+    string text = makeText(100*1000);
+
+    testSource("", 8, 1024);
+    testSource("a\n", 8, 1024);
+    testSource(text, 8, 256*1024);
+    testSource(makeText(1000), 2, 1);
+    testSource(text, 3, 1000);
+
+    testRoundTrip("");
+    testRoundTrip(text);
+    testTruncated(text);
+    testEarlyClose(text);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/util/ThreadPool.hpp"
+#include "cgatools/util/Exception.hpp"
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+
+using namespace std;
+using cgatools::util::Exception;
+using cgatools::util::ThreadPool;
+
+namespace {
+    void square(vector<size_t>& out, size_t offset)
+    {
+        out[offset] = offset*offset;
+    }
+
+    void failOn(size_t badOffset, size_t offset)
+    {
+        if (offset == badOffset)
+            throw Exception("bad offset");
+    }
+}
+
+int TestThreadPool(int argc, char* argv[])
+{
+    for(size_t threadCount=0; threadCount<=4; threadCount++)
+    {
+        ThreadPool pool(threadCount);
+        for(size_t batch=0; batch<10; batch++)
+        {
+            vector<size_t> out(1000+batch, 0);
+            pool.parallelFor(out.size(), boost::bind(&square, boost::ref(out), _1));
+            for(size_t ii=0; ii<out.size(); ii++)
+                CGA_ASSERT(ii*ii == out[ii]);
+        }
+
+        bool caught = false;
+        try
+        {
+            pool.parallelFor(100, boost::bind(&failOn, 17, _1));
+        }
+        catch(std::exception& ee)
+        {
+            caught = true;
+            CGA_ASSERT(string("bad offset") == ee.what());
+        }
+        CGA_ASSERT(caught);
+
+        // The pool is still usable after a failed batch.
+        vector<size_t> out(10, 0);
+        pool.parallelFor(out.size(), boost::bind(&square, boost::ref(out), _1));
+        CGA_ASSERT(81 == out[9]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/util/Streams.hpp"
+#include "cgatools/util/WriteBehindSink.hpp"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace cgatools::util;
+
+namespace {
+    string readFile(const string& fn)
+    {
+        boost::shared_ptr<std::istream> in = InputStream::openCompressedInputStreamByExtension(fn);
+        ostringstream result;
+        result << in->rdbuf();
+        return result.str();
+    }
+
+    // Writes lineCount short records, as SAM and VCF writers do, and
+    // returns what was written.
+    string writeFile(const string& fn, size_t lineCount)
+    {
+        ostringstream expected;
+        boost::shared_ptr<std::ostream> out = OutputStream::openCompressedOutputStreamByExtension(fn);
+        CGA_ASSERT(0 != dynamic_cast<WriteBehindOutputStream*>(out.get()));
+        for(size_t ii=0; ii<lineCount; ii++)
+        {
+            *out << ii << '\t' << "chr" << ii % 23 << '\t' << ii*7919 << '\n';
+            expected << ii << '\t' << "chr" << ii % 23 << '\t' << ii*7919 << '\n';
+        }
+        out.reset();
+        return expected.str();
+    }
+
+    void testRoundTrip(size_t bufferSize, size_t lineCount)
+    {
+        WriteBehindSink::ENABLED = true;
+        WriteBehindSink::BUFFER_SIZE = bufferSize;
+        const char* fns[] = { "test.tsv", "test.tsv.gz", "test.tsv.bz2" };
+        for(size_t ii=0; ii<3; ii++)
+        {
+            string expected = writeFile(fns[ii], lineCount);
+            CGA_ASSERT(expected == readFile(fns[ii]));
+        }
+        WriteBehindSink::ENABLED = false;
+        WriteBehindSink::BUFFER_SIZE = 1024*1024;
+    }
+
+    void testWriteError()
+    {
+        // Writes to /dev/full fail with ENOSPC on the background
+        // thread; the error must reach the writer.
+        boost::shared_ptr<boost::iostreams::filtering_ostream> full(
+            new boost::iostreams::filtering_ostream());
+        full->push(FileSinkDevice("/dev/full"));
+        full->exceptions(std::ios::badbit | std::ios::failbit);
+
+        bool threw = false;
+        try
+        {
+            boost::iostreams::filtering_ostream out;
+            out.exceptions(std::ios::badbit | std::ios::failbit);
+            out.push(WriteBehindSink(full, 100, 2));
+            for(size_t ii=0; ii<100*1000; ii++)
+                out << ii << '\n';
+            out.reset();
+        }
+        catch(std::exception&)
+        {
+            threw = true;
+        }
+        CGA_ASSERT(threw);
+    }
+
+    bool throws(WriteBehindSink& sink, bool close)
+    {
+        try
+        {
+            if (close)
+                sink.close();
+            else
+                sink.write("x\n", 2);
+        }
+        catch(std::exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    void testStickyError()
+    {
+        // Once a write fails, the data queued after it is lost, so
+        // every later write and close must fail, even after the caller
+        // caught the first error.
+        boost::shared_ptr<boost::iostreams::filtering_ostream> full(
+            new boost::iostreams::filtering_ostream());
+        full->push(FileSinkDevice("/dev/full"));
+        full->exceptions(std::ios::badbit | std::ios::failbit);
+
+        WriteBehindSink sink(full, 100, 2);
+        size_t writeCount = 0;
+        while (!throws(sink, false))
+            CGA_ASSERT(++writeCount < 100*1000);
+        CGA_ASSERT(throws(sink, false));
+        CGA_ASSERT(throws(sink, true));
+        CGA_ASSERT(throws(sink, true));
+        CGA_ASSERT(throws(sink, false));
+    }
+}
+
+int TestWriteBehindSink(int argc, char* argv[])
+{
+    testRoundTrip(1024*1024, 0);
+    testRoundTrip(1024*1024, 100*1000);
+    testRoundTrip(1, 1000);
+    testRoundTrip(1000, 100*1000);
+#ifndef CGA_USE_WIN_API
+    testWriteError();
+    testStickyError();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/variants/CallDiffResult.hpp"
+#include "cgatools/variants/PhasedHypothesis.hpp"
+#include "cgatools/variants/SuperlocusIterator.hpp"
+#include "cgatools/variants/VariantFileIterator.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace std;
+using namespace cgatools::reference;
+using namespace cgatools::variants;
+
+namespace pt = boost::posix_time;
+
+// Reports the time calldiff takes to build the phased hypotheses of
+// the superloci of two var files, and to find their best phasing,
+// given the reference crr file and the two var files after the data
+// and output directories. Each superlocus is processed repeatCount
+// times (default 1), to scale the small smoketest files up. The
+// counts of the hypotheses and of the match types found are reported,
+// to check that an optimization keeps the results.
+int BenchCallDiff(int argc, char* argv[])
+{
+    if (argc < 6)
+    {
+        cerr << "usage: BenchCallDiff dataDir outputDir crr varFileA varFileB "
+             << "[maxHypothesisCount [repeatCount]]" << endl;
+        return 1;
+    }
+    CrrFile crr(argv[3]);
+    size_t maxHypothesisCount = argc > 6 ? size_t(atoi(argv[6])) : 32;
+    size_t repeatCount = argc > 7 ? size_t(atoi(argv[7])) : 1;
+
+    VariantFileIterator locItA(crr), locItB(crr);
+    locItA.open(argv[4]);
+    locItB.open(argv[5]);
+    SuperlocusIterator slIt;
+    slIt.setVariantFiles(locItA, locItB);
+
+    vector<size_t> matchTypeCounts(cdmt::MATCH_TYPE_LAST);
+    size_t slCount = 0, hypothesisCount = 0;
+    double buildSeconds = 0, seconds = 0;
+    vector< vector<PhasedHypothesis> > hypotheses;
+    for(slIt.seekFirst(); !slIt.eof(); ++slIt)
+    {
+        slCount++;
+        pt::ptime start = pt::microsec_clock::universal_time();
+        for(size_t ii=0; ii<repeatCount; ii++)
+            slIt->buildPhasedHypotheses(hypotheses, maxHypothesisCount, true);
+        buildSeconds += (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+        hypothesisCount += hypotheses[0].size() + hypotheses[1].size();
+
+        start = pt::microsec_clock::universal_time();
+        CallDiffResult dr;
+        for(size_t ii=0; ii<repeatCount; ii++)
+        {
+            dr = CallDiffResult();
+            PhasedHypothesis::findBestDiff(*slIt, maxHypothesisCount,
+                                           hypotheses[0], hypotheses[1], crr, dr);
+        }
+        seconds += (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+        for(size_t ii=0; ii<dr.matchType_.size(); ii++)
+            matchTypeCounts[dr.matchType_[ii]]++;
+    }
+
+    cout << slCount << " superloci\t" << hypothesisCount << " hypotheses" << endl;
+    cout << "build\t" << buildSeconds << " s\t"
+         << (buildSeconds > 0 ? slCount * repeatCount / buildSeconds : 0.0) << " superloci/s" << endl;
+    cout << "diff\t" << seconds << " s\t"
+         << (seconds > 0 ? slCount * repeatCount / seconds : 0.0) << " superloci/s" << endl;
+    for(size_t ii=0; ii<matchTypeCounts.size(); ii++)
+    {
+        cout << CallDiffResult::getMatchTypeString(cdmt::MatchType(ii)) << "\t"
+             << matchTypeCounts[ii] << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Copyright 2010 Complete Genomics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "cgatools/core.hpp"
+#include "cgatools/reference/CrrFile.hpp"
+#include "cgatools/util/Exception.hpp"
+#include "cgatools/variants/VariantBinaryFile.hpp"
+#include "cgatools/variants/VariantFileIterator.hpp"
+
+#include <iostream>
+#include <string>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace std;
+using namespace cgatools::reference;
+using namespace cgatools::variants;
+
+namespace pt = boost::posix_time;
+
+namespace {
+    // Reads every locus of fn, and returns the number of calls.
+    size_t load(const CrrFile& crr, const string& fn, const char* name)
+    {
+        pt::ptime start = pt::microsec_clock::universal_time();
+        VariantFileIterator vf(crr);
+        vf.open(fn);
+        size_t lociCount = 0, callCount = 0;
+        for(; !vf.eof(); ++vf)
+        {
+            lociCount++;
+            callCount += vf->getCalls().size();
+        }
+        double seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+        cout << name << "\t" << lociCount << " loci\t" << seconds << " s\t"
+             << (seconds > 0 ? lociCount / seconds : 0.0) << " loci/s" << endl;
+        return callCount;
+    }
+}
+
+// Reports the time to load a var or masterVar file, given as the
+// reference crr file and the var file after the data and output
+// directories, and the time to load its var2bin conversion.
+int BenchVariantBinaryFile(int argc, char* argv[])
+{
+    if (argc < 5)
+    {
+        cerr << "usage: BenchVariantBinaryFile dataDir outputDir crr varFile" << endl;
+        return 1;
+    }
+    CrrFile crr(argv[3]);
+    string binFn = string(argv[2]) + "/bench.bin";
+    {
+        VariantFileIterator vf(crr);
+        vf.open(argv[4]);
+        VariantBinaryFileWriter out(binFn, crr, vf);
+        for(; !vf.eof(); ++vf)
+            out.write(*vf);
+        out.close();
+    }
+
+    size_t tsvCalls = load(crr, argv[4], "tsv");
+    size_t binCalls = load(crr, binFn, "var2bin");
+    CGA_ASSERT(tsvCalls == binCalls);
+    return 0;
+}
@@ -29,6 +29,7 @@ cgatoolsapitest = sys.argv[4]
 #####################################################################
 
 from os.path import join as pjoin
+import filecmp
 import shutil
 
 ref9719767_9721767 = """
@@ -174,6 +175,7 @@ def generateReference(file,name,nocallsBefore,sequence,nocallsAfter=0):
 refFileName = pjoin(odir, 'TestRef.fa')
 refFa = open(refFileName,"w")
 generateReference(refFa,'chr21', 9719767, ref9719767_9721767, 1000)
+generateReference(refFa,'chr22', 9719767, ref9719767_9721767, 1000)
 refFa.close()
 
 expDirName = 'GS19240-180-36-21-ASM'
@@ -202,18 +204,63 @@ tc.runCommand([ cgatools, 'fasta2crr',
                 '--input='+pjoin(odir, 'TestRef.fa'),
                 '--output='+pjoin(odir, 'TestRef.crr') ])
 
-tc.runCommand( [ cgatools, 'evidence2cache',
-                 '--beta',
-                 '--genome-root='+pjoin(idir, expRootDir),
-                 '--output='+pjoin(odir, 'evidenceCache'),
-                 '--extract-genomic-region=chr21',
-                 '--reference='+pjoin(odir, 'TestRef.crr'),
-                 ] )
+# The records of the binary cache file must be those of the text
+# cache file written by earlier versions, sorted by DnbOffsetInLaneFile.
+def readTextCache(fn):
+    records = []
+    for line in open(fn):
+        if line.startswith('#') or line.startswith('>') or '' == line.strip():
+            continue
+        records.append(line.rstrip('\n').split('\t'))
+    records.sort(key=lambda fields: int(fields[0]))
+    return records
 
+def compareCache(expected, cacheDir):
+    actual = tc.getCommandStdout([ cgatoolsapitest, 'DumpEvidenceCache',
+                                   pjoin(odir, 'TestRef.crr'),
+                                   pjoin(cacheDir, 'chr21', 'GS10364-FS3-L04_5.bin') ])
+    actual = [ line.split('\t') for line in actual.splitlines() ]
+    if len(expected) != len(actual):
+        raise Exception('record count mismatch: %d != %d' % (len(expected), len(actual)))
+    for (ee, aa) in zip(expected, actual):
+        if ee[:-1] != aa[:-1] or abs(float(ee[-1]) - float(aa[-1])) > 1e-5 * abs(float(ee[-1])):
+            raise Exception('record mismatch:\n%s\n%s' % ('\t'.join(ee), '\t'.join(aa)))
 
-tc.textCompare(pjoin(inputDir,'GS10364-FS3-L04_5.tsv'),
-               pjoin(odir, 'evidenceCache','chr21','GS10364-FS3-L04_5.tsv'),
-               [ '#GENERATED_AT\t', 
-                 '#SOFTWARE_VERSION\t',
-               ] )
+expected = readTextCache(pjoin(inputDir,'GS10364-FS3-L04_5.tsv'))
+for sortMemory in [ [], [ '--sort-memory=0' ] ]:
+    cacheDir = pjoin(odir, 'evidenceCache'+str(len(sortMemory)))
+    tc.runCommand( [ cgatools, 'evidence2cache',
+                     '--beta',
+                     '--genome-root='+pjoin(idir, expRootDir),
+                     '--output='+cacheDir,
+                     '--extract-genomic-region=chr21',
+                     '--reference='+pjoin(odir, 'TestRef.crr'),
+                     ] + sortMemory )
+    compareCache(expected, cacheDir)
+    if [ 'GS10364-FS3-L04_5.bin' ] != os.listdir(pjoin(cacheDir, 'chr21')):
+        raise Exception('unexpected files: '+' '.join(os.listdir(pjoin(cacheDir, 'chr21'))))
 
+# Processing several chromosomes at a time must give the same cache as
+# processing one at a time. The evidence of chr22 is a copy of chr21.
+for fn in [ 'evidenceIntervals', 'evidenceDnbs' ]:
+    src = pjoin(evidenceDir, fn+'-chr21-GS19240-180-36-21-ASM.tsv')
+    dst = pjoin(evidenceDir, fn+'-chr22-GS19240-180-36-21-ASM.tsv')
+    open(dst, 'w').write(open(src).read().replace('chr21', 'chr22'))
+
+cacheDirs = []
+for flags in [ [ '--threads=1' ], [ '--threads=2' ], [ '--threads=2', '--sort-memory=0' ] ]:
+    cacheDir = pjoin(odir, 'evidenceCacheThreads'+str(len(cacheDirs)))
+    tc.runCommand( [ cgatools, 'evidence2cache',
+                     '--beta',
+                     '--genome-root='+pjoin(idir, expRootDir),
+                     '--output='+cacheDir,
+                     '--extract-genomic-region=chr21',
+                     '--extract-genomic-region=chr22',
+                     '--reference='+pjoin(odir, 'TestRef.crr'),
+                     ] + flags )
+    cacheDirs.append(cacheDir)
+for chrName in [ 'chr21', 'chr22' ]:
+    fn = pjoin(chrName, 'GS10364-FS3-L04_5.bin')
+    for cacheDir in cacheDirs[1:]:
+        if not filecmp.cmp(pjoin(cacheDirs[0], fn), pjoin(cacheDir, fn), False):
+            raise Exception('compare failed: %s %s' % (pjoin(cacheDirs[0], fn), pjoin(cacheDir, fn)))
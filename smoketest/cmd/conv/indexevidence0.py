@@ -0,0 +1,139 @@
+#! /usr/bin/env python
+
+# Copyright 2010 Complete Genomics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you
+# may not use this file except in compliance with the License. You
+# may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+
+
+import os,sys
+sys.path = [ os.path.dirname(os.path.dirname(sys.argv[0])) ] + sys.path
+from tutil import tucore as tc
+
+idir = sys.argv[1]
+odir = sys.argv[2]
+cgatools = sys.argv[3]
+cgatoolsapitest = sys.argv[4]
+
+#####################################################################
+
+from os.path import join as pjoin
+
+fn = 'evidenceDnbs-chr22-male36_100.tsv'
+tc.runCommand([ cgatools, 'indexevidence',
+                '--beta',
+                '--block-size=2048',
+                '--input='+pjoin(idir, 'conv/evidence2sam0', fn),
+                '--output='+pjoin(odir, fn+'.gz') ])
+
+# The block-compressed file must decompress to the original.
+tc.textCompare(pjoin(idir, 'conv/evidence2sam0', fn), pjoin(odir, fn+'.gz'))
+
+# The index must list ordered blocks covering the compressed file.
+meta = tc.readMetadataHeader(pjoin(odir, fn+'.gz.idx'))
+if int(meta.get('COMPRESSED_SIZE')) != os.path.getsize(pjoin(odir, fn+'.gz')):
+    raise Exception('index compressed size mismatch')
+blocks = []
+for line in open(pjoin(odir, fn+'.gz.idx')):
+    if line.startswith('#') or line.startswith('>') or '' == line.strip():
+        continue
+    blocks.append([ int(field) for field in line.split('\t') ])
+if len(blocks) < 2:
+    raise Exception('expected several blocks, found %d' % len(blocks))
+if blocks != sorted(blocks):
+    raise Exception('index blocks out of order')
+
+# Annotating variants with evidence read counts must give the same
+# output with indexed evidence as with the original. The variants are
+# at every tenth interval, so that seeks in both evidence files jump
+# over blocks and land in the middle of a block.
+tc.runCommand([ cgatools, 'fasta2crr',
+                '--input='+pjoin(idir, 'conv/evidence2sam0/TestRef.fa'),
+                '--output='+pjoin(odir, 'TestRef.crr') ])
+ref = ''.join([ line.strip() for line in open(pjoin(idir, 'conv/evidence2sam0/TestRef.fa'))
+                if not line.startswith('>') ])
+
+intervals = [ '#ASSEMBLY_ID\tTEST\n', '#CHROMOSOME\tchr22\n', '#FORMAT_VERSION\t1.3\n',
+              '#TYPE\tEVIDENCE-INTERVALS\n', '\n',
+              '>IntervalId\tChromosome\tOffsetInChromosome\tLength\tPloidy\tAlleleIndexes\t'
+              'Score\tAllele0\tAllele1\tAllele2\tAllele1Alignment\tAllele2Alignment\n' ]
+dnbs = [ '#ASSEMBLY_ID\tTEST\n', '#CHROMOSOME\tchr22\n', '#FORMAT_VERSION\t1.1\n',
+         '#TYPE\tEVIDENCE-DNBS\n', '\n',
+         '>IntervalId\tChromosome\tSlide\tLane\tFileNumInLane\tDnbOffsetInLaneFile\t'
+         'AlleleIndex\tSide\tStrand\tOffsetInAllele\tAlleleAlignment\tOffsetInReference\t'
+         'ReferenceAlignment\tMateOffsetInReference\tMateReferenceAlignment\tMappingQuality\t'
+         'ScoreAllele0\tScoreAllele1\tScoreAllele2\tSequence\tScores\n' ]
+var = [ '#ASSEMBLY_ID\tTEST\n', '#TYPE\tVAR-ANNOTATION\n', '\n',
+        '>locus\tploidy\thaplotype\tchromosome\tbegin\tend\tvarType\treference\t'
+        'alleleSeq\ttotalScore\thapLink\txRef\n' ]
+locus = 1
+varEnd = 0
+for ii in range(200):
+    pos = 1000 + 150*ii
+    alt = 'C' if 'A' == ref[pos] else 'A'
+    intervals.append('%d\tchr22\t%d\t11\t2\t0;1\t100\t%s\t%s\t\t11M\t\n' %
+                     (ii, pos-5, ref[pos-5:pos+6], ref[pos-5:pos]+alt+ref[pos+1:pos+6]))
+    for kk in range(4):
+        dnbs.append('%d\tchr22\tGS00000-FS3\tL01\t1\t%d\t%d\tL\t+\t0\t5M2B10M0N10M6N10M\t%d\t'
+                    '5M2B10M0N10M6N10M\t%d\t10M6N10M0N10M2B5M\tZ\t%d\t%d\t0\t%s\t%s\n' %
+                    (ii, 4*ii+kk, kk%2, pos-20+3*kk, pos+300,
+                     [ 40, 5 ][kk%2], [ 5, 40 ][kk%2], 'A'*70, '5'*70))
+    if 5 != ii % 10:
+        continue
+    var.append('%d\t2\tall\tchr22\t%d\t%d\tref\t=\t=\t\t\t\n' % (locus, varEnd, pos))
+    var.append('%d\t2\t1\tchr22\t%d\t%d\tref\t%s\t%s\t100\t\t\n' %
+               (locus+1, pos, pos+1, ref[pos], ref[pos]))
+    var.append('%d\t2\t2\tchr22\t%d\t%d\tsnp\t%s\t%s\t100\t\t\n' %
+               (locus+1, pos, pos+1, ref[pos], alt))
+    locus += 2
+    varEnd = pos+1
+var.append('%d\t2\tall\tchr22\t%d\t%d\tref\t=\t=\t\t\t\n' % (locus, varEnd, len(ref)))
+
+outputs = []
+for indexed in [ False, True ]:
+    genomeDir = pjoin(odir, 'genome-'+str(len(outputs)))
+    os.makedirs(pjoin(genomeDir, 'ASM', 'EVIDENCE'))
+    ff = open(pjoin(genomeDir, 'ASM', 'var-TEST.tsv'), 'w')
+    ff.writelines(var)
+    ff.close()
+    for (prefix, lines, blockSize) in [ ('evidenceIntervals', intervals, 256),
+                                        ('evidenceDnbs', dnbs, 2048) ]:
+        fn = pjoin(genomeDir, 'ASM', 'EVIDENCE', prefix+'-chr22-TEST.tsv')
+        ff = open(fn, 'w')
+        ff.writelines(lines)
+        ff.close()
+        if indexed:
+            tc.runCommand([ cgatools, 'indexevidence',
+                            '--beta',
+                            '--block-size='+str(blockSize),
+                            '--input='+fn,
+                            '--output='+fn+'.gz' ])
+            os.remove(fn)
+    outputs.append(pjoin(odir, 'mastervar-'+str(len(outputs))+'.tsv'))
+    tc.runCommand([ cgatools, 'generatemastervar',
+                    '--beta',
+                    '--reference='+pjoin(odir, 'TestRef.crr'),
+                    '--variants='+pjoin(genomeDir, 'ASM', 'var-TEST.tsv'),
+                    '--genome-root='+genomeDir,
+                    '--annotations=evidence',
+                    '--output='+outputs[-1] ])
+tc.textCompare(outputs[0], outputs[1], ignorePrefixes=['#GENERATED_AT'])
+
+# The read counts must come from the evidence: the four DNBs of the
+# interval of each variant.
+counted = 0
+for line in open(outputs[0]):
+    fields = line.rstrip('\n').split('\t')
+    if len(fields) > 5 and '' != fields[-5] and '4' == fields[-1]:
+        counted += 1
+if 20 != counted:
+    raise Exception('expected read counts for 20 variants, found %d' % counted)
@@ -59,3 +59,34 @@ tc.runCommand( [ cgatools, 'map2sam',
 tc.textCompare(pjoin(idir, 'conv/map2sam0/GS10364-FS3-L01_001.sam'),
                pjoin(odir, 'GS10364-FS3-L01_001.sam'),
                [ '@PG\tID:cgatools\t','@SQ\tSN:' ])
+
+# The output does not depend on the number of threads.
+tc.runCommand( [ cgatools, 'map2sam',
+                 '--reads='+readsFile,
+                 '--mappings='+mappingsFile,
+                 '--genome-root='+pjoin(odir, expDirName, 'GS00028-DNA_C01'),
+                 '--reference='+pjoin(odir, 'TestRef.crr'),
+                 '--output='+pjoin(odir, 'GS10364-FS3-L01_001-threads.sam'),
+                 '--threads=3',
+                 '--cgi-bam-caveat-acknowledgement'
+                 ] )
+
+tc.textCompare(pjoin(idir, 'conv/map2sam0/GS10364-FS3-L01_001.sam'),
+               pjoin(odir, 'GS10364-FS3-L01_001-threads.sam'),
+               [ '@PG\tID:cgatools\t','@SQ\tSN:' ])
+
+# Sorted by coordinate. TestSamSorter covers the temporary runs.
+tc.runCommand( [ cgatools, 'map2sam',
+                 '--reads='+readsFile,
+                 '--mappings='+mappingsFile,
+                 '--genome-root='+pjoin(odir, expDirName, 'GS00028-DNA_C01'),
+                 '--reference='+pjoin(odir, 'TestRef.crr'),
+                 '--output='+pjoin(odir, 'GS10364-FS3-L01_001-sorted.sam'),
+                 '--sort-output',
+                 '--sort-temp-dir='+odir,
+                 '--cgi-bam-caveat-acknowledgement'
+                 ] )
+
+tc.textCompare(pjoin(idir, 'conv/map2sam0/GS10364-FS3-L01_001-sorted.sam'),
+               pjoin(odir, 'GS10364-FS3-L01_001-sorted.sam'),
+               [ '@PG\tID:cgatools\t','@SQ\tSN:' ])
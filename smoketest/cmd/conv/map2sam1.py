@@ -0,0 +1,161 @@
+#! /usr/bin/env python
+
+# Copyright 2010 Complete Genomics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you
+# may not use this file except in compliance with the License. You
+# may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+
+
+import os,sys
+sys.path = [ os.path.dirname(os.path.dirname(sys.argv[0])) ] + sys.path
+from tutil import tucore as tc
+
+idir = sys.argv[1]
+odir = sys.argv[2]
+cgatools = sys.argv[3]
+cgatoolsapitest = sys.argv[4]
+
+#####################################################################
+# END BOILERPLATE
+#####################################################################
+
+from os.path import join as pjoin
+import shutil
+import gzip
+import struct
+
+#os.system(command)
+expDirName = 'GS19240-180-36-21-ASM'
+shutil.rmtree(pjoin(odir, expDirName), True)
+tc.copytree(pjoin(idir, 'common', expDirName),pjoin(odir, expDirName))
+readsFile = pjoin(odir, expDirName, 'GS00028-DNA_C01','MAP','GS10364-FS3-L01','reads_GS10364-FS3-L01_001.tsv')
+mappingsFile = pjoin(odir, expDirName, 'GS00028-DNA_C01','MAP','GS10364-FS3-L01','mapping_GS10364-FS3-L01_001.tsv') 
+shutil.copy(pjoin(idir, 'conv','map2sam0','reads_GS10364-FS3-L01_001.tsv'), readsFile)
+shutil.copy(pjoin(idir, 'conv','map2sam0','mapping_GS10364-FS3-L01_001.tsv'), mappingsFile)
+
+tc.runCommand([ cgatools, 'fasta2crr',
+                '--input='+pjoin(idir, 'conv','map2sam0','TestRef.fa'),
+                '--output='+pjoin(odir, 'TestRef.crr'),
+                '--circular=chrM',
+                ])
+
+CIGAR_OPS = 'MIDNSHP=X'
+SEQ_CODES = '=ACMGRSVTWYHKDBN'
+INT_TAG_FORMATS = { 'c':'<b', 'C':'<B', 's':'<h', 'S':'<H', 'i':'<i', 'I':'<I' }
+
+def readBam(fn):
+    '''Decodes a BAM file into SAM text lines, writing integer tags
+    with type I as cgatools does.'''
+    ff = gzip.open(fn, 'rb')
+    data = ff.read()
+    ff.close()
+    if data[0:4] != b'BAM\x01':
+        raise Exception('bad BAM magic: '+fn)
+    (lText,) = struct.unpack('<i', data[4:8])
+    lines = data[8:8+lText].decode('ascii').rstrip('\n').split('\n')
+    offset = 8+lText
+    (nRef,) = struct.unpack('<i', data[offset:offset+4])
+    offset += 4
+    refs = []
+    for ii in range(nRef):
+        (lName,) = struct.unpack('<i', data[offset:offset+4])
+        refs.append(data[offset+4:offset+4+lName-1].decode('ascii'))
+        offset += 4+lName+4
+    def refName(refId):
+        if refId < 0:
+            return '*'
+        return refs[refId]
+    while offset < len(data):
+        (blockSize, refId, pos, lName, mapq, bin, nCigar, flag, lSeq,
+         nextRefId, nextPos, tlen) = struct.unpack('<iiiBBHHHiiii', data[offset:offset+36])
+        end = offset+4+blockSize
+        pp = offset+36
+        name = data[pp:pp+lName-1].decode('ascii')
+        pp += lName
+        cigar = ''
+        for ii in range(nCigar):
+            (op,) = struct.unpack('<I', data[pp:pp+4])
+            cigar += '%d%s' % (op >> 4, CIGAR_OPS[op & 15])
+            pp += 4
+        seq = ''
+        for ii in range(lSeq):
+            code = struct.unpack('B', data[pp+ii//2:pp+ii//2+1])[0]
+            seq += SEQ_CODES[(code >> 4) if 0 == ii % 2 else (code & 15)]
+        pp += (lSeq+1)//2
+        qual = ''.join([ chr(q+33) for q in struct.unpack('%dB' % lSeq, data[pp:pp+lSeq]) ])
+        pp += lSeq
+        tags = []
+        while pp < end:
+            tag = data[pp:pp+2].decode('ascii')
+            type = data[pp+2:pp+3].decode('ascii')
+            pp += 3
+            if 'Z' == type:
+                zz = data.index(b'\x00', pp)
+                tags.append('%s:Z:%s' % (tag, data[pp:zz].decode('ascii')))
+                pp = zz+1
+            else:
+                fmt = INT_TAG_FORMATS[type]
+                size = struct.calcsize(fmt)
+                (val,) = struct.unpack(fmt, data[pp:pp+size])
+                tags.append('%s:I:%d' % (tag, val))
+                pp += size
+        if refId == nextRefId and nextRefId >= 0:
+            mrnm = '='
+        else:
+            mrnm = refName(nextRefId)
+        fields = [ name, str(flag), refName(refId), str(pos+1), str(mapq),
+                   cigar or '*', mrnm, str(nextPos+1), str(tlen), seq, qual ] + tags
+        lines.append('\t'.join(fields))
+        offset = end
+    return lines
+
+def normalizeSam(line):
+    '''BAM stores the mate reference as an index, so a mate reference
+    name equal to RNAME is decoded as "=".'''
+    if line.startswith('@'):
+        return line
+    fields = line.split('\t')
+    if fields[6] == fields[2] and fields[2] != '*':
+        fields[6] = '='
+    if fields[6] == '=' and fields[2] == '*':
+        fields[6] = '*'
+    return '\t'.join(fields)
+
+def bamCompare(samFn, bamFn):
+    ff = open(samFn)
+    sam = [ normalizeSam(line.rstrip('\n')) for line in ff if not line.startswith('@PG') ]
+    ff.close()
+    bam = [ line for line in readBam(bamFn) if not line.startswith('@PG') ]
+    if sam != bam:
+        for (ii, (ll1, ll2)) in enumerate(zip(sam, bam)):
+            if ll1 != ll2:
+                raise Exception('%s:%d: BAM record differs from SAM:\n%s\n%s' %
+                                (bamFn, ii+1, ll1, ll2))
+        raise Exception('%s: %d lines, expected %d' % (bamFn, len(bam), len(sam)))
+
+for threads in [ '1', '3' ]:
+    samFn = pjoin(odir, 'GS10364-FS3-L01_001.sam')
+    bamFn = pjoin(odir, 'GS10364-FS3-L01_001-%s.bam' % threads)
+    for (fn, format) in [ (samFn, 'sam'), (bamFn, 'bam') ]:
+        tc.runCommand( [ cgatools, 'map2sam',
+                         '--reads='+readsFile,
+                         '--mappings='+mappingsFile,
+                         '--genome-root='+pjoin(odir, expDirName, 'GS00028-DNA_C01'),
+                         '--reference='+pjoin(odir, 'TestRef.crr'),
+                         '--output='+fn,
+                         '--output-format='+format,
+                         '--compression-threads='+threads,
+                         '--mate-sv-candidates',
+                         '--add-mate-sequence',
+                         '--cgi-bam-caveat-acknowledgement'
+                         ] )
+    bamCompare(samFn, bamFn)
@@ -56,5 +56,86 @@ for always in [ True,False ]:
             print 'compared failed: ',p1,p2
             errors.append(fn)
 
+# Streaming join of position-sorted files must match the in-memory
+# join. The files are sorted by chromosome in the order of the
+# reference, as Complete Genomics files are, so chrM follows chrY.
+chromosomes = [ 'chr1', 'chr2', 'chr9', 'chr10', 'chrX', 'chrY', 'chrM' ]
+ff = open(pjoin(odir, 'JoinRef.fa'), 'w')
+for chromosome in chromosomes:
+    ff.write('>'+chromosome+'\n'+'ACGT'*25+'\n')
+ff.close()
+tc.runCommand([ cgatools, 'fasta2crr',
+                '--input='+pjoin(odir, 'JoinRef.fa'),
+                '--output='+pjoin(odir, 'JoinRef.crr') ])
+
+def writeSorted(src, dst, chrCol, beginCol, rename = {}):
+    header = []
+    records = []
+    for line in open(src):
+        if line.startswith('#') or line.startswith('>') or 0 == len(header) or \
+                '' == line.strip():
+            header.append(line)
+            continue
+        fields = line.split('\t')
+        fields[chrCol] = rename.get(fields[chrCol], fields[chrCol])
+        records.append('\t'.join(fields))
+    records.sort(key=lambda line: (chromosomes.index(line.split('\t')[chrCol]),
+                                   int(line.split('\t')[beginCol])))
+    ff = open(dst, 'w')
+    ff.writelines(header + records)
+    ff.close()
+
+renames = { 'sorted' : { },
+            'natural' : { 'chr1' : 'chr9', 'chr2' : 'chr10' },
+            'cg' : { 'chr1' : 'chrY', 'chr2' : 'chrM' } }
+for name in renames:
+    writeSorted(pjoin(idir, 'misc', 'join0', 'var.tsv'), pjoin(odir, 'var-'+name+'.tsv'),
+                3, 4, renames[name])
+    writeSorted(pjoin(idir, 'misc', 'join0', 'ann.tsv'), pjoin(odir, 'ann-'+name+'.tsv'),
+                0, 1, renames[name])
+for oMode in [ 'full','compact', 'compact-pct' ]:
+    for name in [ 'sorted', 'natural', 'cg' ]:
+        fns = []
+        for sortedFlags in [ [], [ '--sorted-input',
+                                   '--reference='+pjoin(odir, 'JoinRef.crr') ] ]:
+            fn = 'join-'+name+'-'+oMode+'-'+str(len(fns))+'.tsv'
+            tc.runCommand([ cgatools, 'join',
+                            '--beta',
+                            '-m', oMode,
+                            '--match=chromosome:chromosome',
+                            '--overlap=begin,end:begin,end',
+                            '-a',
+                            pjoin(odir, 'var-'+name+'.tsv'),
+                            pjoin(odir, 'ann-'+name+'.tsv'),
+                            '--output='+pjoin(odir, fn) ] +
+                          sortedFlags)
+            fns.append(pjoin(odir, fn))
+        try:
+            tc.textCompare(fns[0], fns[1])
+        except:
+            print 'compared failed: ',fns[0],fns[1]
+            errors.append(fns[1])
+
+    # File B is read once, so it may be a pipe.
+    fn = 'join-sorted-'+oMode+'-pipe.tsv'
+    ff = open(pjoin(odir, fn), 'w')
+    ff.write(tc.getCommandStdout([ cgatools, 'join',
+                                   '--beta',
+                                   '-m', oMode,
+                                   '--match=chromosome:chromosome',
+                                   '--overlap=begin,end:begin,end',
+                                   '-a', '--sorted-input',
+                                   '--reference='+pjoin(odir, 'JoinRef.crr'),
+                                   pjoin(odir, 'var-sorted.tsv'),
+                                   '/dev/stdin' ],
+                                 open(pjoin(odir, 'ann-sorted.tsv')).read()))
+    ff.close()
+    expected = pjoin(odir, 'join-sorted-'+oMode+'-0.tsv')
+    try:
+        tc.textCompare(expected, pjoin(odir, fn))
+    except:
+        print 'compared failed: ',expected,pjoin(odir, fn)
+        errors.append(fn)
+
 if len(errors) > 0:
     raise Exception('errors: '+' '.join(errors))
@@ -57,3 +57,17 @@ tc.runCommand([ cgatools, 'calldiff',
 for key in reports.split(','):
     tc.textCompare(pjoin(idir, 'variants/calldiff0/cd-00-09-'+key+'.tsv'),
                    pjoin(odir, 'cd-00-09-'+key+'.tsv'))
+
+# The multi-threaded comparison must produce the same output.
+tc.runCommand([ cgatools, 'calldiff',
+                '--reference='+pjoin(odir, 'TestRef.crr'),
+                '--variantsA='+pjoin(idir, 'variants/var-00.tsv'),
+                '--variantsB='+pjoin(idir, 'variants/var-09.tsv'),
+                '--output-prefix='+pjoin(odir, 'cd-00-09-threads-'),
+                '--reports='+reports,
+                '--threads=4',
+                ])
+
+for key in reports.split(','):
+    tc.textCompare(pjoin(idir, 'variants/calldiff0/cd-00-09-'+key+'.tsv'),
+                   pjoin(odir, 'cd-00-09-threads-'+key+'.tsv'))
@@ -0,0 +1,138 @@
+#! /usr/bin/env python
+
+# Copyright 2010 Complete Genomics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you
+# may not use this file except in compliance with the License. You
+# may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+
+
+import os,sys
+sys.path = [ os.path.dirname(os.path.dirname(sys.argv[0])) ] + sys.path
+from tutil import tucore as tc
+
+idir = sys.argv[1]
+odir = sys.argv[2]
+cgatools = sys.argv[3]
+#####################################################################
+# END BOILERPLATE
+#####################################################################
+
+from os.path import join as pjoin
+
+tc.runCommand([ cgatools, 'fasta2crr',
+                '--input='+pjoin(idir, 'variants/TestRef.fa'),
+                '--output='+pjoin(odir, 'TestRef.crr') ])
+
+def doCompare(a, b):
+    tc.textCompare(a, b, ignorePrefixes=['#GENERATED_AT',
+                                         '#FORMAT_VERSION',
+                                         '#SOFTWARE_VERSION',
+                                         '#CGATOOLS_VERSION'])
+
+def varFilter(input, output, ranges):
+    tc.runCommand([ cgatools, 'varfilter',
+                    '--beta',
+                    '--reference='+pjoin(odir, 'TestRef.crr'),
+                    '--input='+input,
+                    '--output='+output,
+                    ] + [ '--range='+rr for rr in ranges ])
+
+def readLoci(fn):
+    loci = []
+    for line in open(fn):
+        if line.startswith('#') or line.startswith('>') or '' == line.strip():
+            continue
+        fields = line.split('\t')
+        if 0 == len(loci) or loci[-1][0] != fields[0]:
+            loci.append([ fields[0], [] ])
+        loci[-1][1].append(line)
+    return loci
+
+def intersects(fields, ranges):
+    for rr in ranges:
+        (chromosome, begin, end) = rr.split(',')
+        if fields[0] == chromosome and int(fields[1]) < int(end) and int(begin) < int(fields[2]):
+            return True
+    return False
+
+# Small blocks, so that seeks jump over several blocks. The indexed
+# file must decompress to the original, and copying regions of it
+# must give the loci of the original file intersecting the regions.
+ranges = [ 'chr1,620,640', 'chr1,1000,1300', 'chrM,20,40', 'chrM,16000,16571' ]
+for fn, chrColumn in [ ('var-13.tsv', 3), ('varcombine0/b-var-11.tsv', 2) ]:
+    name = os.path.basename(fn)
+    tc.runCommand([ cgatools, 'indexvar',
+                    '--beta',
+                    '--reference='+pjoin(odir, 'TestRef.crr'),
+                    '--input='+pjoin(idir, 'variants', fn),
+                    '--output='+pjoin(odir, name+'.gz'),
+                    '--block-size=64' ])
+    tc.textCompare(pjoin(idir, 'variants', fn), pjoin(odir, name+'.gz'))
+
+    varFilter(pjoin(idir, 'variants', fn), pjoin(odir, 'all-'+name), [])
+    varFilter(pjoin(idir, 'variants', fn), pjoin(odir, 'tsv-'+name), ranges)
+    varFilter(pjoin(odir, name+'.gz'), pjoin(odir, 'idx-'+name), ranges)
+    doCompare(pjoin(odir, 'idx-'+name), pjoin(odir, 'tsv-'+name))
+
+    expected = []
+    for (locus, lines) in readLoci(pjoin(odir, 'all-'+name)):
+        fields = [ line.split('\t')[chrColumn:chrColumn+3] for line in lines ]
+        extent = [ fields[0][0],
+                   min([ int(ff[1]) for ff in fields ]),
+                   max([ int(ff[2]) for ff in fields ]) ]
+        if intersects(extent, ranges):
+            expected.append(lines)
+    if expected != [ lines for (locus, lines) in readLoci(pjoin(odir, 'tsv-'+name)) ]:
+        raise Exception('unexpected loci in regions of '+name)
+
+# Testing variants in regions must give the rows of the full test in
+# these regions, with or without an index. In var-09-long.tsv, a
+# deletion makes a superlocus of chrM 5993 through 10269, so that
+# variants on both sides of it are tested after long seeks.
+ff = open(pjoin(odir, 'var-09-long.tsv'), 'w')
+for line in open(pjoin(idir, 'variants/var-09.tsv')):
+    if line.startswith('5088\t'):
+        line = '5088\t1\t1\tchrM\t5994\t10268\tdel\t=\t\t150\t\t\n'
+    ff.write(line)
+ff.close()
+ranges = [ 'chr1,1000,3000', 'chr1,6600,6700',
+           'chrM,5000,6000', 'chrM,10260,10400', 'chrM,13000,15000' ]
+for name in [ 'var-09.tsv', 'var-09-long.tsv' ]:
+    if 'var-09.tsv' == name:
+        input = pjoin(idir, 'variants', name)
+    else:
+        input = pjoin(odir, name)
+    tc.runCommand([ cgatools, 'indexvar',
+                    '--beta',
+                    '--reference='+pjoin(odir, 'TestRef.crr'),
+                    '--input='+input,
+                    '--output='+pjoin(odir, name+'.gz'),
+                    '--block-size=64' ])
+    outputs = []
+    for (variants, rangeFlags) in [ (input, []),
+                                    (input, [ '--range='+rr for rr in ranges ]),
+                                    (pjoin(odir, name+'.gz'), [ '--range='+rr for rr in ranges ]) ]:
+        fn = pjoin(odir, 'tested-'+str(len(outputs))+'-'+name)
+        tc.runCommand([ cgatools, 'testvariants',
+                        '--beta',
+                        '--reference='+pjoin(odir, 'TestRef.crr'),
+                        '--output='+fn,
+                        '--input='+pjoin(idir, 'variants/testvariants0/variant-listing-00.tsv'),
+                        '--variants='+variants,
+                        ] + rangeFlags)
+        outputs.append(open(fn).readlines())
+    expected = []
+    for line in outputs[0]:
+        if 0 == len(expected) or intersects(line.split('\t')[1:4], ranges):
+            expected.append(line)
+    if expected != outputs[1] or expected != outputs[2]:
+        raise Exception('unexpected testvariants output in regions of '+name)
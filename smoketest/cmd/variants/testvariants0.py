@@ -43,3 +43,39 @@ tc.runCommand([ cgatools, 'testvariants',
 
 tc.textCompare(pjoin(idir, 'variants/testvariants0/tested-variants-00-09.tsv'),
                pjoin(odir, 'tested-variants-00-09.tsv'))
+
+# Each genome is tested on its own thread. Listing each var file twice
+# gives four genomes, whose columns must repeat the two expected ones.
+tc.runCommand([ cgatools, 'testvariants',
+                '--beta',
+                '--reference='+pjoin(odir, 'TestRef.crr'),
+                '--output='+pjoin(odir, 'tested-variants-00-09-threads.tsv'),
+                '--input='+pjoin(idir, 'variants/testvariants0/variant-listing-00.tsv'),
+                '--variants='+pjoin(idir, 'variants/var-00.tsv'),
+                '--variants='+pjoin(idir, 'variants/var-09.tsv'),
+                '--threads=4',
+                ])
+
+tc.textCompare(pjoin(idir, 'variants/testvariants0/tested-variants-00-09.tsv'),
+               pjoin(odir, 'tested-variants-00-09-threads.tsv'))
+
+tc.runCommand([ cgatools, 'testvariants',
+                '--beta',
+                '--reference='+pjoin(odir, 'TestRef.crr'),
+                '--output='+pjoin(odir, 'tested-variants-00-09-00-09-threads.tsv'),
+                '--input='+pjoin(idir, 'variants/testvariants0/variant-listing-00.tsv'),
+                '--variants='+pjoin(idir, 'variants/var-00.tsv'),
+                '--variants='+pjoin(idir, 'variants/var-09.tsv'),
+                '--variants='+pjoin(idir, 'variants/var-00.tsv'),
+                '--variants='+pjoin(idir, 'variants/var-09.tsv'),
+                '--threads=4',
+                ])
+
+expected = open(pjoin(odir, 'tested-variants-00-09-00-09-expected.tsv'), 'w')
+for line in open(pjoin(idir, 'variants/testvariants0/tested-variants-00-09.tsv')):
+    fields = line.rstrip('\r\n').split('\t')
+    expected.write('\t'.join(fields + fields[-2:]) + '\n')
+expected.close()
+
+tc.textCompare(pjoin(odir, 'tested-variants-00-09-00-09-expected.tsv'),
+               pjoin(odir, 'tested-variants-00-09-00-09-threads.tsv'))
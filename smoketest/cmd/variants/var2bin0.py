@@ -0,0 +1,74 @@
+#! /usr/bin/env python
+
+# Copyright 2010 Complete Genomics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you
+# may not use this file except in compliance with the License. You
+# may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+
+
+import os,sys
+sys.path = [ os.path.dirname(os.path.dirname(sys.argv[0])) ] + sys.path
+from tutil import tucore as tc
+
+idir = sys.argv[1]
+odir = sys.argv[2]
+cgatools = sys.argv[3]
+cgatoolsapitest = sys.argv[4]
+
+#####################################################################
+# END BOILERPLATE
+#####################################################################
+
+from os.path import join as pjoin
+
+tc.runCommand([ cgatools, 'fasta2crr',
+                '--input='+pjoin(idir, 'variants/TestRef.fa'),
+                '--output='+pjoin(odir, 'TestRef.crr') ])
+
+def doCompare(a, b):
+    tc.textCompare(a, b, ignorePrefixes=['#GENERATED_AT',
+                                         '#FORMAT_VERSION',
+                                         '#SOFTWARE_VERSION',
+                                         '#CGATOOLS_VERSION'])
+
+def varFilter(input, output):
+    tc.runCommand([ cgatools, 'varfilter',
+                    '--beta',
+                    '--reference='+pjoin(odir, 'TestRef.crr'),
+                    '--input='+input,
+                    '--output='+output,
+                    ])
+
+# The binary file, small blocks and all, must read back as the
+# original, with and without filters. A text var file read from a
+# pipe must read as the file itself.
+filters = '#varType=snp:het:varScoreVAF<100,varType=ins:het:varScoreVAF<500'
+for fn in [ 'var-13.tsv', 'varcombine0/a-var-11.tsv' ]:
+    name = os.path.basename(fn)
+    tc.runCommand([ cgatools, 'var2bin',
+                    '--beta',
+                    '--reference='+pjoin(odir, 'TestRef.crr'),
+                    '--input='+pjoin(idir, 'variants', fn),
+                    '--output='+pjoin(odir, name+'.bin'),
+                    '--block-size=7' ])
+    for filt in [ '', filters ]:
+        varFilter(pjoin(idir, 'variants', fn)+filt, pjoin(odir, 'tsv-'+name))
+        varFilter(pjoin(odir, name+'.bin')+filt, pjoin(odir, 'bin-'+name))
+        doCompare(pjoin(odir, 'bin-'+name), pjoin(odir, 'tsv-'+name))
+        tc.getCommandStdout([ cgatools, 'varfilter',
+                              '--beta',
+                              '--reference='+pjoin(odir, 'TestRef.crr'),
+                              '--input=/dev/stdin'+filt,
+                              '--output='+pjoin(odir, 'pipe-'+name),
+                              ],
+                            open(pjoin(idir, 'variants', fn)).read())
+        doCompare(pjoin(odir, 'pipe-'+name), pjoin(odir, 'tsv-'+name))